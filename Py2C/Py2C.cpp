@@ -84,6 +84,8 @@ void Py2CConverter::initialize_parameters()
   parameters["nprocx"] = Parameter("1","CitcomS.solver.mesher");
   parameters["nprocy"] = Parameter("1","CitcomS.solver.mesher");
   parameters["nprocz"] = Parameter("1","CitcomS.solver.mesher");
+  parameters["shared_memory_halo"] = Parameter("0","CitcomS.solver.mesher");
+  parameters["neighbor_collectives"] = Parameter("1","CitcomS.solver.mesher");
   parameters["coor"] = Parameter("0","CitcomS.solver.mesher");
   parameters["coor_file"] = Parameter("\"coor.dat\"","CitcomS.solver.mesher");
   parameters["coor_refine"] = Parameter("0.1,0.15,0.1,0.2","CitcomS.solver.mesher");
@@ -113,6 +115,11 @@ void Py2CConverter::initialize_parameters()
   parameters["adv_gamma"] = Parameter("0.5","CitcomS.solver.tsolver");
   parameters["adv_sub_iterations"] = Parameter("2","CitcomS.solver.tsolver");
   parameters["inputdiffusivity"] = Parameter("1","CitcomS.solver.tsolver");
+  parameters["pg_cache"] = Parameter("1","CitcomS.solver.tsolver");
+  parameters["pg_cache_max_mb"] = Parameter("256","CitcomS.solver.tsolver");
+  parameters["implicit_diffusion"] = Parameter("0","CitcomS.solver.tsolver");
+  parameters["implicit_diffusion_tol"] = Parameter("1.0e-6","CitcomS.solver.tsolver");
+  parameters["implicit_diffusion_maxiter"] = Parameter("200","CitcomS.solver.tsolver");
   
   // CitcomS.solver.vsolver
   parameters["Solver"] = Parameter("cgrad","CitcomS.solver.vsolver");
@@ -128,6 +135,10 @@ void Py2CConverter::initialize_parameters()
   parameters["vhighstep"] = Parameter("3","CitcomS.solver.vsolver");
   parameters["max_mg_cycles"] = Parameter("50","CitcomS.solver.vsolver");
   parameters["piterations"] = Parameter("1000","CitcomS.solver.vsolver");
+  parameters["stokes_skip"] = Parameter("0","CitcomS.solver.vsolver");
+  parameters["stokes_skip_tol"] = Parameter("1.0e-3","CitcomS.solver.vsolver");
+  parameters["stokes_skip_max"] = Parameter("10","CitcomS.solver.vsolver");
+  parameters["stokes_skip_piterations"] = Parameter("0","CitcomS.solver.vsolver");
   parameters["aug_lagr"] = Parameter("1","CitcomS.solver.vsolver");
   parameters["aug_number"] = Parameter("2000","CitcomS.solver.vsolver");
   parameters["remove_rigid_rotation"] = Parameter("1","CitcomS.solver.vsolver");
@@ -174,6 +185,7 @@ void Py2CConverter::initialize_parameters()
   parameters["restart"] = Parameter("0", "CitcomS.solver.ic");
   parameters["post_p"] = Parameter("0", "CitcomS.solver.ic");
   parameters["solution_cycles_init"] = Parameter("0", "CitcomS.solver.ic");
+  parameters["radial_repartition"] = Parameter("0", "CitcomS.solver.ic");
   parameters["zero_elapsed_time"] = Parameter("1", "CitcomS.solver.ic");
   parameters["tic_method"] = Parameter("0", "CitcomS.solver.ic");
   parameters["num_perturbations"] = Parameter("1", "CitcomS.solver.ic",true);
@@ -195,12 +207,16 @@ void Py2CConverter::initialize_parameters()
   parameters["use_cbf_topo"] = Parameter("0", "CitcomS.solver.output");
   parameters["cb_block_size"] = Parameter("1048576", "CitcomS.solver.output");
   parameters["cb_buffer_size"] = Parameter("4194304", "CitcomS.solver.output");
+  parameters["cb_nodes"] = Parameter("0", "CitcomS.solver.output");
+  parameters["output_async"] = Parameter("0", "CitcomS.solver.output");
   parameters["sieve_buf_size"] = Parameter("1048576", "CitcomS.solver.output");
   parameters["output_alignment"] = Parameter("262144", "CitcomS.solver.output");
   parameters["output_alignment_threshold"] = Parameter("524288", "CitcomS.solver.output");
   parameters["cache_mdc_nelmts"] = Parameter("10330", "CitcomS.solver.output");
   parameters["cache_rdcc_nelmts"] = Parameter("521", "CitcomS.solver.output");
   parameters["cache_rdcc_nbytes"] = Parameter("1048576", "CitcomS.solver.output");
+  parameters["output_time_series"] = Parameter("0", "CitcomS.solver.output");
+  parameters["output_flush_spacing"] = Parameter("10", "CitcomS.solver.output");
   parameters["write_q_files"] = Parameter("0", "CitcomS.solver.output");
   parameters["vtk_format"] = Parameter("binary", "CitcomS.solver.output");
   parameters["gzdir_vtkio"] = Parameter("1", "CitcomS.solver.output");
@@ -246,8 +262,23 @@ void Py2CConverter::initialize_parameters()
   parameters["ic_method_for_flavors"] = Parameter("0", "Citcoms.Solver.tracer");
   parameters["z_interface"] = Parameter("0.7", "Citcoms.Solver.tracer");
   parameters["itracer_warnings"] = Parameter("1", "Citcoms.Solver.tracer");
+  parameters["tracer_sort_spacing"] = Parameter("0", "Citcoms.Solver.tracer");
+  parameters["tracer_batch_velocity"] = Parameter("1", "Citcoms.Solver.tracer");
+  parameters["tracer_hugepages"] = Parameter("0", "Citcoms.Solver.tracer");
+  parameters["tracer_integrator"] = Parameter("2", "Citcoms.Solver.tracer");
+  parameters["tracer_velocity_extrapolation"] = Parameter("0", "Citcoms.Solver.tracer");
+  parameters["tracer_courant"] = Parameter("0.0", "Citcoms.Solver.tracer");
+  parameters["tracer_min_per_element"] = Parameter("0", "Citcoms.Solver.tracer");
+  parameters["tracer_max_per_element"] = Parameter("0", "Citcoms.Solver.tracer");
+  parameters["tracer_load_report"] = Parameter("0", "Citcoms.Solver.tracer");
+  parameters["tracer_cost_weight"] = Parameter("0.0", "Citcoms.Solver.tracer");
   parameters["regular_grid_deltheta"] = Parameter("1.0", "Citcoms.Solver.tracer");
   parameters["regular_grid_delphi"] = Parameter("1.0", "Citcoms.Solver.tracer");
+  parameters["tracer_uv_index"] = Parameter("1", "Citcoms.Solver.tracer");
+  parameters["tracer_uv_refine"] = Parameter("4", "Citcoms.Solver.tracer");
+  parameters["tracer_location_benchmark"] = Parameter("0", "Citcoms.Solver.tracer");
+  parameters["tracer_neighbor_exchange"] = Parameter("1", "Citcoms.Solver.tracer");
+  parameters["analytical_tracer_test"] = Parameter("0", "Citcoms.Solver.tracer");
   parameters["chemical_buoyancy"] = Parameter("1", "Citcoms.Solver.tracer");
   parameters["buoy_type"] = Parameter("1", "Citcoms.Solver.tracer");
   parameters["buoyancy_ratio"] = Parameter("1.0", "Citcoms.Solver.tracer");
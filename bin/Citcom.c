@@ -49,6 +49,7 @@ int main(argc,argv)
 {	/* Functions called by main*/
   void general_stokes_solver();
   void general_stokes_solver_pseudo_surf();
+  void adaptive_stokes_solver();
   void global_default_values();
   void read_instructions();
   void initial_setup();
@@ -65,13 +66,15 @@ int main(argc,argv)
 
   float cpu_time_on_vp_it;
 
-  int cpu_total_seconds,k,need_init_sol;
+  int cpu_total_seconds,k,need_init_sol,thread_level;
   double CPU_time0(),time,initial_time,start_time;
 
   struct All_variables *E;
   MPI_Comm world;
 
-  MPI_Init(&argc,&argv); /* added here to allow command-line input */
+  /* added here to allow command-line input; the OpenMP and output */
+  /* threads make no MPI calls */
+  MPI_Init_thread(&argc,&argv,MPI_THREAD_FUNNELED,&thread_level);
 
   if (argc < 2)   {
     fprintf(stderr,"Usage: %s PARAMETERFILE\n", argv[0]);
@@ -223,7 +226,7 @@ int main(argc,argv)
 
     if(E->control.tracer==1)
       tracer_advection(E);
-    general_stokes_solver(E);
+    adaptive_stokes_solver(E);
 
     if(E->output.write_q_files)
       if ((E->monitor.solution_cycles % E->output.write_q_files)==0)
@@ -37,31 +37,67 @@
 #include "advection_diffusion.h"
 #include "parsing.h"
 
+double temperature_bc_value(struct All_variables *, int, int, unsigned int);
+
+/* Statistics of the new temperature field, collected while it is
+   updated: the max-T monitor and the first pass of the filter */
+struct ENERGY_STATS {
+    double Tmax_interior;   /* max(T), for monitor_max_T */
+    double Tmin, Tmax;      /* min(T,Tmin0) and max(T,Tmax0) before filtering */
+    double Tsum0;           /* local sum(rho*cp*T) before filtering */
+};
+
 static void set_diffusion_timestep(struct All_variables *E);
-static void predictor(struct All_variables *E, double **field,
-                      double **fielddot);
-static void corrector(struct All_variables *E, double **field,
-                      double **fielddot, double **Dfielddot);
+static double predictor(struct All_variables *E, double **field,
+                        double **fielddot,
+                        double **field_old, double **fielddot_old);
+static void corrector(struct All_variables *E, double **DTdot,
+                      struct ENERGY_STATS *stats);
+static void energy_stats(struct All_variables *E, struct ENERGY_STATS *stats);
+static void energy_stats_reduce(struct All_variables *E,
+                                struct ENERGY_STATS *stats);
+/* Quantities at the integration points of one element, computed once and
+   shared by pg_shape_fn() and element_residual(). Stored as structure of
+   arrays so that the loops over the integration points vectorize. */
+struct PG_ELEMENT {
+    double v[4][9];     /* velocity */
+    double rinv[9];     /* 1/r */
+    double sint[9];     /* 1/(r sin(theta)) */
+    struct Shape_function PG;
+};
+
+/* Integration weights of the diffusion operator of one element, i.e. the
+   volume element times the metric factors of the r-theta-phi gradient */
+struct DIFF_ELEMENT {
+    double w[3][9];
+};
+
 static void pg_solver(struct All_variables *E,
                       double **T, double **Tdot, double **DTdot,
                       struct SOURCES *Q0,
                       double diff, int bc, unsigned int **FLAGS);
+static void pg_element_data(struct All_variables *E, int el,
+                            float VV[4][9], double rtf[4][9],
+                            struct PG_ELEMENT *pe);
 static void pg_shape_fn(struct All_variables *E, int el,
-                        struct Shape_function *PG,
+                        struct PG_ELEMENT *pe,
                         struct Shape_function_dx *GNx,
-                        float VV[4][9], double rtf[4][9],
+                        float VV[4][9],
                         double diffusion, int m);
 static void element_residual(struct All_variables *E, int el,
-                             struct Shape_function *PG,
+                             struct PG_ELEMENT *pe,
                              struct Shape_function_dx *GNx,
                              struct Shape_function_dA *dOmega,
-                             float VV[4][9],
                              double **field, double **fielddot,
                              struct SOURCES *Q0,
-                             double Eres[9], double rtf[4][9],
+                             double Eres[9],
                              double diff, float **BC,
                              unsigned int **FLAGS, int m);
-static void filter(struct All_variables *E);
+static void pg_cache_allocate(struct All_variables *E);
+static void implicit_diffusion_setup(struct All_variables *E);
+static void implicit_diffusion_solve(struct All_variables *E,
+                                     double **DTdot, double diff);
+static void filter(struct All_variables *E, struct ENERGY_STATS *stats);
 static void process_heating(struct All_variables *E, int psc_pass);
 
 /* ============================================
@@ -91,6 +127,12 @@ void advection_diffusion_parameters(struct All_variables *E)
 
     input_float("inputdiffusivity",&(E->control.inputdiff),"1.0",m);
 
+    input_boolean("pg_cache",&(E->advection.pg_cache),"on",m);
+    input_float("pg_cache_max_mb",&(E->advection.pg_cache_max_mb),"256.0,0.0",m);
+
+    input_boolean("implicit_diffusion",&(E->advection.implicit_diffusion),"off",m);
+    input_float("implicit_diffusion_tol",&(E->advection.implicit_diffusion_tol),"1.0e-6,0.0",m);
+    input_int("implicit_diffusion_maxiter",&(E->advection.implicit_diffusion_maxiter),"200,1,nomax",m);
 
     return;
 }
@@ -105,7 +147,64 @@ void advection_diffusion_allocate_memory(struct All_variables *E)
 
     for(i=1;i<=E->lmesh.nno;i++)
       E->Tdot[m][i]=0.0;
+
+    /* work arrays of PG_timestep_solve() */
+    E->advection.DTdot[m] = (double *)malloc((E->lmesh.nno+1)*sizeof(double));
+    E->advection.T_old[m] = E->advection.Tdot_old[m] = NULL;
+    if(E->advection.monitor_max_T) {
+      E->advection.T_old[m] = (double *)malloc((E->lmesh.nno+1)*sizeof(double));
+      E->advection.Tdot_old[m] = (double *)malloc((E->lmesh.nno+1)*sizeof(double));
     }
+  }
+
+  pg_cache_allocate(E);
+
+  return;
+}
+
+
+/* Allocate the cache of the Petrov-Galerkin shape functions. The velocity
+   field does not change within one call of PG_timestep_solve(), so the
+   shape functions only need to be computed once per velocity solution.
+   If the whole cache doesn't fit in pg_cache_max_mb, only the first
+   elements of each cap are cached and the rest are computed on the fly. */
+
+static void pg_cache_allocate(struct All_variables *E)
+{
+  int m, nel;
+  double bytes, cached_bytes;
+
+  E->advection.pg_cache_version = -1;
+  E->advection.pg_cache_diff = 0.0;
+
+  nel = 0;
+  if(E->advection.pg_cache && E->advection.ADVECTION) {
+    bytes = E->advection.pg_cache_max_mb * 1024.0 * 1024.0
+      / E->sphere.caps_per_proc;
+    nel = (int) min(bytes / sizeof(struct PG_ELEMENT), (double) E->lmesh.nel);
+  }
+
+  cached_bytes = 0.0;
+  for(m=1;m<=E->sphere.caps_per_proc;m++) {
+    E->advection.pg_cache_el[m] = NULL;
+    if(nel > 0)
+      E->advection.pg_cache_el[m] = (struct PG_ELEMENT *)
+        malloc((nel+1)*sizeof(struct PG_ELEMENT));
+
+    if(E->advection.pg_cache_el[m] == NULL)
+      E->advection.pg_cache_nel[m] = 0;
+    else
+      E->advection.pg_cache_nel[m] = nel;
+
+    cached_bytes += (double)E->advection.pg_cache_nel[m]*sizeof(struct PG_ELEMENT);
+  }
+
+  if(E->parallel.me==0 && E->advection.pg_cache) {
+    fprintf(E->fp, "PG shape function cache: %d of %d elements per cap (%.1f MB)\n",
+            E->advection.pg_cache_nel[1], E->lmesh.nel,
+            cached_bytes/(1024.0*1024.0));
+    fflush(E->fp);
+  }
 
   return;
 }
@@ -114,6 +213,9 @@ void advection_diffusion_allocate_memory(struct All_variables *E)
 void PG_timestep_init(struct All_variables *E)
 {
 
+  if(E->advection.implicit_diffusion)
+    implicit_diffusion_setup(E);
+
   set_diffusion_timestep(E);
 
   return;
@@ -198,39 +300,22 @@ void std_timestep(struct All_variables *E)
 void PG_timestep_solve(struct All_variables *E)
 {
 
-  double Tmaxd();
-  void temperatures_conform_bcs();
+  double global_dmax();
   void lith_age_conform_tbc();
   void assimilate_lith_conform_bcs();
-  int i,m,psc_pass,iredo;
-  double time0,time1,T_interior1;
-  double *DTdot[NCS], *T1[NCS], *Tdot1[NCS];
+  int i,m,psc_pass,iredo,save_old,stats_valid;
+  double T_interior1,Tmax_old;
+  struct ENERGY_STATS stats;
 
   E->advection.timesteps++;
 
-  for(m=1;m<=E->sphere.caps_per_proc;m++)
-    DTdot[m]= (double *)malloc((E->lmesh.nno+1)*sizeof(double));
-
-
-  if(E->advection.monitor_max_T) {
-     for(m=1;m<=E->sphere.caps_per_proc;m++)  {
-         T1[m]= (double *)malloc((E->lmesh.nno+1)*sizeof(double));
-         Tdot1[m]= (double *)malloc((E->lmesh.nno+1)*sizeof(double));
-     }
-
-     for(m=1;m<=E->sphere.caps_per_proc;m++)
-         for (i=1;i<=E->lmesh.nno;i++)   {
-             T1[m][i] = E->T[m][i];
-             Tdot1[m][i] = E->Tdot[m][i];
-         }
-
-     /* get the max temperature for old T */
-     T_interior1 = Tmaxd(E,E->T);
-  }
-
   E->advection.dt_reduced = 1.0;
   E->advection.last_sub_iterations = 1;
+  E->advection.implicit_diffusion_iterations = 0;
 
+  /* the old T is saved (for monitor_max_T) by the first predictor */
+  save_old = E->advection.monitor_max_T;
+  stats_valid = 0;
 
   do {
     E->advection.timestep *= E->advection.dt_reduced;
@@ -238,7 +323,15 @@ void PG_timestep_solve(struct All_variables *E)
     iredo = 0;
     if (E->advection.ADVECTION) {
 
-      predictor(E,E->T,E->Tdot);
+      if(save_old) {
+        /* get the max temperature for old T */
+        Tmax_old = predictor(E,E->T,E->Tdot,
+                             E->advection.T_old,E->advection.Tdot_old);
+        T_interior1 = global_dmax(E,Tmax_old);
+        save_old = 0;
+      }
+      else
+        predictor(E,E->T,E->Tdot,NULL,NULL);
 
       for(psc_pass=0;psc_pass<E->advection.temp_iterations;psc_pass++)   {
         /* adiabatic, dissipative and latent heating*/
@@ -246,14 +339,21 @@ void PG_timestep_solve(struct All_variables *E)
           process_heating(E, psc_pass);
 
         /* XXX: replace inputdiff with refstate.thermal_conductivity */
-	pg_solver(E,E->T,E->Tdot,DTdot,&(E->convection.heat_sources),E->control.inputdiff,1,E->node);
-	corrector(E,E->T,E->Tdot,DTdot);
-	temperatures_conform_bcs(E);
+	pg_solver(E,E->T,E->Tdot,E->advection.DTdot,&(E->convection.heat_sources),E->control.inputdiff,1,E->node);
+
+        /* the last pass also gathers the max-T and filter statistics */
+        if(psc_pass == E->advection.temp_iterations-1) {
+          corrector(E,E->advection.DTdot,&stats);
+          energy_stats_reduce(E,&stats);
+          stats_valid = 1;
+        }
+        else
+          corrector(E,E->advection.DTdot,NULL);
       }
 
       if(E->advection.monitor_max_T) {
           /* get the max temperature for new T */
-          E->monitor.T_interior = Tmaxd(E,E->T);
+          E->monitor.T_interior = stats.Tmax_interior;
 
           /* if the max temperature changes too much, restore the old
            * temperature field, calling the temperature solver using
@@ -267,10 +367,11 @@ void PG_timestep_solve(struct All_variables *E)
               }
               for(m=1;m<=E->sphere.caps_per_proc;m++)
                   for (i=1;i<=E->lmesh.nno;i++)   {
-                      E->T[m][i] = T1[m][i];
-                      E->Tdot[m][i] = Tdot1[m][i];
+                      E->T[m][i] = E->advection.T_old[m][i];
+                      E->Tdot[m][i] = E->advection.Tdot_old[m][i];
                   }
               iredo = 1;
+              stats_valid = 0;
               E->advection.dt_reduced *= 0.5;
               E->advection.last_sub_iterations ++;
           }
@@ -281,26 +382,27 @@ void PG_timestep_solve(struct All_variables *E)
 
 
   /* filter temperature to remove over-/under-shoot */
-  if(E->advection.filter_temperature)
-    filter(E);
+  if(E->advection.filter_temperature) {
+    if(!stats_valid)
+      energy_stats(E,&stats);
+    filter(E,&stats);
+  }
 
 
   E->advection.total_timesteps++;
   E->monitor.elapsed_time += E->advection.timestep;
 
-  if (E->advection.last_sub_iterations==5)
-    E->control.keep_going = 0;
-
-  for(m=1;m<=E->sphere.caps_per_proc;m++) {
-    free((void *) DTdot[m] );
+  if(E->advection.implicit_diffusion && E->parallel.me==0) {
+      fprintf(E->fp, "Step: %d, dt=%e explicit_diffusion_dt=%e (x%.2f) implicit_diffusion_iterations=%d\n",
+              E->monitor.solution_cycles, E->advection.timestep,
+              E->advection.explicit_diff_timestep,
+              E->advection.timestep / E->advection.explicit_diff_timestep,
+              E->advection.implicit_diffusion_iterations);
+      fflush(E->fp);
   }
 
-  if(E->advection.monitor_max_T) {
-      for(m=1;m<=E->sphere.caps_per_proc;m++) {
-          free((void *) T1[m] );
-          free((void *) Tdot1[m] );
-      }
-  }
+  if (E->advection.last_sub_iterations==5)
+    E->control.keep_going = 0;
 
   if(E->control.lith_age) {
       if(E->parallel.me==0) fprintf(stderr,"PG_timestep_solve\n");
@@ -333,6 +435,12 @@ static void set_diffusion_timestep(struct All_variables *E)
 
   diff_timestep = global_fmin(E,diff_timestep);
   E->advection.diff_timestep = 0.5 * diff_timestep;
+  E->advection.explicit_diff_timestep = E->advection.diff_timestep;
+
+  /* implicit diffusion is unconditionally stable for gamma >= 0.5,
+     only the advective time step limit applies then */
+  if(E->advection.implicit_diffusion)
+      E->advection.diff_timestep = 1.0e8;
 
   return;
 }
@@ -342,48 +450,166 @@ static void set_diffusion_timestep(struct All_variables *E)
    predictor and corrector steps.
    ============================== */
 
-static void predictor(struct All_variables *E, double **field,
-                      double **fielddot)
+/* min and max temperature for filtering */
+static const double filter_Tmin0 = 0.0;
+static const double filter_Tmax0 = 1.0;
+
+
+/* Returns the local max of the old field. If field_old is not NULL,
+   the old field and its time derivative are saved there as well. */
+
+static double predictor(struct All_variables *E, double **field,
+                        double **fielddot,
+                        double **field_old, double **fielddot_old)
 {
   int node,m;
-  double multiplier;
+  double multiplier,fmax;
 
   multiplier = (1.0-E->advection.gamma) * E->advection.timestep;
+  fmax = -10.0;
 
   for (m=1;m<=E->sphere.caps_per_proc;m++)
     for(node=1;node<=E->lmesh.nno;node++)  {
+      if(field_old) {
+        field_old[m][node] = field[m][node];
+        fielddot_old[m][node] = fielddot[m][node];
+      }
+      fmax = max(field[m][node],fmax);
       field[m][node] += multiplier * fielddot[m][node] ;
       fielddot[m][node] = 0.0;
     }
 
+  return fmax;
+}
+
+
+/* Update of the local statistics with the new temperature of one node.
+   This is the first pass of filter(): the overshoot is cut here. */
+
+static void energy_stats_node(struct All_variables *E,
+                              int m, int node, int lev,
+                              struct ENERGY_STATS *stats)
+{
+  const double t = E->T[m][node];
+  const int nz = ((node-1) % E->lmesh.noz) + 1;
+
+  stats->Tmax_interior = max(t,stats->Tmax_interior);
+
+  if(E->advection.filter_temperature) {
+    /* compute sum(rho*cp*T) before filtering, skipping nodes
+       that's shared by another processor */
+    if(!(E->NODE[lev][m][node] & SKIP))
+      stats->Tsum0 += t*(E->refstate.rho[nz]*E->refstate.heat_capacity[nz]);
+
+    /* remove overshoot */
+    if(t<stats->Tmin)  stats->Tmin=t;
+    if(t<filter_Tmin0) E->T[m][node]=filter_Tmin0;
+    if(t>stats->Tmax)  stats->Tmax=t;
+    if(t>filter_Tmax0) E->T[m][node]=filter_Tmax0;
+  }
+
   return;
 }
 
 
-static void corrector(struct All_variables *E, double **field,
-                      double **fielddot, double **Dfielddot)
+static void energy_stats_init(struct ENERGY_STATS *stats)
+{
+  stats->Tmax_interior = -10.0;
+  stats->Tmin = stats->Tmax = 0.0;
+  stats->Tsum0 = 0.0;
+  return;
+}
+
+
+/* Corrector step of T, with the temperature boundary conditions applied
+   in the same sweep. If stats is not NULL, the statistics of the new T
+   are collected as well. */
+
+static void corrector(struct All_variables *E, double **DTdot,
+                      struct ENERGY_STATS *stats)
 {
   int node,m;
+  unsigned int type;
   double multiplier;
 
+  const int lev = E->mesh.levmax;
+  /* with lith_age, the boundary conditions are applied at the end
+     of PG_timestep_solve() */
+  const int conform_bcs = !E->control.lith_age;
+
   multiplier = E->advection.gamma * E->advection.timestep;
 
+  if(stats)
+    energy_stats_init(stats);
+
   for (m=1;m<=E->sphere.caps_per_proc;m++)
     for(node=1;node<=E->lmesh.nno;node++) {
-      field[m][node] += multiplier * Dfielddot[m][node];
-      fielddot[m][node] +=  Dfielddot[m][node];
+      E->T[m][node] += multiplier * DTdot[m][node];
+      E->Tdot[m][node] +=  DTdot[m][node];
+
+      if(conform_bcs) {
+        type = (E->node[m][node] & (TBX | TBZ | TBY));
+        if(type)
+          E->T[m][node] = temperature_bc_value(E,m,node,type);
+      }
+
+      if(stats)
+        energy_stats_node(E,m,node,lev,stats);
     }
 
   return;
 }
 
 
+/* Statistics of the current T without updating it */
+
+static void energy_stats(struct All_variables *E, struct ENERGY_STATS *stats)
+{
+  int node,m;
+  const int lev = E->mesh.levmax;
+
+  energy_stats_init(stats);
+
+  for (m=1;m<=E->sphere.caps_per_proc;m++)
+    for(node=1;node<=E->lmesh.nno;node++)
+      energy_stats_node(E,m,node,lev,stats);
+
+  energy_stats_reduce(E,stats);
+  return;
+}
+
+
+/* global max/min of the statistics, in a single reduction. Tsum0 stays
+   local, it is reduced together with the sums of filter(). */
+
+static void energy_stats_reduce(struct All_variables *E,
+                                struct ENERGY_STATS *stats)
+{
+  double local[3], global[3];
+
+  local[0] = stats->Tmax_interior;
+  local[1] = stats->Tmax;
+  local[2] = -stats->Tmin;
+
+  MPI_Allreduce(local,global,3,MPI_DOUBLE,MPI_MAX,E->parallel.world);
+
+  stats->Tmax_interior = global[0];
+  stats->Tmax = global[1];
+  stats->Tmin = -global[2];
+  return;
+}
+
+
 /* ===================================================
    The solution step -- determine residual vector from
-   advective-diffusive terms and solve for delta Tdot
-   Two versions are available -- one for Cray-style
-   vector optimizations etc and one optimized for
-   workstations.
+   advective-diffusive terms and solve for delta Tdot.
+
+   The elements are visited in 8 colors, by the parity of
+   their (x,y,z) indices. Two elements of the same color
+   never share a node, so the elements of one color can be
+   processed by several threads without scatter races, and
+   each node always receives its contributions in the same
+   order, independent of the number of threads.
    =================================================== */
 
 
@@ -392,83 +618,156 @@ static void pg_solver(struct All_variables *E,
                       struct SOURCES *Q0,
                       double diff, int bc, unsigned int **FLAGS)
 {
-    void get_rtf_at_vpts();
-    void velo_from_element();
-
-    int el,e,a,i,a1,m;
-    double Eres[9],rtf[4][9];  /* correction to the (scalar) Tdot field */
-    float VV[4][9];
-
-    struct Shape_function PG;
+    int m,i,color,ncolor,fill;
+    int px,py,pz,nx,ny,nz;
 
     const int dims=E->mesh.nsd;
-    const int dofs=E->mesh.dof;
     const int ends=enodes[dims];
-    const int sphere_key = 1;
     const int lev=E->mesh.levmax;
+    const int elx=E->lmesh.elx;
+    const int ely=E->lmesh.ely;
+    const int elz=E->lmesh.elz;
+    const int nno=E->lmesh.nno;
 
-    for (m=1;m<=E->sphere.caps_per_proc;m++)
-      for(i=1;i<=E->lmesh.nno;i++)
+    for (m=1;m<=E->sphere.caps_per_proc;m++) {
+#pragma omp parallel for schedule(static)
+      for(i=1;i<=nno;i++)
  	 DTdot[m][i] = 0.0;
+    }
+
+    /* the cached shape functions are valid if the velocity hasn't changed
+       since they were computed; otherwise they are refilled in this pass */
+    fill = (E->advection.pg_cache_version != E->monitor.velocity_updates ||
+            E->advection.pg_cache_diff != diff);
 
     for (m=1;m<=E->sphere.caps_per_proc;m++)
-       for(el=1;el<=E->lmesh.nel;el++)    {
+      for(color=0;color<8;color++) {
+        pz = color & 1;
+        px = (color >> 1) & 1;
+        py = (color >> 2) & 1;
 
-          velo_from_element(E,VV,m,el,sphere_key);
+        /* number of elements of this color in each direction */
+        nz = (elz - pz + 1) / 2;
+        nx = (elx - px + 1) / 2;
+        ny = (ely - py + 1) / 2;
+        ncolor = nz * nx * ny;
 
-          get_rtf_at_vpts(E, m, lev, el, rtf);
+#pragma omp parallel for schedule(static)
+        for(i=0;i<ncolor;i++) {
+          void get_rtf_at_vpts();
+          void velo_from_element();
 
-          /* XXX: replace diff with refstate.thermal_conductivity */
-          pg_shape_fn(E, el, &PG, &(E->gNX[m][el]), VV,
-                      rtf, diff, m);
-          element_residual(E, el, &PG, &(E->gNX[m][el]), &(E->gDA[m][el]),
-                           VV, T, Tdot,
-                           Q0, Eres, rtf, diff, E->sphere.cap[m].TB,
+          int el,a;
+          double Eres[9],rtf[4][9];  /* correction to the (scalar) Tdot field */
+          float VV[4][9];
+          struct PG_ELEMENT pe_local, *pe;
+
+          const int sphere_key = 1;
+
+          el = (pz + 2*(i % nz) + 1)
+            + (px + 2*((i / nz) % nx)) * elz
+            + (py + 2*(i / (nz * nx))) * elz * elx;
+
+          if(el <= E->advection.pg_cache_nel[m])
+            pe = &(E->advection.pg_cache_el[m][el]);
+          else
+            pe = &pe_local;
+
+          if(fill || pe == &pe_local) {
+            velo_from_element(E,VV,m,el,sphere_key);
+
+            get_rtf_at_vpts(E, m, lev, el, rtf);
+
+            pg_element_data(E, el, VV, rtf, pe);
+
+            /* XXX: replace diff with refstate.thermal_conductivity */
+            pg_shape_fn(E, el, pe, &(E->gNX[m][el]), VV, diff, m);
+          }
+
+          element_residual(E, el, pe, &(E->gNX[m][el]), &(E->gDA[m][el]),
+                           T, Tdot,
+                           Q0, Eres, diff, E->sphere.cap[m].TB,
                            FLAGS, m);
 
-        for(a=1;a<=ends;a++) {
-	    a1 = E->ien[m][el].node[a];
-	    DTdot[m][a1] += Eres[a];
-           }
+          for(a=1;a<=ends;a++)
+            DTdot[m][E->ien[m][el].node[a]] += Eres[a];
 
         } /* next element */
+      }
+
+    E->advection.pg_cache_version = E->monitor.velocity_updates;
+    E->advection.pg_cache_diff = diff;
 
     (E->exchange_node_d)(E,DTdot,lev);
 
-    for (m=1;m<=E->sphere.caps_per_proc;m++)
-      for(i=1;i<=E->lmesh.nno;i++) {
+    if(E->advection.implicit_diffusion && diff != 0.0) {
+      implicit_diffusion_solve(E, DTdot, diff);
+      return;
+    }
+
+    for (m=1;m<=E->sphere.caps_per_proc;m++) {
+#pragma omp parallel for schedule(static)
+      for(i=1;i<=nno;i++) {
         if(!(E->node[m][i] & (TBX | TBY | TBZ))){
 	  DTdot[m][i] *= E->TMass[m][i];         /* lumped mass matrix */
 	}	else
 	  DTdot[m][i] = 0.0;         /* lumped mass matrix */
       }
+    }
 
     return;
 }
 
 
+/* ===================================================
+   Velocity and geometric factors at the integration
+   points of a given element
+   =================================================== */
+
+static void pg_element_data(struct All_variables *E, int el,
+                            float VV[4][9], double rtf[4][9],
+                            struct PG_ELEMENT *pe)
+{
+    int i,j,d;
+
+    const int ends=ENODES3D;
+    const int vpts=VPOINTS3D;
+
+    for(d=1;d<=3;d++)
+        for(i=1;i<=vpts;i++)
+            pe->v[d][i] = 0.0;
+
+    for(j=1;j<=ends;j++)  /* this loop heavily used */
+        for(d=1;d<=3;d++)
+            for(i=1;i<=vpts;i++)
+                pe->v[d][i] += VV[d][j] * E->N.vpt[GNVINDEX(j,i)];
+
+    for(i=1;i<=vpts;i++) {
+        pe->rinv[i] = rtf[3][i];
+        pe->sint[i] = rtf[3][i]/sin(rtf[1][i]);
+    }
+
+    return;
+}
+
 
 /* ===================================================
    Petrov-Galerkin shape functions for a given element
    =================================================== */
 
 static void pg_shape_fn(struct All_variables *E, int el,
-                        struct Shape_function *PG,
+                        struct PG_ELEMENT *pe,
                         struct Shape_function_dx *GNx,
-                        float VV[4][9], double rtf[4][9],
+                        float VV[4][9],
                         double diffusion, int m)
 {
     int i,j;
-    int *ienm;
 
     double uc1,uc2,uc3;
-    double u1,u2,u3,sint[9];
     double uxse,ueta,ufai,xse,eta,fai,adiff;
 
     double prod1,unorm,twodiff;
 
-    ienm=E->ien[m][el].node;
-
     twodiff = 2.0*diffusion;
 
     uc1 =  uc2 = uc3 = 0.0;
@@ -492,26 +791,15 @@ static void pg_shape_fn(struct All_variables *E, int el,
 
     adiff = (unorm>0.000001)?( (uxse*xse+ueta*eta+ufai*fai)/(2.0*unorm) ):0.0;
 
-    for(i=1;i<=VPOINTS3D;i++)
-       sint[i] = rtf[3][i]/sin(rtf[1][i]);
+    for(j=1;j<=ENODES3D;j++)
+       for(i=1;i<=VPOINTS3D;i++) {
+            prod1 = (pe->v[1][i] * GNx->vpt[GNVXINDEX(0,j,i)]*pe->rinv[i] +
+                     pe->v[2][i] * GNx->vpt[GNVXINDEX(1,j,i)]*pe->sint[i] +
+                     pe->v[3][i] * GNx->vpt[GNVXINDEX(2,j,i)] ) ;
 
-    for(i=1;i<=VPOINTS3D;i++) {
-       u1 = u2 = u3 = 0.0;
-       for(j=1;j<=ENODES3D;j++)  /* this line heavily used */ {
-		u1 += VV[1][j] * E->N.vpt[GNVINDEX(j,i)];
-		u2 += VV[2][j] * E->N.vpt[GNVINDEX(j,i)];
-	   	u3 += VV[3][j] * E->N.vpt[GNVINDEX(j,i)];
+	    pe->PG.vpt[GNVINDEX(j,i)] = E->N.vpt[GNVINDEX(j,i)] + adiff * prod1;
 	    }
 
-       for(j=1;j<=ENODES3D;j++) {
-            prod1 = (u1 * GNx->vpt[GNVXINDEX(0,j,i)]*rtf[3][i] +
-                     u2 * GNx->vpt[GNVXINDEX(1,j,i)]*sint[i] +
-                     u3 * GNx->vpt[GNVXINDEX(2,j,i)] ) ;
-
-	    PG->vpt[GNVINDEX(j,i)] = E->N.vpt[GNVINDEX(j,i)] + adiff * prod1;
-	    }
-       }
-
    return;
 }
 
@@ -523,51 +811,48 @@ static void pg_shape_fn(struct All_variables *E, int el,
    =========================================  */
 
 static void element_residual(struct All_variables *E, int el,
-                             struct Shape_function *PG,
+                             struct PG_ELEMENT *pe,
                              struct Shape_function_dx *GNx,
                              struct Shape_function_dA *dOmega,
-                             float VV[4][9],
                              double **field, double **fielddot,
                              struct SOURCES *Q0,
-                             double Eres[9], double rtf[4][9],
+                             double Eres[9],
                              double diff, float **BC,
                              unsigned int **FLAGS, int m)
 {
-    int i,j,a,k,node,nodes[5],d,aid,back_front,onedfns;
+    int i,j,a,k,node,aid;
     double Q;
     double dT[9];
-    double tx1[9],tx2[9],tx3[9],sint[9];
-    double v1[9],v2[9],v3[9];
-    double adv_dT,t2[4];
+    double tx1[9],tx2[9],tx3[9];
     double T,DT;
 
-    double prod,sfn;
     struct Shape_function1 GM;
     struct Shape_function1_dA dGamma;
-    double temp,rho,cp,heating;
+    double rho,cp,heating;
     int nz;
 
     void get_global_1d_shape_fn();
 
     const int dims=E->mesh.nsd;
-    const int dofs=E->mesh.dof;
-    const int nno=E->lmesh.nno;
-    const int lev=E->mesh.levmax;
     const int ends=enodes[dims];
     const int vpts=vpoints[dims];
     const int onedvpts = onedvpoints[dims];
     const int diffusion = (diff != 0.0);
 
+    const double *v1 = pe->v[1];
+    const double *v2 = pe->v[2];
+    const double *v3 = pe->v[3];
+    const double *rinv = pe->rinv;
+    const double *sint = pe->sint;
+    const struct Shape_function *PG = &(pe->PG);
+
     for(i=1;i<=vpts;i++)	{
       dT[i]=0.0;
-      v1[i] = tx1[i]=  0.0;
-      v2[i] = tx2[i]=  0.0;
-      v3[i] = tx3[i]=  0.0;
+      tx1[i]=  0.0;
+      tx2[i]=  0.0;
+      tx3[i]=  0.0;
       }
 
-    for(i=1;i<=vpts;i++)
-        sint[i] = rtf[3][i]/sin(rtf[1][i]);
-
     for(j=1;j<=ends;j++)       {
       node = E->ien[m][el].node[j];
       T = field[m][node];
@@ -578,13 +863,9 @@ static void element_residual(struct All_variables *E, int el,
 
       for(i=1;i<=vpts;i++)  {
           dT[i] += DT * E->N.vpt[GNVINDEX(j,i)];
-          tx1[i] += GNx->vpt[GNVXINDEX(0,j,i)] * T * rtf[3][i];
+          tx1[i] += GNx->vpt[GNVXINDEX(0,j,i)] * T * rinv[i];
           tx2[i] += GNx->vpt[GNVXINDEX(1,j,i)] * T * sint[i];
           tx3[i] += GNx->vpt[GNVXINDEX(2,j,i)] * T;
-          sfn = E->N.vpt[GNVINDEX(j,i)];
-          v1[i] += VV[1][j] * sfn;
-          v2[i] += VV[2][j] * sfn;
-          v3[i] += VV[3][j] * sfn;
       }
     }
 
@@ -629,7 +910,7 @@ static void element_residual(struct All_variables *E, int el,
               * ((dT[i] + v1[i]*tx1[i] + v2[i]*tx2[i] + v3[i]*tx3[i])*rho*cp
                  - heating )
               + diff * dOmega->vpt[i] * E->heating_latent[m][el]
-              * (GNx->vpt[GNVXINDEX(0,j,i)]*tx1[i]*rtf[3][i] +
+              * (GNx->vpt[GNVXINDEX(0,j,i)]*tx1[i]*rinv[i] +
                  GNx->vpt[GNVXINDEX(1,j,i)]*tx2[i]*sint[i] +
                  GNx->vpt[GNVXINDEX(2,j,i)]*tx3[i] );
       }
@@ -681,53 +962,357 @@ static void element_residual(struct All_variables *E, int el,
 }
 
 
-/* This function filters the temperature field. The temperature above   */
-/* Tmax0(==1.0) and Tmin0(==0.0) is removed, while conserving the total */
-/* energy. See Lenardic and Kaula, JGR, 1993.                           */
-static void filter(struct All_variables *E)
+/* ===================================================
+   Implicit treatment of the diffusion term.
+
+   Instead of DTdot = M^-1 R, the corrector solves
+
+      (M + gamma*dt*K) DTdot = R
+
+   where M is the lumped heat capacity matrix (1/TMass)
+   and K the diffusion matrix, assembled element by
+   element from gNX and gDA. For adv_gamma=0.5 this is
+   the Crank-Nicolson scheme for diffusion, which is
+   unconditionally stable, so that the timestep is only
+   limited by advection. Advection stays explicit.
+   The system is solved by Jacobi-preconditioned CG.
+   =================================================== */
+
+static void implicit_diffusion_setup(struct All_variables *E)
 {
-    double Tsum0,Tmin,Tmax,Tsum1,TDIST,TDIST1;
-    int m,i;
-    double Tmax1,Tmin1;
-    double *rhocp, sum_rhocp, total_sum_rhocp;
-    int lev, nz;
+    void get_rtf_at_vpts();
 
-    /* min and max temperature for filtering */
-    const double Tmin0 = 0.0;
-    const double Tmax0 = 1.0;
+    int m,el,i,k;
+    double rtf[4][9],rinv,sint;
 
-    Tsum0= Tsum1= 0.0;
-    Tmin= Tmax= 0.0;
-    Tmin1= Tmax1= 0.0;
-    TDIST= TDIST1= 0.0;
-    sum_rhocp = 0.0;
+    const int vpts=VPOINTS3D;
+    const int lev=E->mesh.levmax;
 
-    lev=E->mesh.levmax;
+    if(E->advection.gamma < 0.5) {
+        if(E->parallel.me==0)
+            fprintf(stderr,"implicit_diffusion requires adv_gamma >= 0.5, using explicit diffusion\n");
+        E->advection.implicit_diffusion = 0;
+        return;
+    }
 
-    rhocp = (double *)malloc((E->lmesh.noz+1)*sizeof(double));
-    for(i=1;i<=E->lmesh.noz;i++)
-        rhocp[i] = E->refstate.rho[i] * E->refstate.heat_capacity[i];
+    for(m=1;m<=E->sphere.caps_per_proc;m++) {
+        E->advection.diff_el[m] = (struct DIFF_ELEMENT *)
+            malloc((E->lmesh.nel+1)*sizeof(struct DIFF_ELEMENT));
+        for(k=0;k<5;k++)
+            E->advection.implicit_work[k][m] = (double *)
+                malloc((E->lmesh.nno+1)*sizeof(double));
+
+        for(el=1;el<=E->lmesh.nel;el++) {
+            get_rtf_at_vpts(E, m, lev, el, rtf);
+            for(i=1;i<=vpts;i++) {
+                rinv = rtf[3][i];
+                sint = rtf[3][i]/sin(rtf[1][i]);
+                E->advection.diff_el[m][el].w[0][i] = E->gDA[m][el].vpt[i] * rinv * rinv;
+                E->advection.diff_el[m][el].w[1][i] = E->gDA[m][el].vpt[i] * sint * sint;
+                E->advection.diff_el[m][el].w[2][i] = E->gDA[m][el].vpt[i];
+            }
+        }
+    }
 
-    for(m=1;m<=E->sphere.caps_per_proc;m++)
-        for(i=1;i<=E->lmesh.nno;i++)  {
-            nz = ((i-1) % E->lmesh.noz) + 1;
+    return;
+}
 
-            /* compute sum(rho*cp*T) before filtering, skipping nodes
-               that's shared by another processor */
-            if(!(E->NODE[lev][m][i] & SKIP))
-                Tsum0 += E->T[m][i]*rhocp[nz];
 
-            /* remove overshoot */
-            if(E->T[m][i]<Tmin)  Tmin=E->T[m][i];
-            if(E->T[m][i]<Tmin0) E->T[m][i]=Tmin0;
-            if(E->T[m][i]>Tmax) Tmax=E->T[m][i];
-            if(E->T[m][i]>Tmax0) E->T[m][i]=Tmax0;
+/* y = (M + scale*K) x, the nodes with fixed temperature are skipped */
 
+static void implicit_diffusion_apply(struct All_variables *E,
+                                     double diff, double scale,
+                                     double **x, double **y)
+{
+    int m,i,color,ncolor;
+    int px,py,pz,nx,ny,nz;
+
+    const int lev=E->mesh.levmax;
+    const int elx=E->lmesh.elx;
+    const int ely=E->lmesh.ely;
+    const int elz=E->lmesh.elz;
+    const int nno=E->lmesh.nno;
+
+    for (m=1;m<=E->sphere.caps_per_proc;m++) {
+#pragma omp parallel for schedule(static)
+      for(i=1;i<=nno;i++)
+        y[m][i] = 0.0;
+    }
+
+    for (m=1;m<=E->sphere.caps_per_proc;m++)
+      for(color=0;color<8;color++) {
+        pz = color & 1;
+        px = (color >> 1) & 1;
+        py = (color >> 2) & 1;
+
+        nz = (elz - pz + 1) / 2;
+        nx = (elx - px + 1) / 2;
+        ny = (ely - py + 1) / 2;
+        ncolor = nz * nx * ny;
+
+#pragma omp parallel for schedule(static)
+        for(i=0;i<ncolor;i++) {
+          int el,a,j,d;
+          double xe[9],g[3][9],coef,sum;
+          const struct Shape_function_dx *GNx;
+          const struct DIFF_ELEMENT *de;
+
+          el = (pz + 2*(i % nz) + 1)
+            + (px + 2*((i / nz) % nx)) * elz
+            + (py + 2*(i / (nz * nx))) * elz * elx;
+
+          GNx = &(E->gNX[m][el]);
+          de = &(E->advection.diff_el[m][el]);
+          coef = scale * diff * E->heating_latent[m][el];
+
+          for(a=1;a<=ENODES3D;a++)
+            xe[a] = x[m][E->ien[m][el].node[a]];
+
+          /* gradient at the integration points, times the weights */
+          for(d=0;d<3;d++)
+            for(j=1;j<=VPOINTS3D;j++) {
+              sum = 0.0;
+              for(a=1;a<=ENODES3D;a++)
+                sum += GNx->vpt[GNVXINDEX(d,a,j)] * xe[a];
+              g[d][j] = sum * de->w[d][j];
+            }
+
+          for(a=1;a<=ENODES3D;a++) {
+            sum = 0.0;
+            for(d=0;d<3;d++)
+              for(j=1;j<=VPOINTS3D;j++)
+                sum += GNx->vpt[GNVXINDEX(d,a,j)] * g[d][j];
+            y[m][E->ien[m][el].node[a]] += coef * sum;
+          }
+        }
+      }
+
+    (E->exchange_node_d)(E,y,lev);
+
+    for (m=1;m<=E->sphere.caps_per_proc;m++) {
+#pragma omp parallel for schedule(static)
+      for(i=1;i<=nno;i++) {
+        if(E->node[m][i] & (TBX | TBY | TBZ))
+          y[m][i] = 0.0;
+        else
+          y[m][i] += x[m][i] / E->TMass[m][i];
+      }
+    }
+
+    return;
+}
+
+
+/* inverse of the diagonal of (M + scale*K), for preconditioning */
+
+static void implicit_diffusion_diagonal(struct All_variables *E,
+                                        double diff, double scale,
+                                        double **dinv)
+{
+    int m,i,el,a,j,d;
+    double coef,sum,gn;
+
+    const int lev=E->mesh.levmax;
+    const int nno=E->lmesh.nno;
+
+    for (m=1;m<=E->sphere.caps_per_proc;m++) {
+      for(i=1;i<=nno;i++)
+        dinv[m][i] = 0.0;
+
+      for(el=1;el<=E->lmesh.nel;el++) {
+        coef = scale * diff * E->heating_latent[m][el];
+        for(a=1;a<=ENODES3D;a++) {
+          sum = 0.0;
+          for(d=0;d<3;d++)
+            for(j=1;j<=VPOINTS3D;j++) {
+              gn = E->gNX[m][el].vpt[GNVXINDEX(d,a,j)];
+              sum += gn * gn * E->advection.diff_el[m][el].w[d][j];
+            }
+          dinv[m][E->ien[m][el].node[a]] += coef * sum;
         }
+      }
+    }
+
+    (E->exchange_node_d)(E,dinv,lev);
+
+    for (m=1;m<=E->sphere.caps_per_proc;m++)
+      for(i=1;i<=nno;i++)
+        dinv[m][i] = 1.0 / (dinv[m][i] + 1.0 / E->TMass[m][i]);
 
-    /* find global max/min of temperature */
-    MPI_Allreduce(&Tmin,&Tmin1,1,MPI_DOUBLE,MPI_MIN,E->parallel.world);
-    MPI_Allreduce(&Tmax,&Tmax1,1,MPI_DOUBLE,MPI_MAX,E->parallel.world);
+    return;
+}
+
+
+/* dot product of two nodal fields, counting shared nodes only once */
+
+static double implicit_diffusion_dot(struct All_variables *E,
+                                     double **a, double **b)
+{
+    int m,i,n;
+    double sum;
+
+    const int lev=E->mesh.levmax;
+    const int nno=E->lmesh.nno;
+
+    sum = 0.0;
+    for (m=1;m<=E->sphere.caps_per_proc;m++) {
+#pragma omp parallel for reduction(+:sum) schedule(static)
+      for(i=1;i<=nno;i++)
+        if(!(E->NODE[lev][m][i] & SKIP))
+          sum += a[m][i] * b[m][i];
+    }
+
+    n = add_global_sum(E, sum, 1.0);
+    flush_global_sums(E);
+
+    return get_global_sum(E, n);
+}
+
+
+/* <r,z> and <r,r> in one sweep and one reduction */
+
+static void implicit_diffusion_dot2(struct All_variables *E,
+                                    double **r, double **z,
+                                    double *rz, double *rr)
+{
+    int m,i,n1,n2;
+    double sum1,sum2;
+
+    const int lev=E->mesh.levmax;
+    const int nno=E->lmesh.nno;
+
+    sum1 = sum2 = 0.0;
+    for (m=1;m<=E->sphere.caps_per_proc;m++) {
+#pragma omp parallel for reduction(+:sum1,sum2) schedule(static)
+      for(i=1;i<=nno;i++)
+        if(!(E->NODE[lev][m][i] & SKIP)) {
+          sum1 += r[m][i] * z[m][i];
+          sum2 += r[m][i] * r[m][i];
+        }
+    }
+
+    n1 = add_global_sum(E, sum1, 1.0);
+    n2 = add_global_sum(E, sum2, 1.0);
+    flush_global_sums(E);
+
+    *rz = get_global_sum(E, n1);
+    *rr = get_global_sum(E, n2);
+
+    return;
+}
+
+
+/* On input, DTdot is the assembled residual. On output, it is the
+   solution of (M + gamma*dt*K) DTdot = residual. */
+
+static void implicit_diffusion_solve(struct All_variables *E,
+                                     double **DTdot, double diff)
+{
+    int m,i,iter;
+    double scale,alpha,beta,rz,rz0,rr,rr0,pq;
+    double **r, **z, **p, **q, **dinv;
+
+    const int nno=E->lmesh.nno;
+    const double tol=E->advection.implicit_diffusion_tol;
+
+    r = E->advection.implicit_work[0];
+    z = E->advection.implicit_work[1];
+    p = E->advection.implicit_work[2];
+    q = E->advection.implicit_work[3];
+    dinv = E->advection.implicit_work[4];
+
+    scale = E->advection.gamma * E->advection.timestep;
+
+    implicit_diffusion_diagonal(E, diff, scale, dinv);
+
+    /* initial guess is the explicit solution, M^-1 R */
+    for (m=1;m<=E->sphere.caps_per_proc;m++)
+      for(i=1;i<=nno;i++) {
+        if(E->node[m][i] & (TBX | TBY | TBZ)) {
+          r[m][i] = 0.0;
+          DTdot[m][i] = 0.0;
+        }
+        else {
+          r[m][i] = DTdot[m][i];
+          DTdot[m][i] *= E->TMass[m][i];
+        }
+      }
+
+    rr0 = implicit_diffusion_dot(E, r, r);
+
+    implicit_diffusion_apply(E, diff, scale, DTdot, q);
+
+    for (m=1;m<=E->sphere.caps_per_proc;m++)
+      for(i=1;i<=nno;i++) {
+        r[m][i] -= q[m][i];
+        z[m][i] = dinv[m][i] * r[m][i];
+        p[m][i] = z[m][i];
+      }
+
+    implicit_diffusion_dot2(E, r, z, &rz, &rr);
+
+    iter = 0;
+    while(iter < E->advection.implicit_diffusion_maxiter &&
+          rr > tol*tol*rr0 && rr > 0.0) {
+
+      implicit_diffusion_apply(E, diff, scale, p, q);
+
+      pq = implicit_diffusion_dot(E, p, q);
+      alpha = rz / pq;
+
+      for (m=1;m<=E->sphere.caps_per_proc;m++)
+        for(i=1;i<=nno;i++) {
+          DTdot[m][i] += alpha * p[m][i];
+          r[m][i] -= alpha * q[m][i];
+          z[m][i] = dinv[m][i] * r[m][i];
+        }
+
+      rz0 = rz;
+      implicit_diffusion_dot2(E, r, z, &rz, &rr);
+      beta = rz / rz0;
+
+      for (m=1;m<=E->sphere.caps_per_proc;m++)
+        for(i=1;i<=nno;i++)
+          p[m][i] = z[m][i] + beta * p[m][i];
+
+      iter++;
+    }
+
+    E->advection.implicit_diffusion_iterations += iter;
+
+    if(iter == E->advection.implicit_diffusion_maxiter && E->parallel.me==0) {
+      fprintf(stderr, "implicit diffusion: CG not converged after %d iterations, residual %e\n",
+              iter, sqrt(rr/rr0));
+      fprintf(E->fp, "implicit diffusion: CG not converged after %d iterations, residual %e\n",
+              iter, sqrt(rr/rr0));
+    }
+
+    return;
+}
+
+
+/* This function filters the temperature field. The temperature above   */
+/* Tmax0(==1.0) and Tmin0(==0.0) is removed, while conserving the total */
+/* energy. See Lenardic and Kaula, JGR, 1993.                           */
+/* The overshoot has already been removed by energy_stats_node(), which */
+/* also provides the global min/max and the local sum(rho*cp*T) before  */
+/* filtering.                                                           */
+static void filter(struct All_variables *E, struct ENERGY_STATS *stats)
+{
+    double Tsum1,TDIST;
+    int m,i;
+    double rhocp, local[2], global[2];
+    int lev, nz;
+
+    const double Tmin0 = filter_Tmin0;
+    const double Tmax0 = filter_Tmax0;
+    const double Tmin1 = stats->Tmin;
+    const double Tmax1 = stats->Tmax;
+
+    Tsum1 = 0.0;
+    local[1] = 0.0;
+
+    lev=E->mesh.levmax;
 
     for(m=1;m<=E->sphere.caps_per_proc;m++)
         for(i=1;i<=E->lmesh.nno;i++)  {
@@ -739,9 +1324,10 @@ static void filter(struct All_variables *E)
 
             /* sum(rho*cp*T) after filtering */
             if (!(E->NODE[lev][m][i] & SKIP))  {
-                Tsum1 += E->T[m][i]*rhocp[nz];
+                rhocp = E->refstate.rho[nz] * E->refstate.heat_capacity[nz];
+                Tsum1 += E->T[m][i]*rhocp;
                 if(E->T[m][i]!=Tmin0 && E->T[m][i]!=Tmax0) {
-                    sum_rhocp += rhocp[nz];
+                    local[1] += rhocp;
                 }
 
             }
@@ -749,10 +1335,9 @@ static void filter(struct All_variables *E)
         }
 
     /* find the difference of sum(rho*cp*T) before/after the filtering */
-    TDIST=Tsum0-Tsum1;
-    MPI_Allreduce(&TDIST,&TDIST1,1,MPI_DOUBLE,MPI_SUM,E->parallel.world);
-    MPI_Allreduce(&sum_rhocp,&total_sum_rhocp,1,MPI_DOUBLE,MPI_SUM,E->parallel.world);
-    TDIST=TDIST1/total_sum_rhocp;
+    local[0] = stats->Tsum0 - Tsum1;
+    MPI_Allreduce(local,global,2,MPI_DOUBLE,MPI_SUM,E->parallel.world);
+    TDIST=global[0]/global[1];
 
     /* keep sum(rho*cp*T) the same before/after the filtering by distributing
        the difference back to nodes */
@@ -762,7 +1347,6 @@ static void filter(struct All_variables *E)
                 E->T[m][i] +=TDIST;
         }
 
-    free(rhocp);
     return;
 }
 
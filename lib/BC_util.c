@@ -30,6 +30,7 @@
 void horizontal_bc(struct All_variables *,float *[],int,int,float,unsigned int,char,int,int);
 void internal_horizontal_bc(struct All_variables *,float *[],int,int,float,unsigned int,char,int,int);
 void myerror(struct All_variables *,char *);
+double temperature_bc_value(struct All_variables *, int, int, unsigned int);
 int layers(struct All_variables *,int,int);
 
 
@@ -132,31 +133,8 @@ void temperatures_conform_bcs2(E)
 
         type = (E->node[j][node] & (TBX | TBZ | TBY));
 
-        switch (type) {
-        case 0:  /* no match, next node */
-            break;
-        case TBX:
-            E->T[j][node] = E->sphere.cap[j].TB[1][node];
-            break;
-        case TBZ:
-            E->T[j][node] = E->sphere.cap[j].TB[3][node];
-            break;
-        case TBY:
-            E->T[j][node] = E->sphere.cap[j].TB[2][node];
-            break;
-        case (TBX | TBZ):     /* clashes ! */
-            E->T[j][node] = 0.5 * (E->sphere.cap[j].TB[1][node] + E->sphere.cap[j].TB[3][node]);
-            break;
-        case (TBX | TBY):     /* clashes ! */
-            E->T[j][node] = 0.5 * (E->sphere.cap[j].TB[1][node] + E->sphere.cap[j].TB[2][node]);
-            break;
-        case (TBZ | TBY):     /* clashes ! */
-            E->T[j][node] = 0.5 * (E->sphere.cap[j].TB[3][node] + E->sphere.cap[j].TB[2][node]);
-            break;
-        case (TBZ | TBY | TBX):     /* clashes ! */
-            E->T[j][node] = 0.3333333 * (E->sphere.cap[j].TB[1][node] + E->sphere.cap[j].TB[2][node] + E->sphere.cap[j].TB[3][node]);
-            break;
-        }
+        if(type)
+            E->T[j][node] = temperature_bc_value(E,j,node,type);
 
         /* next node */
     }
@@ -166,6 +144,30 @@ void temperatures_conform_bcs2(E)
 }
 
 
+/* prescribed temperature of a node with boundary flags type (!= 0) */
+
+double temperature_bc_value(struct All_variables *E, int j, int node,
+                            unsigned int type)
+{
+  switch (type) {
+  case TBX:
+      return E->sphere.cap[j].TB[1][node];
+  case TBZ:
+      return E->sphere.cap[j].TB[3][node];
+  case TBY:
+      return E->sphere.cap[j].TB[2][node];
+  case (TBX | TBZ):     /* clashes ! */
+      return 0.5 * (E->sphere.cap[j].TB[1][node] + E->sphere.cap[j].TB[3][node]);
+  case (TBX | TBY):     /* clashes ! */
+      return 0.5 * (E->sphere.cap[j].TB[1][node] + E->sphere.cap[j].TB[2][node]);
+  case (TBZ | TBY):     /* clashes ! */
+      return 0.5 * (E->sphere.cap[j].TB[3][node] + E->sphere.cap[j].TB[2][node]);
+  default:              /* (TBZ | TBY | TBX), clashes ! */
+      return 0.3333333 * (E->sphere.cap[j].TB[1][node] + E->sphere.cap[j].TB[2][node] + E->sphere.cap[j].TB[3][node]);
+  }
+}
+
+
 void velocities_conform_bcs(E,U)
     struct All_variables *E;
     double **U;
@@ -28,6 +28,8 @@
 
 #include <sys/file.h>
 #include <unistd.h>
+#include <string.h>
+#include <math.h>
 #include "global_defs.h"
 #include "composition_related.h"
 
@@ -48,12 +50,34 @@ static void read_composition_checkpoint(struct All_variables *E, FILE *fp);
 static void read_energy_checkpoint(struct All_variables *E, FILE *fp);
 static void read_momentum_checkpoint(struct All_variables *E, FILE *fp);
 
+static void suggest_radial_layers(struct All_variables *E, int *suggested);
+static void layer_checkpoint(struct All_variables *E, FILE *fp,
+                             int *suggested);
+static void read_repartitioned_checkpoint(struct All_variables *E);
+static void read_layer_of_checkpoint(struct All_variables *E, FILE *fp,
+                                     int old_ezs, int old_elz);
+static void copy_radial_slice(double *dst, int dst_nz, int dst_zs,
+                              const double *src, int src_nz, int src_zs,
+                              int nx, int ny, int ncomp);
+static void velocity_to_node_order(struct All_variables *E, int m,
+                                   const double *U, double *buf);
+static void velocity_from_node_order(struct All_variables *E, int m,
+                                     const double *buf, double *U);
+
+/* marks the radial layer block at the end of a checkpoint file */
+#define LAYER_MAGIC 0x4c415952
+
 void myerror(struct All_variables *, char *);
 
 void output_checkpoint(struct All_variables *E)
 {
     char output_file[255];
     FILE *fp1;
+    int *suggested;
+
+    /* collective, so it is done before opening the file */
+    suggested = (int *)malloc(E->parallel.nprocz*sizeof(int));
+    suggest_radial_layers(E, suggested);
 
     sprintf(output_file, "%s.chkpt.%d.%d", E->control.data_file,
             E->parallel.me, E->monitor.solution_cycles);
@@ -81,7 +105,11 @@ void output_checkpoint(struct All_variables *E)
             composition_checkpoint(E, fp1);
     }
 
+    /* radial layers, this must be the last to be checkpointed */
+    layer_checkpoint(E, fp1, suggested);
+
     fclose(fp1);
+    free(suggested);
     return;
 }
 
@@ -93,6 +121,14 @@ void read_checkpoint(struct All_variables *E)
 
     char output_file[255];
     FILE *fp;
+    int k;
+
+    /* the checkpoint was written with other radial layers */
+    for(k=0; k<E->parallel.nprocz; k++)
+        if(E->parallel.chkpt_layer_elz[k] != E->parallel.layer_elz[k]) {
+            read_repartitioned_checkpoint(E);
+            return;
+        }
 
     /* open the checkpoint file */
     snprintf(output_file, 254, "%s.chkpt.%d.%d", E->control.old_P_file,
@@ -449,6 +485,7 @@ static void momentum_checkpoint(struct All_variables *E, FILE *fp)
 {
     int m;
     float junk[2];
+    double *buf;
     junk[0] = junk[1] = 0;
 
     write_sentinel(fp);
@@ -462,8 +499,11 @@ static void momentum_checkpoint(struct All_variables *E, FILE *fp)
         /* Pressure at equation points */
         fwrite(E->P[m], sizeof(double), E->lmesh.npno+1, fp);
 
-        /* velocity at equation points */
-        fwrite(E->U[m], sizeof(double), E->lmesh.neq, fp);
+        /* velocity at equation points, in node order */
+        buf = (double *)malloc(E->lmesh.neq*sizeof(double));
+        velocity_to_node_order(E, m, E->U[m], buf);
+        fwrite(buf, sizeof(double), E->lmesh.neq, fp);
+        free(buf);
     }
 
     return;
@@ -479,6 +519,7 @@ static void read_momentum_checkpoint(struct All_variables *E, FILE *fp)
     int m;
     int lev = E->mesh.levmax;
     float junk[2];
+    double *buf;
 
     read_sentinel(fp, E->parallel.me);
 
@@ -490,9 +531,12 @@ static void read_momentum_checkpoint(struct All_variables *E, FILE *fp)
         /* Pressure at equation points */
       if(fread(E->P[m], sizeof(double), E->lmesh.npno+1, fp) !=  E->lmesh.npno+1)
 	myerror(E,"read_momentum_checkpoint: error at P");
-        /* velocity at equation points */
-      if(fread(E->U[m], sizeof(double), E->lmesh.neq, fp) != E->lmesh.neq)
+        /* velocity at equation points, in node order */
+      buf = (double *)malloc(E->lmesh.neq*sizeof(double));
+      if(fread(buf, sizeof(double), E->lmesh.neq, fp) != E->lmesh.neq)
 	myerror(E,"read_momentum_checkpoint: error at U");
+      velocity_from_node_order(E, m, buf, E->U[m]);
+      free(buf);
     }
 
     E->monitor.vdotv = global_v_norm2(E, E->U);
@@ -508,3 +552,452 @@ static void read_momentum_checkpoint(struct All_variables *E, FILE *fp)
 }
 
 
+/* The cost of every radial layer of elements is 1 per element, plus */
+/* the cost of its tracers.  The layers are split into nprocz         */
+/* contiguous groups minimizing the largest cost of a group, in units */
+/* that keep every group divisible down to the coarsest grid.         */
+
+static void suggest_radial_layers(struct All_variables *E, int *suggested)
+{
+    const int nz = E->parallel.nprocz;
+    int unit, nblocks, b, i, k, p;
+    double *cost, *sum, **best, c;
+    int **cut;
+
+    unit = (E->control.NMULTIGRID) ?
+        (int)pow(2.0,(double)(E->mesh.levmax-E->mesh.levmin)) : 1;
+    nblocks = E->mesh.elz/unit;
+
+    cost = (double *)malloc((E->mesh.elz+1)*sizeof(double));
+    for(k=1; k<=E->mesh.elz; k++)
+        cost[k] = 1.0;
+    if(E->control.tracer)
+        tracer_layer_cost(E, cost);
+
+    /* sum[b] is the cost of the first b blocks */
+    sum = (double *)malloc((nblocks+1)*sizeof(double));
+    sum[0] = 0;
+    for(b=1; b<=nblocks; b++) {
+        sum[b] = sum[b-1];
+        for(k=(b-1)*unit+1; k<=b*unit; k++)
+            sum[b] += cost[k];
+    }
+
+    /* best[p][b]: smallest largest cost of p+1 groups of the first b blocks */
+    best = (double **)malloc(nz*sizeof(double *));
+    cut = (int **)malloc(nz*sizeof(int *));
+    for(p=0; p<nz; p++) {
+        best[p] = (double *)malloc((nblocks+1)*sizeof(double));
+        cut[p] = (int *)malloc((nblocks+1)*sizeof(int));
+    }
+
+    for(b=1; b<=nblocks; b++) {
+        best[0][b] = sum[b];
+        cut[0][b] = 0;
+    }
+    for(p=1; p<nz; p++)
+        for(b=p+1; b<=nblocks; b++) {
+            best[p][b] = -1;
+            for(i=p; i<b; i++) {
+                c = max(best[p-1][i], sum[b]-sum[i]);
+                if(best[p][b] < 0 || c < best[p][b]) {
+                    best[p][b] = c;
+                    cut[p][b] = i;
+                }
+            }
+        }
+
+    for(p=nz-1, b=nblocks; p>=0; p--) {
+        suggested[p] = (b - cut[p][b])*unit;
+        b = cut[p][b];
+    }
+
+    for(p=0; p<nz; p++) {
+        free(best[p]);
+        free(cut[p]);
+    }
+    free(best);
+    free(cut);
+    free(sum);
+    free(cost);
+
+    return;
+}
+
+
+/* The radial layers of the checkpoint and the suggested ones, */
+/* then nprocz and LAYER_MAGIC so that the block can be found  */
+/* from the end of the file.                                   */
+
+static void layer_checkpoint(struct All_variables *E, FILE *fp,
+                             int *suggested)
+{
+    int tail[2];
+
+    write_sentinel(fp);
+
+    fwrite(&(E->parallel.nprocz), sizeof(int), 1, fp);
+    fwrite(E->parallel.layer_elz, sizeof(int), E->parallel.nprocz, fp);
+    fwrite(suggested, sizeof(int), E->parallel.nprocz, fp);
+
+    tail[0] = E->parallel.nprocz;
+    tail[1] = LAYER_MAGIC;
+    fwrite(tail, sizeof(int), 2, fp);
+
+    return;
+}
+
+
+/* Reads the radial layers of the checkpoint to restart from (the   */
+/* one of processor 0) and the suggested ones.  Returns 0 if the    */
+/* checkpoint does not have them, i.e. it was written before they   */
+/* were recorded.                                                   */
+
+int read_checkpoint_layers(struct All_variables *E, int *current,
+                           int *suggested)
+{
+    const int nz = E->parallel.nprocz;
+    char output_file[255];
+    FILE *fp;
+    int *buf, tail[2], found;
+
+    buf = (int *)malloc((2*nz+1)*sizeof(int));
+    buf[0] = 0;
+
+    if(E->parallel.me == 0) {
+        snprintf(output_file, 254, "%s.chkpt.%d.%d", E->control.old_P_file,
+                 0, E->monitor.solution_cycles_init);
+        fp = fopen(output_file, "rb");
+        if(fp != NULL) {
+            if(fseek(fp, -2*(long)sizeof(int), SEEK_END) == 0 &&
+               fread(tail, sizeof(int), 2, fp) == 2 &&
+               tail[0] == nz && tail[1] == LAYER_MAGIC &&
+               fseek(fp, -(2+2*nz)*(long)sizeof(int), SEEK_END) == 0 &&
+               fread(buf+1, sizeof(int), 2*nz, fp) == 2*nz)
+                buf[0] = 1;
+            fclose(fp);
+        }
+    }
+
+    MPI_Bcast(buf, 2*nz+1, MPI_INT, 0, E->parallel.world);
+
+    found = buf[0];
+    if(found) {
+        memcpy(current, buf+1, nz*sizeof(int));
+        memcpy(suggested, buf+1+nz, nz*sizeof(int));
+    }
+
+    free(buf);
+    return found;
+}
+
+
+/* Restart from a checkpoint written with other radial layers.  The */
+/* horizontal decomposition is the same, so every processor reads   */
+/* the checkpoints of the processors of its column that overlap it  */
+/* radially, and takes the nodes, elements and tracers inside it.   */
+
+static void read_repartitioned_checkpoint(struct All_variables *E)
+{
+    void initialize_material(struct All_variables *E);
+    void initial_viscosity(struct All_variables *E);
+    void v_from_vector();
+    void p_to_nodes();
+    double global_v_norm2(), global_p_norm2();
+
+    const int nz = E->parallel.nprocz;
+    const int lz = E->parallel.me_loc[3];
+    char output_file[255];
+    FILE *fp;
+    int k, m, old_ezs, read_tracers;
+
+    if(E->parallel.me == 0)
+        fprintf(stderr,"read_checkpoint: restarting from %s.chkpt.*.%d "
+                "with new radial layers\n", E->control.old_P_file,
+                E->monitor.solution_cycles_init);
+
+    /* init E->mat */
+    initialize_material(E);
+
+    read_tracers = E->control.tracer &&
+        (E->trace.ic_method_for_flavors != 99);
+    if(E->control.tracer && !read_tracers && E->parallel.me == 0)
+        fprintf(stderr,"ic_method_for_flavors = 99 will override checkpoint restart\n");
+
+    if(read_tracers)
+        for(m=1; m<=E->sphere.caps_per_proc; m++) {
+            /* grown as the tracers are read */
+            allocate_tracer_arrays(E, m, E->lmesh.nel);
+        }
+
+    old_ezs = 0;
+    for(k=0; k<nz; k++) {
+        /* elements of old layer k: old_ezs+1 .. old_ezs+chkpt_layer_elz[k] */
+        if(old_ezs < E->lmesh.ezs+E->lmesh.elz &&
+           old_ezs+E->parallel.chkpt_layer_elz[k] > E->lmesh.ezs) {
+
+            snprintf(output_file, 254, "%s.chkpt.%d.%d", E->control.old_P_file,
+                     E->parallel.me - lz + k, E->monitor.solution_cycles_init);
+            fp = fopen(output_file, "rb");
+            if(fp == NULL) {
+                fprintf(stderr, "Cannot open file: %s\n", output_file);
+                exit(-1);
+            }
+
+            read_layer_of_checkpoint(E, fp, old_ezs,
+                                     E->parallel.chkpt_layer_elz[k]);
+            fclose(fp);
+        }
+        old_ezs += E->parallel.chkpt_layer_elz[k];
+    }
+
+    E->monitor.vdotv = global_v_norm2(E, E->U);
+    E->monitor.pdotp = global_p_norm2(E, E->P);
+
+    /* update velocity array */
+    v_from_vector(E);
+
+    /* init E->NP */
+    p_to_nodes(E, E->P, E->NP, E->mesh.levmax);
+
+    if(read_tracers) {
+        /* init E->trace.ntracer_flavor */
+        count_tracers_of_flavors(E);
+
+        if(E->composition.on) {
+            /* init E->composition.comp_node */
+            map_composition_to_nodes(E);
+
+            /* preventing uninitialized access */
+            E->trace.istat_iempty = 0;
+
+            for(k=0; k<E->composition.ncomp; k++)
+                E->composition.error_fraction[k] =
+                    E->composition.bulk_composition[k]
+                    / E->composition.initial_bulk_composition[k] - 1.0;
+        }
+    }
+
+    /* finally, init viscosity */
+    initial_viscosity(E);
+
+    return;
+}
+
+
+/* Reads the checkpoint of a processor of old radial layer old_ezs+1 */
+/* .. old_ezs+old_elz and keeps the part inside this processor.      */
+
+static void read_layer_of_checkpoint(struct All_variables *E, FILE *fp,
+                                     int old_ezs, int old_elz)
+{
+    const int nox = E->lmesh.nox;
+    const int noy = E->lmesh.noy;
+    const int elx = E->lmesh.elx;
+    const int ely = E->lmesh.ely;
+    const int old_noz = old_elz + 1;
+    const int old_nno = nox*noy*old_noz;
+    const int old_nel = elx*ely*old_elz;
+
+    int tmp[7], m, i, kk, q, itmp, n, iel, nq, lost;
+    int ntr[NCS];
+    float junk[2];
+    double *buf, *unode, **col;
+    int *iel_old;
+
+    if(fread(tmp, sizeof(int), 7, fp) != 7 ||
+       (tmp[0] != nox) || (tmp[1] != noy) || (tmp[2] != old_noz) ||
+       (tmp[3] != E->parallel.nprocx) ||
+       (tmp[4] != E->parallel.nprocy) ||
+       (tmp[5] != E->parallel.nprocz) ||
+       (tmp[6] != E->sphere.caps_per_proc)) {
+        fprintf(stderr, "Error in reading checkpoint file: mesh parameters mismatch, me=%d\n",
+                E->parallel.me);
+        exit(-1);
+    }
+
+    /* timing information, the same in all files */
+    tmp[0] = fread(&(E->monitor.solution_cycles), sizeof(int), 1, fp);
+    tmp[0]+= fread(&(E->monitor.elapsed_time), sizeof(float), 1, fp);
+    tmp[0]+= fread(&(E->advection.timestep), sizeof(float), 1, fp);
+    tmp[0]+= fread(&(E->control.start_age), sizeof(float), 1, fp);
+    if(tmp[0] != 4)
+      myerror(E,"read_general_checkpoint: header error");
+    E->advection.timesteps = E->monitor.solution_cycles;
+
+    buf = (double *)malloc((3*old_nno+1)*sizeof(double));
+
+    /* energy */
+    read_sentinel(fp, E->parallel.me);
+    for(m=1; m<=E->sphere.caps_per_proc; m++) {
+        if(fread(buf, sizeof(double), old_nno+1, fp) != old_nno+1)
+            myerror(E,"read_energy_checkpoint: error at T");
+        copy_radial_slice(E->T[m]+1, E->lmesh.noz, E->lmesh.nzs,
+                          buf+1, old_noz, old_ezs+1, nox, noy, 1);
+        if(fread(buf, sizeof(double), old_nno+1, fp) != old_nno+1)
+            myerror(E,"read_energy_checkpoint: error at Tdot");
+        copy_radial_slice(E->Tdot[m]+1, E->lmesh.noz, E->lmesh.nzs,
+                          buf+1, old_noz, old_ezs+1, nox, noy, 1);
+    }
+
+    /* momentum */
+    read_sentinel(fp, E->parallel.me);
+    if(fread(junk, sizeof(float), 2, fp) != 2)
+        myerror(E,"read_momentum_checkpoint: error at vdotv");
+    for(m=1; m<=E->sphere.caps_per_proc; m++) {
+        if(fread(buf, sizeof(double), old_nel+1, fp) != old_nel+1)
+            myerror(E,"read_momentum_checkpoint: error at P");
+        copy_radial_slice(E->P[m]+1, E->lmesh.elz, E->lmesh.ezs+1,
+                          buf+1, old_elz, old_ezs+1, elx, ely, 1);
+        if(fread(buf, sizeof(double), 3*old_nno, fp) != 3*old_nno)
+            myerror(E,"read_momentum_checkpoint: error at U");
+        unode = (double *)malloc(E->lmesh.neq*sizeof(double));
+        velocity_to_node_order(E, m, E->U[m], unode);
+        copy_radial_slice(unode, E->lmesh.noz, E->lmesh.nzs,
+                          buf, old_noz, old_ezs+1, nox, noy, 3);
+        velocity_from_node_order(E, m, unode, E->U[m]);
+        free(unode);
+    }
+
+    if(!E->control.tracer || E->trace.ic_method_for_flavors == 99) {
+        free(buf);
+        return;
+    }
+
+    /* tracers, kept if they are inside this processor */
+    read_sentinel(fp, E->parallel.me);
+    fread(tmp, sizeof(int), 4, fp);
+    if(tmp[0] != E->trace.number_of_basic_quantities ||
+       tmp[1] != E->trace.number_of_extra_quantities ||
+       tmp[2] != E->trace.nflavors) {
+        fprintf(stderr, "Error in reading checkpoint file: tracer quantities, me=%d\n",
+                E->parallel.me);
+        exit(-1);
+    }
+    E->trace.ilast_tracer_count = tmp[3];
+
+    for(m=1; m<=E->sphere.caps_per_proc; m++)
+        fread(&ntr[m], sizeof(int), 1, fp);
+
+    nq = 6 + E->trace.number_of_extra_quantities;
+    col = (double **)malloc(nq*sizeof(double *));
+    lost = 0;
+
+    for(m=1; m<=E->sphere.caps_per_proc; m++) {
+        for(q=0; q<nq; q++) {
+            col[q] = (double *)malloc((ntr[m]+1)*sizeof(double));
+            fread(col[q], sizeof(double), ntr[m]+1, fp);
+        }
+        iel_old = (int *)malloc((ntr[m]+1)*sizeof(int));
+        fread(iel_old, sizeof(int), ntr[m]+1, fp);
+
+        for(kk=1; kk<=ntr[m]; kk++) {
+            iel = (E->trace.iget_element)(E, m, -99,
+                                          col[3][kk], col[4][kk], col[5][kk],
+                                          col[0][kk], col[1][kk], col[2][kk]);
+            if(iel == -99) continue;   /* in another processor */
+            if(iel == -1) {
+                lost++;
+                continue;
+            }
+
+            if(E->trace.ntracers[m] >= E->trace.max_ntracers[m]-5)
+                expand_tracer_arrays(E, m);
+
+            n = ++E->trace.ntracers[m];
+            for(q=0; q<6; q++)
+                E->trace.basicq[m][q][n] = col[q][kk];
+            for(q=6; q<nq; q++)
+                E->trace.extraq[m][q-6][n] = col[q][kk];
+            E->trace.ielement[m][n] = iel;
+        }
+
+        for(q=0; q<nq; q++)
+            free(col[q]);
+        free(iel_old);
+    }
+    free(col);
+
+    if(lost > 0) {
+        fprintf(E->trace.fpt, "read_checkpoint: %d tracers not found in any element\n", lost);
+        fflush(E->trace.fpt);
+    }
+
+    /* composition */
+    if(E->composition.on) {
+        read_sentinel(fp, E->parallel.me);
+        fread(&itmp, sizeof(int), 1, fp);
+        if(itmp != E->composition.ncomp) {
+            fprintf(stderr, "Error in reading checkpoint file: ncomp, me=%d\n",
+                    E->parallel.me);
+            exit(-1);
+        }
+        fread(E->composition.bulk_composition, sizeof(double),
+              E->composition.ncomp, fp);
+        fread(E->composition.initial_bulk_composition, sizeof(double),
+              E->composition.ncomp, fp);
+
+        for(m=1; m<=E->sphere.caps_per_proc; m++)
+            for(i=0; i<E->composition.ncomp; i++) {
+                fread(buf, sizeof(double), old_nel+1, fp);
+                copy_radial_slice(E->composition.comp_el[m][i]+1,
+                                  E->lmesh.elz, E->lmesh.ezs+1,
+                                  buf+1, old_elz, old_ezs+1, elx, ely, 1);
+            }
+    }
+
+    free(buf);
+    return;
+}
+
+
+/* Copies the radial range common to two nodal (or element) fields */
+/* stored radius fastest, nz entries per column starting at global */
+/* radial index zs, ncomp values per entry, 0-based.               */
+
+static void copy_radial_slice(double *dst, int dst_nz, int dst_zs,
+                              const double *src, int src_nz, int src_zs,
+                              int nx, int ny, int ncomp)
+{
+    int i, j, z, c, lo, hi, d, s;
+
+    lo = max(dst_zs, src_zs);
+    hi = min(dst_zs+dst_nz, src_zs+src_nz) - 1;
+
+    for(j=0; j<ny; j++)
+        for(i=0; i<nx; i++)
+            for(z=lo; z<=hi; z++) {
+                d = (z-dst_zs) + i*dst_nz + j*dst_nz*nx;
+                s = (z-src_zs) + i*src_nz + j*src_nz*nx;
+                for(c=0; c<ncomp; c++)
+                    dst[d*ncomp+c] = src[s*ncomp+c];
+            }
+
+    return;
+}
+
+
+/* The checkpoint keeps the velocity in node order, 3*(node-1)+d-1,
+ * independent of the equation numbering of construct_id(). */
+static void velocity_to_node_order(struct All_variables *E, int m,
+                                   const double *U, double *buf)
+{
+    int node, d;
+
+    for(node=1; node<=E->lmesh.nno; node++)
+        for(d=1; d<=3; d++)
+            buf[3*(node-1)+d-1] = U[E->id[m][node].doff[d]];
+    return;
+}
+
+
+static void velocity_from_node_order(struct All_variables *E, int m,
+                                     const double *buf, double *U)
+{
+    int node, d;
+
+    for(node=1; node<=E->lmesh.nno; node++)
+        for(d=1; d<=3; d++)
+            U[E->id[m][node].doff[d]] = buf[3*(node-1)+d-1];
+    return;
+}
@@ -51,6 +51,15 @@ struct All_variables* citcom_init(MPI_Comm *world)
           rank, nproc, E, E->control.PID); */
 
   E->monitor.solution_cycles=0;
+  E->monitor.velocity_updates=0;
+  E->parallel.nsums=0;
+  E->parallel.num_reductions=0;
+  E->parallel.generic_halo=0;
+  E->parallel.fields_bufsize=0;
+  E->parallel.fields_nrequest=0;
+  E->parallel.fields_sbuf=NULL;
+  E->parallel.fields_rbuf=NULL;
+  E->parallel.fields_request=NULL;
   E->control.keep_going=1;
 
   E->control.total_iteration_cycles=0;
@@ -65,9 +74,11 @@ struct All_variables* citcom_init(MPI_Comm *world)
 void citcom_finalize(struct All_variables *E, int status)
 {
     void output_finalize(struct All_variables*);
+    void teardown_halo_exchange(struct All_variables*);
     void parallel_process_finalize();
 
     output_finalize(E);
+    teardown_halo_exchange(E);
     parallel_process_finalize();
     exit(status);
 }
@@ -219,6 +219,9 @@ static void allocate_composition_memory(struct All_variables *E)
     /* allocat memory for composition fields at the nodes and elements */
 
     for (j=1;j<=E->sphere.caps_per_proc;j++) {
+        /* elements around each node, made on the first mapping */
+        E->composition.node_el[j] = NULL;
+
         if ((E->composition.comp_el[j]=(double **)malloc((E->composition.ncomp)*sizeof(double*)))==NULL) {
             fprintf(E->trace.fpt,"AKM(allocate_composition_memory)-no memory 8987y\n");
             fflush(E->trace.fpt);
@@ -307,9 +310,11 @@ static void compute_elemental_composition_ratio_method(struct All_variables *E)
 {
     int i, j, e, flavor, numtracers;
     int iempty = 0;
+    double weight;
 
 
     for (j=1; j<=E->sphere.caps_per_proc; j++) {
+#pragma omp parallel for private(i,flavor,numtracers,weight) reduction(+:iempty) schedule(static)
         for (e=1; e<=E->lmesh.nel; e++) {
             numtracers = 0;
             for (flavor=0; flavor<E->trace.nflavors; flavor++)
@@ -324,6 +329,20 @@ static void compute_elemental_composition_ratio_method(struct All_variables *E)
                 continue;
             }
 
+            if (E->trace.iweight >= 0) {
+                /* merged and split tracers count by their weight */
+                weight = 0.0;
+                for (flavor=0; flavor<E->trace.nflavors; flavor++)
+                    weight += E->trace.wtracer_flavor[j][flavor][e];
+
+                for(i=0;i<E->composition.ncomp;i++) {
+                    flavor = i + 1;
+                    E->composition.comp_el[j][i][e] =
+                        E->trace.wtracer_flavor[j][flavor][e] / weight;
+                }
+                continue;
+            }
+
             for(i=0;i<E->composition.ncomp;i++) {
                 flavor = i + 1;
                 E->composition.comp_el[j][i][e] =
@@ -394,9 +413,14 @@ static void compute_elemental_composition_absolute_method(struct All_variables *
             /* Composition is proportional to (local) tracer density */
             for(i=0;i<E->composition.ncomp;i++) {
                 flavor = i;
-                comp =
-                    E->trace.ntracer_flavor[j][flavor][e] / E->eco[j][e].area
-                    * domain_volume / E->trace.number_of_tracers;
+                if (E->trace.iweight >= 0)
+                    comp =
+                        E->trace.wtracer_flavor[j][flavor][e] / E->eco[j][e].area
+                        * domain_volume / E->trace.number_of_tracers;
+                else
+                    comp =
+                        E->trace.ntracer_flavor[j][flavor][e] / E->eco[j][e].area
+                        * domain_volume / E->trace.number_of_tracers;
 
                 /* truncate composition at 1.0 */
                 /* This violates mass conservation but prevents unphysical C */
@@ -414,56 +438,105 @@ static void compute_elemental_composition_absolute_method(struct All_variables *
 
 /********** MAP COMPOSITION TO NODES ****************/
 /*                                                  */
+/* The elements around each node and their weights  */
+/* are listed once (the mesh does not change), so   */
+/* every node gathers its own value and the nodes   */
+/* can be shared among threads without conflicts.   */
 
-
-void map_composition_to_nodes(struct All_variables *E)
+static void make_node_element_list(struct All_variables *E)
 {
-    double *tmp[NCS];
-    int i, n, kk;
-    int nelem, nodenum;
-    int j;
-
+    int j, n, nelem, nodenum, k;
+    int *count;
+    const int lev = E->mesh.levmax;
 
     for (j=1;j<=E->sphere.caps_per_proc;j++) {
+        count = (int *)calloc(E->lmesh.nno+2, sizeof(int));
 
-        /* first, initialize node array */
-        for(i=0;i<E->composition.ncomp;i++) {
-            for (kk=1;kk<=E->lmesh.nno;kk++)
-                E->composition.comp_node[j][i][kk]=0.0;
-        }
+        for (nelem=1;nelem<=E->lmesh.nel;nelem++)
+            for (nodenum=1;nodenum<=8;nodenum++)
+                count[E->ien[j][nelem].node[nodenum]]++;
 
-        /* Loop through all elements */
-        for (nelem=1;nelem<=E->lmesh.nel;nelem++) {
+        E->composition.node_el_start[j] = (int *)malloc((E->lmesh.nno+2)*sizeof(int));
+        E->composition.node_el_start[j][1] = 0;
+        for (n=1;n<=E->lmesh.nno;n++)
+            E->composition.node_el_start[j][n+1] =
+                E->composition.node_el_start[j][n] + count[n];
 
-            /* for each element, loop through element nodes */
+        k = E->composition.node_el_start[j][E->lmesh.nno+1];
+        E->composition.node_el[j] = (int *)malloc((k+1)*sizeof(int));
+        E->composition.node_el_weight[j] = (double *)malloc((k+1)*sizeof(double));
 
-            /* weight composition */
+        /* in increasing element order, as the old scatter added them */
+        for (n=1;n<=E->lmesh.nno;n++)
+            count[n] = E->composition.node_el_start[j][n];
 
+        for (nelem=1;nelem<=E->lmesh.nel;nelem++)
             for (nodenum=1;nodenum<=8;nodenum++) {
                 n = E->ien[j][nelem].node[nodenum];
-                for(i=0;i<E->composition.ncomp;i++) {
-
-                    E->composition.comp_node[j][i][n] +=
-                        E->composition.comp_el[j][i][nelem]*
-                        E->TWW[E->mesh.levmax][j][nelem].node[nodenum];
-                }
+                k = count[n]++;
+                E->composition.node_el[j][k] = nelem;
+                E->composition.node_el_weight[j][k] =
+                    E->TWW[lev][j][nelem].node[nodenum];
             }
 
-        } /* end nelem */
-    } /* end j */
+        free(count);
+    }
+
+    return;
+}
+
+
+void map_composition_to_nodes(struct All_variables *E)
+{
+    double **tmp[MAX_HALO_FIELDS], sum[MAX_HALO_FIELDS];
+    int i, n, k, f, nf;
+    int j;
+
+    const int ncomp = E->composition.ncomp;
+
+    if (E->composition.node_el[1] == NULL)
+        make_node_element_list(E);
+
+    for(i=0;i<MAX_HALO_FIELDS;i++)
+        tmp[i] = (double **)malloc(NCS*sizeof(double *));
 
-    for(i=0;i<E->composition.ncomp;i++) {
-        for (j=1;j<=E->sphere.caps_per_proc;j++)
-            tmp[j] = E->composition.comp_node[j][i];
+    /* up to MAX_HALO_FIELDS components are gathered in one pass */
+    /* over the nodes and exchanged together */
+    for(f=0;f<ncomp;f+=nf) {
+        nf = min(ncomp-f, MAX_HALO_FIELDS);
 
-        (E->exchange_node_d)(E,tmp,E->mesh.levmax);
+        for (j=1;j<=E->sphere.caps_per_proc;j++) {
+#pragma omp parallel for private(i,k,sum) schedule(static)
+            for (n=1;n<=E->lmesh.nno;n++) {
+                for(i=0;i<nf;i++)
+                    sum[i] = 0.0;
+
+                for (k=E->composition.node_el_start[j][n];
+                     k<E->composition.node_el_start[j][n+1]; k++)
+                    for(i=0;i<nf;i++)
+                        sum[i] += E->composition.comp_el[j][f+i][E->composition.node_el[j][k]]
+                            * E->composition.node_el_weight[j][k];
+
+                for(i=0;i<nf;i++)
+                    E->composition.comp_node[j][f+i][n] = sum[i];
+            }
+
+            for(i=0;i<nf;i++)
+                tmp[i][j] = E->composition.comp_node[j][f+i];
+        }
+
+        (E->exchange_node_fields)(E,nf,tmp,0,NULL,E->mesh.levmax);
     }
 
+    for(i=0;i<MAX_HALO_FIELDS;i++)
+        free(tmp[i]);
+
     /* Divide by nodal volume */
     for (j=1;j<=E->sphere.caps_per_proc;j++) {
-        for(i=0;i<E->composition.ncomp;i++)
-            for (kk=1;kk<=E->lmesh.nno;kk++)
-                E->composition.comp_node[j][i][kk] *= E->MASS[E->mesh.levmax][j][kk];
+#pragma omp parallel for private(i) schedule(static)
+        for (n=1;n<=E->lmesh.nno;n++)
+            for(i=0;i<ncomp;i++)
+                E->composition.comp_node[j][i][n] *= E->MASS[E->mesh.levmax][j][n];
 
         /* testing */
         /*
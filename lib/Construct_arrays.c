@@ -134,6 +134,11 @@ void construct_surface( struct All_variables *E)
 
 /*============================================
   Function to make the ID array for above case
+
+  The equations of the nodes owned by this processor come
+  first, then those of the shared nodes that another processor
+  owns (SKIP).  Sums over [0, NEQ-Skip_neq) count every
+  equation once globally.
   ============================================ */
 
 void construct_id(E)
@@ -154,23 +159,24 @@ void construct_id(E)
       eqn_count = 0;
 
       for(node=1;node<=E->lmesh.NNO[lev];node++)
-        for(doff=1;doff<=dims;doff++)  {
-          E->ID[lev][j][node].doff[doff] = eqn_count;
-          eqn_count ++;
-          }
+        if (!(E->NODE[lev][j][node] & SKIP))
+          for(doff=1;doff<=dims;doff++)  {
+            E->ID[lev][j][node].doff[doff] = eqn_count;
+            eqn_count ++;
+            }
 
-      E->lmesh.NEQ[lev] = eqn_count;
+      i = eqn_count;
 
-      i = 0;
-      for(node=1;node<=E->lmesh.NNO[lev];node++) {
+      for(node=1;node<=E->lmesh.NNO[lev];node++)
         if (E->NODE[lev][j][node] & SKIP)
-        for(doff=1;doff<=dims;doff++)  {
-	  i++;
-          E->parallel.Skip_id[lev][j][i] = E->ID[lev][j][node].doff[doff];
-          }
-        }
+          for(doff=1;doff<=dims;doff++)  {
+            E->ID[lev][j][node].doff[doff] = eqn_count;
+            eqn_count ++;
+            }
+
+      E->lmesh.NEQ[lev] = eqn_count;
 
-      E->parallel.Skip_neq[lev][j] = i;
+      E->parallel.Skip_neq[lev][j] = eqn_count - i;
 
       /* global # of unskipped eqn */
       neq = E->lmesh.NEQ[lev] - E->parallel.Skip_neq[lev][j];
@@ -57,12 +57,15 @@ void general_stokes_solver_setup(struct All_variables *E)
 
 
 
-void general_stokes_solver(struct All_variables *E)
+/* buoyancy_ready: E->buoyancy is already that of the current step */
+
+static void stokes_solve(struct All_variables *E, int buoyancy_ready)
 {
   void solve_constrained_flow_iterative();
   void construct_stiffness_B_matrix();
   void velocities_conform_bcs();
   void assemble_forces();
+  void assemble_forces_buoyancy();
   void sphere_harmonics_layer();
   void get_system_viscosity();
   void remove_rigid_rot();
@@ -78,7 +81,10 @@ void general_stokes_solver(struct All_variables *E)
 
   velocities_conform_bcs(E,E->U);
 
-  assemble_forces(E,0);
+  if(buoyancy_ready)
+    assemble_forces_buoyancy(E,0);
+  else
+    assemble_forces(E,0);
   if(need_visc_update(E)){
     get_system_viscosity(E,1,E->EVI[E->mesh.levmax],E->VI[E->mesh.levmax]);
     construct_stiffness_B_matrix(E);
@@ -145,9 +151,143 @@ void general_stokes_solver(struct All_variables *E)
       remove_rigid_rot(E);
   }
 
+  /* remember the buoyancy this solution belongs to */
+  if(E->control.stokes_skip) {
+    for (m=1;m<=E->sphere.caps_per_proc;m++)
+      for (i=1;i<=E->lmesh.nno;i++)
+        E->buoyancy_last[m][i] = E->buoyancy[m][i];
+    E->control.stokes_skip_count = 0;
+    E->control.stokes_full_solves++;
+  }
+
+  return;
+}
+
+
+void general_stokes_solver(struct All_variables *E)
+{
+  stokes_solve(E, 0);
+}
+
+
+/* relative L2 change of the buoyancy since the last full Stokes solve */
+
+static double buoyancy_change(struct All_variables *E)
+{
+  void get_buoyancy();
+
+  int m, i;
+  double db, local[2], global[2];
+  const int lev = E->mesh.levmax;
+
+  get_buoyancy(E, E->buoyancy);
+
+  local[0] = local[1] = 0.0;
+  for (m=1;m<=E->sphere.caps_per_proc;m++)
+    for (i=1;i<=E->lmesh.nno;i++)
+      if (!(E->NODE[lev][m][i] & SKIP)) {
+        db = E->buoyancy[m][i] - E->buoyancy_last[m][i];
+        local[0] += db*db;
+        local[1] += E->buoyancy_last[m][i]*E->buoyancy_last[m][i];
+      }
+
+  MPI_Allreduce(local, global, 2, MPI_DOUBLE, MPI_SUM, E->parallel.world);
+
+  if (global[1] > 0.0)
+    return sqrt(global[0]/global[1]);
+  else
+    return (global[0] > 0.0) ? 1.0 : 0.0;
+}
+
+
+/* Stokes solver for the time loop. With stokes_skip on, the full
+ * solve is replaced by the previous solution (optionally corrected
+ * by a few outer iterations at fixed viscosity) as long as the
+ * buoyancy stays within stokes_skip_tol of the last full solve. */
+
+void adaptive_stokes_solver(struct All_variables *E)
+{
+  void solve_constrained_flow_iterative();
+  void velocities_conform_bcs();
+  void assemble_forces_buoyancy();
+  void remove_rigid_rot();
+
+  double change;
+  int full, p_iterations;
+  const char *action;
+
+  if(!E->control.stokes_skip) {
+    general_stokes_solver(E);
+    return;
+  }
+
+  /* before the first full solve (also on a restart), there is no
+     buoyancy to compare with */
+  if(E->control.stokes_full_solves == 0)
+    change = -1.0;
+  else
+    change = buoyancy_change(E);
+
+  /* time-dependent inputs and first-step viscosity updates always
+     need a full solve */
+  full = (E->control.stokes_full_solves == 0) ||
+    (change > E->control.stokes_skip_tol) ||
+    (E->control.stokes_skip_count + 1 >= E->control.stokes_skip_max) ||
+    E->control.vbcs_file || E->control.mat_control ||
+    (!E->viscosity.update_allowed && need_visc_update(E));
+#ifdef USE_GGRD
+  full = full || E->control.ggrd.ray_control;
+#endif
+
+  if(full) {
+    stokes_solve(E, change >= 0.0);
+    action = "full";
+  }
+  else {
+    E->control.stokes_skip_count++;
+
+    if(E->control.stokes_skip_piterations > 0) {
+      /* few outer iterations from the previous solution, keeping
+         the viscosity and stiffness matrices of the last full solve */
+      E->monitor.visc_iter_count = 0;
+      velocities_conform_bcs(E,E->U);
+      assemble_forces_buoyancy(E,0);
+
+      p_iterations = E->control.p_iterations;
+      E->control.p_iterations = E->control.stokes_skip_piterations;
+      solve_constrained_flow_iterative(E);
+      E->control.p_iterations = p_iterations;
+
+      if((E->sphere.caps == 12) &&
+         (E->control.remove_rigid_rotation || E->control.remove_angular_momentum))
+        remove_rigid_rot(E);
+
+      E->control.stokes_corrections++;
+      action = "corrected";
+    }
+    else {
+      E->control.stokes_skips++;
+      action = "skipped";
+    }
+  }
+
+  if(E->parallel.me==0) {
+    if(change >= 0.0)
+      fprintf(E->fp,"Stokes solve %s: buoyancy change = %.4e (tol %.4e); full %d corrected %d skipped %d\n",
+              action, change, E->control.stokes_skip_tol,
+              E->control.stokes_full_solves, E->control.stokes_corrections,
+              E->control.stokes_skips);
+    else
+      fprintf(E->fp,"Stokes solve %s: first solve; full %d corrected %d skipped %d\n",
+              action, E->control.stokes_full_solves,
+              E->control.stokes_corrections, E->control.stokes_skips);
+    fflush(E->fp);
+  }
+
   return;
 }
 
+
 int need_visc_update(struct All_variables *E)
 {
   if(E->viscosity.update_allowed){
@@ -79,11 +79,26 @@ static void add_force(struct All_variables *E, int e, double elt_f[24], int m)
 void assemble_forces(E,penalty)
      struct All_variables *E;
      int penalty;
+{
+  void get_buoyancy();
+  void assemble_forces_buoyancy();
+
+  get_buoyancy(E,E->buoyancy);
+  assemble_forces_buoyancy(E,penalty);
+
+  return;
+}
+
+
+/* as assemble_forces(), with E->buoyancy already up to date */
+
+void assemble_forces_buoyancy(E,penalty)
+     struct All_variables *E;
+     int penalty;
 {
   double elt_f[24];
   int m,a,e,i;
 
-  void get_buoyancy();
   void get_elt_f();
   void strip_bcs_from_residual();
   double global_vdot();
@@ -92,8 +107,6 @@ void assemble_forces(E,penalty)
   const int nel=E->lmesh.nel;
   const int lev=E->mesh.levmax;
 
-  get_buoyancy(E,E->buoyancy);
-
   for(m=1;m<=E->sphere.caps_per_proc;m++)    {
 
     for(a=0;a<neq;a++)
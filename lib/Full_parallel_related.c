@@ -29,6 +29,7 @@
 
 #include <mpi.h>
 #include <math.h>
+#include <string.h>
 
 #include "element_definitions.h"
 #include "global_defs.h"
@@ -39,9 +40,15 @@
 
 static void set_horizontal_communicator(struct All_variables*);
 static void set_vertical_communicator(struct All_variables*);
+static void set_radial_layers(struct All_variables*);
+static void set_halo_passes(struct All_variables*);
 
 static void exchange_node_d(struct All_variables *, double**, int);
 static void exchange_node_f(struct All_variables *, float**, int);
+static void exchange_node_fields(struct All_variables *, int, double***,
+                                 int, float***, int);
+static void exchange_snode_fields(struct All_variables *, int, double***,
+                                  int, float***, int);
 
 
 /* ============================================ */
@@ -165,6 +172,8 @@ oordinate and F-B
 
   E->exchange_node_d = exchange_node_d;
   E->exchange_node_f = exchange_node_f;
+  E->exchange_node_fields = exchange_node_fields;
+  E->exchange_snode_fields = exchange_snode_fields;
 
   return;
   }
@@ -249,12 +258,14 @@ get element information for each processor.
 void full_parallel_domain_decomp0(struct All_variables *E)
   {
 
-  int i,nox,noz,noy,me;
+  int i,k,nox,noz,noy,me,step;
 
   me = E->parallel.me;
 
+  set_radial_layers(E);
+
   E->lmesh.elx = E->mesh.elx/E->parallel.nprocx;
-  E->lmesh.elz = E->mesh.elz/E->parallel.nprocz;
+  E->lmesh.elz = E->parallel.layer_elz[E->parallel.me_loc[3]];
   E->lmesh.ely = E->mesh.ely/E->parallel.nprocy;
   E->lmesh.nox = E->lmesh.elx + 1;
   E->lmesh.noz = E->lmesh.elz + 1;
@@ -262,10 +273,12 @@ void full_parallel_domain_decomp0(struct All_variables *E)
 
   E->lmesh.exs = E->parallel.me_loc[1]*E->lmesh.elx;
   E->lmesh.eys = E->parallel.me_loc[2]*E->lmesh.ely;
-  E->lmesh.ezs = E->parallel.me_loc[3]*E->lmesh.elz;
+  E->lmesh.ezs = 0;
+  for (k=0;k<E->parallel.me_loc[3];k++)
+    E->lmesh.ezs += E->parallel.layer_elz[k];
   E->lmesh.nxs = E->parallel.me_loc[1]*E->lmesh.elx+1;
   E->lmesh.nys = E->parallel.me_loc[2]*E->lmesh.ely+1;
-  E->lmesh.nzs = E->parallel.me_loc[3]*E->lmesh.elz+1;
+  E->lmesh.nzs = E->lmesh.ezs+1;
 
   E->lmesh.nno = E->lmesh.noz*E->lmesh.nox*E->lmesh.noy;
   E->lmesh.nel = E->lmesh.ely*E->lmesh.elx*E->lmesh.elz;
@@ -305,10 +318,11 @@ void full_parallel_domain_decomp0(struct All_variables *E)
 
      E->lmesh.EXS[i] = E->parallel.me_loc[1]*E->lmesh.ELX[i];
      E->lmesh.EYS[i] = E->parallel.me_loc[2]*E->lmesh.ELY[i];
-     E->lmesh.EZS[i] = E->parallel.me_loc[3]*E->lmesh.ELZ[i];
+     step = (E->control.NMULTIGRID) ? (int)pow(2.0,(double)(E->mesh.levmax-i)) : 1;
+     E->lmesh.EZS[i] = E->lmesh.ezs/step;
      E->lmesh.NXS[i] = E->parallel.me_loc[1]*E->lmesh.ELX[i]+1;
      E->lmesh.NYS[i] = E->parallel.me_loc[2]*E->lmesh.ELY[i]+1;
-     E->lmesh.NZS[i] = E->parallel.me_loc[3]*E->lmesh.ELZ[i]+1;
+     E->lmesh.NZS[i] = E->lmesh.EZS[i]+1;
      }
 
 /*
@@ -321,6 +335,78 @@ fprintf(stderr,"b %d %d %d %d %d %d %d\n",E->parallel.me,E->parallel.me_loc[1],E
 
 
 
+/* =========================================================================
+ The number of elements in each radial layer of processors.  The layers
+ are even, unless a restart reads a checkpoint written with other layers,
+ or radial_repartition asks for the layers the checkpoint suggests.  With
+ multigrid, every layer must be divisible down to the coarsest level.
+ ========================================================================= */
+
+static void set_radial_layers(struct All_variables *E)
+  {
+
+  int k,nz,unit,total,found;
+  int *suggested;
+
+  nz = E->parallel.nprocz;
+  unit = (E->control.NMULTIGRID) ? (int)pow(2.0,(double)(E->mesh.levmax-E->mesh.levmin)) : 1;
+
+  E->parallel.layer_elz = (int *)malloc(nz*sizeof(int));
+  E->parallel.chkpt_layer_elz = (int *)malloc(nz*sizeof(int));
+  suggested = (int *)malloc(nz*sizeof(int));
+
+  for (k=0;k<nz;k++)
+    E->parallel.layer_elz[k] = E->parallel.chkpt_layer_elz[k] = E->mesh.elz/nz;
+
+  found = 0;
+  if (E->control.restart || E->control.post_p)
+    found = read_checkpoint_layers(E, E->parallel.chkpt_layer_elz, suggested);
+
+  if (found) {
+    for (k=0;k<nz;k++)
+      E->parallel.layer_elz[k] = (E->parallel.radial_repartition) ?
+        suggested[k] : E->parallel.chkpt_layer_elz[k];
+  }
+  else if (E->parallel.radial_repartition && E->parallel.me==0)
+    fprintf(stderr,"radial_repartition: no layer information in the checkpoint, keeping even layers\n");
+
+  total = 0;
+  for (k=0;k<nz;k++) {
+    if (E->parallel.layer_elz[k] < unit || E->parallel.layer_elz[k] % unit != 0) {
+      if (E->parallel.me==0)
+        fprintf(stderr,"!!!! radial layer %d has %d elements, not a multiple of %d\n",
+                k,E->parallel.layer_elz[k],unit);
+      parallel_process_termination();
+    }
+    total += E->parallel.layer_elz[k];
+  }
+  if (total != E->mesh.elz) {
+    if (E->parallel.me==0)
+      fprintf(stderr,"!!!! radial layers have %d elements instead of %d\n",total,E->mesh.elz);
+    parallel_process_termination();
+  }
+
+  for (k=0;k<nz;k++)
+    if (E->parallel.layer_elz[k] != E->mesh.elz/nz) break;
+  if (k<nz) {
+    if (strcmp(E->output.format, "hdf5") == 0) {
+      if (E->parallel.me==0)
+        fprintf(stderr,"!!!! uneven radial layers are not supported with hdf5 output\n");
+      parallel_process_termination();
+    }
+    if (E->parallel.me==0) {
+      fprintf(stderr,"Radial layers of processors (elements):");
+      for (k=0;k<nz;k++)
+        fprintf(stderr," %d",E->parallel.layer_elz[k]);
+      fprintf(stderr,"\n");
+    }
+  }
+
+  free(suggested);
+  return;
+  }
+
+
 /* ============================================
  determine boundary nodes for
  exchange info across the boundaries
@@ -749,10 +835,43 @@ void full_parallel_communication_routs_v(E)
     fflush(E->fp_out);
   }
 
+  if(E->parallel.shm_halo || E->parallel.neighbor_coll) {
+    set_halo_passes(E);
+    setup_halo_exchange(E);
+  }
+
   return;
   }
 
 
+/* the horizontal passes are exchanged together, then the vertical ones */
+
+static void set_halo_passes(struct All_variables *E)
+{
+  int lev,k,n;
+
+  for(lev=E->mesh.gridmin;lev<=E->mesh.gridmax;lev++) {
+    n = 0;
+    for (k=1;k<=E->parallel.TNUM_PASS[lev][1];k++) {
+      n++;
+      E->parallel.halo_pass[lev].pass[n] = k;
+      E->parallel.halo_proc[lev].pass[n] = E->parallel.PROCESSOR[lev][1].pass[k];
+      E->parallel.halo_phase[lev].pass[n] = 0;
+    }
+    for (k=1;k<=E->parallel.TNUM_PASSz[lev];k++) {
+      n++;
+      E->parallel.halo_pass[lev].pass[n] = k + E->sphere.max_connections;
+      E->parallel.halo_proc[lev].pass[n] = E->parallel.PROCESSORz[lev].pass[k];
+      E->parallel.halo_phase[lev].pass[n] = 1;
+    }
+    E->parallel.halo_npass[lev] = n;
+  }
+
+  E->parallel.halo_nphase = 2;
+  return;
+}
+
+
 /* ============================================
  determine communication routs for
  exchange info across the boundaries on the surfaces
@@ -916,6 +1035,11 @@ void full_exchange_id_d(E, U, lev)
  MPI_Status status1;
  MPI_Request request[100];
 
+ if (E->parallel.generic_halo) {
+   halo_exchange(E, lev, 1, 1, &U, 0, NULL);
+   return;
+ }
+
  for (m=1;m<=E->sphere.caps_per_proc;m++)    {
    for (k=1;k<=E->parallel.TNUM_PASS[lev][m];k++)  {
      sizeofk = (1+E->parallel.NUM_NEQ[lev][m].pass[k])*sizeof(double);
@@ -1032,6 +1156,11 @@ static void exchange_node_d(E, U, lev)
  MPI_Status status1;
  MPI_Request request[100];
 
+ if (E->parallel.generic_halo) {
+   halo_exchange(E, lev, 0, 1, &U, 0, NULL);
+   return;
+ }
+
  kk=0;
  for (m=1;m<=E->sphere.caps_per_proc;m++)    {
    for (k=1;k<=E->parallel.TNUM_PASS[lev][m];k++)  {
@@ -1157,6 +1286,11 @@ static void exchange_node_f(E, U, lev)
  MPI_Status status1;
  MPI_Request request[100];
 
+ if (E->parallel.generic_halo) {
+   halo_exchange(E, lev, 0, 0, NULL, 1, &U);
+   return;
+ }
+
  kk=0;
  for (m=1;m<=E->sphere.caps_per_proc;m++)    {
    for (k=1;k<=E->parallel.TNUM_PASS[lev][m];k++)  {
@@ -1266,104 +1400,200 @@ static void exchange_node_f(E, U, lev)
 /* ================================================ */
 /* ================================================ */
 
-void full_exchange_snode_f(struct All_variables *E, float **U1,
-                           float **U2, int lev)
+/* Exchange nd double and nf float fields at once, packing all the     */
+/* fields for a neighbor into one message of doubles.  With surf set,  */
+/* the fields are on the surface nodes and only the horizontal passes  */
+/* are exchanged.  The buffers are kept in E->parallel.                */
+
+static void pack_node_fields(exch, m, k, n, nd, Ud, nf, Uf, buf)
+ struct PASS *exch;
+ int m, k, n, nd, nf;
+ double ***Ud;
+ float ***Uf;
+ double *buf;
+{
+ int f,j;
+
+ for (f=0;f<nd;f++)
+   for (j=1;j<=n;j++)
+     *buf++ = Ud[f][m][ exch[j].pass[k] ];
+ for (f=0;f<nf;f++)
+   for (j=1;j<=n;j++)
+     *buf++ = Uf[f][m][ exch[j].pass[k] ];
+
+ return;
+}
+
+
+static void add_node_fields(exch, m, k, n, nd, Ud, nf, Uf, buf)
+ struct PASS *exch;
+ int m, k, n, nd, nf;
+ double ***Ud;
+ float ***Uf;
+ double *buf;
+{
+ int f,j;
+
+ for (f=0;f<nd;f++)
+   for (j=1;j<=n;j++)
+     Ud[f][m][ exch[j].pass[k] ] += *buf++;
+ for (f=0;f<nf;f++)
+   for (j=1;j<=n;j++)
+     Uf[f][m][ exch[j].pass[k] ] += (float)*buf++;
+
+ return;
+}
+
+
+static void exchange_fields(E, surf, nd, Ud, nf, Uf, lev)
+ struct All_variables *E;
+ int surf, nd, nf;
+ double ***Ud;
+ float ***Uf;
+ int lev;
  {
 
- int ii,j,k,m,kk,t_cap,idb,msginfo[8];
- float *S[73],*R[73];
- int mid_recv, sizeofk;
+ int jj,m,k,kk,n,idb,nfield,size,nreq;
+ struct PASS *num, *exch;
+ double *S, *R;
 
- MPI_Status status[100];
  MPI_Status status1;
- MPI_Request request[100];
 
-   kk=0;
-   for (m=1;m<=E->sphere.caps_per_proc;m++)    {
-     for (k=1;k<=E->parallel.TNUM_PASS[E->mesh.levmax][m];k++)  {
-       ++kk;
-       sizeofk = (1+2*E->parallel.NUM_sNODE[E->mesh.levmax][m].pass[k])*sizeof(float);
-       S[kk]=(float *)malloc( sizeofk );
-       R[kk]=(float *)malloc( sizeofk );
-       }
-     }
+ nfield = nd + nf;
+
+ /* the horizontal passes take consecutive blocks of the buffers, */
+ /* the vertical passes reuse them afterwards                     */
+ size = nreq = 0;
+ for (m=1;m<=E->sphere.caps_per_proc;m++)    {
+   num = surf ? &E->parallel.NUM_sNODE[lev][m] : &E->parallel.NUM_NODE[lev][m];
+   for (k=1;k<=E->parallel.TNUM_PASS[lev][m];k++)
+     size += nfield*num->pass[k];
+   nreq += 2*E->parallel.TNUM_PASS[lev][m];
+ }
+ if (!surf)
+   for (k=1;k<=E->parallel.TNUM_PASSz[lev];k++)
+     size = max(size, nfield*E->parallel.NUM_NODEz[lev].pass[k]);
+
+ grow_field_buffers(E, size, nreq);
+ S = E->parallel.fields_sbuf;
+ R = E->parallel.fields_rbuf;
 
   idb=0;
-  /* sending */
+  jj=0;
   for (m=1;m<=E->sphere.caps_per_proc;m++)   {
+    num = surf ? &E->parallel.NUM_sNODE[lev][m] : &E->parallel.NUM_NODE[lev][m];
+    exch = surf ? E->parallel.EXCHANGE_sNODE[lev][m] : E->parallel.EXCHANGE_NODE[lev][m];
     for (k=1;k<=E->parallel.TNUM_PASS[lev][m];k++)     {
-      kk=k;
+      n = num->pass[k];
 
-      /* pack */
-      for (j=1;j<=E->parallel.NUM_sNODE[lev][m].pass[k];j++)  {
-        S[kk][j-1] = U1[m][ E->parallel.EXCHANGE_sNODE[lev][m][j].pass[k] ];
-        S[kk][j-1+E->parallel.NUM_sNODE[lev][m].pass[k]]
-                   = U2[m][ E->parallel.EXCHANGE_sNODE[lev][m][j].pass[k] ];
-        }
+      pack_node_fields(exch,m,k,n,nd,Ud,nf,Uf,S+jj);
 
-      if (E->parallel.PROCESSOR[lev][m].pass[k]!=E->parallel.me) {
-	if (E->parallel.PROCESSOR[lev][m].pass[k]!=-1) {
-         idb ++;
-         MPI_Isend(S[kk],2*E->parallel.NUM_sNODE[lev][m].pass[k],MPI_FLOAT,
-             E->parallel.PROCESSOR[lev][m].pass[k],1,E->parallel.world,&request[idb-1]);
-         }
-      }
+      if (E->parallel.PROCESSOR[lev][m].pass[k]!=E->parallel.me)
+	if (E->parallel.PROCESSOR[lev][m].pass[k]!=-1)
+          MPI_Isend(S+jj,nfield*n,MPI_DOUBLE,
+             E->parallel.PROCESSOR[lev][m].pass[k],1,E->parallel.world,
+             &E->parallel.fields_request[idb++]);
+
+      jj += nfield*n;
       }           /* for k */
     }     /* for m */         /* finish sending */
 
-  /* receiving */
+  jj=0;
   for (m=1;m<=E->sphere.caps_per_proc;m++)   {
+    num = surf ? &E->parallel.NUM_sNODE[lev][m] : &E->parallel.NUM_NODE[lev][m];
+    exch = surf ? E->parallel.EXCHANGE_sNODE[lev][m] : E->parallel.EXCHANGE_NODE[lev][m];
     for (k=1;k<=E->parallel.TNUM_PASS[lev][m];k++)   {
-      kk=k;
+      n = num->pass[k];
 
       if (E->parallel.PROCESSOR[lev][m].pass[k]!=E->parallel.me)  {
-	if (E->parallel.PROCESSOR[lev][m].pass[k]!=-1) {
-
-         idb ++;
-         MPI_Irecv(R[kk],2*E->parallel.NUM_sNODE[lev][m].pass[k],MPI_FLOAT,
-           E->parallel.PROCESSOR[lev][m].pass[k],1,E->parallel.world,&request[idb-1]);
-         }
+	if (E->parallel.PROCESSOR[lev][m].pass[k]!=-1)
+          MPI_Irecv(R+jj,nfield*n,MPI_DOUBLE,
+             E->parallel.PROCESSOR[lev][m].pass[k],1,E->parallel.world,
+             &E->parallel.fields_request[idb++]);
       }
+      else
+         add_node_fields(exch,m,k,n,nd,Ud,nf,Uf,S+jj);
 
-      else   {
-	kk=k;
-         for (j=1;j<=E->parallel.NUM_sNODE[lev][m].pass[k];j++)     {
-           U1[m][ E->parallel.EXCHANGE_sNODE[lev][m][j].pass[k] ] += S[kk][j-1];
-           U2[m][ E->parallel.EXCHANGE_sNODE[lev][m][j].pass[k] ] +=
-                               S[kk][j-1+E->parallel.NUM_sNODE[lev][m].pass[k]];
-           }
-         }
+      jj += nfield*n;
       }      /* for k */
     }     /* for m */         /* finish receiving */
 
-  MPI_Waitall(idb,request,status);
+  MPI_Waitall(idb,E->parallel.fields_request,MPI_STATUSES_IGNORE);
 
+  jj=0;
   for (m=1;m<=E->sphere.caps_per_proc;m++)   {
+    num = surf ? &E->parallel.NUM_sNODE[lev][m] : &E->parallel.NUM_NODE[lev][m];
+    exch = surf ? E->parallel.EXCHANGE_sNODE[lev][m] : E->parallel.EXCHANGE_NODE[lev][m];
     for (k=1;k<=E->parallel.TNUM_PASS[lev][m];k++)   {
-      kk=k;
+      n = num->pass[k];
 
-      /* unpack */
       if (E->parallel.PROCESSOR[lev][m].pass[k]!=E->parallel.me)
-	if (E->parallel.PROCESSOR[lev][m].pass[k]!=-1) {
-        for (j=1;j<=E->parallel.NUM_sNODE[lev][m].pass[k];j++)    {
-           U1[m][ E->parallel.EXCHANGE_sNODE[lev][m][j].pass[k] ] += R[kk][j-1];
-           U2[m][ E->parallel.EXCHANGE_sNODE[lev][m][j].pass[k] ] +=
-                              R[kk][j-1+E->parallel.NUM_sNODE[lev][m].pass[k]];
-           }
-	}
-      }
-  }
+	if (E->parallel.PROCESSOR[lev][m].pass[k]!=-1)
+          add_node_fields(exch,m,k,n,nd,Ud,nf,Uf,R+jj);
 
-  kk=0;
-  for (m=1;m<=E->sphere.caps_per_proc;m++)    {
-    for (k=1;k<=E->parallel.TNUM_PASS[E->mesh.levmax][m];k++)  {
-      ++kk;
-      free((void*) S[kk]);
-      free((void*) R[kk]);
+      jj += nfield*n;
+    }
+    }
+
+  if (surf)
+    return;
+
+                /* for vertical direction  */
+
+  for (k=1;k<=E->parallel.TNUM_PASSz[lev];k++)  {
+    jj = 0;
+    kk = k + E->sphere.max_connections;
+
+    for(m=1;m<=E->sphere.caps_per_proc;m++) {
+      n = E->parallel.NUM_NODE[lev][m].pass[kk];
+      pack_node_fields(E->parallel.EXCHANGE_NODE[lev][m],m,kk,n,nd,Ud,nf,Uf,S+jj);
+      jj += nfield*n;
+    }
+
+    MPI_Sendrecv(S,nfield*E->parallel.NUM_NODEz[lev].pass[k],MPI_DOUBLE,
+             E->parallel.PROCESSORz[lev].pass[k],1,
+                 R,nfield*E->parallel.NUM_NODEz[lev].pass[k],MPI_DOUBLE,
+             E->parallel.PROCESSORz[lev].pass[k],1,E->parallel.world,&status1);
+
+    jj = 0;
+    for(m=1;m<=E->sphere.caps_per_proc;m++) {
+      n = E->parallel.NUM_NODE[lev][m].pass[kk];
+      add_node_fields(E->parallel.EXCHANGE_NODE[lev][m],m,kk,n,nd,Ud,nf,Uf,R+jj);
+      jj += nfield*n;
+    }
     }
-  }
 
  return;
  }
 
 
+static void exchange_node_fields(E, nd, Ud, nf, Uf, lev)
+ struct All_variables *E;
+ int nd, nf;
+ double ***Ud;
+ float ***Uf;
+ int lev;
+{
+ if (E->parallel.generic_halo)
+   halo_exchange(E, lev, 0, nd, Ud, nf, Uf);
+ else
+   exchange_fields(E, 0, nd, Ud, nf, Uf, lev);
+
+ return;
+}
+
+
+/* the same for fields on the surface nodes, e.g. the dynamic topography */
+
+static void exchange_snode_fields(E, nd, Ud, nf, Uf, lev)
+ struct All_variables *E;
+ int nd, nf;
+ double ***Ud;
+ float ***Uf;
+ int lev;
+{
+ exchange_fields(E, 1, nd, Ud, nf, Uf, lev);
+ return;
+}
+
+
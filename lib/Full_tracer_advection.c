@@ -85,12 +85,27 @@ static int iget_regel(struct All_variables *E, int j,
                       double theta, double phi,
                       int *ntheta, int *nphi);
 static void define_uv_space(struct All_variables *E);
+static void make_uv_index(struct All_variables *E);
+static int iget_uv_column(struct All_variables *E, int j,
+                          double x, double y, double z);
+static void make_radial_index(struct All_variables *E);
+static void benchmark_element_location(struct All_variables *E);
 static void determine_shape_coefficients(struct All_variables *E);
 static void full_put_lost_tracers(struct All_variables *E,
                                   int isend[13][13], double *send[13][13]);
+#if MPI_VERSION >= 3
+static void make_neighbor_graph(struct All_variables *E);
+static void full_lost_souls_neighbor(struct All_variables *E);
+#endif
+static void analytical_place_tracer(struct All_variables *E,
+                                    double theta, double phi, double rad);
 void pdebug(struct All_variables *E, int i);
 int full_icheck_cap(struct All_variables *E, int icap,
                     double x, double y, double z, double rad);
+int full_iget_element(struct All_variables *E,
+                      int j, int iprevious_element,
+                      double x, double y, double z,
+                      double theta, double phi, double rad);
 
 
 
@@ -110,12 +125,27 @@ void full_tracer_input(struct All_variables *E)
     input_double("regular_grid_deltheta",&(E->trace.deltheta[0]),"1.0",m);
     input_double("regular_grid_delphi",&(E->trace.delphi[0]),"1.0",m);
 
+    /* Direct (u,v) lookup grid, tracer_uv_refine cells per element */
+    input_boolean("tracer_uv_index",&(E->trace.uv_index),"on",m);
+    input_int("tracer_uv_refine",&(E->trace.uv_refine),"4,1,nomax",m);
+
+    /* Number of random points to time the element search with */
+    input_int("tracer_location_benchmark",&(E->trace.location_benchmark),
+              "0,0,nomax",m);
+
+    /* Send escaped tracers straight to their new processor */
+    /* with one neighborhood collective (needs MPI-3)       */
+    input_boolean("tracer_neighbor_exchange",
+                  &(E->trace.neighbor_exchange),"on",m);
+#if MPI_VERSION < 3
+    E->trace.neighbor_exchange = 0;
+#endif
+
 
     /* Analytical Test Function */
 
-    E->trace.ianalytical_tracer_test=0;
-    /* input_int("analytical_tracer_test",&(E->trace.ianalytical_tracer_test),
-              "0,0,nomax",m); */
+    input_int("analytical_tracer_test",&(E->trace.ianalytical_tracer_test),
+              "0,0,1",m);
 
 
     return;
@@ -128,7 +158,6 @@ void full_tracer_setup(struct All_variables *E)
 
     char output_file[200];
     void get_neighboring_caps();
-    void analytical_test();
     double CPU_time0();
     double begin_time = CPU_time0();
 
@@ -170,6 +199,11 @@ void full_tracer_setup(struct All_variables *E)
     if (E->trace.nflavors > 0)
         E->trace.number_of_extra_quantities += 1;
 
+    /* weight of the tracers, for population control */
+    E->trace.iweight = -1;
+    if (E->trace.min_per_element > 0 || E->trace.max_per_element > 0)
+        E->trace.iweight = E->trace.number_of_extra_quantities++;
+
 
     E->trace.number_of_tracer_quantities =
         E->trace.number_of_basic_quantities +
@@ -211,17 +245,25 @@ void full_tracer_setup(struct All_variables *E)
     /* The bounding box of neiboring processors */
     get_neighboring_caps(E);
 
+#if MPI_VERSION >= 3
+    if (E->trace.neighbor_exchange)
+        make_neighbor_graph(E);
+#endif
+
 
     /* Fine-grained regular grid to search tracers */
     make_regular_grid(E);
 
-
-    if (E->trace.ianalytical_tracer_test==1) {
-        //TODO: walk into this code...
-        analytical_test(E);
-        parallel_process_termination();
+    /* Direct lookup of the element column and layer */
+    if (E->trace.uv_index || E->trace.location_benchmark) {
+        make_uv_index(E);
+        make_radial_index(E);
     }
 
+    if (E->trace.location_benchmark > 0)
+        benchmark_element_location(E);
+
+
     if (E->composition.on)
         composition_setup(E);
 
@@ -306,6 +348,12 @@ void full_lost_souls(struct All_variables *E)
     MPI_Status status2;
     int itag=1;
 
+#if MPI_VERSION >= 3
+    if (E->trace.neighbor_exchange) {
+        full_lost_souls_neighbor(E);
+        return;
+    }
+#endif
 
     parallel_process_sync(E);
     if(E->control.verbose)
@@ -841,6 +889,405 @@ static void full_put_lost_tracers(struct All_variables *E,
     return;
 }
 
+#if MPI_VERSION >= 3
+
+/************** MAKE NEIGHBOR GRAPH ******************************************/
+/*                                                                           */
+/* Sets up the distributed graph used by full_lost_souls_neighbor().  The    */
+/* neighbors are the horizontal neighbors of this processor (faces and       */
+/* corners, as in E->parallel.PROCESSOR) and the processors directly above  */
+/* and below them and this processor.  Since processors are numbered with    */
+/* z fastest, the processor dz layers above rank r is r+dz.  The radial      */
+/* extent of every layer is gathered so that a tracer's layer can be found.  */
+
+static void make_neighbor_graph(struct All_variables *E)
+{
+    const int j = 1;
+    const int lev = E->mesh.levmax;
+    const int num_ngb = E->parallel.TNUM_PASS[lev][j];
+    const int nprocz = E->parallel.nprocz;
+    const int lz = E->parallel.me_loc[3];
+
+    const int nq = E->trace.number_of_tracer_quantities;
+
+    int h, dz, k, n, rank, hrank, layer, maxn;
+    int *weight, *counts;
+    double mine[3], *all;
+
+    E->trace.layer_rbot = (double *)malloc(nprocz*sizeof(double));
+    E->trace.layer_rtop = (double *)malloc(nprocz*sizeof(double));
+    all = (double *)malloc(3*E->parallel.nproc*sizeof(double));
+
+    mine[0] = lz;
+    mine[1] = E->sx[j][3][1];
+    mine[2] = E->sx[j][3][E->lmesh.noz];
+    MPI_Allgather(mine, 3, MPI_DOUBLE, all, 3, MPI_DOUBLE, E->parallel.world);
+
+    for (k=0; k<E->parallel.nproc; k++) {
+        layer = (int)all[3*k];
+        E->trace.layer_rbot[layer] = all[3*k+1];
+        E->trace.layer_rtop[layer] = all[3*k+2];
+    }
+    free(all);
+
+    /* at most 3 layers of each horizontal neighbor and of this column */
+    maxn = 3*(num_ngb+1);
+    E->trace.ngb_rank = (int *)malloc(maxn*sizeof(int));
+    E->trace.ngb_index = (int *)malloc(maxn*sizeof(int));
+
+    n = 0;
+    for (h=0; h<=num_ngb; h++) {
+        if (h == 0)
+            hrank = E->parallel.me;
+        else
+            hrank = E->parallel.PROCESSOR[lev][j].pass[h];
+
+        for (dz=-1; dz<=1; dz++) {
+            E->trace.ngb_index[3*h+dz+1] = -1;
+            if (lz+dz < 0 || lz+dz >= nprocz || (h == 0 && dz == 0))
+                continue;
+
+            rank = hrank + dz;
+            for (k=0; k<n; k++)
+                if (E->trace.ngb_rank[k] == rank) break;
+            if (k == n)
+                E->trace.ngb_rank[n++] = rank;
+            E->trace.ngb_index[3*h+dz+1] = k;
+        }
+    }
+    E->trace.ngb_n = n;
+
+    weight = (int *)malloc((n+1)*sizeof(int));
+    for (k=0; k<n; k++)
+        weight[k] = 1;
+
+    MPI_Dist_graph_create_adjacent(E->parallel.world,
+                                   n, E->trace.ngb_rank, weight,
+                                   n, E->trace.ngb_rank, weight,
+                                   MPI_INFO_NULL, 0, &(E->trace.ngb_comm));
+    free(weight);
+
+    counts = (int *)malloc(9*(n+1)*sizeof(int));
+    E->trace.ngb_scount = counts;
+    E->trace.ngb_rcount = counts + (n+1);
+    E->trace.ngb_sdispl = counts + 2*(n+1);
+    E->trace.ngb_rdispl = counts + 3*(n+1);
+    E->trace.ngb_sc = counts + 4*(n+1);
+    E->trace.ngb_rc = counts + 5*(n+1);
+    E->trace.ngb_sd = counts + 6*(n+1);
+    E->trace.ngb_rd = counts + 7*(n+1);
+    E->trace.ngb_fill = counts + 8*(n+1);
+
+    E->trace.ngb_stay = (double *)malloc(nq*sizeof(double));
+
+    /* grown as needed in full_lost_souls_neighbor() */
+    E->trace.ngb_sendsize = E->trace.ngb_recvsize = 100;
+    E->trace.ngb_sendbuf = (double *)malloc(E->trace.ngb_sendsize*sizeof(double));
+    E->trace.ngb_recvbuf = (double *)malloc(E->trace.ngb_recvsize*sizeof(double));
+
+    E->trace.ngb_lostsize = 100;
+    E->trace.ngb_dest = (int *)malloc((E->trace.ngb_lostsize+1)*sizeof(int));
+    E->trace.ngb_far = (double *)malloc(E->trace.ngb_lostsize*nq*sizeof(double));
+
+    fprintf(E->trace.fpt, "Escaped tracers are exchanged with %d neighbors\n", n);
+    fflush(E->trace.fpt);
+
+    return;
+}
+
+
+/* Position in E->trace.ngb_rank of the processor holding the point, */
+/* -2 if it is this processor, or -1 if it is beyond the neighbors.  */
+
+static int lost_tracer_destination(struct All_variables *E,
+                                   double x, double y, double z, double rad)
+{
+    const int lev = E->mesh.levmax;
+    const int nprocz = E->parallel.nprocz;
+    int h, k, dz;
+
+    dz = 0;
+    if (nprocz > 1) {
+        for (k=0; k<nprocz; k++)
+            if (rad >= E->trace.layer_rbot[k] &&
+                (rad < E->trace.layer_rtop[k] ||
+                 (k == nprocz-1 && rad <= E->trace.layer_rtop[k])))
+                break;
+        dz = k - E->parallel.me_loc[3];
+        if (k == nprocz || dz < -1 || dz > 1) return -1;
+    }
+
+    /* same cap first if nprocz>1, then neighboring caps */
+    for (h=(nprocz>1 ? 0 : 1); h<=E->parallel.TNUM_PASS[lev][1]; h++)
+        if (full_icheck_cap(E,h,x,y,z,rad) == 1) {
+            if (h == 0 && dz == 0) return -2;
+            return E->trace.ngb_index[3*h+dz+1];
+        }
+
+    return -1;
+}
+
+
+/* Append one tracer whose quantities are src[0], src[stride], ... */
+
+static void put_lost_tracer(struct All_variables *E, int j,
+                            const double *src, int stride)
+{
+    void expand_tracer_arrays();
+
+    int mm, it, iel;
+    const int nb = E->trace.number_of_basic_quantities;
+
+    E->trace.ntracers[j]++;
+    it = E->trace.ntracers[j];
+
+    if (it > (E->trace.max_ntracers[j]-5)) expand_tracer_arrays(E,j);
+
+    for (mm=0; mm<nb; mm++)
+        E->trace.basicq[j][mm][it] = src[mm*stride];
+    for (mm=0; mm<E->trace.number_of_extra_quantities; mm++)
+        E->trace.extraq[j][mm][it] = src[(nb+mm)*stride];
+
+    iel = (E->trace.iget_element)(E,j,-99,
+                                  E->trace.basicq[j][3][it],
+                                  E->trace.basicq[j][4][it],
+                                  E->trace.basicq[j][5][it],
+                                  E->trace.basicq[j][0][it],
+                                  E->trace.basicq[j][1][it],
+                                  E->trace.basicq[j][2][it]);
+
+    if (iel<1) {
+        fprintf(E->trace.fpt,"Error(lost souls) - element not here?\n");
+        fprintf(E->trace.fpt,"x,y,z-theta,phi,rad: %f %f %f - %f %f %f\n",
+                E->trace.basicq[j][3][it],E->trace.basicq[j][4][it],
+                E->trace.basicq[j][5][it],E->trace.basicq[j][0][it],
+                E->trace.basicq[j][1][it],E->trace.basicq[j][2][it]);
+        fflush(E->trace.fpt);
+        exit(10);
+    }
+
+    E->trace.ielement[j][it] = iel;
+
+    return;
+}
+
+
+/* Tracers that moved past the neighbors are broadcast to all processors; */
+/* the lowest ranked processor whose domain contains a tracer takes it.   */
+
+static void find_lost_tracers_globally(struct All_variables *E, int j,
+                                       int nmine, double *mine)
+{
+    const int nq = E->trace.number_of_tracer_quantities;
+    const int nproc = E->parallel.nproc;
+    int *counts, *displs, *claim, *owner;
+    int k, t, total;
+    double *all, *q;
+
+    counts = (int *)malloc(nproc*sizeof(int));
+    displs = (int *)malloc(nproc*sizeof(int));
+
+    k = nmine*nq;
+    MPI_Allgather(&k, 1, MPI_INT, counts, 1, MPI_INT, E->parallel.world);
+
+    total = 0;
+    for (k=0; k<nproc; k++) {
+        displs[k] = total;
+        total += counts[k];
+    }
+
+    all = (double *)malloc(max(total,1)*sizeof(double));
+    MPI_Allgatherv(mine, nmine*nq, MPI_DOUBLE,
+                   all, counts, displs, MPI_DOUBLE, E->parallel.world);
+
+    total /= nq;
+    claim = (int *)malloc(max(total,1)*sizeof(int));
+    owner = (int *)malloc(max(total,1)*sizeof(int));
+
+    for (t=0; t<total; t++) {
+        q = all + t*nq;
+        claim[t] = nproc;
+        if (icheck_processor_shell(E,j,q[2]) == 1 &&
+            full_icheck_cap(E,0,q[3],q[4],q[5],q[2]) == 1)
+            claim[t] = E->parallel.me;
+    }
+
+    MPI_Allreduce(claim, owner, total, MPI_INT, MPI_MIN, E->parallel.world);
+
+    for (t=0; t<total; t++) {
+        q = all + t*nq;
+        if (owner[t] == nproc) {
+            fprintf(E->trace.fpt,"Error(lost souls)-no processor holds tracer\n");
+            fprintf(E->trace.fpt,"x: %f y: %f z: %f rad: %f\n",q[3],q[4],q[5],q[2]);
+            fflush(E->trace.fpt);
+            exit(10);
+        }
+        if (owner[t] == E->parallel.me)
+            put_lost_tracer(E, j, q, 1);
+    }
+
+    fprintf(E->trace.fpt,"%d tracers moved past the neighboring processors\n",
+            total);
+
+    free(all);
+    free(claim);
+    free(owner);
+    free(counts);
+    free(displs);
+
+    return;
+}
+
+
+/************** LOST SOULS (NEIGHBORHOOD) ************************************/
+/*                                                                           */
+/* Sends every tracer in rlater directly to the processor that contains it,  */
+/* using one MPI_Neighbor_alltoallv over the graph of make_neighbor_graph(). */
+/* The tracer counts go first with MPI_Neighbor_alltoall.  Each destination  */
+/* gets a block of the send buffer with one row per tracer quantity.  All    */
+/* the work arrays are kept between calls.  Tracers that are not in          */
+/* any neighbor are rare, and are located with find_lost_tracers_globally(). */
+
+static void full_lost_souls_neighbor(struct All_variables *E)
+{
+    const int j = 1;
+    const int nq = E->trace.number_of_tracer_quantities;
+    const int n = E->trace.ngb_n;
+
+    int *const scount = E->trace.ngb_scount;
+    int *const rcount = E->trace.ngb_rcount;
+    int *const sdispl = E->trace.ngb_sdispl;
+    int *const rdispl = E->trace.ngb_rdispl;
+    int *const sc = E->trace.ngb_sc;
+    int *const rc = E->trace.ngb_rc;
+    int *const sd = E->trace.ngb_sd;
+    int *const rd = E->trace.ngb_rd;
+    int *const fill = E->trace.ngb_fill;
+    double *const stay = E->trace.ngb_stay;
+
+    int nlater, kk, k, q, i, nsend, nrecv, nfar, nfar_total;
+    int *dest;
+    double *far;
+
+    double CPU_time0();
+    double begin_time = CPU_time0();
+
+    if(E->control.verbose)
+      fprintf(E->trace.fpt, "Entering lost_souls()\n");
+
+    nlater = E->trace.ilater[j];
+    E->trace.istat_isend = nlater;
+
+    if (nlater > E->trace.ngb_lostsize) {
+        E->trace.ngb_lostsize = nlater + nlater/4 + 100;
+        free(E->trace.ngb_dest);
+        free(E->trace.ngb_far);
+        E->trace.ngb_dest = (int *)malloc((E->trace.ngb_lostsize+1)*sizeof(int));
+        E->trace.ngb_far = (double *)malloc(E->trace.ngb_lostsize*nq*sizeof(double));
+        if (E->trace.ngb_dest == NULL || E->trace.ngb_far == NULL) {
+            fprintf(E->trace.fpt,"Error(lost souls)-no memory (n100)\n");
+            fflush(E->trace.fpt);
+            exit(10);
+        }
+    }
+    dest = E->trace.ngb_dest;
+    far = E->trace.ngb_far;
+
+    for (k=0; k<n; k++)
+        scount[k] = 0;
+
+    nfar = 0;
+    for (kk=1; kk<=nlater; kk++) {
+        dest[kk] = lost_tracer_destination(E,
+                                           E->trace.rlater[j][3][kk],
+                                           E->trace.rlater[j][4][kk],
+                                           E->trace.rlater[j][5][kk],
+                                           E->trace.rlater[j][2][kk]);
+        if (dest[kk] >= 0)
+            scount[dest[kk]]++;
+        else if (dest[kk] == -1) {
+            for (q=0; q<nq; q++)
+                far[nfar*nq+q] = E->trace.rlater[j][q][kk];
+            nfar++;
+        }
+    }
+
+    MPI_Neighbor_alltoall(scount, 1, MPI_INT, rcount, 1, MPI_INT,
+                          E->trace.ngb_comm);
+
+    nsend = nrecv = 0;
+    for (k=0; k<n; k++) {
+        sdispl[k] = nsend;
+        rdispl[k] = nrecv;
+        nsend += scount[k];
+        nrecv += rcount[k];
+        sc[k] = scount[k]*nq;
+        rc[k] = rcount[k]*nq;
+        sd[k] = sdispl[k]*nq;
+        rd[k] = rdispl[k]*nq;
+    }
+
+    if (nsend*nq > E->trace.ngb_sendsize) {
+        E->trace.ngb_sendsize = nsend*nq + nsend*nq/4 + 100;
+        free(E->trace.ngb_sendbuf);
+        E->trace.ngb_sendbuf = (double *)malloc(E->trace.ngb_sendsize*sizeof(double));
+    }
+    if (nrecv*nq > E->trace.ngb_recvsize) {
+        E->trace.ngb_recvsize = nrecv*nq + nrecv*nq/4 + 100;
+        free(E->trace.ngb_recvbuf);
+        E->trace.ngb_recvbuf = (double *)malloc(E->trace.ngb_recvsize*sizeof(double));
+    }
+    if (E->trace.ngb_sendbuf == NULL || E->trace.ngb_recvbuf == NULL) {
+        fprintf(E->trace.fpt,"Error(lost souls)-no memory (n101)\n");
+        fflush(E->trace.fpt);
+        exit(10);
+    }
+
+    /* pack: quantity q of the i-th tracer for neighbor k */
+    /* is at sd[k] + q*scount[k] + i                       */
+    for (k=0; k<n; k++)
+        fill[k] = 0;
+
+    for (kk=1; kk<=nlater; kk++) {
+        k = dest[kk];
+        if (k < 0) continue;
+        i = fill[k]++;
+        for (q=0; q<nq; q++)
+            E->trace.ngb_sendbuf[sd[k] + q*scount[k] + i] = E->trace.rlater[j][q][kk];
+    }
+
+    MPI_Neighbor_alltoallv(E->trace.ngb_sendbuf, sc, sd, MPI_DOUBLE,
+                           E->trace.ngb_recvbuf, rc, rd, MPI_DOUBLE,
+                           E->trace.ngb_comm);
+
+    /* tracers that stay on this processor */
+    for (kk=1; kk<=nlater; kk++)
+        if (dest[kk] == -2) {
+            for (q=0; q<nq; q++)
+                stay[q] = E->trace.rlater[j][q][kk];
+            put_lost_tracer(E, j, stay, 1);
+        }
+
+    for (k=0; k<n; k++)
+        for (i=0; i<rcount[k]; i++)
+            put_lost_tracer(E, j, E->trace.ngb_recvbuf + rd[k] + i, rcount[k]);
+
+    MPI_Allreduce(&nfar, &nfar_total, 1, MPI_INT, MPI_SUM, E->parallel.world);
+    if (nfar_total > 0)
+        find_lost_tracers_globally(E, j, nfar, far);
+
+    if(E->control.verbose){
+      fprintf(E->trace.fpt,"Leaving lost_souls()\n");
+      fflush(E->trace.fpt);
+    }
+
+    E->trace.lost_souls_time += CPU_time0() - begin_time;
+    return;
+}
+
+#endif /* MPI_VERSION >= 3 */
+
+
 /************************ GET SHAPE FUNCTION *********************************/
 /* Real theta,phi,rad space is transformed into u,v space. This transformation */
 /* maps great circles into straight lines. Here, elements boundaries are     */
@@ -1105,6 +1552,103 @@ void full_get_velocity(struct All_variables *E,
     return;
 }
 
+/******************** GET VELOCITY (BATCH) ***********************************/
+/*                                                                           */
+/* Same as full_get_velocity, for n tracers that all lie in element nelem.   */
+/* The Cartesian nodal velocities, shape function coefficients and radial    */
+/* bounds of the element are fetched once for the whole batch.  A tracer     */
+/* that fits neither wedge (or lies outside the element radially) goes       */
+/* through full_get_velocity, which holds the error handling.                */
+
+void full_get_velocity_batch(struct All_variables *E,
+                             int j, int nelem, int n,
+                             const double *theta, const double *phi,
+                             const double *rad,
+                             double *vx, double *vy, double *vz)
+{
+    const int sphere_key = 0;
+    const double eps=-1e-4;
+    const double top_bound=1.0+1e-6;
+    const double bottom_bound=0.0-1e-6;
+
+    int i, k, iwedge;
+    int ns = (nelem - 1) / E->lmesh.elz + 1;
+    double VV[4][9];
+    double c[3][10];
+    double w[3][4][7];
+    double rad1, rad5, delrad;
+    double u, v, f1, f2;
+    double s1, s2, s3;
+    double shp[7];
+    double vel[4];
+
+    void velo_from_element_d();
+
+    /* get cartesian velocity */
+    velo_from_element_d(E, VV, j, nelem, sphere_key);
+
+    /* nodal velocities of each wedge, see full_get_velocity */
+    for (k=1; k<=3; k++) {
+        w[1][k][1]=VV[k][1]; w[1][k][2]=VV[k][2]; w[1][k][3]=VV[k][3];
+        w[1][k][4]=VV[k][5]; w[1][k][5]=VV[k][6]; w[1][k][6]=VV[k][7];
+        w[2][k][1]=VV[k][1]; w[2][k][2]=VV[k][3]; w[2][k][3]=VV[k][4];
+        w[2][k][4]=VV[k][5]; w[2][k][5]=VV[k][7]; w[2][k][6]=VV[k][8];
+    }
+
+    for (iwedge=1; iwedge<=2; iwedge++)
+        for (k=1; k<=9; k++)
+            c[iwedge][k]=E->trace.shape_coefs[j][iwedge][k][ns];
+
+    rad1=E->sx[j][3][E->ien[j][nelem].node[1]];
+    rad5=E->sx[j][3][E->ien[j][nelem].node[5]];
+    delrad=rad5-rad1;
+
+    for (i=0; i<n; i++) {
+
+        spherical_to_uv(E,j,theta[i],phi[i],&u,&v);
+
+        iwedge=1;
+        s1=c[1][1]+c[1][2]*u+c[1][3]*v;
+        s2=c[1][4]+c[1][5]*u+c[1][6]*v;
+        s3=c[1][7]+c[1][8]*u+c[1][9]*v;
+        if (s1<eps||s2<eps||s3<eps) {
+            iwedge=2;
+            s1=c[2][1]+c[2][2]*u+c[2][3]*v;
+            s2=c[2][4]+c[2][5]*u+c[2][6]*v;
+            s3=c[2][7]+c[2][8]*u+c[2][9]*v;
+        }
+
+        f1=(rad[i]-rad1)/delrad;
+        f2=(rad5-rad[i])/delrad;
+
+        if (s1<eps||s2<eps||s3<eps||
+            f2>top_bound||f2<bottom_bound||
+            f1>top_bound||f1<bottom_bound) {
+            full_get_velocity(E,j,nelem,theta[i],phi[i],rad[i],vel);
+            vx[i]=vel[1];
+            vy[i]=vel[2];
+            vz[i]=vel[3];
+            continue;
+        }
+
+        shp[1]=f2*s1;
+        shp[2]=f2*s2;
+        shp[3]=f2*s3;
+        shp[4]=f1*s1;
+        shp[5]=f1*s2;
+        shp[6]=f1*s3;
+
+        vx[i]=w[iwedge][1][1]*shp[1]+w[iwedge][1][2]*shp[2]+shp[3]*w[iwedge][1][3]+
+            w[iwedge][1][4]*shp[4]+w[iwedge][1][5]*shp[5]+shp[6]*w[iwedge][1][6];
+        vy[i]=w[iwedge][2][1]*shp[1]+w[iwedge][2][2]*shp[2]+shp[3]*w[iwedge][2][3]+
+            w[iwedge][2][4]*shp[4]+w[iwedge][2][5]*shp[5]+shp[6]*w[iwedge][2][6];
+        vz[i]=w[iwedge][3][1]*shp[1]+w[iwedge][3][2]*shp[2]+shp[3]*w[iwedge][3][3]+
+            w[iwedge][3][4]*shp[4]+w[iwedge][3][5]*shp[5]+shp[6]*w[iwedge][3][6];
+    }
+
+    return;
+}
+
 /***************************************************************/
 /* GET 2DSHAPE                                                 */
 /*                                                             */
@@ -1964,6 +2508,10 @@ static void write_trace_instructions(struct All_variables *E)
     fprintf(E->trace.fpt,"Regular Grid-> deltheta: %f delphi: %f\n",
             E->trace.deltheta[0],E->trace.delphi[0]);
 
+    if (E->trace.uv_index)
+        fprintf(E->trace.fpt,"UV lookup grid-> cells per element: %d\n",
+                E->trace.uv_refine);
+
 
 
 
@@ -2191,6 +2739,7 @@ static int icheck_element_column(struct All_variables *E,
     int node;
 
 
+#pragma omp atomic
     E->trace.istat_elements_checked++;
 
     /* surface coords of element nodes */
@@ -2589,6 +3138,21 @@ int full_iget_element(struct All_variables *E,
             if (ival!=1) return -99;
         }
 
+    /* direct lookup; only points in cells at the cap boundary */
+    /* that are not found in the candidate elements need the  */
+    /* search below                                           */
+
+    if (E->trace.uv_index)
+        {
+            nelem=iget_uv_column(E,j,x,y,z);
+            if (nelem>0)
+                {
+                    iel=nelem*elz;
+                    goto foundit;
+                }
+            if (nelem==-99) return -99;
+        }
+
     /* do quick search to see if element can be easily found. */
     /* note that element may still be out of this cap, but    */
     /* it is probably fast to do a quick search before        */
@@ -2710,6 +3274,7 @@ int full_iget_element(struct All_variables *E,
 
     /* As a last resort, check all element columns */
 
+#pragma omp atomic
     E->trace.istat1++;
 
     iel=icheck_all_columns(E,j,x,y,z,rad);
@@ -2778,6 +3343,26 @@ static int iget_radial_element(struct All_variables *E,
     idum=(iel-1)/elz;
     ibottom_element=idum*elz+1;
 
+    /* with the radial index, at most one layer above the */
+    /* indexed one needs to be checked                    */
+
+    if (E->trace.uv_index)
+        {
+            idum=(rad-E->trace.rad_index_min[j])*E->trace.rad_index_inv[j];
+            idum=max(0,min(idum,E->trace.nrad_index[j]-1));
+
+            for (kk=E->trace.rad_index[j][idum];kk<=elz;kk++)
+                {
+                    /* the radius of node kk+1 is the top of layer kk */
+                    top_rad=E->sx[j][3][kk+1];
+                    if (rad<top_rad) return ibottom_element+kk-1;
+                }
+
+            fprintf(E->trace.fpt,"Error(iget_radial_element)-out of range %f %d %d %d\n",rad,j,iel,ibottom_element);
+            fflush(E->trace.fpt);
+            exit(10);
+        }
+
     iradial_element=ibottom_element;
 
     for (kk=1;kk<=elz;kk++)
@@ -2848,6 +3433,476 @@ static int iget_regel(struct All_variables *E, int j,
 
 
 
+/*********** MAKE UV INDEX ***************************************/
+/*                                                               */
+/* This function builds a uniform grid in gnomonic (u,v) space   */
+/* over the cap, with tracer_uv_refine cells per element in each */
+/* direction. Great circles are straight lines in (u,v) space,   */
+/* so the element columns are convex quadrilaterals there, and   */
+/* the side of an element edge a point lies on is the same test  */
+/* as in icheck_bounds. Each cell stores the surface elements    */
+/* overlapping it; most cells hold one or two, and a cell lying  */
+/* entirely inside one element needs no test at all.             */
+
+static void make_uv_index(struct All_variables *E)
+{
+    const int j = 1;
+    const int elz = E->lmesh.elz;
+    const int snel = E->lmesh.snel;
+    int s, kk, pass, snode, nelem;
+    int nu, nv, iu, iv, iu0, iu1, iv0, iv1;
+    int icell, ic, ncells, ntotal, ninside, nmax, iinside, ioutside;
+    int *count;
+
+    double u[5], v[5], uc[4], vc[4];
+    double umin, umax, vmin, vmax, margin, du, dv, tol;
+    double area, sign, len, fmin, fmax, fval, eu, ev;
+    double cost_f, sint_f, phi_f, alpha, cosa, sina, e[3][4];
+    double *edge, *su, *sv;
+
+    /* orthonormal frame of the gnomonic projection of           */
+    /* spherical_to_uv(), rotated so that the u axis follows the */
+    /* first row of surface nodes and the cells line up with the */
+    /* elements: u = p.e1/p.e0, v = p.e2/p.e0                    */
+
+    cost_f=E->gnomonic[0].u;
+    sint_f=E->gnomonic[0].v;
+    phi_f=E->gnomonic_reference_phi;
+
+    alpha=atan2(E->gnomonic[E->lmesh.nox].v-E->gnomonic[1].v,
+                E->gnomonic[E->lmesh.nox].u-E->gnomonic[1].u);
+    cosa=cos(alpha);
+    sina=sin(alpha);
+
+    e[1][1]=-sin(phi_f);
+    e[1][2]=cos(phi_f);
+    e[1][3]=0.0;
+    e[2][1]=-cost_f*cos(phi_f);
+    e[2][2]=-cost_f*sin(phi_f);
+    e[2][3]=sint_f;
+
+    E->trace.uv_frame[j][0][1]=sint_f*cos(phi_f);
+    E->trace.uv_frame[j][0][2]=sint_f*sin(phi_f);
+    E->trace.uv_frame[j][0][3]=cost_f;
+    for (kk=1;kk<=3;kk++)
+        {
+            E->trace.uv_frame[j][1][kk]=cosa*e[1][kk]+sina*e[2][kk];
+            E->trace.uv_frame[j][2][kk]=-sina*e[1][kk]+cosa*e[2][kk];
+        }
+
+    if ((su=(double *)malloc((E->lmesh.nsf+1)*sizeof(double)))==NULL ||
+        (sv=(double *)malloc((E->lmesh.nsf+1)*sizeof(double)))==NULL)
+        {
+            fprintf(E->trace.fpt,"ERROR(make uv index)-no memory\n");
+            fflush(E->trace.fpt);
+            exit(10);
+        }
+
+    /* rotated (u,v) of the surface nodes, and the bounding box of the cap */
+
+    umin=vmin=1.0e30;
+    umax=vmax=-1.0e30;
+    for (kk=1;kk<=E->lmesh.nsf;kk++)
+        {
+            su[kk]=cosa*E->gnomonic[kk].u+sina*E->gnomonic[kk].v;
+            sv[kk]=-sina*E->gnomonic[kk].u+cosa*E->gnomonic[kk].v;
+            umin=min(umin,su[kk]);
+            umax=max(umax,su[kk]);
+            vmin=min(vmin,sv[kk]);
+            vmax=max(vmax,sv[kk]);
+        }
+
+    margin=1.0e-6*((umax-umin)+(vmax-vmin));
+    umin-=margin;
+    umax+=margin;
+    vmin-=margin;
+    vmax+=margin;
+
+    nu=E->trace.uv_refine*E->lmesh.elx;
+    nv=E->trace.uv_refine*E->lmesh.ely;
+    du=(umax-umin)/nu;
+    dv=(vmax-vmin)/nv;
+    ncells=nu*nv;
+
+    /* cells closer than tol to an edge count as overlapping */
+    tol=1.0e-9*(du+dv);
+
+    E->trace.uv_nu[j]=nu;
+    E->trace.uv_nv[j]=nv;
+    E->trace.uv_umin[j]=umin;
+    E->trace.uv_vmin[j]=vmin;
+    E->trace.uv_du_inv[j]=1.0/du;
+    E->trace.uv_dv_inv[j]=1.0/dv;
+
+    /* edge functions of each surface element, */
+    /* the signed distance from the edge, positive inside */
+
+    if ((E->trace.uv_edge[j]=(double *)malloc(12*snel*sizeof(double)))==NULL ||
+        (E->trace.uv_cell_start[j]=(int *)malloc((ncells+1)*sizeof(int)))==NULL ||
+        (count=(int *)malloc((ncells+1)*sizeof(int)))==NULL)
+        {
+            fprintf(E->trace.fpt,"ERROR(make uv index)-no memory\n");
+            fflush(E->trace.fpt);
+            exit(10);
+        }
+
+    for (s=1;s<=snel;s++)
+        {
+            nelem=(s-1)*elz+1;
+            for (kk=1;kk<=4;kk++)
+                {
+                    snode=(E->ien[j][nelem].node[kk]-1)/E->lmesh.noz+1;
+                    u[kk]=su[snode];
+                    v[kk]=sv[snode];
+                }
+
+            area=0.0;
+            for (kk=1;kk<=4;kk++)
+                area+=u[kk]*v[kk%4+1]-u[kk%4+1]*v[kk];
+            sign=(area>0.0) ? 1.0 : -1.0;
+
+            edge=E->trace.uv_edge[j]+12*(s-1);
+            for (kk=1;kk<=4;kk++)
+                {
+                    eu=u[kk%4+1]-u[kk];
+                    ev=v[kk%4+1]-v[kk];
+                    len=sign/sqrt(eu*eu+ev*ev);
+                    edge[3*(kk-1)]=(ev*u[kk]-eu*v[kk])*len;
+                    edge[3*(kk-1)+1]=-ev*len;
+                    edge[3*(kk-1)+2]=eu*len;
+                }
+        }
+
+    /* count the candidates of each cell (pass 0), then fill (pass 1) */
+
+    for (icell=0;icell<=ncells;icell++) count[icell]=0;
+    E->trace.uv_cell_el[j]=NULL;
+
+    for (pass=0;pass<=1;pass++)
+        {
+            for (s=1;s<=snel;s++)
+                {
+                    edge=E->trace.uv_edge[j]+12*(s-1);
+                    nelem=(s-1)*elz+1;
+
+                    umin=vmin=1.0e30;
+                    umax=vmax=-1.0e30;
+                    for (kk=1;kk<=4;kk++)
+                        {
+                            snode=(E->ien[j][nelem].node[kk]-1)/E->lmesh.noz+1;
+                            umin=min(umin,su[snode]);
+                            umax=max(umax,su[snode]);
+                            vmin=min(vmin,sv[snode]);
+                            vmax=max(vmax,sv[snode]);
+                        }
+
+                    iu0=max(0,(int)((umin-tol-E->trace.uv_umin[j])/du));
+                    iu1=min(nu-1,(int)((umax+tol-E->trace.uv_umin[j])/du));
+                    iv0=max(0,(int)((vmin-tol-E->trace.uv_vmin[j])/dv));
+                    iv1=min(nv-1,(int)((vmax+tol-E->trace.uv_vmin[j])/dv));
+
+                    for (iv=iv0;iv<=iv1;iv++)
+                        for (iu=iu0;iu<=iu1;iu++)
+                            {
+                                uc[0]=uc[3]=E->trace.uv_umin[j]+iu*du;
+                                uc[1]=uc[2]=uc[0]+du;
+                                vc[0]=vc[1]=E->trace.uv_vmin[j]+iv*dv;
+                                vc[2]=vc[3]=vc[0]+dv;
+
+                                /* the cell misses the element if all its */
+                                /* corners are outside of one edge        */
+                                ioutside=0;
+                                iinside=1;
+                                for (kk=0;kk<4;kk++)
+                                    {
+                                        fmin=1.0e30;
+                                        fmax=-1.0e30;
+                                        for (ic=0;ic<4;ic++)
+                                            {
+                                                fval=edge[3*kk]+edge[3*kk+1]*uc[ic]
+                                                    +edge[3*kk+2]*vc[ic];
+                                                fmin=min(fmin,fval);
+                                                fmax=max(fmax,fval);
+                                            }
+                                        if (fmax<-tol) ioutside=1;
+                                        if (fmin<=tol) iinside=0;
+                                    }
+                                if (ioutside) continue;
+
+                                icell=iu+iv*nu;
+                                if (pass==0)
+                                    count[icell]++;
+                                else
+                                    E->trace.uv_cell_el[j][E->trace.uv_cell_start[j][icell]+(count[icell]++)]
+                                        = (iinside) ? -s : s;
+                            }
+                }
+
+            if (pass==0)
+                {
+                    E->trace.uv_cell_start[j][0]=0;
+                    for (icell=0;icell<ncells;icell++)
+                        E->trace.uv_cell_start[j][icell+1]=
+                            E->trace.uv_cell_start[j][icell]+count[icell];
+                    ntotal=E->trace.uv_cell_start[j][ncells];
+
+                    if ((E->trace.uv_cell_el[j]=(int *)malloc((ntotal+1)*sizeof(int)))==NULL)
+                        {
+                            fprintf(E->trace.fpt,"ERROR(make uv index)-no memory\n");
+                            fflush(E->trace.fpt);
+                            exit(10);
+                        }
+                    for (icell=0;icell<=ncells;icell++) count[icell]=0;
+                }
+        }
+
+    /* statistics */
+
+    nmax=0;
+    ninside=0;
+    for (icell=0;icell<ncells;icell++)
+        {
+            nmax=max(nmax,count[icell]);
+            if (count[icell]==1 &&
+                E->trace.uv_cell_el[j][E->trace.uv_cell_start[j][icell]]<0)
+                ninside++;
+        }
+    E->trace.uv_max_candidates[j]=nmax;
+
+    fprintf(E->trace.fpt,"\nUV lookup grid: %d x %d cells\n",nu,nv);
+    fprintf(E->trace.fpt,"Cells inside one element: %.1f percent\n",
+            (100.0*ninside)/ncells);
+    fprintf(E->trace.fpt,"Candidates per cell: mean %.2f max %d (%.1f MB)\n",
+            (1.0*ntotal)/ncells,nmax,
+            ((ncells+ntotal+2)*sizeof(int)+12*snel*sizeof(double))/(1024.0*1024.0));
+    fflush(E->trace.fpt);
+
+    free(count);
+    free(su);
+    free(sv);
+    return;
+}
+
+
+/*********** IGET UV COLUMN **************************************/
+/*                                                               */
+/* This function returns the surface element containing (x,y,z)  */
+/* from the (u,v) lookup grid, -99 if the point is outside the   */
+/* cap, or 0 if it is in none of the candidates of its cell      */
+/* (possible for cells at the cap boundary only).                */
+
+static int iget_uv_column(struct All_variables *E, int j,
+                          double x, double y, double z)
+{
+    int iu, iv, icell, kk, kend, nelem;
+    double w, u, v, ru, rv;
+    double *edge;
+
+    w=x*E->trace.uv_frame[j][0][1]+y*E->trace.uv_frame[j][0][2]
+        +z*E->trace.uv_frame[j][0][3];
+    if (w<=0.0) return -99;
+
+    u=(x*E->trace.uv_frame[j][1][1]+y*E->trace.uv_frame[j][1][2]
+       +z*E->trace.uv_frame[j][1][3])/w;
+    v=(x*E->trace.uv_frame[j][2][1]+y*E->trace.uv_frame[j][2][2]
+       +z*E->trace.uv_frame[j][2][3])/w;
+
+    ru=(u-E->trace.uv_umin[j])*E->trace.uv_du_inv[j];
+    rv=(v-E->trace.uv_vmin[j])*E->trace.uv_dv_inv[j];
+    if (ru<0.0 || rv<0.0) return -99;
+
+    iu=ru;
+    iv=rv;
+    if (iu>=E->trace.uv_nu[j] || iv>=E->trace.uv_nv[j]) return -99;
+
+    icell=iu+iv*E->trace.uv_nu[j];
+    kk=E->trace.uv_cell_start[j][icell];
+    kend=E->trace.uv_cell_start[j][icell+1];
+
+    if (kk==kend) return -99;
+
+    nelem=E->trace.uv_cell_el[j][kk];
+    if (nelem<0) return -nelem;
+
+    for (;kk<kend;kk++)
+        {
+            nelem=E->trace.uv_cell_el[j][kk];
+            edge=E->trace.uv_edge[j]+12*(nelem-1);
+
+#pragma omp atomic
+            E->trace.istat_elements_checked++;
+
+            if (edge[0]+edge[1]*u+edge[2]*v>=0.0 &&
+                edge[3]+edge[4]*u+edge[5]*v>=0.0 &&
+                edge[6]+edge[7]*u+edge[8]*v>=0.0 &&
+                edge[9]+edge[10]*u+edge[11]*v>=0.0)
+                return nelem;
+        }
+
+    return 0;
+}
+
+
+/*********** MAKE RADIAL INDEX ***********************************/
+/*                                                               */
+/* This function maps uniform radial cells, half as thick as the */
+/* thinnest layer, to the lowest layer they overlap. The layer   */
+/* of a radius is then this one or the next.                     */
+
+static void make_radial_index(struct All_variables *E)
+{
+    const int j = 1;
+    const int noz = E->lmesh.noz;
+    int kk, layer, n;
+    double rbot, rtop, mindr, r;
+
+    rbot=E->sx[j][3][1];
+    rtop=E->sx[j][3][noz];
+
+    mindr=rtop-rbot;
+    for (kk=1;kk<noz;kk++)
+        mindr=min(mindr,E->sx[j][3][kk+1]-E->sx[j][3][kk]);
+
+    n=ceil(2.0*(rtop-rbot)/mindr);
+
+    if ((E->trace.rad_index[j]=(int *)malloc(n*sizeof(int)))==NULL)
+        {
+            fprintf(E->trace.fpt,"ERROR(make radial index)-no memory\n");
+            fflush(E->trace.fpt);
+            exit(10);
+        }
+
+    E->trace.nrad_index[j]=n;
+    E->trace.rad_index_min[j]=rbot;
+    E->trace.rad_index_inv[j]=n/(rtop-rbot);
+
+    layer=1;
+    for (kk=0;kk<n;kk++)
+        {
+            r=rbot+kk/E->trace.rad_index_inv[j];
+            while (layer<noz-1 && r>=E->sx[j][3][layer+1]) layer++;
+            E->trace.rad_index[j][kk]=layer;
+        }
+
+    return;
+}
+
+
+/*********** BENCHMARK ELEMENT LOCATION **************************/
+/*                                                               */
+/* This function times the element search through the regular   */
+/* grid against the (u,v) lookup grid, for random points inside  */
+/* this processor (located with and without the correct previous */
+/* element) and random points anywhere in the spherical shell.   */
+
+static void benchmark_element_location(struct All_variables *E)
+{
+    const int j = 1;
+    const int npoints = E->trace.location_benchmark;
+    const int uv_index = E->trace.uv_index;
+    int i, kk, nelem, node, method, nmismatch;
+    int *iel_start, *iel_found[3];
+    double *x, *y, *z, *theta, *phi, *rad;
+    double w[5], xx, yy, zz, r, rbot, rtop;
+    double time[3];
+    double CPU_time0();
+    void cart_to_sphere();
+
+    x=(double *)malloc(npoints*sizeof(double));
+    y=(double *)malloc(npoints*sizeof(double));
+    z=(double *)malloc(npoints*sizeof(double));
+    theta=(double *)malloc(npoints*sizeof(double));
+    phi=(double *)malloc(npoints*sizeof(double));
+    rad=(double *)malloc(npoints*sizeof(double));
+    iel_start=(int *)malloc(npoints*sizeof(int));
+    for (method=0;method<3;method++)
+        iel_found[method]=(int *)malloc(npoints*sizeof(int));
+
+    rbot=E->sx[j][3][1];
+    rtop=E->sx[j][3][E->lmesh.noz];
+
+    /* the first half of the points lie in random elements, */
+    /* the rest anywhere in the shell                        */
+
+    for (i=0;i<npoints;i++)
+        {
+            r=rbot+(rtop-rbot)*drand48();
+            if (i<npoints/2)
+                {
+                    nelem=1+(int)(drand48()*E->lmesh.nel);
+                    nelem=min(nelem,E->lmesh.nel);
+                    xx=yy=zz=0.0;
+                    for (kk=1;kk<=4;kk++)
+                        {
+                            w[kk]=drand48();
+                            node=E->ien[j][nelem].node[kk];
+                            xx+=w[kk]*E->x[j][1][node];
+                            yy+=w[kk]*E->x[j][2][node];
+                            zz+=w[kk]*E->x[j][3][node];
+                        }
+                    iel_start[i]=nelem;
+                }
+            else
+                {
+                    xx=2.0*drand48()-1.0;
+                    yy=2.0*drand48()-1.0;
+                    zz=2.0*drand48()-1.0;
+                    iel_start[i]=-99;
+                }
+            r/=sqrt(xx*xx+yy*yy+zz*zz);
+            x[i]=xx*r;
+            y[i]=yy*r;
+            z[i]=zz*r;
+            cart_to_sphere(E,x[i],y[i],z[i],&theta[i],&phi[i],&rad[i]);
+        }
+
+    /* 0: regular grid with previous element, */
+    /* 1: regular grid without, 2: uv grid    */
+
+    for (method=0;method<3;method++)
+        {
+            E->trace.uv_index=(method==2);
+            time[method]=CPU_time0();
+            for (i=0;i<npoints;i++)
+                iel_found[method][i]=full_iget_element(E,j,(method==0)?iel_start[i]:-99,
+                                                       x[i],y[i],z[i],
+                                                       theta[i],phi[i],rad[i]);
+            time[method]=CPU_time0()-time[method];
+        }
+    E->trace.uv_index=uv_index;
+
+    nmismatch=0;
+    for (i=0;i<npoints;i++)
+        if (iel_found[2][i]!=iel_found[0][i] || iel_found[2][i]!=iel_found[1][i])
+            nmismatch++;
+
+    fprintf(E->trace.fpt,"\nElement location benchmark: %d points\n",npoints);
+    fprintf(E->trace.fpt,"regular grid, previous element known: %e s/point\n",
+            time[0]/npoints);
+    fprintf(E->trace.fpt,"regular grid, previous element unknown: %e s/point\n",
+            time[1]/npoints);
+    fprintf(E->trace.fpt,"uv lookup grid: %e s/point\n",time[2]/npoints);
+    fprintf(E->trace.fpt,"points located differently: %d\n",nmismatch);
+    fflush(E->trace.fpt);
+
+    if (E->parallel.me==0)
+        fprintf(stderr,"Element location benchmark: regular grid %e/%e s, uv grid %e s per point, %d mismatches\n",
+                time[0]/npoints,time[1]/npoints,time[2]/npoints,nmismatch);
+
+    free(x);
+    free(y);
+    free(z);
+    free(theta);
+    free(phi);
+    free(rad);
+    free(iel_start);
+    for (method=0;method<3;method++)
+        free(iel_found[method]);
+
+    return;
+}
+
+
 /****************************************************************/
 /* DEFINE UV SPACE                                              */
 /*                                                              */
@@ -3066,15 +4121,21 @@ void full_keep_within_bounds(struct All_variables *E,
 /*                                                                                        */
 /* This function (and the 2 following) are used to test advection of tracers by assigning */
 /* a test function (in "analytical_test_function").                                       */
+/*                                                                                        */
+/* A single tracer is advected with the current tracer integrator over the same time      */
+/* interval at successively halved time steps.  The final positions are compared to a     */
+/* fine Runge-Kutte path of the analytical velocity, and to each other.  The latter       */
+/* excludes the velocity interpolation error, so it shows the order of the time           */
+/* integration itself.                                                                    */
+
+#define NRESOLUTIONS 4
 
 void analytical_test(E)
      struct All_variables *E;
 
 {
-#if 0
-    int kk,pp;
-    int nsteps;
-    int j;
+    int kk,j,r,i;
+    int nsteps,steps;
     int my_number,number;
     int nrunge_steps;
     int nrunge_refinement;
@@ -3085,22 +4146,16 @@ void analytical_test(E)
     double time;
     double vel_s[4];
     double vel_c[4];
-    double my_theta0,my_phi0,my_rad0;
-    double my_thetaf,my_phif,my_radf;
-    double theta0,phi0,rad0;
-    double thetaf,phif,radf;
+    double my_pos[3],pos0[3],posf[3];
     double x0_s[4],xf_s[4];
     double x0_c[4],xf_c[4];
     double vec[4];
-    double runge_path_length,runge_time;
-    double x0,y0,z0;
-    double xf,yf,zf;
-    double difference;
-    double difperpath;
+    double runge_path_length;
+    double xf[NRESOLUTIONS][4];
+    double error[NRESOLUTIONS],change[NRESOLUTIONS];
+    FILE *fp;
 
     void analytical_test_function();
-    void predict_tracers();
-    void correct_tracers();
     void analytical_runge_kutte();
     void sphere_to_cart();
 
@@ -3113,14 +4168,10 @@ void analytical_test(E)
 
     E->trace.box_cushion=0.0000;
 
-    /* test paramters */
-
-    nsteps=200;
-    dt=0.0001;
+    /* test paramters (coarsest resolution) */
 
-    E->advection.timestep=dt;
-
-    fprintf(E->trace.fpt,"steps: %d  dt: %f\n",nsteps,dt);
+    nsteps=25;
+    dt=0.0008;
 
     /* Assign test velocity to Citcom nodes */
 
@@ -3141,186 +4192,166 @@ void analytical_test(E)
                 }
         }
 
-    time=0.0;
-
-    my_theta0=0.0;
-    my_phi0=0.0;
-    my_rad0=0.0;
-    my_thetaf=0.0;
-    my_phif=0.0;
-    my_radf=0.0;
-
-    for (j=1;j<=E->sphere.caps_per_proc;j++)
-        {
-            if (E->trace.ntracers[j]>10)
-                {
-                    fprintf(E->trace.fpt,"Warning(analytical)-too many tracers to print!\n");
-                    fflush(E->trace.fpt);
-                    if (E->trace.itracer_warnings) exit(10);
-                }
-        }
-
-    /* print initial positions */
+    /* only works for one tracer */
 
-    E->monitor.solution_cycles=0;
+    my_number=0;
+    my_pos[0]=my_pos[1]=my_pos[2]=0.0;
     for (j=1;j<=E->sphere.caps_per_proc;j++)
         {
-            for (pp=1;pp<=E->trace.ntracers[j];pp++)
-                {
-                    theta=E->trace.basicq[j][0][pp];
-                    phi=E->trace.basicq[j][1][pp];
-                    rad=E->trace.basicq[j][2][pp];
-
-                    fprintf(E->trace.fpt,"(%d) time: %f theta: %f phi: %f rad: %f\n",E->monitor.solution_cycles,time,theta,phi,rad);
-
-                    if (pp==1) fprintf(stderr,"(%d) time: %f theta: %f phi: %f rad: %f\n",E->monitor.solution_cycles,time,theta,phi,rad);
-
-                    if (pp==1)
-                        {
-                            my_theta0=theta;
-                            my_phi0=phi;
-                            my_rad0=rad;
-                        }
-                }
-        }
-
-    /* advect tracers */
-
-    for (kk=1;kk<=nsteps;kk++)
-        {
-            E->monitor.solution_cycles=kk;
-
-            time=time+dt;
-
-            predict_tracers(E);
-            correct_tracers(E);
-
-            for (j=1;j<=E->sphere.caps_per_proc;j++)
-                {
-                    for (pp=1;pp<=E->trace.ntracers[j];pp++)
-                        {
-                            theta=E->trace.basicq[j][0][pp];
-                            phi=E->trace.basicq[j][1][pp];
-                            rad=E->trace.basicq[j][2][pp];
-
-                            fprintf(E->trace.fpt,"(%d) time: %f theta: %f phi: %f rad: %f\n",E->monitor.solution_cycles,time,theta,phi,rad);
-
-                            if (pp==1) fprintf(stderr,"(%d) time: %f theta: %f phi: %f rad: %f\n",E->monitor.solution_cycles,time,theta,phi,rad);
-
-                            if ((kk==nsteps) && (pp==1))
-                                {
-                                    my_thetaf=theta;
-                                    my_phif=phi;
-                                    my_radf=rad;
-                                }
-                        }
-                }
-
-        }
-
-    /* Get ready for comparison to Runge-Kutte (only works for one tracer) */
-
-    fflush(E->trace.fpt);
-    parallel_process_sync(E);
-
-    fprintf(E->trace.fpt,"\n\nComparison to Runge-Kutte\n");
-    if (E->parallel.me==0) fprintf(stderr,"Comparison to Runge-Kutte\n");
-
-    for (j=1;j<=E->sphere.caps_per_proc;j++)
-        {
-            my_number=E->trace.ntracers[j];
+            my_number+=E->trace.ntracers[j];
+            if (E->trace.ntracers[j]>0)
+                for (i=0;i<3;i++)
+                    my_pos[i]=E->trace.basicq[j][i][1];
         }
 
     MPI_Allreduce(&my_number,&number,1,MPI_INT,MPI_SUM,E->parallel.world);
 
-    fprintf(E->trace.fpt,"Number of tracers: %d\n", number);
-    if (E->parallel.me==0) fprintf(stderr,"Number of tracers: %d\n", number);
-
-    /* if more than 1 tracer, exit */
-
     if (number!=1)
         {
-            fprintf(E->trace.fpt,"(Note: RK comparison only appropriate for one tracing particle (%d here) \n",number);
-            if (E->parallel.me==0) fprintf(stderr,"(Note: RK comparison only appropriate for one tracing particle (%d here) \n",number);
+            fprintf(E->trace.fpt,"(Note: analytical test only appropriate for one tracing particle (%d here) \n",number);
+            if (E->parallel.me==0) fprintf(stderr,"(Note: analytical test only appropriate for one tracing particle (%d here) \n",number);
             fflush(E->trace.fpt);
-            parallel_process_termination();
+            return;
         }
 
+    MPI_Allreduce(my_pos,pos0,3,MPI_DOUBLE,MPI_SUM,E->parallel.world);
 
-    /* communicate starting and final positions */
+    /* Runge-Kutte path of the analytical velocity */
 
-    MPI_Allreduce(&my_theta0,&theta0,1,MPI_DOUBLE,MPI_SUM,E->parallel.world);
-    MPI_Allreduce(&my_phi0,&phi0,1,MPI_DOUBLE,MPI_SUM,E->parallel.world);
-    MPI_Allreduce(&my_rad0,&rad0,1,MPI_DOUBLE,MPI_SUM,E->parallel.world);
-    MPI_Allreduce(&my_thetaf,&thetaf,1,MPI_DOUBLE,MPI_SUM,E->parallel.world);
-    MPI_Allreduce(&my_phif,&phif,1,MPI_DOUBLE,MPI_SUM,E->parallel.world);
-    MPI_Allreduce(&my_radf,&radf,1,MPI_DOUBLE,MPI_SUM,E->parallel.world);
-
-    x0_s[1]=theta0;
-    x0_s[2]=phi0;
-    x0_s[3]=rad0;
+    x0_s[1]=pos0[0];
+    x0_s[2]=pos0[1];
+    x0_s[3]=pos0[2];
 
     nrunge_refinement=1000;
 
     nrunge_steps=nsteps*nrunge_refinement;
     runge_dt=dt/(1.0*nrunge_refinement);
 
-
     analytical_runge_kutte(E,nrunge_steps,runge_dt,x0_s,x0_c,xf_s,xf_c,vec);
 
-    runge_time=vec[1];
     runge_path_length=vec[2];
 
-    /* initial coordinates - both citcom and RK */
+    /* advect the tracer at each resolution */
 
-    x0=x0_c[1];
-    y0=x0_c[2];
-    z0=x0_c[3];
+    for (r=0;r<NRESOLUTIONS;r++)
+        {
+            steps=nsteps<<r;
+            E->advection.timestep=dt/(1<<r);
 
-    /* convert final citcom coords into cartesian */
+            analytical_place_tracer(E,pos0[0],pos0[1],pos0[2]);
 
-    sphere_to_cart(E,thetaf,phif,radf,&xf,&yf,&zf);
+            time=0.0;
+            for (kk=1;kk<=steps;kk++)
+                {
+                    E->monitor.solution_cycles=kk;
+                    advect_tracers(E);
+                    time=time+E->advection.timestep;
+                }
 
-    difference=sqrt((xf-xf_c[1])*(xf-xf_c[1])+(yf-xf_c[2])*(yf-xf_c[2])+(zf-xf_c[3])*(zf-xf_c[3]));
+            my_pos[0]=my_pos[1]=my_pos[2]=0.0;
+            for (j=1;j<=E->sphere.caps_per_proc;j++)
+                if (E->trace.ntracers[j]>0)
+                    for (i=0;i<3;i++)
+                        my_pos[i]=E->trace.basicq[j][i][1];
 
-    difperpath=difference/runge_path_length;
+            MPI_Allreduce(my_pos,posf,3,MPI_DOUBLE,MPI_SUM,E->parallel.world);
 
-    /* Print out results */
+            sphere_to_cart(E,posf[0],posf[1],posf[2],&xf[r][1],&xf[r][2],&xf[r][3]);
 
-    fprintf(E->trace.fpt,"Citcom calculation: steps: %d  dt: %f\n",nsteps,dt);
-    fprintf(E->trace.fpt,"  (nodes per cap: %d x %d x %d)\n",E->lmesh.nox,E->lmesh.noy,(E->lmesh.noz-1)*E->parallel.nprocz+1);
-    fprintf(E->trace.fpt,"                    starting position: theta: %f phi: %f rad: %f\n", theta0,phi0,rad0);
-    fprintf(E->trace.fpt,"                    final position: theta: %f phi: %f rad: %f\n", thetaf,phif,radf);
-    fprintf(E->trace.fpt,"                    (final time: %f) \n",time );
+            error[r]=sqrt((xf[r][1]-xf_c[1])*(xf[r][1]-xf_c[1])+
+                          (xf[r][2]-xf_c[2])*(xf[r][2]-xf_c[2])+
+                          (xf[r][3]-xf_c[3])*(xf[r][3]-xf_c[3]));
 
-    fprintf(E->trace.fpt,"\n\nRunge-Kutte calculation: steps: %d  dt: %g\n",nrunge_steps,runge_dt);
-    fprintf(E->trace.fpt,"                    starting position: theta: %f phi: %f rad: %f\n", theta0,phi0,rad0);
-    fprintf(E->trace.fpt,"                    final position: theta: %f phi: %f rad: %f\n",xf_s[1],xf_s[2],xf_s[3]);
-    fprintf(E->trace.fpt,"                    path length: %f \n",runge_path_length );
-    fprintf(E->trace.fpt,"                    (final time: %f) \n",runge_time );
+            change[r]=0.0;
+            if (r>0)
+                change[r]=sqrt((xf[r][1]-xf[r-1][1])*(xf[r][1]-xf[r-1][1])+
+                               (xf[r][2]-xf[r-1][2])*(xf[r][2]-xf[r-1][2])+
+                               (xf[r][3]-xf[r-1][3])*(xf[r][3]-xf[r-1][3]));
+        }
 
-    fprintf(E->trace.fpt,"\n\n Difference between Citcom and RK: %e  (diff per path length: %e)\n\n",difference,difperpath);
+    /* Print out results */
 
-    if (E->parallel.me==0)
+    for (i=0;i<2;i++)
         {
-            fprintf(stderr,"Citcom calculation: steps: %d  dt: %f\n",nsteps,dt);
-            fprintf(stderr,"  (nodes per cap: %d x %d x %d)\n",E->lmesh.nox,E->lmesh.noy,(E->lmesh.noz-1)*E->parallel.nprocz+1);
-            fprintf(stderr,"                    starting position: theta: %f phi: %f rad: %f\n", theta0,phi0,rad0);
-            fprintf(stderr,"                    final position: theta: %f phi: %f rad: %f\n", thetaf,phif,radf);
-            fprintf(stderr,"                    (final time: %f) \n",time );
+            if (i==0)
+                fp=E->trace.fpt;
+            else if (E->parallel.me==0)
+                fp=stderr;
+            else
+                break;
+
+            fprintf(fp,"\n\nCitcom calculation: integrator: %d  sub-step courant: %g  (final time: %f)\n",
+                    E->trace.integrator,E->trace.courant,time);
+            fprintf(fp,"  (nodes per cap: %d x %d x %d)\n",E->lmesh.nox,E->lmesh.noy,(E->lmesh.noz-1)*E->parallel.nprocz+1);
+            fprintf(fp,"                    starting position: theta: %f phi: %f rad: %f\n",pos0[0],pos0[1],pos0[2]);
+            fprintf(fp,"Runge-Kutte calculation: steps: %d  dt: %g\n",nrunge_steps,runge_dt);
+            fprintf(fp,"                    final position: theta: %f phi: %f rad: %f\n",xf_s[1],xf_s[2],xf_s[3]);
+            fprintf(fp,"                    path length: %f \n",runge_path_length);
+
+            fprintf(fp,"\n  steps          dt   diff from RK  order   change from previous  order\n");
+            for (r=0;r<NRESOLUTIONS;r++)
+                {
+                    fprintf(fp,"%7d %11.4e   %11.4e",nsteps<<r,dt/(1<<r),error[r]);
+                    if (r>0)
+                        fprintf(fp,"  %5.2f",log(error[r-1]/error[r])/log(2.0));
+                    else
+                        fprintf(fp,"       ");
+                    if (r>0)
+                        fprintf(fp,"   %11.4e",change[r]);
+                    if (r>1)
+                        fprintf(fp,"           %5.2f",log(change[r-1]/change[r])/log(2.0));
+                    fprintf(fp,"\n");
+                }
+            fprintf(fp,"\n (diff per path length at the finest step: %e)\n\n",error[NRESOLUTIONS-1]/runge_path_length);
+            fflush(fp);
+        }
 
-            fprintf(stderr,"\n\nRunge-Kutte calculation: steps: %d  dt: %f\n",nrunge_steps,runge_dt);
-            fprintf(stderr,"                    starting position: theta: %f phi: %f rad: %f\n", theta0,phi0,rad0);
-            fprintf(stderr,"                    final position: theta: %f phi: %f rad: %f\n",xf_s[1],xf_s[2],xf_s[3]);
-            fprintf(stderr,"                    path length: %f \n",runge_path_length );
-            fprintf(stderr,"                    (final time: %f) \n",runge_time );
+    return;
+}
 
-            fprintf(stderr,"\n\n Difference between Citcom and RK: %e  (diff per path length: %e)\n\n",difference,difperpath);
+#undef NRESOLUTIONS
 
-        }
 
-    fflush(E->trace.fpt);
-#endif
+/* Put the test tracer back at (theta,phi,rad), on whichever processor owns it */
+
+static void analytical_place_tracer(struct All_variables *E,
+                                    double theta, double phi, double rad)
+{
+    int j, i, iel;
+    double x, y, z;
+
+    int icheck_processor_shell();
+
+    sphere_to_cart(E,theta,phi,rad,&x,&y,&z);
+
+    for (j=1;j<=E->sphere.caps_per_proc;j++) {
+
+        E->trace.ntracers[j]=0;
+        E->trace.sorted[j]=0;
+
+        if (E->parallel.nprocz>1 && icheck_processor_shell(E,j,rad)!=1)
+            continue;
+        if (full_icheck_cap(E,0,x,y,z,rad)==0)
+            continue;
+
+        iel=full_iget_element(E,j,-99,x,y,z,theta,phi,rad);
+        if (iel<1)
+            continue;
+
+        E->trace.ntracers[j]=1;
+        E->trace.ielement[j][1]=iel;
+        E->trace.basicq[j][0][1]=theta;
+        E->trace.basicq[j][1][1]=phi;
+        E->trace.basicq[j][2][1]=rad;
+        E->trace.basicq[j][3][1]=x;
+        E->trace.basicq[j][4][1]=y;
+        E->trace.basicq[j][5][1]=z;
+        for (i=0;i<E->trace.number_of_extra_quantities;i++)
+            E->trace.extraq[j][i][1]=0.0;
+        if (E->trace.iweight>=0)
+            E->trace.extraq[j][E->trace.iweight][1]=1.0;
+    }
+
     return;
 }
 
@@ -37,6 +37,9 @@ double theta_g(double , struct All_variables *);
 
 void calc_cbase_at_tp(float , float , float *);
 void myerror(struct All_variables *E,char *message);
+void sph_coef_sum(struct All_variables *, struct SPH_COMM *, MPI_Comm);
+void sph_coef_bcast(struct All_variables *, struct SPH_COMM *, MPI_Comm);
+void sph_coef_wait(struct All_variables *, struct SPH_COMM *);
 
 /* ===============================================
    strips horizontal average from nodal field X.
@@ -87,29 +90,58 @@ void return_horiz_ave(E,X,H)
      struct All_variables *E;
      double **X, *H;
 {
-  const int dims = E->mesh.nsd;
-  int m,i,j,k,d,nint,noz,nox,noy,el,elz,elx,ely,j1,j2,i1,i2,k1,k2,nproc;
-  int top,lnode[5], sizeofH, noz2,iroot;
-  double *Have,*temp,aa[5];
+  void return_horiz_ave_fields();
+
+  return_horiz_ave_fields(E,1,&X,&H,0,NULL,NULL);
+
+  return;
+  }
+
+void return_horiz_ave_f(E,X,H)
+     struct All_variables *E;
+     float **X, *H;
+{
+  void return_horiz_ave_fields();
+
+  return_horiz_ave_fields(E,0,NULL,NULL,1,&X,&H);
+
+  return;
+  }
+
+
+/* ===============================================
+   surface quadrature weights of the horizontal
+   averages. The mesh does not move, so the
+   jacobians of the bottom face of every element
+   (and the top face of the top layer) and the
+   global area of each layer are computed once.
+   =============================================== */
+
+static void set_horiz_ave_weights(E)
+     struct All_variables *E;
+{
+  int m,i,j,k,nint,el,es,elz,elx,ely,noz,top;
+  double *temp;
   struct Shape_function1 M;
   struct Shape_function1_dA dGamma;
   void get_global_1d_shape_fn();
 
-  sizeofH = (2*E->lmesh.noz+2)*sizeof(double);
-
-  Have = (double *)malloc(sizeofH);
-  temp = (double *)malloc(sizeofH);
+  const int oned = onedvpoints[E->mesh.nsd];
 
   noz = E->lmesh.noz;
-  noy = E->lmesh.noy;
   elz = E->lmesh.elz;
   elx = E->lmesh.elx;
   ely = E->lmesh.ely;
-  noz2 = 2*noz;
+
+  E->Have.dA = (double *)malloc((E->lmesh.nel*oned+1)*sizeof(double));
+  E->Have.dAtop = (double *)malloc((elx*ely*oned+1)*sizeof(double));
+  E->Have.area = (double *)malloc((noz+1)*sizeof(double));
+  temp = (double *)malloc((noz+1)*sizeof(double));
+
+  for (i=1;i<=noz;i++)
+    temp[i] = 0.0;
 
   for (i=1;i<=elz;i++)  {
-    temp[i] = temp[i+noz] = 0.0;
-    temp[i+1] = temp[i+1+noz] = 0.0;
     top = 0;
     if (i==elz) top = 1;
     for (m=1;m<=E->sphere.caps_per_proc;m++)
@@ -118,125 +150,126 @@ void return_horiz_ave(E,X,H)
           el = i + (j-1)*elz + (k-1)*elx*elz;
           get_global_1d_shape_fn(E,el,&M,&dGamma,top,m);
 
-          lnode[1] = E->ien[m][el].node[1];
-          lnode[2] = E->ien[m][el].node[2];
-          lnode[3] = E->ien[m][el].node[3];
-          lnode[4] = E->ien[m][el].node[4];
-
-          for(nint=1;nint<=onedvpoints[E->mesh.nsd];nint++)   {
-            for(d=1;d<=onedvpoints[E->mesh.nsd];d++)
-              temp[i] += X[m][lnode[d]] * E->M.vpt[GMVINDEX(d,nint)]
-                          * dGamma.vpt[GMVGAMMA(0,nint)];
-            temp[i+noz] += dGamma.vpt[GMVGAMMA(0,nint)];
+          for(nint=1;nint<=oned;nint++)   {
+            E->Have.dA[(el-1)*oned+nint] = dGamma.vpt[GMVGAMMA(0,nint)];
+            temp[i] += dGamma.vpt[GMVGAMMA(0,nint)];
             }
 
           if (i==elz)  {
-            lnode[1] = E->ien[m][el].node[5];
-            lnode[2] = E->ien[m][el].node[6];
-            lnode[3] = E->ien[m][el].node[7];
-            lnode[4] = E->ien[m][el].node[8];
-
-            for(nint=1;nint<=onedvpoints[E->mesh.nsd];nint++)   {
-              for(d=1;d<=onedvpoints[E->mesh.nsd];d++)
-                temp[i+1] += X[m][lnode[d]] * E->M.vpt[GMVINDEX(d,nint)]
-                          * dGamma.vpt[GMVGAMMA(1,nint)];
-              temp[i+1+noz] += dGamma.vpt[GMVGAMMA(1,nint)];
+            es = j + (k-1)*elx;
+            for(nint=1;nint<=oned;nint++)   {
+              E->Have.dAtop[(es-1)*oned+nint] = dGamma.vpt[GMVGAMMA(1,nint)];
+              temp[i+1] += dGamma.vpt[GMVGAMMA(1,nint)];
               }
+            }
+          }
+     }
 
-            }   /* end of if i==elz    */
-          }   /* end of j  and k, and m  */
-     }        /* Done for i */
-
-  MPI_Allreduce(temp,Have,noz2+1,MPI_DOUBLE,MPI_SUM,E->parallel.horizontal_comm);
+  MPI_Allreduce(&temp[1],&E->Have.area[1],noz,MPI_DOUBLE,MPI_SUM,
+                E->parallel.horizontal_comm);
 
-  for (i=1;i<=noz;i++) {
-    if(Have[i+noz] != 0.0)
-       H[i] = Have[i]/Have[i+noz];
-    }
- /* if (E->parallel.me==0)
-    for(i=1;i<=noz;i++)
-      fprintf(stderr,"area %d %d %g\n",E->parallel.me,i,Have[i+noz]);
-*/
-  free ((void *) Have);
   free ((void *) temp);
 
   return;
   }
 
-void return_horiz_ave_f(E,X,H)
+
+/* ===============================================
+   horizontal averages of nd double and nf float
+   nodal fields: Xd[f][m][node] --> Hd[f][layer],
+   Xf[f][m][node] --> Hf[f][layer]. All fields are integrated in one sweep over the
+   elements and summed by a single reduction. The
+   float fields are accumulated in double too.
+   =============================================== */
+
+void return_horiz_ave_fields(E,nd,Xd,Hd,nf,Xf,Hf)
      struct All_variables *E;
-     float **X, *H;
+     int nd,nf;
+     double ***Xd, **Hd;
+     float ***Xf, **Hf;
 {
-  const int dims = E->mesh.nsd;
-  int m,i,j,k,d,nint,noz,nox,noy,el,elz,elx,ely,j1,j2,i1,i2,k1,k2,nproc;
-  int top,lnode[5], sizeofH, noz2,iroot;
-  float *Have,*temp,aa[5];
-  struct Shape_function1 M;
-  struct Shape_function1_dA dGamma;
-  void get_global_1d_shape_fn();
+  int m,i,j,k,d,f,n,nint,noz,el,es,elz,elx,ely,lnode[5];
+  double *Have,*temp,*sum,w;
 
-  sizeofH = (2*E->lmesh.noz+2)*sizeof(float);
+  const int oned = onedvpoints[E->mesh.nsd];
+  const int nfield = nd+nf;
 
-  Have = (float *)malloc(sizeofH);
-  temp = (float *)malloc(sizeofH);
+  if (E->Have.dA == NULL)
+    set_horiz_ave_weights(E);
 
   noz = E->lmesh.noz;
-  noy = E->lmesh.noy;
   elz = E->lmesh.elz;
   elx = E->lmesh.elx;
   ely = E->lmesh.ely;
-  noz2 = 2*noz;
 
-  for (i=1;i<=elz;i++)  {
-    temp[i] = temp[i+noz] = 0.0;
-    temp[i+1] = temp[i+1+noz] = 0.0;
-    top = 0;
-    if (i==elz) top = 1;
+  Have = (double *)malloc((nfield*noz+1)*sizeof(double));
+  temp = (double *)malloc((nfield*noz+1)*sizeof(double));
+
+  /* temp[f*noz + i] is the integral of field f on layer i */
+  for (n=0;n<nfield*noz;n++)
+    temp[n] = 0.0;
+
+  for (i=1;i<=elz;i++)
     for (m=1;m<=E->sphere.caps_per_proc;m++)
       for (k=1;k<=ely;k++)
         for (j=1;j<=elx;j++)     {
           el = i + (j-1)*elz + (k-1)*elx*elz;
-          get_global_1d_shape_fn(E,el,&M,&dGamma,top,m);
 
           lnode[1] = E->ien[m][el].node[1];
           lnode[2] = E->ien[m][el].node[2];
           lnode[3] = E->ien[m][el].node[3];
           lnode[4] = E->ien[m][el].node[4];
 
-          for(nint=1;nint<=onedvpoints[E->mesh.nsd];nint++)   {
-            for(d=1;d<=onedvpoints[E->mesh.nsd];d++)
-              temp[i] += X[m][lnode[d]] * E->M.vpt[GMVINDEX(d,nint)]
-                          * dGamma.vpt[GMVGAMMA(0,nint)];
-            temp[i+noz] += dGamma.vpt[GMVGAMMA(0,nint)];
+          for(nint=1;nint<=oned;nint++)   {
+            w = E->Have.dA[(el-1)*oned+nint];
+            for(f=0;f<nd;f++) {
+              sum = &temp[f*noz + i-1];
+              for(d=1;d<=oned;d++)
+                *sum += Xd[f][m][lnode[d]] * E->M.vpt[GMVINDEX(d,nint)] * w;
+              }
+            for(f=0;f<nf;f++) {
+              sum = &temp[(nd+f)*noz + i-1];
+              for(d=1;d<=oned;d++)
+                *sum += Xf[f][m][lnode[d]] * E->M.vpt[GMVINDEX(d,nint)] * w;
+              }
             }
 
           if (i==elz)  {
+            es = j + (k-1)*elx;
+
             lnode[1] = E->ien[m][el].node[5];
             lnode[2] = E->ien[m][el].node[6];
             lnode[3] = E->ien[m][el].node[7];
             lnode[4] = E->ien[m][el].node[8];
 
-            for(nint=1;nint<=onedvpoints[E->mesh.nsd];nint++)   {
-              for(d=1;d<=onedvpoints[E->mesh.nsd];d++)
-                temp[i+1] += X[m][lnode[d]] * E->M.vpt[GMVINDEX(d,nint)]
-                          * dGamma.vpt[GMVGAMMA(1,nint)];
-              temp[i+1+noz] += dGamma.vpt[GMVGAMMA(1,nint)];
+            for(nint=1;nint<=oned;nint++)   {
+              w = E->Have.dAtop[(es-1)*oned+nint];
+              for(f=0;f<nd;f++) {
+                sum = &temp[f*noz + noz-1];
+                for(d=1;d<=oned;d++)
+                  *sum += Xd[f][m][lnode[d]] * E->M.vpt[GMVINDEX(d,nint)] * w;
+                }
+              for(f=0;f<nf;f++) {
+                sum = &temp[(nd+f)*noz + noz-1];
+                for(d=1;d<=oned;d++)
+                  *sum += Xf[f][m][lnode[d]] * E->M.vpt[GMVINDEX(d,nint)] * w;
+                }
               }
-
             }   /* end of if i==elz    */
-          }   /* end of j  and k, and m  */
-     }        /* Done for i */
-
-  MPI_Allreduce(temp,Have,noz2+1,MPI_FLOAT,MPI_SUM,E->parallel.horizontal_comm);
+          }   /* end of j  and k, and m, and i */
+
+  MPI_Allreduce(temp,Have,nfield*noz,MPI_DOUBLE,MPI_SUM,E->parallel.horizontal_comm);
+
+  for (f=0;f<nfield;f++)
+    for (i=1;i<=noz;i++) {
+      if(E->Have.area[i] == 0.0)
+        continue;
+      if(f<nd)
+        Hd[f][i] = Have[f*noz + i-1]/E->Have.area[i];
+      else
+        Hf[f-nd][i] = Have[f*noz + i-1]/E->Have.area[i];
+      }
 
-  for (i=1;i<=noz;i++) {
-    if(Have[i+noz] != 0.0)
-       H[i] = Have[i]/Have[i+noz];
-    }
- /* if (E->parallel.me==0)
-    for(i=1;i<=noz;i++)
-      fprintf(stderr,"area %d %d %g\n",E->parallel.me,i,Have[i+noz]);
-*/
   free ((void *) Have);
   free ((void *) temp);
 
@@ -434,31 +467,14 @@ void sum_across_surf_sph1(E,sphc,sphs)
 struct All_variables *E;
 float *sphc,*sphs;
 {
- int jumpp,total,j,d;
- float *sphcs,*temp;
-
- temp = (float *) malloc((E->sphere.hindice*2)*sizeof(float));
- sphcs = (float *) malloc((E->sphere.hindice*2)*sizeof(float));
-
- /* pack */
- jumpp = E->sphere.hindice;
- total = E->sphere.hindice*2;
- for (j=0;j<E->sphere.hindice;j++)   {
-   sphcs[j] = sphc[j];
-   sphcs[j+jumpp] = sphs[j];
- }
+ struct SPH_COMM *c = &E->sphere.coef_comm[0];
 
  /* sum across processors in horizontal direction */
- MPI_Allreduce(sphcs,temp,total,MPI_FLOAT,MPI_SUM,E->parallel.horizontal_comm);
-
- /* unpack */
- for (j=0;j<E->sphere.hindice;j++)   {
-   sphc[j] = temp[j];
-   sphs[j] = temp[j+jumpp];
- }
-
- free((void *)temp);
- free((void *)sphcs);
+ c->nfield = 1;
+ c->sphc[0] = sphc;
+ c->sphs[0] = sphs;
+ sph_coef_sum(E,c,E->parallel.horizontal_comm);
+ sph_coef_wait(E,c);
 
  return;
 }
@@ -473,24 +489,15 @@ float global_fvdot(E,A,B,lev)
 
 {
   int m,i,neq;
-  float prod, temp,temp1;
-
-  neq=E->lmesh.NEQ[lev];
+  float prod, temp;
 
   temp = 0.0;
-  temp1 = 0.0;
   prod = 0.0;
   for (m=1;m<=E->sphere.caps_per_proc;m++)  {
-    neq=E->lmesh.NEQ[lev];
-    temp1 = 0.0;
+    /* owned equations only, see construct_id() */
+    neq=E->lmesh.NEQ[lev]-E->parallel.Skip_neq[lev][m];
     for (i=0;i<neq;i++)
       temp += A[m][i]*B[m][i];
-
-    for (i=1;i<=E->parallel.Skip_neq[lev][m];i++)
-       temp1 += A[m][E->parallel.Skip_id[lev][m][i]]*B[m][E->parallel.Skip_id[lev][m][i]];
-
-    temp -= temp1;
-
     }
 
   MPI_Allreduce(&temp, &prod,1,MPI_FLOAT,MPI_SUM,E->parallel.world);
@@ -506,24 +513,16 @@ double kineticE_radial(E,A,lev)
 
 {
   int m,i,neq;
-  double prod, temp,temp1;
+  double prod, temp;
 
     temp = 0.0;
     prod = 0.0;
 
   for (m=1;m<=E->sphere.caps_per_proc;m++)  {
-    neq=E->lmesh.NEQ[lev];
-    temp1 = 0.0;
-    for (i=0;i<neq;i++)
-      if ((i+1)%3==0)
-        temp += A[m][i]*A[m][i];
-
-    for (i=1;i<=E->parallel.Skip_neq[lev][m];i++)
-      if ((E->parallel.Skip_id[lev][m][i]+1)%3==0)
-        temp1 += A[m][E->parallel.Skip_id[lev][m][i]]*A[m][E->parallel.Skip_id[lev][m][i]];
-
-    temp -= temp1;
-
+    /* owned equations only, radial component of each node */
+    neq=E->lmesh.NEQ[lev]-E->parallel.Skip_neq[lev][m];
+    for (i=2;i<neq;i+=3)
+      temp += A[m][i]*A[m][i];
     }
 
   MPI_Allreduce(&temp, &prod,1,MPI_DOUBLE,MPI_SUM,E->parallel.world);
@@ -538,22 +537,16 @@ double global_vdot(E,A,B,lev)
 
 {
   int m,i,neq;
-  double prod, temp,temp1;
+  double prod, temp;
 
     temp = 0.0;
     prod = 0.0;
 
   for (m=1;m<=E->sphere.caps_per_proc;m++)  {
-    neq=E->lmesh.NEQ[lev];
-    temp1 = 0.0;
+    /* owned equations only, see construct_id() */
+    neq=E->lmesh.NEQ[lev]-E->parallel.Skip_neq[lev][m];
     for (i=0;i<neq;i++)
       temp += A[m][i]*B[m][i];
-
-    for (i=1;i<=E->parallel.Skip_neq[lev][m];i++)
-       temp1 += A[m][E->parallel.Skip_id[lev][m][i]]*B[m][E->parallel.Skip_id[lev][m][i]];
-
-    temp -= temp1;
-
     }
 
   MPI_Allreduce(&temp, &prod,1,MPI_DOUBLE,MPI_SUM,E->parallel.world);
@@ -562,40 +555,33 @@ double global_vdot(E,A,B,lev)
 }
 
 
-double global_pdot(E,A,B,lev)
+static double local_pdot(E,A,B,lev)
    struct All_variables *E;
    double **A,**B;
    int lev;
 
 {
   int i,m,npno;
-  double prod, temp;
-
-  npno=E->lmesh.NPNO[lev];
+  double temp;
 
   temp = 0.0;
-  prod = 0.0;
   for (m=1;m<=E->sphere.caps_per_proc;m++)  {
     npno=E->lmesh.NPNO[lev];
     for (i=1;i<=npno;i++)
       temp += A[m][i]*B[m][i];
     }
 
-  MPI_Allreduce(&temp, &prod,1,MPI_DOUBLE,MPI_SUM,E->parallel.world);
-
-  return (prod);
+  return (temp);
 }
 
 
-/* return ||V||^2 */
-double global_v_norm2(struct All_variables *E,  double **V)
+static double local_v_norm2(struct All_variables *E,  double **V)
 {
-    int i, m, d;
+    int i, m;
     int eqn1, eqn2, eqn3;
-    double prod, temp;
+    double temp;
 
     temp = 0.0;
-    prod = 0.0;
     for (m=1; m<=E->sphere.caps_per_proc; m++)
         for (i=1; i<=E->lmesh.nno; i++) {
             eqn1 = E->id[m][i].doff[1];
@@ -607,40 +593,32 @@ double global_v_norm2(struct All_variables *E,  double **V)
                      V[m][eqn3] * V[m][eqn3]) * E->NMass[m][i];
         }
 
-    MPI_Allreduce(&temp, &prod, 1, MPI_DOUBLE, MPI_SUM, E->parallel.world);
-
-    return (prod/E->mesh.volume);
+    return (temp);
 }
 
 
-/* return ||P||^2 */
-double global_p_norm2(struct All_variables *E,  double **P)
+static double local_p_norm2(struct All_variables *E,  double **P)
 {
     int i, m;
-    double prod, temp;
+    double temp;
 
     temp = 0.0;
-    prod = 0.0;
     for (m=1; m<=E->sphere.caps_per_proc; m++)
         for (i=1; i<=E->lmesh.npno; i++) {
             /* L2 norm */
             temp += P[m][i] * P[m][i] * E->eco[m][i].area;
         }
 
-    MPI_Allreduce(&temp, &prod, 1, MPI_DOUBLE, MPI_SUM, E->parallel.world);
-
-    return (prod/E->mesh.volume);
+    return (temp);
 }
 
 
-/* return ||A||^2, where A_i is \int{div(u) d\Omega_i} */
-double global_div_norm2(struct All_variables *E,  double **A)
+static double local_div_norm2(struct All_variables *E,  double **A)
 {
     int i, m;
-    double prod, temp;
+    double temp;
 
     temp = 0.0;
-    prod = 0.0;
     for (m=1; m<=E->sphere.caps_per_proc; m++)
         for (i=1; i<=E->lmesh.npno; i++) {
             /* L2 norm of div(u) */
@@ -650,12 +628,141 @@ double global_div_norm2(struct All_variables *E,  double **A)
             /*temp += fabs(A[m][i]);*/
         }
 
+    return (temp);
+}
+
+
+double global_pdot(E,A,B,lev)
+   struct All_variables *E;
+   double **A,**B;
+   int lev;
+
+{
+  double prod, temp;
+
+  temp = local_pdot(E,A,B,lev);
+  prod = 0.0;
+
+  MPI_Allreduce(&temp, &prod,1,MPI_DOUBLE,MPI_SUM,E->parallel.world);
+
+  return (prod);
+}
+
+
+/* return ||V||^2 */
+double global_v_norm2(struct All_variables *E,  double **V)
+{
+    double prod, temp;
+
+    temp = local_v_norm2(E, V);
+    prod = 0.0;
+
     MPI_Allreduce(&temp, &prod, 1, MPI_DOUBLE, MPI_SUM, E->parallel.world);
 
     return (prod/E->mesh.volume);
 }
 
 
+/* return ||P||^2 */
+double global_p_norm2(struct All_variables *E,  double **P)
+{
+    double prod, temp;
+
+    temp = local_p_norm2(E, P);
+    prod = 0.0;
+
+    MPI_Allreduce(&temp, &prod, 1, MPI_DOUBLE, MPI_SUM, E->parallel.world);
+
+    return (prod/E->mesh.volume);
+}
+
+
+/* return ||A||^2, where A_i is \int{div(u) d\Omega_i} */
+double global_div_norm2(struct All_variables *E,  double **A)
+{
+    double prod, temp;
+
+    temp = local_div_norm2(E, A);
+    prod = 0.0;
+
+    MPI_Allreduce(&temp, &prod, 1, MPI_DOUBLE, MPI_SUM, E->parallel.world);
+
+    return (prod/E->mesh.volume);
+}
+
+
+/* ==================================================
+   Batched global sums.  A solver adds the local parts of
+   several independent sums, then gets all of them with one
+   MPI_Allreduce in flush_global_sums():
+
+     i = add_global_pdot(E, A, B, lev);
+     j = add_global_v_norm2(E, V);
+     flush_global_sums(E);
+     ... get_global_sum(E, i) ... get_global_sum(E, j) ...
+
+   The results are the same as global_pdot() and global_v_norm2().
+   ================================================== */
+
+int add_global_sum(struct All_variables *E, double local, double scale)
+{
+    const int n = E->parallel.nsums;
+
+    if (n >= MAX_GLOBAL_SUMS)
+        myerror(E, "add_global_sum: too many batched global sums");
+
+    E->parallel.sum_local[n] = local;
+    E->parallel.sum_scale[n] = scale;
+    E->parallel.nsums++;
+
+    return n;
+}
+
+
+int add_global_pdot(struct All_variables *E, double **A, double **B, int lev)
+{
+    return add_global_sum(E, local_pdot(E, A, B, lev), 1.0);
+}
+
+
+int add_global_v_norm2(struct All_variables *E, double **V)
+{
+    return add_global_sum(E, local_v_norm2(E, V), E->mesh.volume);
+}
+
+
+int add_global_p_norm2(struct All_variables *E, double **P)
+{
+    return add_global_sum(E, local_p_norm2(E, P), E->mesh.volume);
+}
+
+
+int add_global_div_norm2(struct All_variables *E, double **A)
+{
+    return add_global_sum(E, local_div_norm2(E, A), E->mesh.volume);
+}
+
+
+void flush_global_sums(struct All_variables *E)
+{
+    if (E->parallel.nsums == 0) return;
+
+    MPI_Allreduce(E->parallel.sum_local, E->parallel.sum_global,
+                  E->parallel.nsums, MPI_DOUBLE, MPI_SUM, E->parallel.world);
+
+    E->parallel.nsums = 0;
+    E->parallel.num_reductions++;
+
+    return;
+}
+
+
+double get_global_sum(struct All_variables *E, int i)
+{
+    return E->parallel.sum_global[i] / E->parallel.sum_scale[i];
+}
+
+
 double global_tdot_d(E,A,B,lev)
    struct All_variables *E;
    double **A,**B;
@@ -807,37 +914,17 @@ void sum_across_depth_sph1(E,sphc,sphs)
      struct All_variables *E;
      float *sphc,*sphs;
 {
-    int jumpp,total,j;
-
-    float *sphcs,*temp;
+    struct SPH_COMM *c = &E->sphere.coef_comm[0];
 
     if (E->parallel.nprocz > 1)  {
-	total = E->sphere.hindice*2;
-	temp = (float *) malloc(total*sizeof(float));
-	sphcs = (float *) malloc(total*sizeof(float));
-
-	/* pack sphc[] and sphs[] into sphcs[] */
-	jumpp = E->sphere.hindice;
-	for (j=0;j<E->sphere.hindice;j++)   {
-	    sphcs[j] = sphc[j];
-	    sphcs[j+jumpp] = sphs[j];
-	}
-
 	/* sum across processors in z direction */
-	MPI_Allreduce(sphcs, temp, total, MPI_FLOAT, MPI_SUM,
-		      E->parallel.vertical_comm);
-
-	/* unpack */
-	for (j=0;j<E->sphere.hindice;j++)   {
-	    sphc[j] = temp[j];
-	    sphs[j] = temp[j+jumpp];
-	}
-
-	free(temp);
-	free(sphcs);
+	c->nfield = 1;
+	c->sphc[0] = sphc;
+	c->sphs[0] = sphs;
+	sph_coef_sum(E,c,E->parallel.vertical_comm);
+	sph_coef_wait(E,c);
     }
 
-
     return;
 }
 
@@ -848,34 +935,121 @@ void broadcast_vertical(struct All_variables *E,
                         float *sphc, float *sphs,
                         int root)
 {
-    int jumpp, total, j;
-    float *temp;
+    struct SPH_COMM *c = &E->sphere.coef_comm[0];
 
     if(E->parallel.nprocz == 1) return;
 
-    jumpp = E->sphere.hindice;
-    total = E->sphere.hindice*2;
-    temp = (float *) malloc(total*sizeof(float));
+    c->nfield = 1;
+    c->sphc[0] = sphc;
+    c->sphs[0] = sphs;
+    c->root[0] = root;
+    sph_coef_bcast(E,c,E->parallel.vertical_comm);
+    sph_coef_wait(E,c);
+
+    return;
+}
+
+
+/* ==================================================
+   Batched, nonblocking exchange of the spherical
+   harmonic coefficients of c->nfield fields. The
+   caller fills c->sphc[], c->sphs[] (and c->root[]
+   for a broadcast), posts the exchange, may do other
+   work that leaves these arrays alone, and then calls
+   sph_coef_wait() to get the results in place.
+   ================================================== */
 
-    if (E->parallel.me_loc[3] == root) {
-        /* pack */
+void sph_coef_sum(struct All_variables *E, struct SPH_COMM *c,
+                  MPI_Comm comm)
+{
+    int f, j;
+    const int jumpp = E->sphere.hindice;
+    const int total = 2*E->sphere.hindice;
+
+    /* pack */
+    for (f=0; f<c->nfield; f++)
         for (j=0; j<E->sphere.hindice; j++)   {
-            temp[j] = sphc[j];
-            temp[j+jumpp] = sphs[j];
+            c->sbuf[f*total+j] = c->sphc[f][j];
+            c->sbuf[f*total+j+jumpp] = c->sphs[f][j];
+        }
+
+    c->bcast = 0;
+#if MPI_VERSION >= 3
+    MPI_Iallreduce(c->sbuf, c->rbuf, c->nfield*total, MPI_FLOAT, MPI_SUM,
+                   comm, &c->req[0]);
+    c->nreq = 1;
+#else
+    MPI_Allreduce(c->sbuf, c->rbuf, c->nfield*total, MPI_FLOAT, MPI_SUM,
+                  comm);
+    c->nreq = 0;
+#endif
+
+    return;
+}
+
+
+void sph_coef_bcast(struct All_variables *E, struct SPH_COMM *c,
+                    MPI_Comm comm)
+{
+    int f, j;
+    float *buf;
+    const int jumpp = E->sphere.hindice;
+    const int total = 2*E->sphere.hindice;
+
+    MPI_Comm_rank(comm, &c->rank);
+    c->bcast = 1;
+
+    for (f=0; f<c->nfield; f++) {
+        buf = c->rbuf + f*total;
+
+        if (c->rank == c->root[f]) {
+            /* pack */
+            for (j=0; j<E->sphere.hindice; j++)   {
+                buf[j] = c->sphc[f][j];
+                buf[j+jumpp] = c->sphs[f][j];
+            }
         }
+
+#if MPI_VERSION >= 3
+        MPI_Ibcast(buf, total, MPI_FLOAT, c->root[f], comm, &c->req[f]);
+#else
+        MPI_Bcast(buf, total, MPI_FLOAT, c->root[f], comm);
+#endif
     }
 
-    MPI_Bcast(temp, total, MPI_FLOAT, root, E->parallel.vertical_comm);
+#if MPI_VERSION >= 3
+    c->nreq = c->nfield;
+#else
+    c->nreq = 0;
+#endif
+
+    return;
+}
+
+
+void sph_coef_wait(struct All_variables *E, struct SPH_COMM *c)
+{
+    int f, j;
+    float *buf;
+    const int jumpp = E->sphere.hindice;
+    const int total = 2*E->sphere.hindice;
+
+    if (c->nreq > 0)
+        MPI_Waitall(c->nreq, c->req, MPI_STATUSES_IGNORE);
+
+    /* unpack */
+    for (f=0; f<c->nfield; f++) {
+        if (c->bcast && c->rank == c->root[f]) continue;
 
-    if (E->parallel.me_loc[3] != root) {
-        /* unpack */
+        buf = c->rbuf + f*total;
         for (j=0; j<E->sphere.hindice; j++)   {
-            sphc[j] = temp[j];
-            sphs[j] = temp[j+jumpp];
+            c->sphc[f][j] = buf[j];
+            c->sphs[f][j] = buf[j+jumpp];
         }
     }
 
-    free((void *)temp);
+    c->nfield = 0;
+    c->nreq = 0;
 
     return;
 }
@@ -327,6 +327,12 @@ void read_initial_settings(struct All_variables *E)
   input_int("nprocx",&(E->parallel.nprocx),"1",m);
   input_int("nprocy",&(E->parallel.nprocy),"1",m);
   input_int("nprocz",&(E->parallel.nprocz),"1",m);
+  /* exchange the halo with the processors on the same node through */
+  /* MPI-3 shared memory instead of messages */
+  input_boolean("shared_memory_halo",&(E->parallel.shm_halo),"off",m);
+  /* exchange the halo with the other processors by neighborhood */
+  /* collectives on a distributed graph */
+  input_boolean("neighbor_collectives",&(E->parallel.neighbor_coll),"on",m);
 
   if (E->control.CONJ_GRAD) {
       input_int("nodex",&(E->mesh.nox),"essential",m);
@@ -409,6 +415,9 @@ void read_initial_settings(struct All_variables *E)
   input_boolean("restart",&(E->control.restart),"off",m);
   input_int("post_p",&(E->control.post_p),"0",m);
   input_int("solution_cycles_init",&(E->monitor.solution_cycles_init),"0",m);
+  /* on restart, use the radial layers of processors suggested by the
+     checkpoint, which balance the elements and tracers */
+  input_boolean("radial_repartition",&(E->parallel.radial_repartition),"off",m);
 
   /* for layers    */
 
@@ -675,6 +684,17 @@ void read_initial_settings(struct All_variables *E)
   input_int("max_mg_cycles",&(E->control.max_mg_cycles),"50,0,nomax",m);
   input_int("piterations",&(E->control.p_iterations),"100,0,nomax",m);
 
+  /* skip (or cheaply correct) the Stokes solve when the buoyancy
+     has hardly changed since the last full solve */
+  input_boolean("stokes_skip",&(E->control.stokes_skip),"off",m);
+  input_double("stokes_skip_tol",&(E->control.stokes_skip_tol),"1.0e-3,0.0",m);
+  input_int("stokes_skip_max",&(E->control.stokes_skip_max),"10,1,nomax",m);
+  input_int("stokes_skip_piterations",&(E->control.stokes_skip_piterations),"0,0,nomax",m);
+  E->control.stokes_skip_count = 0;
+  E->control.stokes_full_solves = 0;
+  E->control.stokes_corrections = 0;
+  E->control.stokes_skips = 0;
+
   input_float("rayleigh",&(E->control.Atemp),"essential",m);
 
   input_float("dissipation_number",&(E->control.disptn_number),"0.0",m);
@@ -958,6 +978,8 @@ void allocate_common_vars(E)
   E->T[j]        = (double *) malloc((nno+1)*sizeof(double));
   E->NP[j]       = (float *) malloc((nno+1)*sizeof(float));
   E->buoyancy[j] = (double *) malloc((nno+1)*sizeof(double));
+  if(E->control.stokes_skip)
+    E->buoyancy_last[j] = (double *) malloc((nno+1)*sizeof(double));
 
   E->gstress[j] = (float *) malloc((6*nno+1)*sizeof(float));
   // TWB do we need this anymore XXX
@@ -1004,6 +1026,7 @@ void allocate_common_vars(E)
   E->Have.T         = (float *)malloc((E->lmesh.noz+2)*sizeof(float));
   E->Have.V[1]      = (float *)malloc((E->lmesh.noz+2)*sizeof(float));
   E->Have.V[2]      = (float *)malloc((E->lmesh.noz+2)*sizeof(float));
+  E->Have.dA        = NULL;
 
   E->sphere.gr = (double *)malloc((E->mesh.noz+1)*sizeof(double));
 
@@ -1215,7 +1238,6 @@ void allocate_velocity_vars(E)
       k = (E->lmesh.NOX[l]*E->lmesh.NOZ[l]+E->lmesh.NOX[l]*E->lmesh.NOY[l]+
           E->lmesh.NOY[l]*E->lmesh.NOZ[l])*6;
       E->zero_resid[l][j] = (int *) malloc((k+2)*sizeof(int));
-      E->parallel.Skip_id[l][j] = (int *) malloc((k+2)*sizeof(int));
 
       for(i=0;i<E->lmesh.NEQ[l];i++) {
          E->BI[l][j][i]=0.0;
@@ -1471,6 +1493,8 @@ void initial_velocity(E)
         E->sphere.cap[m].V[3][i]=0.0;
         }
 
+    E->monitor.velocity_updates++;
+
     return;
 }
 
@@ -1798,14 +1822,18 @@ void output_init(struct  All_variables *E)
         E->problem_output = h5output;
     else if (strcmp(E->output.format, "vtk") == 0)
         E->problem_output = vtk_output;
+    else if (strcmp(E->output.format, "binary") == 0)
+        E->problem_output = binary_output;
+    else if (strcmp(E->output.format, "mpiio") == 0)
+        E->problem_output = mpiio_output;
 #ifdef USE_GZDIR
     else if (strcmp(E->output.format, "ascii-gz") == 0)
         E->problem_output = gzdir_output;
     else {
         /* indicate error here */
         if (E->parallel.me == 0) {
-            fprintf(stderr, "wrong output_format, must be 'ascii', 'hdf5', 'ascii-gz' or 'vtk'\n");
-            fprintf(E->fp, "wrong output_format, must be  'ascii', 'hdf5' 'ascii-gz', or 'vtk'\n");
+            fprintf(stderr, "wrong output_format, must be 'ascii', 'hdf5', 'ascii-gz', 'binary', 'mpiio' or 'vtk'\n");
+            fprintf(E->fp, "wrong output_format, must be  'ascii', 'hdf5' 'ascii-gz', 'binary', 'mpiio', or 'vtk'\n");
         }
         parallel_process_termination();
     }
@@ -1813,13 +1841,35 @@ void output_init(struct  All_variables *E)
     else {
         /* indicate error here */
         if (E->parallel.me == 0) {
-            fprintf(stderr, "wrong output_format, must be 'ascii', 'hdf5', or 'vtk' (USE_GZDIR undefined)\n");
-            fprintf(E->fp, "wrong output_format, must be 'ascii', 'hdf5', or 'vtk' (USE_GZDIR undefined)\n");
+            fprintf(stderr, "wrong output_format, must be 'ascii', 'hdf5', 'binary', 'mpiio', or 'vtk' (USE_GZDIR undefined)\n");
+            fprintf(E->fp, "wrong output_format, must be 'ascii', 'hdf5', 'binary', 'mpiio', or 'vtk' (USE_GZDIR undefined)\n");
         }
         parallel_process_termination();
     }
 #endif
 
+    if (E->output.async) {
+#ifdef USE_PTHREADS
+        if (E->problem_output == output)
+            E->problem_output = async_ascii_output;
+        else if (E->problem_output == binary_output)
+            E->problem_output = async_binary_output;
+        else {
+            if (E->parallel.me == 0) {
+                fprintf(stderr, "output_async=on needs output_format 'ascii' or 'binary'\n");
+                fprintf(E->fp, "output_async=on needs output_format 'ascii' or 'binary'\n");
+            }
+            parallel_process_termination();
+        }
+#else
+        if (E->parallel.me == 0) {
+            fprintf(stderr, "output_async=on needs POSIX threads (USE_PTHREADS undefined)\n");
+            fprintf(E->fp, "output_async=on needs POSIX threads (USE_PTHREADS undefined)\n");
+        }
+        parallel_process_termination();
+#endif
+    }
+
     output_parse_optional(E);
 }
 
@@ -1828,6 +1878,14 @@ void output_init(struct  All_variables *E)
 void output_finalize(struct  All_variables *E)
 {
   char message[255],files[255];
+
+  /* closes the time-series file and logs the I/O time to E->fp */
+  if (strcmp(E->output.format, "hdf5") == 0)
+    h5output_finalize(E);
+
+  /* writes the last staged snapshots */
+  async_output_finalize(E);
+
   if (E->fp)
     fclose(E->fp);
   if (E->fptime)
@@ -1931,6 +1989,8 @@ void print_all_config_parameters(struct All_variables *E)
     fprintf(fp, "nprocx=%d\n", E->parallel.nprocx);
     fprintf(fp, "nprocy=%d\n", E->parallel.nprocy);
     fprintf(fp, "nprocz=%d\n", E->parallel.nprocz);
+    fprintf(fp, "shared_memory_halo=%d\n", E->parallel.shm_halo);
+    fprintf(fp, "neighbor_collectives=%d\n", E->parallel.neighbor_coll);
     fprintf(fp, "coor=%d\n", E->control.coor);
     fprintf(fp, "coor_file=%s\n", E->control.coor_file);
     fprintf(fp, "coor_refine=");
@@ -1984,6 +2044,11 @@ void print_all_config_parameters(struct All_variables *E)
     fprintf(fp, "adv_gamma=%f\n", E->advection.gamma);
     fprintf(fp, "adv_sub_iterations=%d\n", E->advection.temp_iterations);
     fprintf(fp, "inputdiffusivity=%f\n", E->control.inputdiff);
+    fprintf(fp, "pg_cache=%d\n", E->advection.pg_cache);
+    fprintf(fp, "pg_cache_max_mb=%f\n", E->advection.pg_cache_max_mb);
+    fprintf(fp, "implicit_diffusion=%d\n", E->advection.implicit_diffusion);
+    fprintf(fp, "implicit_diffusion_tol=%g\n", E->advection.implicit_diffusion_tol);
+    fprintf(fp, "implicit_diffusion_maxiter=%d\n", E->advection.implicit_diffusion_maxiter);
     fprintf(fp, "\n\n");
 
     fprintf(fp, "# CitcomS.solver.vsolver\n");
@@ -2000,6 +2065,10 @@ void print_all_config_parameters(struct All_variables *E)
     fprintf(fp, "vhighstep=%d\n", E->control.v_steps_high);
     fprintf(fp, "max_mg_cycles=%d\n", E->control.max_mg_cycles);
     fprintf(fp, "piterations=%d\n", E->control.p_iterations);
+    fprintf(fp, "stokes_skip=%d\n", E->control.stokes_skip);
+    fprintf(fp, "stokes_skip_tol=%g\n", E->control.stokes_skip_tol);
+    fprintf(fp, "stokes_skip_max=%d\n", E->control.stokes_skip_max);
+    fprintf(fp, "stokes_skip_piterations=%d\n", E->control.stokes_skip_piterations);
     fprintf(fp, "aug_lagr=%d\n", E->control.augmented_Lagr);
     fprintf(fp, "aug_number=%g\n", E->control.augmented);
     fprintf(fp, "remove_rigid_rotation=%d\n", E->control.remove_rigid_rotation);
@@ -2053,6 +2122,7 @@ void print_all_config_parameters(struct All_variables *E)
     fprintf(fp, "restart=%d\n", E->control.restart);
     fprintf(fp, "post_p=%d\n", E->control.post_p);
     fprintf(fp, "solution_cycles_init=%d\n", E->monitor.solution_cycles_init);
+    fprintf(fp, "radial_repartition=%d\n", E->parallel.radial_repartition);
     fprintf(fp, "zero_elapsed_time=%d\n", E->control.zero_elapsed_time);
     fprintf(fp, "tic_method=%d\n", E->convection.tic_method);
     fprintf(fp, "num_perturbations=%d\n", E->convection.number_of_perturbations);
@@ -2101,12 +2171,16 @@ void print_all_config_parameters(struct All_variables *E)
     fprintf(fp, "use_cbf_topo=%d\n", E->control.use_cbf_topo);
     fprintf(fp, "cb_block_size=%d\n", E->output.cb_block_size);
     fprintf(fp, "cb_buffer_size=%d\n", E->output.cb_buffer_size);
+    fprintf(fp, "cb_nodes=%d\n", E->output.cb_nodes);
+    fprintf(fp, "output_async=%d\n", E->output.async);
     fprintf(fp, "sieve_buf_size=%d\n", E->output.sieve_buf_size);
     fprintf(fp, "output_alignment=%d\n", E->output.alignment);
     fprintf(fp, "output_alignment_threshold=%d\n", E->output.alignment_threshold);
     fprintf(fp, "cache_mdc_nelmts=%d\n", E->output.cache_mdc_nelmts);
     fprintf(fp, "cache_rdcc_nelmts=%d\n", E->output.cache_rdcc_nelmts);
     fprintf(fp, "cache_rdcc_nbytes=%d\n", E->output.cache_rdcc_nbytes);
+    fprintf(fp, "output_time_series=%d\n", E->output.time_series);
+    fprintf(fp, "output_flush_spacing=%d\n", E->output.flush_spacing);
     fprintf(fp, "write_q_files=%d\n", E->output.write_q_files);
     fprintf(fp, "vtk_format=%s\n", E->output.vtk_format);
     fprintf(fp, "gzdir_vtkio=%d\n", E->output.gzdir.vtk_io);
@@ -2174,8 +2248,23 @@ void print_all_config_parameters(struct All_variables *E)
       fprintf(fp, "\n");
     }
     fprintf(fp, "itracer_warnings=%d\n", E->trace.itracer_warnings);
+    fprintf(fp, "tracer_sort_spacing=%d\n", E->trace.sort_spacing);
+    fprintf(fp, "tracer_batch_velocity=%d\n", E->trace.batch_velocity);
+    fprintf(fp, "tracer_hugepages=%d\n", E->trace.hugepages);
+    fprintf(fp, "tracer_integrator=%d\n", E->trace.integrator);
+    fprintf(fp, "tracer_velocity_extrapolation=%d\n", E->trace.extrapolate_velocity);
+    fprintf(fp, "tracer_courant=%g\n", E->trace.courant);
+    fprintf(fp, "tracer_min_per_element=%d\n", E->trace.min_per_element);
+    fprintf(fp, "tracer_max_per_element=%d\n", E->trace.max_per_element);
+    fprintf(fp, "tracer_load_report=%d\n", E->trace.load_report);
+    fprintf(fp, "tracer_cost_weight=%g\n", E->trace.cost_weight);
     fprintf(fp, "regular_grid_deltheta=%g\n", E->trace.deltheta[0]);
     fprintf(fp, "regular_grid_delphi=%g\n", E->trace.delphi[0]);
+    fprintf(fp, "tracer_uv_index=%d\n", E->trace.uv_index);
+    fprintf(fp, "tracer_uv_refine=%d\n", E->trace.uv_refine);
+    fprintf(fp, "tracer_location_benchmark=%d\n", E->trace.location_benchmark);
+    fprintf(fp, "tracer_neighbor_exchange=%d\n", E->trace.neighbor_exchange);
+    fprintf(fp, "analytical_tracer_test=%d\n", E->trace.ianalytical_tracer_test);
     fprintf(fp, "chemical_buoyancy=%d\n", E->composition.ichemical_buoyancy);
     fprintf(fp, "buoy_type=%d\n", E->composition.ibuoy_type);
     fprintf(fp, "buoyancy_ratio=");
@@ -56,6 +56,8 @@ void v_from_vector(E)
         }
     }
 
+    E->monitor.velocity_updates++;
+
     return;
 }
 
@@ -115,6 +117,8 @@ void v_from_vector_pseudo_surf(E)
 
     }
 
+    E->monitor.velocity_updates++;
+
     return;
 }
 /* cartesian velocities within element, single prec version */
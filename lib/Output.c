@@ -94,6 +94,19 @@ void output_common_input(struct All_variables *E)
       //      E->output.gzdir.vtk_io,E->output.gzdir.vtk_base_save);
     }
 
+    /* collective buffering hints of the MPI-IO output, also read */
+    /* by h5input_params() for hdf5 */
+    E->output.cb_nodes = 0;
+    if(strcmp(E->output.format, "mpiio") == 0) {
+        input_int("cb_block_size", &(E->output.cb_block_size), "1048576", m);
+        input_int("cb_buffer_size", &(E->output.cb_buffer_size), "4194304", m);
+        input_int("cb_nodes", &(E->output.cb_nodes), "0", m);
+    }
+
+    /* write the ascii or binary snapshots in an I/O thread */
+    input_boolean("output_async", &(E->output.async), "off", m);
+    E->output.async_state = NULL;
+
     if(strcmp(E->output.format, "vtk") == 0) {
         input_string("vtk_format", E->output.vtk_format, "ascii",m);
         if (strcmp(E->output.vtk_format, "binary") != 0 &&
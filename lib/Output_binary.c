@@ -0,0 +1,1261 @@
+/*
+ *~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
+ *<LicenseText>
+ *
+ * CitcomS by Louis Moresi, Shijie Zhong, Lijie Han, Eh Tan,
+ * Clint Conrad, Michael Gurnis, and Eun-seo Choi.
+ * Copyright (C) 1994-2005, California Institute of Technology.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *</LicenseText>
+ *
+ *~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ */
+/* Routine to write each output cycle as one binary snapshot file per
+   processor, instead of one ASCII file per field (output_format=binary).
+
+   The file is little-endian:
+
+     char      magic[8]         "CITSNAP"
+     int32     guard            0x12345678
+     int32     version          SNAP_VERSION
+     int32     cycle, rank
+     double    time
+     int32     nno, nel, nsf, nox, noy, noz, ncomp, nfield
+     nfield x  { char name[24]; int32 size (4: float, 8: double);
+                 int32 ncomp, n, 0; int64 offset }
+     blocks
+
+   Each field has ncomp blocks of n values, one block per component,
+   starting at offset bytes from the beginning of the file.  Every
+   block starts at a multiple of 8 bytes, so that the file can be
+   mmap'ed and used in place on little-endian machines.
+
+   With output_format=mpiio, the snapshots of all processors are
+   written into one shared file per cycle, datafile.mpiio.cycle:
+
+     char      magic[8]         "CITSHARE"
+     int32     guard, version, cycle, nproc
+     double    time
+     int32     nno, nel, nsf, nox, noy, noz, ncomp, nfield
+                                (of processor 0)
+     int32     ncaps, nprocx, nprocy, nprocz,
+               nox, noy, noz    (of one cap)
+     int32     header_size
+     nfield x  { char name[24]; int32 size, ncomp, n, scope, radial, 0;
+                 int64 offset }
+     int32     rank[nproc]      processor of each slot
+     int32     layer_elz[nprocz]
+                                radial elements of each layer of
+                                processors, from the bottom
+     blocks
+
+   A field has a slot for each processor holding it (see scope), and
+   a slot has the ncomp blocks of that processor, as above.  The slots
+   are ordered by cap, then by the radial, y and x position of the
+   processor in the cap, so that a cap or a range of radial layers of
+   processors is a contiguous piece of the file.  The layers need not
+   be even (see radial_repartition), so the size of a slot depends on
+   the layer: in layer k, a field holds n values per component if
+   radial is 0, n*(layer_elz[k]+1) if it is nodal (radial 1) and
+   n*layer_elz[k] if it is per element (radial 2).
+
+   visual/snap2ascii converts both kinds of files back to the ASCII
+   files that output() would have written.
+
+   The snapshot is also the unit of the asynchronous output
+   (output_async=on, see below), which writes it either as these
+   binary files or as the ASCII files of output().  */
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <mpi.h>
+#include "element_definitions.h"
+#include "global_defs.h"
+#include "output.h"
+
+#define SNAP_VERSION 1
+#define SNAP_HEADER_SIZE 64
+#define SNAP_FIELD_SIZE 48
+#define SHARED_HEADER_SIZE 96
+#define SHARED_FIELD_SIZE 56
+#define SNAP_MAX_FIELDS 20
+
+void output_geoid(struct All_variables *, int);
+void output_horiz_avg(struct All_variables *, int);
+void output_tracer(struct All_variables *, int);
+
+extern void parallel_process_termination();
+extern double CPU_time0();
+extern void heat_flux(struct All_variables *);
+extern void get_STD_topo(struct All_variables *, float**, float**,
+                         float**, float**, int);
+extern void get_CBF_topo(struct All_variables *, float**, float**);
+extern void allocate_STD_mem(struct All_variables *, float**, float**,
+                             float**, float**, float**, float**,
+                             float**, float**);
+extern void compute_nodal_stress(struct All_variables *, float**, float**,
+                                 float**, float**, float**, float**,
+                                 float**, float**);
+extern void free_STD_mem(struct All_variables *, float**, float**,
+                         float**, float**, float**, float**,
+                         float**, float**);
+
+/* which processors hold a field */
+#define SNAP_ALL 0
+#define SNAP_TOP 1                 /* top layer of processors only */
+#define SNAP_BOTM 2                /* bottom layer of processors only */
+#define SNAP_GLOBAL 3              /* same on all processors */
+
+/* how the size of a field follows the radial layer of processors */
+#define SNAP_FLAT 0                /* not at all */
+#define SNAP_NODES 1               /* noz values per column */
+#define SNAP_ELEMENTS 2            /* elz values per column */
+
+struct snap_field {
+    char name[24];
+    int size;                      /* bytes per value */
+    int ncomp;
+    int n;
+    const void **data;             /* first value of each component */
+    int stride;                    /* distance between values, 1 if packed */
+    int scope;
+    int radial;
+};
+
+struct snapshot {
+    double time;
+    int nfield;
+    struct snap_field field[SNAP_MAX_FIELDS];
+};
+
+
+static int little_endian(void)
+{
+    const int32_t one = 1;
+    return *(const char *)&one == 1;
+}
+
+
+/* copy n values of the given size into buf in little-endian order */
+static void put_le(char *buf, const void *src, int size, int n)
+{
+    const char *s = (const char *)src;
+    int i, b;
+
+    if (little_endian()) {
+        memcpy(buf, src, (size_t)size*n);
+        return;
+    }
+
+    for (i=0; i<n; i++)
+        for (b=0; b<size; b++)
+            buf[i*size + b] = s[i*size + size-1-b];
+}
+
+
+static void add_field(struct snapshot *snap, const char *name,
+                      int size, int ncomp, int n, int stride, int scope,
+                      int radial)
+{
+    struct snap_field *f = &snap->field[snap->nfield++];
+
+    memset(f->name, 0, sizeof(f->name));
+    strncpy(f->name, name, sizeof(f->name)-1);
+    f->size = size;
+    f->ncomp = ncomp;
+    f->n = n;
+    f->stride = stride;
+    f->scope = scope;
+    f->radial = radial;
+    f->data = (const void **)malloc(ncomp*sizeof(void *));
+
+    return;
+}
+
+
+static int has_field(struct All_variables *E, const struct snap_field *f)
+{
+    switch (f->scope) {
+    case SNAP_TOP:
+        return E->parallel.me_loc[3] == E->parallel.nprocz-1;
+    case SNAP_BOTM:
+        return E->parallel.me_loc[3] == 0;
+    default:
+        return 1;
+    }
+}
+
+
+static long block_bytes(const struct snap_field *f)
+{
+    /* padded to a multiple of 8 bytes */
+    return (((long)f->size*f->n + 7) / 8) * 8;
+}
+
+
+/* values per component of a field on a processor in radial layer k */
+static int layer_values(struct All_variables *E,
+                        const struct snap_field *f, int k)
+{
+    switch (f->radial) {
+    case SNAP_NODES:
+        return f->n / E->lmesh.noz * (E->parallel.layer_elz[k] + 1);
+    case SNAP_ELEMENTS:
+        return f->n / E->lmesh.elz * E->parallel.layer_elz[k];
+    default:
+        return f->n;
+    }
+}
+
+
+/* bytes of the ncomp blocks of a processor in radial layer k */
+static int64_t layer_slot_bytes(struct All_variables *E,
+                                const struct snap_field *f, int k)
+{
+    return (((int64_t)f->size*layer_values(E, f, k) + 7) / 8) * 8 * f->ncomp;
+}
+
+
+/* copy m values of a component, starting from the i-th, to buf */
+static void pack_values(char *buf, const struct snap_field *f,
+                        const void *data, int i, int m)
+{
+    const char *src = (const char *)data;
+    int k;
+
+    if (f->stride == 1) {
+        put_le(buf, src + (long)i*f->size, f->size, m);
+        return;
+    }
+
+    for (k=0; k<m; k++)
+        put_le(buf + k*f->size,
+               src + ((long)(i+k)*f->stride)*f->size, f->size, 1);
+}
+
+
+static void write_block(FILE *fp, const struct snap_field *f,
+                        const void *data, char *buf, int bufsize)
+{
+    const int nbuf = bufsize / f->size;
+    long pad;
+    int i, m;
+
+    if (f->stride == 1 && little_endian())
+        fwrite(data, f->size, f->n, fp);
+    else {
+        for (i=0; i<f->n; i+=nbuf) {
+            m = (f->n - i < nbuf) ? f->n - i : nbuf;
+            pack_values(buf, f, data, i, m);
+            fwrite(buf, f->size, m, fp);
+        }
+    }
+
+    pad = block_bytes(f) - (long)f->size*f->n;
+    memset(buf, 0, 8);
+    if (pad) fwrite(buf, 1, pad, fp);
+
+    return;
+}
+
+
+static void write_snapshot_file(struct All_variables *E, int cycles,
+                                struct snapshot *snap, FILE *fp1)
+{
+    char header[SNAP_HEADER_SIZE], *buf;
+    int32_t i32[8];
+    int64_t offset;
+    int i, c, nfield;
+    const int bufsize = 1 << 16;
+
+    /* fields held by this processor */
+    nfield = 0;
+    for (i=0; i<snap->nfield; i++)
+        if (has_field(E, &snap->field[i])) nfield++;
+
+    /* fixed part of the header */
+    memset(header, 0, SNAP_HEADER_SIZE);
+    memcpy(header, "CITSNAP", 8);
+    i32[0] = 0x12345678;
+    i32[1] = SNAP_VERSION;
+    i32[2] = cycles;
+    i32[3] = E->parallel.me;
+    put_le(header + 8, i32, 4, 4);
+    put_le(header + 24, &snap->time, 8, 1);
+    i32[0] = E->lmesh.nno;
+    i32[1] = E->lmesh.nel;
+    i32[2] = E->lmesh.nsf;
+    i32[3] = E->lmesh.nox;
+    i32[4] = E->lmesh.noy;
+    i32[5] = E->lmesh.noz;
+    i32[6] = E->composition.on ? E->composition.ncomp : 0;
+    i32[7] = nfield;
+    put_le(header + 32, i32, 4, 8);
+    fwrite(header, 1, SNAP_HEADER_SIZE, fp1);
+
+    /* field table */
+    offset = SNAP_HEADER_SIZE + (int64_t)SNAP_FIELD_SIZE*nfield;
+    for (i=0; i<snap->nfield; i++) {
+        struct snap_field *f = &snap->field[i];
+
+        if (!has_field(E, f)) continue;
+
+        memset(header, 0, SNAP_FIELD_SIZE);
+        memcpy(header, f->name, 24);
+        i32[0] = f->size;
+        i32[1] = f->ncomp;
+        i32[2] = f->n;
+        i32[3] = 0;
+        put_le(header + 24, i32, 4, 4);
+        put_le(header + 40, &offset, 8, 1);
+        fwrite(header, 1, SNAP_FIELD_SIZE, fp1);
+
+        offset += block_bytes(f) * f->ncomp;
+    }
+
+    /* blocks */
+    buf = (char *)malloc(bufsize);
+    for (i=0; i<snap->nfield; i++) {
+        if (!has_field(E, &snap->field[i])) continue;
+        for (c=0; c<snap->field[i].ncomp; c++)
+            write_block(fp1, &snap->field[i], snap->field[i].data[c],
+                        buf, bufsize);
+    }
+    free(buf);
+
+    return;
+}
+
+
+static void write_snapshot(struct All_variables *E, int cycles,
+                           struct snapshot *snap)
+{
+    char output_file[255];
+    FILE *fp1;
+
+    sprintf(output_file,"%s.snap.%d.%d", E->control.data_file,
+            E->parallel.me, cycles);
+    fp1 = output_open(output_file, "wb");
+    write_snapshot_file(E, cycles, snap, fp1);
+    fclose(fp1);
+
+    return;
+}
+
+
+/* Write the snapshot of all processors into one shared file with
+   MPI-IO.  The blocks of each field are stored one processor after
+   another, and every processor writes its blocks, and processor 0
+   also the header, in a single collective call.  Everything is a
+   multiple of 8 bytes and is written in 8-byte words, so that the int
+   counts of MPI-IO allow up to 16 GB per processor. */
+
+static void write_shared_snapshot(struct All_variables *E, int cycles,
+                                  struct snapshot *snap)
+{
+    const int nprocx = E->parallel.nprocx;
+    const int nprocy = E->parallel.nprocy;
+    const int nprocz = E->parallel.nprocz;
+    const int nprocxy = nprocx*nprocy;
+    const int proc_per_cap = nprocxy*nprocz;
+    const int ncaps = E->sphere.caps;
+    const int cap = E->sphere.capid[1] - 1;
+    const int lx = E->parallel.me_loc[1];
+    const int ly = E->parallel.me_loc[2];
+    const int lz = E->parallel.me_loc[3];
+
+    char output_file[255], tmp[100];
+    char *buf, *p;
+    int nslot[4], myslot[4];
+    int *len;
+    MPI_Aint *disp;
+    MPI_Datatype word, filetype;
+    MPI_File fh;
+    MPI_Info info;
+    int64_t offset, header_size, nbytes;
+    int64_t slot_size, slot_disp, field_size, cap_size, below;
+    int32_t i32[8];
+    long n;
+    int i, c, k, m, lx1, ly1, lz1, nblock, ierr;
+
+    /* the slots of a field are ordered by cap, then by radial layer,  */
+    /* so that a cap, or a layer of processors in a cap, is contiguous */
+    nslot[SNAP_ALL] = ncaps*proc_per_cap;
+    nslot[SNAP_TOP] = nslot[SNAP_BOTM] = ncaps*nprocxy;
+    nslot[SNAP_GLOBAL] = 1;
+
+    myslot[SNAP_ALL] = cap*proc_per_cap + lz*nprocxy + ly*nprocx + lx;
+    myslot[SNAP_TOP] = (lz == nprocz-1) ? cap*nprocxy + ly*nprocx + lx : -1;
+    myslot[SNAP_BOTM] = (lz == 0) ? cap*nprocxy + ly*nprocx + lx : -1;
+    myslot[SNAP_GLOBAL] = (E->parallel.me == 0) ? 0 : -1;
+
+    header_size = SHARED_HEADER_SIZE + (int64_t)SHARED_FIELD_SIZE*snap->nfield
+        + 4*nslot[SNAP_ALL] + 4*nprocz;
+    header_size = ((header_size + 7) / 8) * 8;
+
+    /* size of the local blocks */
+    nbytes = (E->parallel.me == 0) ? header_size : 0;
+    for (i=0; i<snap->nfield; i++)
+        if (myslot[snap->field[i].scope] >= 0)
+            nbytes += block_bytes(&snap->field[i]) * snap->field[i].ncomp;
+
+    if (nbytes / 8 > INT_MAX) {
+        fprintf(stderr,"mpiio output: %ld bytes on processor %d, more than "
+                "16 GB\n", (long)nbytes, E->parallel.me);
+        parallel_process_termination();
+    }
+
+    buf = (char *)malloc(nbytes);
+    len = (int *)malloc((snap->nfield+1)*sizeof(int));
+    disp = (MPI_Aint *)malloc((snap->nfield+1)*sizeof(MPI_Aint));
+    p = buf;
+    nblock = 0;
+
+    if (E->parallel.me == 0) {
+        memset(buf, 0, header_size);
+        memcpy(p, "CITSHARE", 8);
+        i32[0] = 0x12345678;
+        i32[1] = SNAP_VERSION;
+        i32[2] = cycles;
+        i32[3] = E->parallel.nproc;
+        put_le(p + 8, i32, 4, 4);
+        put_le(p + 24, &snap->time, 8, 1);
+        i32[0] = E->lmesh.nno;
+        i32[1] = E->lmesh.nel;
+        i32[2] = E->lmesh.nsf;
+        i32[3] = E->lmesh.nox;
+        i32[4] = E->lmesh.noy;
+        i32[5] = E->lmesh.noz;
+        i32[6] = E->composition.on ? E->composition.ncomp : 0;
+        i32[7] = snap->nfield;
+        put_le(p + 32, i32, 4, 8);
+
+        /* processor layout */
+        i32[0] = ncaps;
+        i32[1] = nprocx;
+        i32[2] = nprocy;
+        i32[3] = nprocz;
+        i32[4] = E->mesh.nox;
+        i32[5] = E->mesh.noy;
+        i32[6] = E->mesh.noz;
+        i32[7] = header_size;
+        put_le(p + 64, i32, 4, 8);
+
+        len[nblock] = header_size / 8;
+        disp[nblock] = 0;
+        nblock++;
+    }
+
+    /* field table; all processors compute the offsets, from the */
+    /* slot sizes of all radial layers                           */
+    offset = header_size;
+    for (i=0; i<snap->nfield; i++) {
+        struct snap_field *f = &snap->field[i];
+
+        slot_size = layer_slot_bytes(E, f, lz);
+        if (f->scope == SNAP_ALL) {
+            cap_size = below = 0;
+            for (k=0; k<nprocz; k++) {
+                if (k == lz) below = cap_size;
+                cap_size += nprocxy*layer_slot_bytes(E, f, k);
+            }
+            slot_disp = cap*cap_size + below + (ly*nprocx + lx)*slot_size;
+            field_size = ncaps*cap_size;
+        }
+        else {
+            /* surface and global fields are the same on all layers */
+            slot_disp = myslot[f->scope]*slot_size;
+            field_size = nslot[f->scope]*slot_size;
+        }
+
+        if (E->parallel.me == 0) {
+            char *q = buf + SHARED_HEADER_SIZE + i*SHARED_FIELD_SIZE;
+            memcpy(q, f->name, 24);
+            i32[0] = f->size;
+            i32[1] = f->ncomp;
+            i32[2] = f->n;
+            if (f->radial == SNAP_NODES)
+                i32[2] = f->n / E->lmesh.noz;
+            else if (f->radial == SNAP_ELEMENTS)
+                i32[2] = f->n / E->lmesh.elz;
+            i32[3] = f->scope;
+            i32[4] = f->radial;
+            i32[5] = 0;
+            put_le(q + 24, i32, 4, 6);
+            put_le(q + 48, &offset, 8, 1);
+        }
+
+        if (myslot[f->scope] >= 0) {
+            len[nblock] = slot_size / 8;
+            disp[nblock] = offset + slot_disp;
+            nblock++;
+        }
+
+        offset += field_size;
+    }
+
+    /* the processor of each slot */
+    if (E->parallel.me == 0) {
+        p = buf + SHARED_HEADER_SIZE + SHARED_FIELD_SIZE*snap->nfield;
+        k = 0;
+        for (m=0; m<ncaps; m++)
+            for (lz1=0; lz1<nprocz; lz1++)
+                for (ly1=0; ly1<nprocy; ly1++)
+                    for (lx1=0; lx1<nprocx; lx1++) {
+                        i32[0] = E->parallel.loc2proc_map[m][lx1][ly1][lz1];
+                        put_le(p + 4*k, i32, 4, 1);
+                        k++;
+                    }
+
+        /* and the radial layers */
+        put_le(p + 4*k, E->parallel.layer_elz, 4, nprocz);
+        p = buf + header_size;
+    }
+
+    /* local blocks, in the order of the file */
+    for (i=0; i<snap->nfield; i++) {
+        struct snap_field *f = &snap->field[i];
+
+        if (myslot[f->scope] < 0) continue;
+
+        for (c=0; c<f->ncomp; c++) {
+            n = block_bytes(f);
+            pack_values(p, f, f->data[c], 0, f->n);
+            memset(p + (long)f->size*f->n, 0, n - (long)f->size*f->n);
+            p += n;
+        }
+    }
+
+    ierr = MPI_Type_contiguous(8, MPI_BYTE, &word);
+    ierr = MPI_Type_commit(&word);
+    ierr = MPI_Type_create_hindexed(nblock, len, disp, word, &filetype);
+    ierr = MPI_Type_commit(&filetype);
+
+    /* collective buffering hints, as for the hdf5 output */
+    ierr = MPI_Info_create(&info);
+    ierr = MPI_Info_set(info, "access_style", "write_once");
+    ierr = MPI_Info_set(info, "collective_buffering", "true");
+    snprintf(tmp, (size_t)100, "%d", E->output.cb_block_size);
+    ierr = MPI_Info_set(info, "cb_block_size", tmp);
+    snprintf(tmp, (size_t)100, "%d", E->output.cb_buffer_size);
+    ierr = MPI_Info_set(info, "cb_buffer_size", tmp);
+    if (E->output.cb_nodes > 0) {
+        snprintf(tmp, (size_t)100, "%d", E->output.cb_nodes);
+        ierr = MPI_Info_set(info, "cb_nodes", tmp);
+    }
+
+    sprintf(output_file,"%s.mpiio.%d", E->control.data_file, cycles);
+    ierr = MPI_File_open(E->parallel.world, output_file,
+                         MPI_MODE_CREATE | MPI_MODE_WRONLY, info, &fh);
+    if (ierr != MPI_SUCCESS) {
+        fprintf(stderr,"Cannot open file '%s' for '%s'\n",
+                output_file, "w");
+        parallel_process_termination();
+    }
+
+    /* truncate the file left by an earlier run */
+    ierr = MPI_File_set_size(fh, (MPI_Offset)offset);
+    ierr = MPI_File_set_view(fh, 0, word, filetype, "native", info);
+    ierr = MPI_File_write_all(fh, buf, (int)(nbytes / 8), word,
+                              MPI_STATUS_IGNORE);
+    if (ierr != MPI_SUCCESS) {
+        fprintf(stderr,"Cannot write file '%s'\n", output_file);
+        parallel_process_termination();
+    }
+    ierr = MPI_File_close(&fh);
+
+    MPI_Info_free(&info);
+    MPI_Type_free(&filetype);
+    MPI_Type_free(&word);
+    free(disp);
+    free(len);
+    free(buf);
+
+    return;
+}
+
+
+static void snapshot_output(struct All_variables *E, int cycles,
+                            void (*write)(struct All_variables *, int,
+                                          struct snapshot *))
+{
+    struct snapshot snap;
+    struct snap_field *f;
+    float *SXX[NCS],*SYY[NCS],*SXY[NCS],*SXZ[NCS],*SZY[NCS],*SZZ[NCS];
+    float *divv[NCS],*vorv[NCS];
+    double *bulk = NULL;
+    int i;
+    const int j = 1;
+    const int lev = E->mesh.levmax;
+
+    if (cycles == 0) {
+        output_domain(E);
+
+        if (E->output.coord_bin)
+            output_coord_bin(E);
+    }
+
+    /* quantities computed by output_surf_botm() */
+    if((E->output.write_q_files == 0) || (cycles == 0) ||
+       (cycles % E->output.write_q_files)!=0)
+        heat_flux(E);
+
+    if(E->control.use_cbf_topo)
+        get_CBF_topo(E,E->slice.tpg,E->slice.tpgb);
+    else
+        get_STD_topo(E,E->slice.tpg,E->slice.tpgb,E->slice.divg,E->slice.vort,cycles);
+
+    /* list the fields of the snapshot */
+    snap.time = E->monitor.elapsed_time;
+    snap.nfield = 0;
+
+    if (cycles == 0) {
+        add_field(&snap, "coord", sizeof(double), 3,
+                  E->lmesh.nno, 1, SNAP_ALL, SNAP_NODES);
+        f = &snap.field[snap.nfield-1];
+        for (i=0; i<3; i++)
+            f->data[i] = &E->sx[j][i+1][1];
+    }
+
+    add_field(&snap, "velocity", sizeof(float), 3, E->lmesh.nno, 1, SNAP_ALL,
+              SNAP_NODES);
+    f = &snap.field[snap.nfield-1];
+    for (i=0; i<3; i++)
+        f->data[i] = &E->sphere.cap[j].V[i+1][1];
+
+    add_field(&snap, "temperature", sizeof(double), 1,
+              E->lmesh.nno, 1, SNAP_ALL, SNAP_NODES);
+    snap.field[snap.nfield-1].data[0] = &E->T[j][1];
+
+    add_field(&snap, "viscosity", sizeof(float), 1,
+              E->lmesh.nno, 1, SNAP_ALL, SNAP_NODES);
+    snap.field[snap.nfield-1].data[0] = &E->VI[lev][j][1];
+
+#ifdef CITCOM_ALLOW_ANISOTROPIC_VISC
+    if(E->viscosity.allow_anisotropic_viscosity) {
+        add_field(&snap, "avisc", sizeof(float), 4,
+                  E->lmesh.nno, 1, SNAP_ALL, SNAP_NODES);
+        f = &snap.field[snap.nfield-1];
+        f->data[0] = &E->VI2[lev][j][1];
+        f->data[1] = &E->VIn1[lev][j][1];
+        f->data[2] = &E->VIn2[lev][j][1];
+        f->data[3] = &E->VIn3[lev][j][1];
+    }
+#endif
+
+    /* every processor lists the surface fields, so that the list is */
+    /* the same everywhere, but only the top or bottom layer has them */
+    if (E->output.surf) {
+        /* choose either STD topo or pseudo-free-surf topo */
+        add_field(&snap, "surf_topo", sizeof(float), 1, E->lmesh.nsf, 1,
+                  SNAP_TOP, SNAP_FLAT);
+        snap.field[snap.nfield-1].data[0] = E->control.pseudo_free_surf ?
+            &E->slice.freesurf[j][1] : &E->slice.tpg[j][1];
+        add_field(&snap, "surf_heatflux", sizeof(float), 1, E->lmesh.nsf, 1,
+                  SNAP_TOP, SNAP_FLAT);
+        snap.field[snap.nfield-1].data[0] = &E->slice.shflux[j][1];
+    }
+
+    if (E->output.botm) {
+        add_field(&snap, "botm_topo", sizeof(float), 1, E->lmesh.nsf, 1,
+                  SNAP_BOTM, SNAP_FLAT);
+        snap.field[snap.nfield-1].data[0] = &E->slice.tpgb[j][1];
+        add_field(&snap, "botm_heatflux", sizeof(float), 1, E->lmesh.nsf, 1,
+                  SNAP_BOTM, SNAP_FLAT);
+        snap.field[snap.nfield-1].data[0] = &E->slice.bhflux[j][1];
+    }
+
+    if (E->output.stress) {
+        /* for CBF topo, stress will not have been computed */
+        if(E->control.use_cbf_topo) {
+            allocate_STD_mem(E, SXX, SYY, SZZ, SXY, SXZ, SZY, divv, vorv);
+            compute_nodal_stress(E, SXX, SYY, SZZ, SXY, SXZ, SZY, divv, vorv);
+            free_STD_mem(E, SXX, SYY, SZZ, SXY, SXZ, SZY, divv, vorv);
+        }
+
+        /* stt spp srr stp str srp, interleaved in gstress */
+        add_field(&snap, "stress", sizeof(float), 6,
+                  E->lmesh.nno, 6, SNAP_ALL, SNAP_NODES);
+        f = &snap.field[snap.nfield-1];
+        for (i=0; i<6; i++)
+            f->data[i] = &E->gstress[j][i+1];
+    }
+
+    if (E->output.pressure) {
+        add_field(&snap, "pressure", sizeof(float), 1,
+                  E->lmesh.nno, 1, SNAP_ALL, SNAP_NODES);
+        snap.field[snap.nfield-1].data[0] = &E->NP[j][1];
+    }
+
+    if (E->composition.on && (E->output.comp_nd || E->output.comp_el)) {
+        /* initial and current bulk composition */
+        bulk = (double *)malloc(2*E->composition.ncomp*sizeof(double));
+        for (i=0; i<E->composition.ncomp; i++) {
+            bulk[i] = E->composition.initial_bulk_composition[i];
+            bulk[i+E->composition.ncomp] = E->composition.bulk_composition[i];
+        }
+        add_field(&snap, "bulk_composition", sizeof(double), 2,
+                  E->composition.ncomp, 1, SNAP_GLOBAL, SNAP_FLAT);
+        f = &snap.field[snap.nfield-1];
+        f->data[0] = bulk;
+        f->data[1] = bulk + E->composition.ncomp;
+    }
+
+    if (E->output.comp_nd && E->composition.on) {
+        add_field(&snap, "comp_nd", sizeof(double), E->composition.ncomp,
+                  E->lmesh.nno, 1, SNAP_ALL, SNAP_NODES);
+        f = &snap.field[snap.nfield-1];
+        for (i=0; i<E->composition.ncomp; i++)
+            f->data[i] = &E->composition.comp_node[j][i][1];
+    }
+
+    if (E->output.comp_el && E->composition.on) {
+        add_field(&snap, "comp_el", sizeof(double), E->composition.ncomp,
+                  E->lmesh.nel, 1, SNAP_ALL, SNAP_ELEMENTS);
+        f = &snap.field[snap.nfield-1];
+        for (i=0; i<E->composition.ncomp; i++)
+            f->data[i] = &E->composition.comp_el[j][i][1];
+    }
+
+    if (E->output.heating && E->control.disptn_number != 0) {
+        add_field(&snap, "heating", sizeof(double), 3,
+                  E->lmesh.nel, 1, SNAP_ALL, SNAP_ELEMENTS);
+        f = &snap.field[snap.nfield-1];
+        f->data[0] = &E->heating_adi[j][1];
+        f->data[1] = &E->heating_visc[j][1];
+        f->data[2] = &E->heating_latent[j][1];
+    }
+
+    write(E, cycles, &snap);
+
+    for (i=0; i<snap.nfield; i++)
+        free(snap.field[i].data);
+    if (bulk) free(bulk);
+
+    /* the remaining output is small, or already binary, and is */
+    /* written as by output() */
+
+    if (E->output.geoid)
+        output_geoid(E, cycles);
+
+    if (E->output.horiz_avg)
+        output_horiz_avg(E, cycles);
+
+    if (E->output.seismic)
+        output_seismic(E, cycles);
+
+    if (E->output.tracer && E->control.tracer)
+        output_tracer(E, cycles);
+
+    return;
+}
+
+
+void binary_output(struct All_variables *E, int cycles)
+{
+    snapshot_output(E, cycles, write_snapshot);
+}
+
+
+void mpiio_output(struct All_variables *E, int cycles)
+{
+    snapshot_output(E, cycles, write_shared_snapshot);
+}
+
+
+/* With output_async=on, the snapshots of output_format=ascii or binary
+   are written by an I/O thread.  The time loop still computes the
+   derived fields (heat flux, topography, stress) and writes the small
+   outputs that need collectives (geoid, horizontal averages, seismic,
+   tracers), but it only copies the fields of the snapshot into a
+   staging buffer and goes on; the thread formats and writes them.
+   There are two staging buffers, so that a snapshot can be staged
+   while the previous one is written.  If both are still in use, the
+   time loop waits for the thread (back-pressure).  The thread makes no
+   MPI calls; a failure to write is reported to the time loop, which
+   stops the run at the next output. */
+
+#ifdef USE_PTHREADS
+
+#include <pthread.h>
+#include <sys/time.h>
+
+struct staged_snapshot {
+    struct snapshot snap;      /* fields point into buf, stride 1 */
+    int cycles;
+    char *buf;
+    long bufsize;
+    const void **data;         /* component pointers of all fields */
+    int ndata;
+};
+
+struct async_output {
+    struct All_variables *E;
+    int (*write)(struct All_variables *, int, struct snapshot *);
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    struct staged_snapshot stage[2];
+    int head;                  /* next staged snapshot to write */
+    int count;                 /* staged snapshots not yet written */
+    int quit, failed;
+
+    int nsnap;
+    double stage_time, wait_time, write_time;
+};
+
+
+static double wall_time(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+
+static int write_binary_snapshot(struct All_variables *E, int cycles,
+                                 struct snapshot *snap)
+{
+    char output_file[255];
+    FILE *fp1;
+
+    sprintf(output_file,"%s.snap.%d.%d", E->control.data_file,
+            E->parallel.me, cycles);
+    fp1 = fopen(output_file, "wb");
+    if (!fp1) {
+        fprintf(stderr,"Cannot open file '%s' for '%s'\n",
+                output_file, "wb");
+        return 1;
+    }
+    write_snapshot_file(E, cycles, snap, fp1);
+    fclose(fp1);
+
+    return 0;
+}
+
+
+/* the staged field of this name, if this processor holds it */
+static const struct snap_field *find_field(struct All_variables *E,
+                                           const struct snapshot *snap,
+                                           const char *name)
+{
+    int i;
+
+    for (i=0; i<snap->nfield; i++)
+        if (strcmp(snap->field[i].name, name) == 0)
+            return has_field(E, &snap->field[i]) ? &snap->field[i] : NULL;
+    return NULL;
+}
+
+
+/* value i of component c of a field, as a double */
+static double value(const struct snap_field *f, int c, int i)
+{
+    const char *p = (const char *)f->data[c] + (long)i*f->stride*f->size;
+
+    if (f->size == sizeof(float))
+        return *(const float *)p;
+    else
+        return *(const double *)p;
+}
+
+
+static FILE *open_ascii(struct All_variables *E, const char *kind,
+                        int cycles, int with_cycle, int *failed)
+{
+    char output_file[255];
+    FILE *fp1;
+
+    if (with_cycle)
+        sprintf(output_file,"%s.%s.%d.%d", E->control.data_file, kind,
+                E->parallel.me, cycles);
+    else
+        sprintf(output_file,"%s.%s.%d", E->control.data_file, kind,
+                E->parallel.me);
+
+    fp1 = fopen(output_file, "w");
+    if (!fp1) {
+        fprintf(stderr,"Cannot open file '%s' for '%s'\n",
+                output_file, "w");
+        *failed = 1;
+    }
+    return fp1;
+}
+
+
+/* the ASCII files of output(), from a staged snapshot */
+static int write_ascii_snapshot(struct All_variables *E, int cycles,
+                                struct snapshot *snap)
+{
+    const struct snap_field *f, *g, *v;
+    const int nno = E->lmesh.nno;
+    const int nel = E->lmesh.nel;
+    const int nsf = E->lmesh.nsf;
+    const int noz = E->lmesh.noz;
+    const double time = snap->time;
+    FILE *fp1;
+    int i, k, n, failed = 0;
+
+    /* the formats follow Output.c */
+
+    if ((f = find_field(E, snap, "coord")) &&
+        (fp1 = open_ascii(E, "coord", cycles, 0, &failed))) {
+        fprintf(fp1,"%3d %7d\n",1,nno);
+        for(i=0;i<nno;i++)
+            fprintf(fp1,"%.6e %.6e %.6e\n",
+                    value(f,0,i),value(f,1,i),value(f,2,i));
+        fclose(fp1);
+    }
+
+    v = find_field(E, snap, "velocity");
+    g = find_field(E, snap, "temperature");
+    if (v && g && (fp1 = open_ascii(E, "velo", cycles, 1, &failed))) {
+        fprintf(fp1,"%d %d %.5e\n",cycles,nno,time);
+        fprintf(fp1,"%3d %7d\n",1,nno);
+        for(i=0;i<nno;i++)
+            fprintf(fp1,"%.6e %.6e %.6e %.6e\n",value(v,0,i),
+                    value(v,1,i),value(v,2,i),value(g,0,i));
+        fclose(fp1);
+    }
+
+    if ((f = find_field(E, snap, "viscosity")) &&
+        (fp1 = open_ascii(E, "visc", cycles, 1, &failed))) {
+        fprintf(fp1,"%3d %7d\n",1,nno);
+        for(i=0;i<nno;i++)
+            fprintf(fp1,"%.4e\n",value(f,0,i));
+        fclose(fp1);
+    }
+
+    if ((f = find_field(E, snap, "avisc")) &&
+        (fp1 = open_ascii(E, "avisc", cycles, 1, &failed))) {
+        fprintf(fp1,"%3d %7d\n",1,nno);
+        for(i=0;i<nno;i++)
+            fprintf(fp1,"%.4e %.4e %.4e %.4e\n",value(f,0,i),
+                    value(f,1,i),value(f,2,i),value(f,3,i));
+        fclose(fp1);
+    }
+
+    f = find_field(E, snap, "surf_topo");
+    g = find_field(E, snap, "surf_heatflux");
+    if (f && g && (fp1 = open_ascii(E, "surf", cycles, 1, &failed))) {
+        fprintf(fp1,"%3d %7d\n",1,nsf);
+        for(i=1;i<=nsf;i++) {
+            n = i*noz - 1;
+            fprintf(fp1,"%.4e %.4e %.4e %.4e\n",value(f,0,i-1),
+                    value(g,0,i-1),value(v,0,n),value(v,1,n));
+        }
+        fclose(fp1);
+    }
+
+    f = find_field(E, snap, "botm_topo");
+    g = find_field(E, snap, "botm_heatflux");
+    if (f && g && (fp1 = open_ascii(E, "botm", cycles, 1, &failed))) {
+        fprintf(fp1,"%3d %7d\n",1,nsf);
+        for(i=1;i<=nsf;i++) {
+            n = (i-1)*noz;
+            fprintf(fp1,"%.4e %.4e %.4e %.4e\n",value(f,0,i-1),
+                    value(g,0,i-1),value(v,0,n),value(v,1,n));
+        }
+        fclose(fp1);
+    }
+
+    if ((f = find_field(E, snap, "stress")) &&
+        (fp1 = open_ascii(E, "stress", cycles, 1, &failed))) {
+        fprintf(fp1,"%d %d %.5e\n",cycles,nno,time);
+        fprintf(fp1,"%3d %7d\n",1,nno);
+        for(i=0;i<nno;i++)
+            fprintf(fp1,"%.4e %.4e %.4e %.4e %.4e %.4e\n",
+                    value(f,0,i),value(f,1,i),value(f,2,i),
+                    value(f,3,i),value(f,4,i),value(f,5,i));
+        fclose(fp1);
+    }
+
+    if ((f = find_field(E, snap, "pressure")) &&
+        (fp1 = open_ascii(E, "pressure", cycles, 1, &failed))) {
+        fprintf(fp1,"%d %d %.5e\n",cycles,nno,time);
+        fprintf(fp1,"%3d %7d\n",1,nno);
+        for(i=0;i<nno;i++)
+            fprintf(fp1,"%.6e\n",value(f,0,i));
+        fclose(fp1);
+    }
+
+    g = find_field(E, snap, "bulk_composition");
+    for (k=0; k<2; k++) {
+        const char *kind = k ? "comp_el" : "comp_nd";
+        const int nn = k ? nel : nno;
+
+        if (!g || !(f = find_field(E, snap, kind)) ||
+            !(fp1 = open_ascii(E, kind, cycles, 1, &failed)))
+            continue;
+
+        fprintf(fp1,"%3d %7d %.5e %d\n",1,nel,time,f->ncomp);
+        for(i=0;i<f->ncomp;i++)
+            fprintf(fp1,"%.5e %.5e ",value(g,0,i),value(g,1,i));
+        fprintf(fp1,"\n");
+        for(i=0;i<nn;i++) {
+            for(n=0;n<f->ncomp;n++)
+                fprintf(fp1,"%.6e ",value(f,n,i));
+            fprintf(fp1,"\n");
+        }
+        fclose(fp1);
+    }
+
+    if ((f = find_field(E, snap, "heating")) &&
+        (fp1 = open_ascii(E, "heating", cycles, 1, &failed))) {
+        fprintf(fp1,"%.5e\n",time);
+        fprintf(fp1,"%3d %7d\n",1,nel);
+        for(i=0;i<nel;i++)
+            fprintf(fp1,"%.4e %.4e %.4e\n",
+                    value(f,0,i),value(f,1,i),value(f,2,i));
+        fclose(fp1);
+    }
+
+    return failed;
+}
+
+
+static void *async_writer(void *arg)
+{
+    struct async_output *a = (struct async_output *)arg;
+    struct staged_snapshot *s;
+    double t0, t;
+    int failed;
+
+    pthread_mutex_lock(&a->lock);
+    while (1) {
+        while (a->count == 0 && !a->quit)
+            pthread_cond_wait(&a->cond, &a->lock);
+        if (a->count == 0)
+            break;
+
+        /* the staged snapshot is not touched by the time loop until */
+        /* it is released below                                      */
+        s = &a->stage[a->head];
+        pthread_mutex_unlock(&a->lock);
+
+        t0 = wall_time();
+        failed = (a->write)(a->E, s->cycles, &s->snap);
+        t = wall_time() - t0;
+
+        pthread_mutex_lock(&a->lock);
+        a->write_time += t;
+        a->failed |= failed;
+        a->nsnap++;
+        a->head = 1 - a->head;
+        a->count--;
+        pthread_cond_broadcast(&a->cond);
+    }
+    pthread_mutex_unlock(&a->lock);
+
+    return NULL;
+}
+
+
+static void start_async_output(struct All_variables *E,
+                               int (*write)(struct All_variables *, int,
+                                            struct snapshot *))
+{
+    struct async_output *a;
+
+    a = (struct async_output *)calloc(1, sizeof(struct async_output));
+    a->E = E;
+    a->write = write;
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->cond, NULL);
+
+    if (pthread_create(&a->thread, NULL, async_writer, a) != 0) {
+        fprintf(stderr,"Cannot start the output thread (me=%d)\n",
+                E->parallel.me);
+        parallel_process_termination();
+    }
+
+    E->output.async_state = a;
+
+    return;
+}
+
+
+/* copy the fields held by this processor into a free staging buffer, */
+/* and hand it to the I/O thread                                      */
+static void stage_snapshot(struct All_variables *E, int cycles,
+                           struct snapshot *snap)
+{
+    struct async_output *a = E->output.async_state;
+    struct staged_snapshot *s;
+    struct snap_field *f;
+    const void **d;
+    const char *src;
+    char *p;
+    long nbytes;
+    double t0, t1;
+    int i, c, k, ndata;
+
+    t0 = CPU_time0();
+
+    /* back-pressure: wait until a staging buffer is free */
+    pthread_mutex_lock(&a->lock);
+    while (a->count == 2)
+        pthread_cond_wait(&a->cond, &a->lock);
+    s = &a->stage[(a->head + a->count) % 2];
+    if (a->failed) {
+        pthread_mutex_unlock(&a->lock);
+        fprintf(stderr,"async output: a snapshot could not be written "
+                "(me=%d)\n", E->parallel.me);
+        parallel_process_termination();
+    }
+    pthread_mutex_unlock(&a->lock);
+
+    t1 = CPU_time0();
+    a->wait_time += t1 - t0;
+
+    nbytes = 0;
+    ndata = 0;
+    for (i=0; i<snap->nfield; i++)
+        if (has_field(E, &snap->field[i])) {
+            nbytes += block_bytes(&snap->field[i]) * snap->field[i].ncomp;
+            ndata += snap->field[i].ncomp;
+        }
+
+    if (nbytes > s->bufsize) {
+        free(s->buf);
+        s->buf = (char *)malloc(nbytes);
+        s->bufsize = nbytes;
+    }
+    if (ndata > s->ndata) {
+        free(s->data);
+        s->data = (const void **)malloc(ndata*sizeof(void *));
+        s->ndata = ndata;
+    }
+
+    s->snap = *snap;
+    s->cycles = cycles;
+    p = s->buf;
+    d = s->data;
+    for (i=0; i<snap->nfield; i++) {
+        const struct snap_field *from = &snap->field[i];
+
+        f = &s->snap.field[i];
+        if (!has_field(E, f)) {
+            f->data = NULL;
+            continue;
+        }
+
+        /* packed, in the byte order of this machine */
+        for (c=0; c<f->ncomp; c++) {
+            src = (const char *)from->data[c];
+            if (from->stride == 1)
+                memcpy(p, src, (size_t)f->size*f->n);
+            else
+                for (k=0; k<f->n; k++)
+                    memcpy(p + (long)k*f->size,
+                           src + (long)k*from->stride*f->size, f->size);
+            d[c] = p;
+            p += block_bytes(f);
+        }
+        f->data = d;
+        f->stride = 1;
+        d += f->ncomp;
+    }
+
+    pthread_mutex_lock(&a->lock);
+    a->count++;
+    pthread_cond_broadcast(&a->cond);
+    pthread_mutex_unlock(&a->lock);
+
+    a->stage_time += CPU_time0() - t1;
+
+    return;
+}
+
+
+/* write the staged snapshots, stop the I/O thread and report the */
+/* time spent on output                                           */
+static void stop_async_output(struct All_variables *E)
+{
+    struct async_output *a = E->output.async_state;
+    int i;
+
+    if (!a) return;
+
+    pthread_mutex_lock(&a->lock);
+    a->quit = 1;
+    pthread_cond_broadcast(&a->cond);
+    pthread_mutex_unlock(&a->lock);
+    pthread_join(a->thread, NULL);
+
+    if (a->failed)
+        fprintf(stderr,"async output: a snapshot could not be written "
+                "(me=%d)\n", E->parallel.me);
+
+    if (E->parallel.me == 0 && E->fp) {
+        fprintf(E->fp, "async output: %d snapshots; time loop %.4e seconds "
+                "staging, %.4e seconds waiting; output thread %.4e seconds "
+                "writing\n", a->nsnap, a->stage_time, a->wait_time,
+                a->write_time);
+        fflush(E->fp);
+    }
+
+    for (i=0; i<2; i++) {
+        free(a->stage[i].buf);
+        free(a->stage[i].data);
+    }
+    pthread_cond_destroy(&a->cond);
+    pthread_mutex_destroy(&a->lock);
+    free(a);
+    E->output.async_state = NULL;
+
+    return;
+}
+
+
+static void async_output(struct All_variables *E, int cycles,
+                         int (*write)(struct All_variables *, int,
+                                      struct snapshot *))
+{
+    if (!E->output.async_state)
+        start_async_output(E, write);
+
+    snapshot_output(E, cycles, stage_snapshot);
+}
+
+
+void async_ascii_output(struct All_variables *E, int cycles)
+{
+    async_output(E, cycles, write_ascii_snapshot);
+}
+
+
+void async_binary_output(struct All_variables *E, int cycles)
+{
+    async_output(E, cycles, write_binary_snapshot);
+}
+
+#endif /* USE_PTHREADS */
+
+
+void async_output_finalize(struct All_variables *E)
+{
+#ifdef USE_PTHREADS
+    stop_async_output(E);
+#endif
+}
@@ -43,6 +43,9 @@ enum field_class_t
     TENSOR_FIELD = 2
 };
 
+/* capdim, three spatial dimensions and components, plus time */
+#define MAX_FIELD_RANK 6
+
 struct field_t
 {
     /* field datatype (in file) */
@@ -64,6 +67,12 @@ struct field_t
     int n;
     float *data;
 
+    /* when writing a time series, the datasets have an additional
+     * leading time dimension, and the data goes to the given record
+     */
+    int series;
+    hsize_t record;
+
 };
 
 
@@ -78,6 +87,8 @@ static void h5output_close(struct All_variables *);
 
 static void h5output_const(struct All_variables *E);
 static void h5output_timedep(struct All_variables *E, int cycles);
+static void h5output_series(struct All_variables *E, int cycles);
+static void h5output_fields(struct All_variables *E, int cycles);
 
 /* for creation of HDF5 objects (wrapped for compatibility with PyTables) */
 static hid_t h5create_file(const char *filename, unsigned flags, hid_t fcpl_id, hid_t fapl_id);
@@ -138,6 +149,7 @@ extern void heat_flux(struct All_variables *);
 extern void get_STD_topo(struct All_variables *, float**, float**, float**, float**, int);
 extern void get_CBF_topo(struct All_variables *, float**, float**);
 extern void compute_geoid(struct All_variables *);
+extern double CPU_time0();
 
 
 /****************************************************************************
@@ -208,6 +220,11 @@ void h5output_allocate_memory(struct All_variables *E)
     E->hdf5.scalar2d = scalar2d;
     E->hdf5.scalar1d = scalar1d;
 
+    E->hdf5.file_id = -1;
+    E->hdf5.record = 0;
+    E->hdf5.io_time = 0;
+    E->hdf5.open_time = 0;
+
 #endif
 }
 
@@ -226,14 +243,47 @@ void h5output(struct All_variables *E, int cycles)
     MPI_Finalize();
     exit(8);
 #else
+    double begin_time = CPU_time0();
+
     if (cycles == 0) {
-        h5output_const(E);
+        /* the time series file holds the constant data too */
+        if (!E->output.time_series)
+            h5output_const(E);
         output_domain(E);
 
         if (E->output.coord_bin)
             output_coord_bin(E);
     }
-    h5output_timedep(E, cycles);
+
+    if (E->output.time_series)
+        h5output_series(E, cycles);
+    else
+        h5output_timedep(E, cycles);
+
+    E->hdf5.io_time += CPU_time0() - begin_time;
+#endif
+}
+
+
+/* Close the time series file, and report the time spent in output,
+ * so that the two layouts can be compared.
+ */
+void h5output_finalize(struct All_variables *E)
+{
+#ifdef USE_HDF5
+    if (E->hdf5.file_id >= 0) {
+        double begin_time = CPU_time0();
+        h5output_close(E);
+        E->hdf5.io_time += CPU_time0() - begin_time;
+    }
+
+    if (E->parallel.me == 0 && E->fp) {
+        fprintf(E->fp, "HDF5 output (%s): %.4e seconds, "
+                "of which %.4e seconds opening and closing files\n",
+                E->output.time_series ? "time series" : "file per cycle",
+                E->hdf5.io_time, E->hdf5.open_time);
+        fflush(E->fp);
+    }
 #endif
 }
 
@@ -244,6 +294,9 @@ void h5output(struct All_variables *E, int cycles)
 
 void h5input_params(struct All_variables *E)
 {
+    E->output.time_series = 0;
+    E->output.flush_spacing = 0;
+
 #ifdef USE_HDF5
 
     int m = E->parallel.me;
@@ -262,6 +315,9 @@ void h5input_params(struct All_variables *E)
     input_int("cache_rdcc_nelmts", &(E->output.cache_rdcc_nelmts), "521", m);
     input_int("cache_rdcc_nbytes", &(E->output.cache_rdcc_nbytes), "1048576", m);
 
+    input_boolean("output_time_series", &(E->output.time_series), "off", m);
+    input_int("output_flush_spacing", &(E->output.flush_spacing), "10", m);
+
 #endif
 }
 
@@ -294,7 +350,62 @@ static void h5output_timedep(struct All_variables *E, int cycles)
              E->control.data_file, cycles);
 
     h5output_open(E, filename);
+    h5output_fields(E, cycles);
+    h5output_close(E);
+}
+
+
+/* Append one record of every time-dependent field to the time series
+ * file, which is created by the first output of the run.
+ */
+static void h5output_series(struct All_variables *E, int cycles)
+{
+    char filename[100];
+    field_t *field[6];
+    herr_t status;
+    int i;
 
+    if (E->hdf5.file_id < 0) {
+        /* name the file by its first cycle, so that a restarted run */
+        /* does not overwrite it */
+        snprintf(filename, (size_t)100, "%s.series.%d.h5",
+                 E->control.data_file, cycles);
+
+        h5output_open(E, filename);
+
+        h5output_meta(E);
+        h5output_coord(E);
+        h5output_connectivity(E);
+    }
+
+    field[0] = E->hdf5.tensor3d;
+    field[1] = E->hdf5.vector3d;
+    field[2] = E->hdf5.vector2d;
+    field[3] = E->hdf5.scalar3d;
+    field[4] = E->hdf5.scalar2d;
+    field[5] = E->hdf5.scalar1d;
+
+    for(i = 0; i < 6; i++) {
+        field[i]->series = 1;
+        field[i]->record = E->hdf5.record;
+    }
+
+    h5output_fields(E, cycles);
+
+    for(i = 0; i < 6; i++)
+        field[i]->series = 0;
+
+    E->hdf5.record++;
+
+    /* flush periodically, so that a crash loses few records */
+    if (E->output.flush_spacing > 0 &&
+        (E->hdf5.record % E->output.flush_spacing) == 0)
+        status = H5Fflush(E->hdf5.file_id, H5F_SCOPE_GLOBAL);
+}
+
+
+static void h5output_fields(struct All_variables *E, int cycles)
+{
     h5output_time(E, cycles);
     h5output_velocity(E, cycles);
     h5output_temperature(E, cycles);
@@ -318,9 +429,6 @@ static void h5output_timedep(struct All_variables *E, int cycles)
 
     if (E->output.horiz_avg == 1)
         h5output_horiz_avg(E, cycles);
-
-    h5output_close(E);
-
 }
 
 
@@ -351,6 +459,8 @@ static void h5output_open(struct All_variables *E, char *filename)
     hid_t fapl_id;      /* file access property list identifier */
     herr_t status;
 
+    double begin_time = CPU_time0();
+
 
     /********************************************************************
      * Create HDF5 file using parallel I/O                              *
@@ -398,6 +508,8 @@ static void h5output_open(struct All_variables *E, char *filename)
     /* save the file identifier for later use */
     E->hdf5.file_id = file_id;
 
+    E->hdf5.open_time += CPU_time0() - begin_time;
+
 }
 
 
@@ -406,9 +518,13 @@ static void h5output_open(struct All_variables *E, char *filename)
 static void h5output_close(struct All_variables *E)
 {
     herr_t status;
+    double begin_time = CPU_time0();
 
     /* close file */
     status = H5Fclose(E->hdf5.file_id);
+    E->hdf5.file_id = -1;
+
+    E->hdf5.open_time += CPU_time0() - begin_time;
 }
 
 
@@ -1080,11 +1196,14 @@ void h5output_geoid(struct All_variables *E, int cycles)
     hid_t datatype;     /* row datatype identifier */
     hid_t dataspace;    /* memory dataspace */
     hid_t dxpl_id;      /* data transfer property list identifier */
+    hid_t filespace;    /* file dataspace */
+    hid_t dcpl_id;      /* dataset creation property list identifier */
 
     herr_t status;
 
     hsize_t rank = 1;
     hsize_t dim = E->sphere.hindice;
+    hsize_t dims[2], maxdims[2], offset[2], count[2];
     int i, ll, mm;
 
     /* Create the memory data type */
@@ -1115,38 +1234,69 @@ void h5output_geoid(struct All_variables *E, int cycles)
     /* Create the dataspace */
     dataspace = H5Screate_simple(rank, &dim, NULL);
 
-    /* Create the dataset */
-    dataset = H5Dcreate(E->hdf5.file_id, "geoid", datatype,
-                        dataspace, H5P_DEFAULT);
+    /* In a time series, the table has one row of coefficients per
+     * record, and is created by the first record */
+    dims[0] = E->hdf5.record + 1;
+    dims[1] = dim;
+    maxdims[0] = H5S_UNLIMITED;
+    maxdims[1] = dim;
+    offset[0] = E->hdf5.record;
+    offset[1] = 0;
+    count[0] = 1;
+    count[1] = dim;
+
+    if (E->output.time_series && E->hdf5.record > 0)
+    {
+        dataset = H5Dopen(E->hdf5.file_id, "geoid");
+        status = H5Dextend(dataset, dims);
+    }
+    else if (E->output.time_series)
+    {
+        filespace = H5Screate_simple(2, dims, maxdims);
+        dcpl_id = H5Pcreate(H5P_DATASET_CREATE);
+        status = H5Pset_chunk(dcpl_id, 2, count);
+        dataset = H5Dcreate(E->hdf5.file_id, "geoid", datatype,
+                            filespace, dcpl_id);
+        status = H5Pclose(dcpl_id);
+        status = H5Sclose(filespace);
+    }
+    else
+    {
+        /* Create the dataset */
+        dataset = H5Dcreate(E->hdf5.file_id, "geoid", datatype,
+                            dataspace, H5P_DEFAULT);
+    }
 
     /*
      * Write necessary attributes for PyTables compatibility
      */
-
-    set_attribute_string(dataset, "TITLE", "Geoid table");
-    set_attribute_string(dataset, "CLASS", "TABLE");
-    set_attribute_string(dataset, "FLAVOR", "numpy");
-    set_attribute_string(dataset, "VERSION", "2.6");
-
-    set_attribute_llong(dataset, "NROWS", dim);
-
-    set_attribute_string(dataset, "FIELD_0_NAME", "degree");
-    set_attribute_string(dataset, "FIELD_1_NAME", "order");
-    set_attribute_string(dataset, "FIELD_2_NAME", "total_sin");
-    set_attribute_string(dataset, "FIELD_3_NAME", "total_cos");
-    set_attribute_string(dataset, "FIELD_4_NAME", "tpgt_sin");
-    set_attribute_string(dataset, "FIELD_5_NAME", "tpgt_cos");
-    set_attribute_string(dataset, "FIELD_6_NAME", "bncy_sin");
-    set_attribute_string(dataset, "FIELD_7_NAME", "bncy_cos");
-
-    set_attribute_double(dataset, "FIELD_0_FILL", 0);
-    set_attribute_double(dataset, "FIELD_1_FILL", 0);
-    set_attribute_double(dataset, "FIELD_2_FILL", 0);
-    set_attribute_double(dataset, "FIELD_3_FILL", 0);
-    set_attribute_double(dataset, "FIELD_4_FILL", 0);
-    set_attribute_double(dataset, "FIELD_5_FILL", 0);
-    set_attribute_double(dataset, "FIELD_6_FILL", 0);
-    set_attribute_double(dataset, "FIELD_7_FILL", 0);
+    if (!E->output.time_series || E->hdf5.record == 0)
+    {
+        set_attribute_string(dataset, "TITLE", "Geoid table");
+        set_attribute_string(dataset, "CLASS", "TABLE");
+        set_attribute_string(dataset, "FLAVOR", "numpy");
+        set_attribute_string(dataset, "VERSION", "2.6");
+
+        set_attribute_llong(dataset, "NROWS", dim);
+
+        set_attribute_string(dataset, "FIELD_0_NAME", "degree");
+        set_attribute_string(dataset, "FIELD_1_NAME", "order");
+        set_attribute_string(dataset, "FIELD_2_NAME", "total_sin");
+        set_attribute_string(dataset, "FIELD_3_NAME", "total_cos");
+        set_attribute_string(dataset, "FIELD_4_NAME", "tpgt_sin");
+        set_attribute_string(dataset, "FIELD_5_NAME", "tpgt_cos");
+        set_attribute_string(dataset, "FIELD_6_NAME", "bncy_sin");
+        set_attribute_string(dataset, "FIELD_7_NAME", "bncy_cos");
+
+        set_attribute_double(dataset, "FIELD_0_FILL", 0);
+        set_attribute_double(dataset, "FIELD_1_FILL", 0);
+        set_attribute_double(dataset, "FIELD_2_FILL", 0);
+        set_attribute_double(dataset, "FIELD_3_FILL", 0);
+        set_attribute_double(dataset, "FIELD_4_FILL", 0);
+        set_attribute_double(dataset, "FIELD_5_FILL", 0);
+        set_attribute_double(dataset, "FIELD_6_FILL", 0);
+        set_attribute_double(dataset, "FIELD_7_FILL", 0);
+    }
 
     /* Create property list for independent dataset write */
     dxpl_id = H5Pcreate(H5P_DATASET_XFER);
@@ -1173,8 +1323,18 @@ void h5output_geoid(struct All_variables *E, int cycles)
             }
 
         /* write data */
-        status = H5Dwrite(dataset, datatype, dataspace, H5S_ALL,
-                          dxpl_id, row);
+        if (E->output.time_series)
+        {
+            filespace = H5Dget_space(dataset);
+            status = H5Sselect_hyperslab(filespace, H5S_SELECT_SET,
+                                         offset, NULL, count, NULL);
+            status = H5Dwrite(dataset, datatype, dataspace, filespace,
+                              dxpl_id, row);
+            status = H5Sclose(filespace);
+        }
+        else
+            status = H5Dwrite(dataset, datatype, dataspace, H5S_ALL,
+                              dxpl_id, row);
 
         free(row);
     }
@@ -1306,6 +1466,36 @@ void h5output_connectivity(struct All_variables *E)
  ****************************************************************************/
 
 
+/* Append a value to a one-dimensional dataset of the time series */
+static void h5output_series_value(struct All_variables *E,
+                                  const char *name,
+                                  const char *title,
+                                  float value)
+{
+    hid_t dataset;
+    herr_t status;
+
+    hsize_t dims = E->hdf5.record + 1;
+    hsize_t maxdims = H5S_UNLIMITED;
+    hsize_t chunkdims = 1024;
+    hsize_t offset = E->hdf5.record;
+    hsize_t one = 1;
+
+    if (E->hdf5.record == 0)
+        status = h5create_dataset(E->hdf5.file_id, name, title,
+                                  H5T_NATIVE_FLOAT, 1, &dims, &maxdims,
+                                  &chunkdims);
+
+    dataset = H5Dopen(E->hdf5.file_id, name);
+    if (E->hdf5.record > 0)
+        status = H5Dextend(dataset, &dims);
+
+    status = h5write_dataset(dataset, H5T_NATIVE_FLOAT, &value, 1, &one,
+                             &offset, &one, &one, &one, 0,
+                             (E->parallel.me == 0));
+    status = H5Dclose(dataset);
+}
+
 void h5output_time(struct All_variables *E, int cycles)
 {
     hid_t root;
@@ -1315,6 +1505,15 @@ void h5output_time(struct All_variables *E, int cycles)
     status = set_attribute_float(root, "time", E->monitor.elapsed_time);
     status = set_attribute_float(root, "timestep", cycles);
     status = H5Gclose(root);
+
+    /* in a time series, the attributes are those of the last record */
+    if (E->output.time_series)
+    {
+        h5output_series_value(E, "time", "time of each record",
+                              E->monitor.elapsed_time);
+        h5output_series_value(E, "timestep", "timestep of each record",
+                              cycles);
+    }
 }
 
 
@@ -1692,6 +1891,13 @@ static hid_t h5create_group(hid_t loc_id, const char *name, size_t size_hint)
 {
     hid_t group_id;
 
+    /* a time series file has the group since its first record */
+    H5E_BEGIN_TRY {
+        group_id = H5Gopen(loc_id, name);
+    } H5E_END_TRY;
+    if (group_id >= 0)
+        return group_id;
+
     /* TODO:
      *  Make sure this function is called with an appropriately
      *  estimated size_hint parameter
@@ -1867,6 +2073,14 @@ static herr_t h5allocate_field(struct All_variables *E,
         (*field)->maxdims = (hsize_t *)malloc(rank * sizeof(hsize_t));
         (*field)->chunkdims = NULL;
 
+        /* a time series is extendable, hence chunked, one chunk per
+         * process block and record */
+        if (E->output.time_series)
+            (*field)->chunkdims = (hsize_t *)malloc(rank * sizeof(hsize_t));
+
+        (*field)->series = 0;
+        (*field)->record = 0;
+
         (*field)->offset = (hsize_t *)malloc(rank * sizeof(hsize_t));
         (*field)->stride = (hsize_t *)malloc(rank * sizeof(hsize_t));
         (*field)->count  = (hsize_t *)malloc(rank * sizeof(hsize_t));
@@ -1884,6 +2098,9 @@ static herr_t h5allocate_field(struct All_variables *E,
             (*field)->stride[s] = 1;
             (*field)->count[s]  = 1;
             (*field)->block[s]  = 1;
+
+            if ((*field)->chunkdims)
+                (*field)->chunkdims[s] = 1;
         }
 
         if (x >= 0)
@@ -1897,6 +2114,9 @@ static herr_t h5allocate_field(struct All_variables *E,
             (*field)->stride[x] = 1;
             (*field)->count[x]  = 1;
             (*field)->block[x]  = ((px == nprocx-1) ? nx : nx-1);
+
+            if ((*field)->chunkdims)
+                (*field)->chunkdims[x] = ((nprocx > 1) ? nx-1 : nx);
         }
 
         if (y >= 0)
@@ -1910,6 +2130,9 @@ static herr_t h5allocate_field(struct All_variables *E,
             (*field)->stride[y] = 1;
             (*field)->count[y]  = 1;
             (*field)->block[y]  = ((py == nprocy-1) ? ny : ny-1);
+
+            if ((*field)->chunkdims)
+                (*field)->chunkdims[y] = ((nprocy > 1) ? ny-1 : ny);
         }
 
         if (z >= 0)
@@ -1923,6 +2146,9 @@ static herr_t h5allocate_field(struct All_variables *E,
             (*field)->stride[z] = 1;
             (*field)->count[z]  = 1;
             (*field)->block[z]  = ((pz == nprocz-1) ? nz : nz-1);
+
+            if ((*field)->chunkdims)
+                (*field)->chunkdims[z] = ((nprocz > 1) ? nz-1 : nz);
         }
 
         if (c >= 0)
@@ -1936,6 +2162,9 @@ static herr_t h5allocate_field(struct All_variables *E,
             (*field)->stride[c] = 1;
             (*field)->count[c]  = 1;
             (*field)->block[c]  = cdim;
+
+            if ((*field)->chunkdims)
+                (*field)->chunkdims[c] = cdim;
         }
 
         /* count number of data points */
@@ -1971,10 +2200,46 @@ static herr_t h5create_field(hid_t loc_id,
                              const char *name,
                              const char *title)
 {
+    hid_t dataset;
     herr_t status;
 
-    status = h5create_dataset(loc_id, name, title, field->dtype, field->rank,
-                              field->dims, field->maxdims, field->chunkdims);
+    hsize_t dims[MAX_FIELD_RANK];
+    hsize_t maxdims[MAX_FIELD_RANK];
+    hsize_t chunkdims[MAX_FIELD_RANK];
+    int d;
+
+    if (!field->series)
+    {
+        status = h5create_dataset(loc_id, name, title, field->dtype,
+                                  field->rank, field->dims, field->maxdims,
+                                  field->chunkdims);
+        return status;
+    }
+
+    /* prepend the unlimited time dimension */
+    dims[0] = field->record + 1;
+    maxdims[0] = H5S_UNLIMITED;
+    chunkdims[0] = 1;
+    for(d = 0; d < field->rank; d++)
+    {
+        dims[d+1] = field->dims[d];
+        maxdims[d+1] = field->maxdims[d];
+        chunkdims[d+1] = field->chunkdims[d];
+    }
+
+    /* create the dataset for the first record, extend it afterwards */
+    if (field->record == 0)
+    {
+        status = h5create_dataset(loc_id, name, title, field->dtype,
+                                  field->rank+1, dims, maxdims, chunkdims);
+        return status;
+    }
+
+    dataset = H5Dopen(loc_id, name);
+    if (dataset < 0)
+        return -1;
+    status = H5Dextend(dataset, dims);
+    H5Dclose(dataset);
 
     return status;
 }
@@ -2075,10 +2340,37 @@ static herr_t h5write_field(hid_t dset_id, field_t *field, int collective, int d
 {
     herr_t status;
 
+    hsize_t offset[MAX_FIELD_RANK];
+    hsize_t stride[MAX_FIELD_RANK];
+    hsize_t count[MAX_FIELD_RANK];
+    hsize_t block[MAX_FIELD_RANK];
+    int d;
+
+    if (!field->series)
+    {
+        status = h5write_dataset(dset_id, H5T_NATIVE_FLOAT, field->data,
+                                 field->rank, field->block, field->offset,
+                                 field->stride, field->count, field->block,
+                                 collective, dowrite);
+        return status;
+    }
+
+    /* select the current record of the time dimension */
+    offset[0] = field->record;
+    stride[0] = 1;
+    count[0] = 1;
+    block[0] = 1;
+    for(d = 0; d < field->rank; d++)
+    {
+        offset[d+1] = field->offset[d];
+        stride[d+1] = field->stride[d];
+        count[d+1] = field->count[d];
+        block[d+1] = field->block[d];
+    }
+
     status = h5write_dataset(dset_id, H5T_NATIVE_FLOAT, field->data,
-                             field->rank, field->block, field->offset,
-                             field->stride, field->count, field->block,
-                             collective, dowrite);
+                             field->rank+1, block, offset, stride, count,
+                             block, collective, dowrite);
     return status;
 }
 
@@ -370,7 +370,7 @@ static void write_pvts(struct All_variables *E, int cycles)
 {
     FILE *fp;
     char pvts_file[255];
-    int i,j,k;
+    int i,j,k,ezs;
     snprintf(pvts_file, 255, "%s.%d.pvts",
              E->control.data_file,cycles);
     fp = output_open(pvts_file, "w");
@@ -387,7 +387,7 @@ static void write_pvts(struct All_variables *E, int cycles)
     char extent[64], header[1024];
 
     snprintf(extent, 64, "%d %d %d %d %d %d",
-        E->lmesh.ezs, E->lmesh.ezs + E->lmesh.elz*E->parallel.nprocz,
+        E->lmesh.ezs, E->lmesh.ezs + E->mesh.elz,
         E->lmesh.exs, E->lmesh.exs + E->lmesh.elx*E->parallel.nprocx,
         E->lmesh.eys, E->lmesh.eys + E->lmesh.ely*E->parallel.nprocy);
 
@@ -414,10 +414,10 @@ static void write_pvts(struct All_variables *E, int cycles)
 
     for(i=0; i < E->parallel.nprocy;i++){
         for(j=0; j < E->parallel.nprocx;j++){
-            for(k=0; k < E->parallel.nprocz;k++){
+            for(k=0, ezs=0; k < E->parallel.nprocz;
+                ezs+=E->parallel.layer_elz[k], k++){
                 fprintf(fp, "    <Piece Extent=\"%d %d %d %d %d %d\" Source=\"%s.proc%d.%d.vts\"/>\n",
-                    (k%E->parallel.nprocz)*E->lmesh.elz,
-                    (k%E->parallel.nprocz+1)*E->lmesh.elz,
+                    ezs, ezs + E->parallel.layer_elz[k],
                     (j%E->parallel.nprocx)*E->lmesh.elx, (j%E->parallel.nprocx+1)*E->lmesh.elx,
                     (i%E->parallel.nprocy)*E->lmesh.ely, (i%E->parallel.nprocy+1)*E->lmesh.ely,
                     E->control.data_prefix,
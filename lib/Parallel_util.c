@@ -61,6 +61,546 @@ void parallel_process_sync(struct All_variables *E)
   return;
   }
 
+/* ============================================ */
+/* ============================================ */
+
+/* Make room for size doubles in each of the send and receive buffers */
+/* of the multi-field exchanges, and for nrequest requests.  The      */
+/* buffers only grow, so the exchanges do not allocate once warmed up. */
+
+void grow_field_buffers(struct All_variables *E, int size, int nrequest)
+{
+  if (size > E->parallel.fields_bufsize) {
+    E->parallel.fields_bufsize = size + size/4;
+    free(E->parallel.fields_sbuf);
+    free(E->parallel.fields_rbuf);
+    E->parallel.fields_sbuf = (double *) malloc(E->parallel.fields_bufsize*sizeof(double));
+    E->parallel.fields_rbuf = (double *) malloc(E->parallel.fields_bufsize*sizeof(double));
+  }
+
+  if (nrequest > E->parallel.fields_nrequest) {
+    E->parallel.fields_nrequest = nrequest;
+    free(E->parallel.fields_request);
+    E->parallel.fields_request = (MPI_Request *) malloc(nrequest*sizeof(MPI_Request));
+  }
+
+  if (E->parallel.fields_sbuf == NULL || E->parallel.fields_rbuf == NULL ||
+      (nrequest > 0 && E->parallel.fields_request == NULL)) {
+    fprintf(stderr, "grow_field_buffers: cannot allocate %d doubles\n", size);
+    parallel_process_termination();
+  }
+
+  return;
+}
+
+
+/* ============================================
+ Generic halo exchange.
+
+ The geometry lists the passes of an exchange in halo_pass/halo_proc/
+ halo_phase, grouped into ordered phases (e.g. the vertical passes use
+ the values updated by the horizontal ones), and calls
+ setup_halo_exchange(). Within a phase, the passes are exchanged
+ together:
+
+ - with the neighbors on the same compute node through an MPI-3 shared
+   memory window (shared_memory_halo). Each processor packs the values
+   for them into its own part of the window, and the neighbor reads
+   them from there after a barrier among the processors of the node.
+   The window has two halves used in turn, so a processor can fill one
+   half while its neighbors may still be reading the other half from
+   the last phase;
+
+ - with the other neighbors by one MPI_Ineighbor_alltoallv on a
+   distributed graph of the neighbors (neighbor_collectives), or else
+   by point-to-point messages.
+ ============================================ */
+
+static int on_node(struct All_variables *, MPI_Group, MPI_Group, int);
+static void setup_shared_window(struct All_variables *, MPI_Group, MPI_Group);
+static void setup_neighbor_graph(struct All_variables *, MPI_Group, MPI_Group);
+static void setup_halo_buffers(struct All_variables *);
+
+
+void setup_halo_exchange(struct All_variables *E)
+{
+#if MPI_VERSION >= 3
+  MPI_Group world_group, node_group;
+  int lev, i, node_size;
+
+  E->parallel.generic_halo = 0;
+  E->parallel.shm_base = NULL;
+  E->parallel.shm_size = 0;
+  E->parallel.shm_parity = 0;
+  E->parallel.graph_degree = 0;
+  E->parallel.halo_sbuf = E->parallel.halo_rbuf = NULL;
+  E->parallel.halo_request = NULL;
+  E->parallel.halo_counts = NULL;
+  if (!E->parallel.shm_halo && !E->parallel.neighbor_coll)
+    return;
+
+  for (lev=E->mesh.gridmin; lev<=E->mesh.gridmax; lev++)
+    for (i=1; i<=E->parallel.halo_npass[lev]; i++) {
+      E->parallel.shm_slot[lev].pass[i] = -1;
+      E->parallel.halo_edge[lev].pass[i] = -1;
+    }
+
+  if (E->parallel.shm_halo) {
+    MPI_Comm_split_type(E->parallel.world, MPI_COMM_TYPE_SHARED,
+                        E->parallel.me, MPI_INFO_NULL,
+                        &E->parallel.node_comm);
+    MPI_Comm_size(E->parallel.node_comm, &node_size);
+    if (node_size == 1) {
+      /* nobody to share with */
+      MPI_Comm_free(&E->parallel.node_comm);
+      E->parallel.shm_halo = 0;
+    }
+  }
+
+  world_group = node_group = MPI_GROUP_NULL;
+  if (E->parallel.shm_halo) {
+    MPI_Comm_group(E->parallel.world, &world_group);
+    MPI_Comm_group(E->parallel.node_comm, &node_group);
+    setup_shared_window(E, world_group, node_group);
+  }
+
+  if (E->parallel.neighbor_coll)
+    setup_neighbor_graph(E, world_group, node_group);
+
+  if (world_group != MPI_GROUP_NULL) {
+    MPI_Group_free(&world_group);
+    MPI_Group_free(&node_group);
+  }
+
+  E->parallel.generic_halo = (E->parallel.shm_halo ||
+                              E->parallel.neighbor_coll);
+  if (E->parallel.generic_halo)
+    setup_halo_buffers(E);
+#else
+  if ((E->parallel.shm_halo || E->parallel.neighbor_coll) &&
+      E->parallel.me == 0)
+    fprintf(stderr, "shared_memory_halo and neighbor_collectives need "
+            "MPI-3, using messages\n");
+  E->parallel.shm_halo = 0;
+  E->parallel.neighbor_coll = 0;
+  E->parallel.generic_halo = 0;
+#endif
+
+  return;
+}
+
+
+/* Close the passive target epoch opened by setup_shared_window(),    */
+/* and free the window, the communicators and the message buffers.    */
+/* Must be called before MPI_Finalize.                                */
+
+void teardown_halo_exchange(struct All_variables *E)
+{
+#if MPI_VERSION >= 3
+  if (E->parallel.shm_halo) {
+    MPI_Win_unlock_all(E->parallel.shm_win);
+    MPI_Win_free(&E->parallel.shm_win);
+    MPI_Comm_free(&E->parallel.node_comm);
+    E->parallel.shm_halo = 0;
+    E->parallel.shm_base = NULL;
+  }
+
+  if (E->parallel.neighbor_coll) {
+    MPI_Comm_free(&E->parallel.graph_comm);
+    E->parallel.neighbor_coll = 0;
+  }
+
+  if (E->parallel.generic_halo) {
+    free(E->parallel.halo_sbuf);
+    free(E->parallel.halo_rbuf);
+    free(E->parallel.halo_request);
+    free(E->parallel.halo_counts);
+    E->parallel.halo_sbuf = E->parallel.halo_rbuf = NULL;
+    E->parallel.halo_request = NULL;
+    E->parallel.halo_counts = NULL;
+    E->parallel.generic_halo = 0;
+  }
+#endif
+
+  return;
+}
+
+
+#if MPI_VERSION >= 3
+
+/* is the neighbor p of a pass on the same node? */
+
+static int on_node(struct All_variables *E, MPI_Group world_group,
+                   MPI_Group node_group, int p)
+{
+  int node_rank;
+
+  if (!E->parallel.shm_halo || p == -1 || p == E->parallel.me)
+    return 0;
+
+  MPI_Group_translate_ranks(world_group, 1, &p, node_group, &node_rank);
+  return node_rank != MPI_UNDEFINED;
+}
+
+
+static void setup_shared_window(struct All_variables *E,
+                                MPI_Group world_group, MPI_Group node_group)
+{
+  MPI_Request *request;
+  MPI_Aint size;
+  int disp_unit, node_size, node_rank, nreq;
+  int lev, i, k, n, p, nshared, total;
+  int active[MAX_LEVELS][3];
+  struct PASS remote[MAX_LEVELS];
+  double *base;
+
+  MPI_Comm_size(E->parallel.node_comm, &node_size);
+
+  /* a slot for each on-node pass, large enough for the equations */
+  /* or MAX_HALO_FIELDS nodal fields */
+  n = 0;
+  for (lev=0; lev<MAX_LEVELS; lev++)
+    for (k=0; k<3; k++)
+      active[lev][k] = 0;
+
+  for (lev=E->mesh.gridmin; lev<=E->mesh.gridmax; lev++)
+    for (i=1; i<=E->parallel.halo_npass[lev]; i++) {
+      k = E->parallel.halo_pass[lev].pass[i];
+      p = E->parallel.halo_proc[lev].pass[i];
+      if (!on_node(E, world_group, node_group, p))
+        continue;
+
+      E->parallel.shm_slot[lev].pass[i] = n;
+      n += max(E->parallel.NUM_NEQ[lev][1].pass[k],
+               MAX_HALO_FIELDS*E->parallel.NUM_NODE[lev][1].pass[k]);
+      active[lev][E->parallel.halo_phase[lev].pass[i]] = 1;
+    }
+
+  E->parallel.shm_size = n;
+  E->parallel.shm_parity = 0;
+  MPI_Win_allocate_shared((MPI_Aint)(2*n*sizeof(double)), sizeof(double),
+                          MPI_INFO_NULL, E->parallel.node_comm,
+                          &E->parallel.shm_base, &E->parallel.shm_win);
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, E->parallel.shm_win);
+
+  /* tell each on-node neighbor where my slot of the pass is, */
+  /* in the same order as the messages of the exchange */
+  nreq = 0;
+  for (lev=E->mesh.gridmin; lev<=E->mesh.gridmax; lev++)
+    nreq += 2*E->parallel.halo_npass[lev];
+  request = (MPI_Request *)malloc((nreq+1)*sizeof(MPI_Request));
+
+  nreq = 0;
+  for (lev=E->mesh.gridmin; lev<=E->mesh.gridmax; lev++)
+    for (i=1; i<=E->parallel.halo_npass[lev]; i++) {
+      if (E->parallel.shm_slot[lev].pass[i] < 0)
+        continue;
+      p = E->parallel.halo_proc[lev].pass[i];
+      MPI_Isend(&E->parallel.shm_slot[lev].pass[i], 1, MPI_INT, p, lev,
+                E->parallel.world, &request[nreq++]);
+      MPI_Irecv(&remote[lev].pass[i], 1, MPI_INT, p, lev,
+                E->parallel.world, &request[nreq++]);
+    }
+  MPI_Waitall(nreq, request, MPI_STATUSES_IGNORE);
+  free((void *)request);
+
+  nshared = total = 0;
+  for (lev=E->mesh.gridmin; lev<=E->mesh.gridmax; lev++)
+    for (i=1; i<=E->parallel.halo_npass[lev]; i++) {
+      p = E->parallel.halo_proc[lev].pass[i];
+      if (lev == E->mesh.gridmax && p != -1 && p != E->parallel.me)
+        total++;
+      E->parallel.shm_remote[lev][i] = NULL;
+      if (E->parallel.shm_slot[lev].pass[i] < 0)
+        continue;
+      if (lev == E->mesh.gridmax)
+        nshared++;
+
+      MPI_Group_translate_ranks(world_group, 1, &p, node_group, &node_rank);
+      MPI_Win_shared_query(E->parallel.shm_win, node_rank, &size,
+                           &disp_unit, &base);
+      E->parallel.shm_remote[lev][i] = base + remote[lev].pass[i];
+      E->parallel.shm_rsize[lev].pass[i] = size / sizeof(double) / 2;
+    }
+
+  /* a phase needs the node barrier if any processor of the node */
+  /* has an on-node pass in it */
+  MPI_Allreduce(active, E->parallel.shm_active, MAX_LEVELS*3, MPI_INT,
+                MPI_MAX, E->parallel.node_comm);
+
+  if (E->control.verbose) {
+    fprintf(E->fp_out, "shared memory halo: %d of %d neighbors on node "
+            "(%d processors), %d doubles\n",
+            nshared, total, node_size, 2*n);
+    fflush(E->fp_out);
+  }
+
+  return;
+}
+
+
+/* The off-node neighbors, in the order of the passes, are the edges of */
+/* a distributed graph. The edges (and their order) must be the same on */
+/* all levels, only the sizes differ.                                   */
+
+static void setup_neighbor_graph(struct All_variables *E,
+                                 MPI_Group world_group, MPI_Group node_group)
+{
+  int lev, i, p, n, ok;
+  int *nbr, *weight;
+
+  nbr = (int *)malloc(2*(E->parallel.halo_npass[E->mesh.gridmax]+1)*sizeof(int));
+  weight = nbr + E->parallel.halo_npass[E->mesh.gridmax] + 1;
+
+  n = -1;
+  ok = 1;
+  for (lev=E->mesh.gridmax; lev>=E->mesh.gridmin; lev--) {
+    int e = 0;
+    for (i=1; i<=E->parallel.halo_npass[lev]; i++) {
+      p = E->parallel.halo_proc[lev].pass[i];
+      if (p == -1 || p == E->parallel.me ||
+          on_node(E, world_group, node_group, p))
+        continue;
+      if (lev == E->mesh.gridmax) {
+        nbr[e] = p;
+        weight[e] = E->parallel.NUM_NEQ[lev][1].pass[E->parallel.halo_pass[lev].pass[i]];
+      }
+      else if (e >= n || nbr[e] != p)
+        ok = 0;
+      E->parallel.halo_edge[lev].pass[i] = e++;
+    }
+    if (lev == E->mesh.gridmax)
+      n = e;
+    else if (e != n)
+      ok = 0;
+  }
+
+  if (!ok) {
+    fprintf(stderr, "!!!! the neighbors differ between the levels, "
+            "cannot use neighbor_collectives (me=%d)\n", E->parallel.me);
+    parallel_process_termination();
+  }
+
+  /* the edges are weighted by the size of the finest halo.  The ranks  */
+  /* are not reordered: the decomposition and the halo are keyed on     */
+  /* the ranks of E->parallel.world, which must stay those of the graph */
+  E->parallel.graph_degree = n;
+  MPI_Dist_graph_create_adjacent(E->parallel.world, n, nbr, weight,
+                                 n, nbr, weight, MPI_INFO_NULL, 0,
+                                 &E->parallel.graph_comm);
+  free((void *)nbr);
+
+  if (E->control.verbose) {
+    fprintf(E->fp_out, "neighbor collectives: %d edges\n", n);
+    fflush(E->fp_out);
+  }
+
+  return;
+}
+
+
+static int halo_size(struct All_variables *E, int lev, int k, int by_id)
+{
+  return by_id ? E->parallel.NUM_NEQ[lev][1].pass[k]
+               : E->parallel.NUM_NODE[lev][1].pass[k];
+}
+
+
+/* Every pass gets its own block of the send and receive buffers, large */
+/* enough for the equations or MAX_HALO_FIELDS nodal fields, so that    */
+/* halo_exchange() needs no allocation. The collective addresses the     */
+/* blocks of its edges through the displacements.                        */
+
+static void setup_halo_buffers(struct All_variables *E)
+{
+  int lev, i, k, n, size, npass;
+
+  size = npass = 0;
+  for (lev=E->mesh.gridmin; lev<=E->mesh.gridmax; lev++) {
+    n = 0;
+    for (i=1; i<=E->parallel.halo_npass[lev]; i++) {
+      k = E->parallel.halo_pass[lev].pass[i];
+      E->parallel.halo_offset[lev].pass[i] = n;
+      n += max(E->parallel.NUM_NEQ[lev][1].pass[k],
+               MAX_HALO_FIELDS*E->parallel.NUM_NODE[lev][1].pass[k]);
+    }
+    size = max(size, n);
+    npass = max(npass, E->parallel.halo_npass[lev]);
+  }
+
+  E->parallel.halo_sbuf = (double *)malloc((size+1)*sizeof(double));
+  E->parallel.halo_rbuf = (double *)malloc((size+1)*sizeof(double));
+  E->parallel.halo_request = (MPI_Request *)malloc((2*npass+1)*sizeof(MPI_Request));
+  E->parallel.halo_counts = (int *)malloc((2*E->parallel.graph_degree+1)*sizeof(int));
+
+  if (E->parallel.halo_sbuf == NULL || E->parallel.halo_rbuf == NULL ||
+      E->parallel.halo_request == NULL || E->parallel.halo_counts == NULL) {
+    fprintf(stderr, "setup_halo_buffers: cannot allocate %d doubles\n", size);
+    parallel_process_termination();
+  }
+
+  return;
+}
+
+
+static void pack_halo(struct All_variables *E, int lev, int k, int by_id,
+                      int nd, double ***Ud, int nf, float ***Uf, double *buf)
+{
+  struct PASS *index = by_id ? E->parallel.EXCHANGE_ID[lev][1]
+                             : E->parallel.EXCHANGE_NODE[lev][1];
+  const int n = halo_size(E, lev, k, by_id);
+  int f, j;
+
+  for (f=0; f<nd; f++)
+    for (j=1; j<=n; j++)
+      *buf++ = Ud[f][1][ index[j].pass[k] ];
+  for (f=0; f<nf; f++)
+    for (j=1; j<=n; j++)
+      *buf++ = Uf[f][1][ index[j].pass[k] ];
+
+  return;
+}
+
+
+static void add_halo(struct All_variables *E, int lev, int k, int by_id,
+                     int nd, double ***Ud, int nf, float ***Uf, double *buf)
+{
+  struct PASS *index = by_id ? E->parallel.EXCHANGE_ID[lev][1]
+                             : E->parallel.EXCHANGE_NODE[lev][1];
+  const int n = halo_size(E, lev, k, by_id);
+  int f, j;
+
+  for (f=0; f<nd; f++)
+    for (j=1; j<=n; j++)
+      Ud[f][1][ index[j].pass[k] ] += *buf++;
+  for (f=0; f<nf; f++)
+    for (j=1; j<=n; j++)
+      Uf[f][1][ index[j].pass[k] ] += (float)*buf++;
+
+  return;
+}
+
+#endif
+
+
+/* Exchange nd double fields Ud and nf float fields Uf. by_id selects   */
+/* EXCHANGE_ID (as exchange_id_d) or EXCHANGE_NODE (as exchange_node_*). */
+/* The float values are sent as doubles, which is exact. The sums are   */
+/* added in the same order as by the message exchange, so the results   */
+/* are identical.                                                       */
+
+void halo_exchange(struct All_variables *E, int lev, int by_id,
+                   int nd, double ***Ud, int nf, float ***Uf)
+{
+#if MPI_VERSION >= 3
+  MPI_Request *const request = E->parallel.halo_request;
+  MPI_Request coll_request;
+  const int me = E->parallel.me;
+  const int nfield = nd + nf;
+  const int degree = E->parallel.graph_degree;
+  int i, k, n, p, e, phase, nreq, slot, off;
+  int *counts, *displs;
+  double *sbuf, *rbuf, *mine;
+
+  if (nfield > MAX_HALO_FIELDS) {
+    fprintf(stderr, "halo_exchange: too many fields (%d)\n", nfield);
+    parallel_process_termination();
+  }
+
+  sbuf = E->parallel.halo_sbuf;
+  rbuf = E->parallel.halo_rbuf;
+  counts = E->parallel.halo_counts;
+  displs = counts + degree;
+
+  for (phase=0; phase<E->parallel.halo_nphase; phase++) {
+    mine = E->parallel.shm_base + E->parallel.shm_parity*E->parallel.shm_size;
+
+    /* the edges of the graph not in this phase exchange nothing */
+    if (E->parallel.neighbor_coll) {
+      for (e=0; e<degree; e++)
+        counts[e] = displs[e] = 0;
+      for (i=1; i<=E->parallel.halo_npass[lev]; i++) {
+        e = E->parallel.halo_edge[lev].pass[i];
+        if (e >= 0 && E->parallel.halo_phase[lev].pass[i] == phase) {
+          counts[e] = nfield*halo_size(E, lev, E->parallel.halo_pass[lev].pass[i], by_id);
+          displs[e] = E->parallel.halo_offset[lev].pass[i];
+        }
+      }
+    }
+
+    nreq = 0;
+    for (i=1; i<=E->parallel.halo_npass[lev]; i++) {
+      if (E->parallel.halo_phase[lev].pass[i] != phase)
+        continue;
+      k = E->parallel.halo_pass[lev].pass[i];
+      p = E->parallel.halo_proc[lev].pass[i];
+      slot = E->parallel.shm_slot[lev].pass[i];
+      e = E->parallel.halo_edge[lev].pass[i];
+      off = E->parallel.halo_offset[lev].pass[i];
+      if (p == -1)
+        continue;
+
+      if (slot >= 0) {
+        pack_halo(E, lev, k, by_id, nd, Ud, nf, Uf, mine + slot);
+        continue;
+      }
+
+      pack_halo(E, lev, k, by_id, nd, Ud, nf, Uf, sbuf + off);
+      if (e < 0 && p != me) {
+        n = nfield*halo_size(E, lev, k, by_id);
+        MPI_Isend(sbuf + off, n, MPI_DOUBLE, p, 1, E->parallel.world,
+                  &request[nreq++]);
+        MPI_Irecv(rbuf + off, n, MPI_DOUBLE, p, 1, E->parallel.world,
+                  &request[nreq++]);
+      }
+    }
+
+    if (E->parallel.neighbor_coll)
+      MPI_Ineighbor_alltoallv(sbuf, counts, displs, MPI_DOUBLE,
+                              rbuf, counts, displs, MPI_DOUBLE,
+                              E->parallel.graph_comm, &coll_request);
+
+    if (E->parallel.shm_halo && E->parallel.shm_active[lev][phase]) {
+      MPI_Win_sync(E->parallel.shm_win);
+      MPI_Barrier(E->parallel.node_comm);
+      MPI_Win_sync(E->parallel.shm_win);
+    }
+
+    /* passes to myself first, then the others in order */
+    for (i=1; i<=E->parallel.halo_npass[lev]; i++)
+      if (E->parallel.halo_phase[lev].pass[i] == phase &&
+          E->parallel.halo_proc[lev].pass[i] == me)
+        add_halo(E, lev, E->parallel.halo_pass[lev].pass[i], by_id,
+                 nd, Ud, nf, Uf, sbuf + E->parallel.halo_offset[lev].pass[i]);
+
+    MPI_Waitall(nreq, request, MPI_STATUSES_IGNORE);
+    if (E->parallel.neighbor_coll)
+      MPI_Wait(&coll_request, MPI_STATUS_IGNORE);
+
+    for (i=1; i<=E->parallel.halo_npass[lev]; i++) {
+      if (E->parallel.halo_phase[lev].pass[i] != phase)
+        continue;
+      k = E->parallel.halo_pass[lev].pass[i];
+      p = E->parallel.halo_proc[lev].pass[i];
+      if (p == -1 || p == me)
+        continue;
+
+      if (E->parallel.shm_slot[lev].pass[i] >= 0)
+        add_halo(E, lev, k, by_id, nd, Ud, nf, Uf,
+                 E->parallel.shm_remote[lev][i]
+                 + E->parallel.shm_parity*E->parallel.shm_rsize[lev].pass[i]);
+      else
+        add_halo(E, lev, k, by_id, nd, Ud, nf, Uf,
+                 rbuf + E->parallel.halo_offset[lev].pass[i]);
+    }
+
+    if (E->parallel.shm_halo && E->parallel.shm_active[lev][phase])
+      E->parallel.shm_parity = 1 - E->parallel.shm_parity;
+  }
+#endif
+
+  return;
+}
 
 /* ==========================   */
 
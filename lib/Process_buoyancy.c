@@ -204,46 +204,64 @@ void heat_flux(E)
 */
 void compute_horiz_avg(struct All_variables *E)
 {
-    void return_horiz_ave_f();
-
-    int m, n, i;
-    float *S1[NCS],*S2[NCS],*S3[NCS];
+    void return_horiz_ave_fields();
+
+    int m, n, i, nd;
+    float *S2[NCS],*S3[NCS];
+    float **Xf[2], *Hf[2];
+    double ***Xd, **Hd;
+
+    /* temperature and compositions are averaged in double, the
+       squared velocities in float, all by one reduction */
+    nd = 1 + (E->composition.on ? E->composition.ncomp : 0);
+    Xd = (double ***)malloc(nd*sizeof(double **));
+    Hd = (double **)malloc(nd*sizeof(double *));
+
+    for(n=0; n<nd; n++) {
+        Xd[n] = (double **)malloc(NCS*sizeof(double *));
+        Hd[n] = (double *)malloc((E->lmesh.noz+1)*sizeof(double));
+        for(m=1;m<=E->sphere.caps_per_proc;m++)
+            Xd[n][m] = (n == 0) ? E->T[m] : E->composition.comp_node[m][n-1];
+    }
 
     for(m=1;m<=E->sphere.caps_per_proc;m++)      {
-	S1[m] = (float *)malloc((E->lmesh.nno+1)*sizeof(float));
 	S2[m] = (float *)malloc((E->lmesh.nno+1)*sizeof(float));
 	S3[m] = (float *)malloc((E->lmesh.nno+1)*sizeof(float));
     }
 
     for(m=1;m<=E->sphere.caps_per_proc;m++) {
 	for(i=1;i<=E->lmesh.nno;i++) {
-	    S1[m][i] = E->T[m][i];
 	    S2[m][i] = E->sphere.cap[m].V[1][i]*E->sphere.cap[m].V[1][i]
           	+ E->sphere.cap[m].V[2][i]*E->sphere.cap[m].V[2][i];
 	    S3[m][i] = E->sphere.cap[m].V[3][i]*E->sphere.cap[m].V[3][i];
 	}
     }
 
-    return_horiz_ave_f(E,S1,E->Have.T);
-    return_horiz_ave_f(E,S2,E->Have.V[1]);
-    return_horiz_ave_f(E,S3,E->Have.V[2]);
-
-    if (E->composition.on) {
-        for(n=0; n<E->composition.ncomp; n++) {
-            for(m=1;m<=E->sphere.caps_per_proc;m++) {
-                for(i=1;i<=E->lmesh.nno;i++)
-                    S1[m][i] = E->composition.comp_node[m][n][i];
-            }
-            return_horiz_ave_f(E,S1,E->Have.C[n]);
-        }
+    Xf[0] = S2;
+    Xf[1] = S3;
+    Hf[0] = E->Have.V[1];
+    Hf[1] = E->Have.V[2];
+
+    return_horiz_ave_fields(E,nd,Xd,Hd,2,Xf,Hf);
+
+    for (i=1;i<=E->lmesh.noz;i++) {
+        E->Have.T[i] = Hd[0][i];
+        for(n=1; n<nd; n++)
+            E->Have.C[n-1][i] = Hd[n][i];
     }
 
     for(m=1;m<=E->sphere.caps_per_proc;m++) {
-	free((void *)S1[m]);
 	free((void *)S2[m]);
 	free((void *)S3[m]);
     }
 
+    for(n=0; n<nd; n++) {
+        free((void *)Xd[n]);
+        free((void *)Hd[n]);
+    }
+    free((void *)Xd);
+    free((void *)Hd);
+
     for (i=1;i<=E->lmesh.noz;i++) {
 	E->Have.V[1][i] = sqrt(E->Have.V[1][i]);
 	E->Have.V[2][i] = sqrt(E->Have.V[2][i]);
@@ -37,9 +37,14 @@
 
 static void set_horizontal_communicator(struct All_variables*);
 static void set_vertical_communicator(struct All_variables*);
+static void set_halo_passes(struct All_variables*);
 
 static void exchange_node_d(struct All_variables *, double**, int);
 static void exchange_node_f(struct All_variables *, float**, int);
+static void exchange_node_fields(struct All_variables *, int, double***,
+                                 int, float***, int);
+static void exchange_snode_fields(struct All_variables *, int, double***,
+                                  int, float***, int);
 
 
 /* ============================================ */
@@ -126,6 +131,8 @@ void regional_parallel_processor_setup(struct All_variables *E)
 
   E->exchange_node_d = exchange_node_d;
   E->exchange_node_f = exchange_node_f;
+  E->exchange_node_fields = exchange_node_fields;
+  E->exchange_snode_fields = exchange_snode_fields;
 
   return;
   }
@@ -213,10 +220,22 @@ get element information for each processor.
 void regional_parallel_domain_decomp0(struct All_variables *E)
   {
 
-  int i,nox,noz,noy,me;
+  int i,k,nox,noz,noy,me;
 
   me = E->parallel.me;
 
+  if (E->parallel.radial_repartition) {
+    if (me==0)
+      fprintf(stderr,"!!!! radial_repartition is only available for the full spherical model\n");
+    parallel_process_termination();
+  }
+
+  /* the radial layers are always even */
+  E->parallel.layer_elz = (int *)malloc(E->parallel.nprocz*sizeof(int));
+  E->parallel.chkpt_layer_elz = (int *)malloc(E->parallel.nprocz*sizeof(int));
+  for (k=0;k<E->parallel.nprocz;k++)
+    E->parallel.layer_elz[k] = E->parallel.chkpt_layer_elz[k] = E->mesh.elz/E->parallel.nprocz;
+
   E->lmesh.elx = E->mesh.elx/E->parallel.nprocx;
   E->lmesh.elz = E->mesh.elz/E->parallel.nprocz;
   E->lmesh.ely = E->mesh.ely/E->parallel.nprocy;
@@ -610,9 +629,38 @@ void regional_parallel_communication_routs_v(E)
     fflush(E->fp_out);
   }
 
+  if(E->parallel.shm_halo || E->parallel.neighbor_coll) {
+    set_halo_passes(E);
+    setup_halo_exchange(E);
+  }
+
   return;
   }
 
+
+/* the passes are exchanged one after another, but the two passes of a */
+/* direction touch different boundaries and can go together             */
+
+static void set_halo_passes(struct All_variables *E)
+{
+  int lev,ii,n;
+
+  for(lev=E->mesh.gridmin;lev<=E->mesh.gridmax;lev++) {
+    n = 0;
+    for (ii=1;ii<=6;ii++)
+      if (E->parallel.NUM_PASS[lev][1].bound[ii] == 1) {
+        n++;
+        E->parallel.halo_pass[lev].pass[n] = n;
+        E->parallel.halo_proc[lev].pass[n] = E->parallel.PROCESSOR[lev][1].pass[n];
+        E->parallel.halo_phase[lev].pass[n] = (ii-1)/2;
+      }
+    E->parallel.halo_npass[lev] = n;
+  }
+
+  E->parallel.halo_nphase = 3;
+  return;
+}
+
 /* ============================================
  determine communication routs for
  exchange info across the boundaries on the surfaces
@@ -753,6 +801,11 @@ void regional_exchange_id_d(E, U, lev)
 
  MPI_Status status;
 
+ if (E->parallel.generic_halo) {
+   halo_exchange(E, lev, 1, 1, &U, 0, NULL);
+   return;
+ }
+
  for (m=1;m<=E->sphere.caps_per_proc;m++)    {
    for (k=1;k<=E->parallel.TNUM_PASS[lev][m];k++)  {
      sizeofk = (1+E->parallel.NUM_NEQ[lev][m].pass[k])*sizeof(double);
@@ -803,6 +856,11 @@ static void exchange_node_d(E, U, lev)
 
  MPI_Status status;
 
+ if (E->parallel.generic_halo) {
+   halo_exchange(E, lev, 0, 1, &U, 0, NULL);
+   return;
+ }
+
  for (m=1;m<=E->sphere.caps_per_proc;m++)    {
    for (k=1;k<=E->parallel.TNUM_PASS[lev][m];k++)  {
      sizeofk = (1+E->parallel.NUM_NODE[lev][m].pass[k])*sizeof(double);
@@ -852,6 +910,11 @@ static void exchange_node_f(E, U, lev)
 
  MPI_Status status;
 
+ if (E->parallel.generic_halo) {
+   halo_exchange(E, lev, 0, 0, NULL, 1, &U);
+   return;
+ }
+
  for (m=1;m<=E->sphere.caps_per_proc;m++)    {
    for (k=1;k<=E->parallel.TNUM_PASS[lev][m];k++)  {
      sizeofk = (1+E->parallel.NUM_NODE[lev][m].pass[k])*sizeof(float);
@@ -891,54 +954,99 @@ static void exchange_node_f(E, U, lev)
 /* ================================================ */
 /* ================================================ */
 
-void regional_exchange_snode_f(struct All_variables *E, float **U1,
-                               float **U2, int lev)
- {
+/* Exchange nd double and nf float fields at once, packing all the     */
+/* fields for a neighbor into one message of doubles.  With surf set,  */
+/* the fields are on the surface nodes and the surface passes are      */
+/* used.  The buffers are kept in E->parallel.                         */
 
- int ii,j,k,m,kk,t_cap,idb,msginfo[8];
- float *S[27],*R[27];
- int sizeofk;
+static void exchange_fields(E, surf, nd, Ud, nf, Uf, lev)
+ struct All_variables *E;
+ int surf, nd, nf;
+ double ***Ud;
+ float ***Uf;
+ int lev;
+{
+
+ int f,j,m,k,n,npass,nfield,size;
+ struct PASS *num, *proc, *exch;
+ double *S, *R;
 
  MPI_Status status;
 
+ nfield = nd + nf;
+
+ size = 0;
  for (m=1;m<=E->sphere.caps_per_proc;m++)    {
-   for (k=1;k<=E->parallel.sTNUM_PASS[lev][m];k++)  {
-     sizeofk = (1+2*E->parallel.NUM_sNODE[lev][m].pass[k])*sizeof(float);
-     S[k]=(float *)malloc( sizeofk );
-     R[k]=(float *)malloc( sizeofk );
-   }
+   npass = surf ? E->parallel.sTNUM_PASS[lev][m] : E->parallel.TNUM_PASS[lev][m];
+   num = surf ? &E->parallel.NUM_sNODE[lev][m] : &E->parallel.NUM_NODE[lev][m];
+   for (k=1;k<=npass;k++)
+     size = max(size, nfield*num->pass[k]);
  }
 
- for (m=1;m<=E->sphere.caps_per_proc;m++)   {
-   for (k=1;k<=E->parallel.sTNUM_PASS[lev][m];k++)  {
+ grow_field_buffers(E, size, 0);
+ S = E->parallel.fields_sbuf;
+ R = E->parallel.fields_rbuf;
 
-     for (j=1;j<=E->parallel.NUM_sNODE[lev][m].pass[k];j++)  {
-       S[k][j-1] = U1[m][ E->parallel.EXCHANGE_sNODE[lev][m][j].pass[k] ];
-       S[k][j-1+E->parallel.NUM_sNODE[lev][m].pass[k]]
-	 = U2[m][ E->parallel.EXCHANGE_sNODE[lev][m][j].pass[k] ];
-     }
+ for(m=1;m<=E->sphere.caps_per_proc;m++)     {
+   npass = surf ? E->parallel.sTNUM_PASS[lev][m] : E->parallel.TNUM_PASS[lev][m];
+   num = surf ? &E->parallel.NUM_sNODE[lev][m] : &E->parallel.NUM_NODE[lev][m];
+   proc = surf ? &E->parallel.sPROCESSOR[lev][m] : &E->parallel.PROCESSOR[lev][m];
+   exch = surf ? E->parallel.EXCHANGE_sNODE[lev][m] : E->parallel.EXCHANGE_NODE[lev][m];
 
-     MPI_Sendrecv(S[k],2*E->parallel.NUM_sNODE[lev][m].pass[k],MPI_FLOAT,
-		  E->parallel.sPROCESSOR[lev][m].pass[k],1,
-		  R[k],2*E->parallel.NUM_sNODE[lev][m].pass[k],MPI_FLOAT,
-		  E->parallel.sPROCESSOR[lev][m].pass[k],1,
-		  E->parallel.world,&status);
+   for (k=1;k<=npass;k++)   {
 
-     for (j=1;j<=E->parallel.NUM_sNODE[lev][m].pass[k];j++)   {
-       U1[m][ E->parallel.EXCHANGE_sNODE[lev][m][j].pass[k] ] += R[k][j-1];
-       U2[m][ E->parallel.EXCHANGE_sNODE[lev][m][j].pass[k] ] +=
-	 R[k][j-1+E->parallel.NUM_sNODE[lev][m].pass[k]];
-     }
+     n = num->pass[k];
+
+     for (f=0;f<nd;f++)
+       for (j=1;j<=n;j++)
+         S[f*n+j-1] = Ud[f][m][ exch[j].pass[k] ];
+     for (f=0;f<nf;f++)
+       for (j=1;j<=n;j++)
+         S[(nd+f)*n+j-1] = Uf[f][m][ exch[j].pass[k] ];
 
+     MPI_Sendrecv(S,nfield*n,MPI_DOUBLE,proc->pass[k],1,
+		  R,nfield*n,MPI_DOUBLE,proc->pass[k],1,
+		  E->parallel.world,&status);
+
+     for (f=0;f<nd;f++)
+       for (j=1;j<=n;j++)
+         Ud[f][m][ exch[j].pass[k] ] += R[f*n+j-1];
+     for (f=0;f<nf;f++)
+       for (j=1;j<=n;j++)
+         Uf[f][m][ exch[j].pass[k] ] += (float)R[(nd+f)*n+j-1];
    }
  }
 
- for (m=1;m<=E->sphere.caps_per_proc;m++)
- for (k=1;k<=E->parallel.sTNUM_PASS[lev][m];k++)  {
-   free((void*) S[k]);
-   free((void*) R[k]);
- }
+ return;
+}
+
+
+static void exchange_node_fields(E, nd, Ud, nf, Uf, lev)
+ struct All_variables *E;
+ int nd, nf;
+ double ***Ud;
+ float ***Uf;
+ int lev;
+{
+ if (E->parallel.generic_halo)
+   halo_exchange(E, lev, 0, nd, Ud, nf, Uf);
+ else
+   exchange_fields(E, 0, nd, Ud, nf, Uf, lev);
 
  return;
- }
+}
+
+
+/* the same for fields on the surface nodes, e.g. the dynamic topography */
+
+static void exchange_snode_fields(E, nd, Ud, nf, Uf, lev)
+ struct All_variables *E;
+ int nd, nf;
+ double ***Ud;
+ float ***Uf;
+ int lev;
+{
+ exchange_fields(E, 1, nd, Ud, nf, Uf, lev);
+ return;
+}
 
@@ -104,6 +104,11 @@ void regional_tracer_setup(struct All_variables *E)
     if (E->trace.nflavors > 0)
         E->trace.number_of_extra_quantities += 1;
 
+    /* weight of the tracers, for population control */
+    E->trace.iweight = -1;
+    if (E->trace.min_per_element > 0 || E->trace.max_per_element > 0)
+        E->trace.iweight = E->trace.number_of_extra_quantities++;
+
 
     E->trace.number_of_tracer_quantities =
         E->trace.number_of_basic_quantities +
@@ -573,6 +578,72 @@ void regional_get_velocity(struct All_variables *E,
 }
 
 
+/******** GET VELOCITY (BATCH) *******************************/
+/*                                                           */
+/* Same as regional_get_velocity, for n tracers that all lie */
+/* in element nelem.  The element geometry and its Cartesian */
+/* nodal velocities are computed once for the batch.         */
+
+void regional_get_velocity_batch(struct All_variables *E,
+                                 int m, int nelem, int n,
+                                 const double *theta, const double *phi,
+                                 const double *rad,
+                                 double *vx, double *vy, double *vz)
+{
+    void velo_from_element_d();
+
+    double VV[4][9], shp[9];
+    double x0, y0, z0, dx, dy, dz, volume;
+    double tr_dx, tr_dy, tr_dz;
+    int e, i, j, k, t, nn, d;
+    const int sphere_key = 0;
+    double *vel[4];
+
+    e = nelem - 1;
+    k = e % E->lmesh.elz;
+    i = (e / E->lmesh.elz) % E->lmesh.elx;
+    j = e / (E->lmesh.elz*E->lmesh.elx);
+
+    x0 = E->trace.x_space[i];
+    dx = E->trace.x_space[i+1] - x0;
+    y0 = E->trace.y_space[j];
+    dy = E->trace.y_space[j+1] - y0;
+    z0 = E->trace.z_space[k];
+    dz = E->trace.z_space[k+1] - z0;
+    volume = dx*dz*dy;
+
+    /* get cartesian velocity */
+    velo_from_element_d(E, VV, m, nelem, sphere_key);
+
+    vel[1] = vx;
+    vel[2] = vy;
+    vel[3] = vz;
+
+    for(t=0; t<n; t++) {
+        tr_dx = theta[t] - x0;
+        tr_dy = phi[t] - y0;
+        tr_dz = rad[t] - z0;
+
+        shp[1] = (dx-tr_dx) * (dy-tr_dy) * (dz-tr_dz) / volume;
+        shp[2] = tr_dx      * (dy-tr_dy) * (dz-tr_dz) / volume;
+        shp[3] = tr_dx      * tr_dy      * (dz-tr_dz) / volume;
+        shp[4] = (dx-tr_dx) * tr_dy      * (dz-tr_dz) / volume;
+        shp[5] = (dx-tr_dx) * (dy-tr_dy) * tr_dz      / volume;
+        shp[6] = tr_dx      * (dy-tr_dy) * tr_dz      / volume;
+        shp[7] = tr_dx      * tr_dy      * tr_dz      / volume;
+        shp[8] = (dx-tr_dx) * tr_dy      * tr_dz      / volume;
+
+        for(d=1; d<=3; d++) {
+            vel[d][t] = 0;
+            for(nn=1; nn<=8; nn++)
+                vel[d][t] += VV[d][nn] * shp[nn];
+        }
+    }
+
+    return;
+}
+
+
 void regional_keep_within_bounds(struct All_variables *E,
                                  double *x, double *y, double *z,
                                  double *theta, double *phi, double *rad)
@@ -1008,16 +1079,7 @@ static void put_found_tracers(struct All_variables *E,
         }
         else {
             if (E->trace.ilatersize[j]==0) {
-
-                E->trace.ilatersize[j]=E->trace.max_ntracers[j]/5;
-
-                for (kk=0;kk<E->trace.number_of_tracer_quantities;kk++) {
-                    if ((E->trace.rlater[j][kk]=(double *)malloc(E->trace.ilatersize[j]*sizeof(double)))==NULL) {
-                        fprintf(E->trace.fpt,"AKM(put_found_tracers)-no memory (%d)\n",kk);
-                        fflush(E->trace.fpt);
-                        exit(10);
-                    }
-                }
+                allocate_later_array(E, j, E->trace.max_ntracers[j]/5);
             } /* end first particle initiating memory allocation */
 
             E->trace.ilater[j]++;
@@ -1010,6 +1010,7 @@ void mass_matrix(struct All_variables *E)
     int m,node,i,nint,e,lev;
     int n[9], nz;
     double myatan(),area,centre[4],temp[9],temp2[9],dx1,dx2,dx3;
+    double **fields[2];
 
     const int vpts=vpoints[E->mesh.nsd];
 
@@ -1107,7 +1108,11 @@ void mass_matrix(struct All_variables *E)
                 for(node=1;node<=E->lmesh.NNO[lev];node++)
                     E->NMass[m][node] = E->MASS[lev][m][node];
 
-        if (E->control.NMULTIGRID||E->mesh.levmax==lev)
+        /* the finest level is exchanged with TMass below */
+        if (lev == E->mesh.levmax)
+            continue;
+
+        if (E->control.NMULTIGRID)
             (E->exchange_node_d)(E,E->MASS[lev],lev);
 
         for (m=1;m<=E->sphere.caps_per_proc;m++)
@@ -1141,10 +1146,15 @@ void mass_matrix(struct All_variables *E)
         } /* end of for e */
     } /* end of for m */
 
-    (E->exchange_node_d)(E,E->TMass,E->mesh.levmax);
+    fields[0] = E->MASS[E->mesh.levmax];
+    fields[1] = E->TMass;
+    (E->exchange_node_fields)(E,2,fields,0,NULL,E->mesh.levmax);
+
     for (m=1;m<=E->sphere.caps_per_proc;m++)
-        for(node=1;node<=E->lmesh.nno;node++)
+        for(node=1;node<=E->lmesh.nno;node++) {
+            E->MASS[E->mesh.levmax][m][node] = 1.0 / E->MASS[E->mesh.levmax][m][node];
             E->TMass[m][node] = 1.0 / E->TMass[m][node];
+        }
 
 
     /* compute volume of this processor mesh and the whole mesh */
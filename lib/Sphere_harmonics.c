@@ -40,6 +40,14 @@ void set_sphere_harmonics(E)
         E->sphere.harm_tpgb[i]=(float*)malloc(E->sphere.hindice*sizeof(float));
     }
 
+    /* buffers of the coefficient exchanges */
+    for (i=0;i<=1;i++)   {
+        E->sphere.coef_comm[i].nfield = 0;
+        E->sphere.coef_comm[i].nreq = 0;
+        E->sphere.coef_comm[i].sbuf = (float*)malloc(MAX_SPH_FIELDS*2*E->sphere.hindice*sizeof(float));
+        E->sphere.coef_comm[i].rbuf = (float*)malloc(MAX_SPH_FIELDS*2*E->sphere.hindice*sizeof(float));
+    }
+
     compute_sphereh_table(E);
 
     return;
@@ -104,9 +112,26 @@ void sphere_expansion(E,TG,sphc,sphs)
      struct All_variables *E;
      float **TG,*sphc,*sphs;
 {
-    int el,nint,d,p,i,m,j,es,mm,ll,rand();
+    void sphere_expansion_local();
     void sum_across_surf_sph1();
 
+    sphere_expansion_local(E,TG,sphc,sphs);
+    sum_across_surf_sph1(E,sphc,sphs);
+
+    return;
+}
+
+
+/* =========================================================
+   the local part of sphere_expansion, without the sum
+   across the processors in the horizontal direction
+   ========================================================= */
+void sphere_expansion_local(E,TG,sphc,sphs)
+     struct All_variables *E;
+     float **TG,*sphc,*sphs;
+{
+    int el,nint,d,p,i,m,j,es,mm,ll,rand();
+
     for (i=0;i<E->sphere.hindice;i++)    {
         sphc[i] = 0.0;
         sphs[i] = 0.0;
@@ -140,8 +165,6 @@ void sphere_expansion(E,TG,sphc,sphs)
 
         }
 
-    sum_across_surf_sph1(E,sphc,sphs);
-
     return;
 }
 
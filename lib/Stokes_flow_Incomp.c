@@ -166,6 +166,8 @@ static void solve_Ahat_p_fhat(struct All_variables *E,
                                double **V, double **P, double **F,
                                double imp, int *steps_max)
 {
+    int nreductions = E->parallel.num_reductions;
+
     if(E->control.inv_gruneisen == 0)
         solve_Ahat_p_fhat_CG(E, V, P, F, imp, steps_max);
     else {
@@ -177,6 +179,16 @@ static void solve_Ahat_p_fhat(struct All_variables *E,
             myerror(E, "Error: unknown Uzawa iteration\n");
     }
 
+    /* global reductions of the Uzawa iterations, outside of the */
+    /* velocity solves                                           */
+    nreductions = E->parallel.num_reductions - nreductions;
+    if (E->control.print_convergence && E->parallel.me==0) {
+        fprintf(E->fp, "Uzawa: %d iterations, %d global reductions (%.1f per iteration)\n",
+                *steps_max, nreductions,
+                nreductions / (double)max(*steps_max, 1));
+        fflush(E->fp);
+    }
+
     return;
 }
 
@@ -194,11 +206,16 @@ static void solve_Ahat_p_fhat_CG(struct All_variables *E,
     double *r1[NCS], *r2[NCS], *z1[NCS], *s1[NCS], *s2[NCS], *cu[NCS];
     double *F[NCS];
     double *shuffle[NCS];
-    double alpha, delta, r0dotz0, r1dotz1;
+    double alpha, delta, r0dotz0, r1dotz1, r2dotz2;
     double v_res;
     double inner_imp;
     double global_pdot();
     double global_v_norm2(), global_p_norm2(), global_div_norm2();
+    int add_global_pdot(), add_global_v_norm2(), add_global_p_norm2();
+    int add_global_div_norm2();
+    void flush_global_sums();
+    double get_global_sum();
+    int i, iv, ip, idv, idp, idiv, irz;
 
     double time0, CPU_time0();
     double v_norm, p_norm;
@@ -270,9 +287,20 @@ static void solve_Ahat_p_fhat_CG(struct All_variables *E,
                 r1[m][j] += cu[m][j];
             }
 
-    E->monitor.vdotv = global_v_norm2(E, V);
-    E->monitor.incompressibility = sqrt(global_div_norm2(E, r1)
+    /* preconditioner BPI ~= inv(K), z1 = BPI*r1 */
+    for(m=1; m<=E->sphere.caps_per_proc; m++)
+        for(j=1; j<=npno; j++)
+            z1[m][j] = E->BPI[lev][m][j] * r1[m][j];
+
+    iv = add_global_v_norm2(E, V);
+    idiv = add_global_div_norm2(E, r1);
+    irz = add_global_pdot(E, r1, z1, lev);
+    flush_global_sums(E);
+
+    E->monitor.vdotv = get_global_sum(E, iv);
+    E->monitor.incompressibility = sqrt(get_global_sum(E, idiv)
                                         / (1e-32 + E->monitor.vdotv));
+    r1dotz1 = get_global_sum(E, irz);
 
     v_norm = sqrt(E->monitor.vdotv);
     p_norm = sqrt(E->monitor.pdotp);
@@ -293,14 +321,8 @@ static void solve_Ahat_p_fhat_CG(struct All_variables *E,
     while( (count < *steps_max) && keep_iterating(E, imp, converging) ) {
         /* require two consecutive converging iterations to quit the while-loop */
 
-        /* preconditioner BPI ~= inv(K), z1 = BPI*r1 */
-        for(m=1; m<=E->sphere.caps_per_proc; m++)
-            for(j=1; j<=npno; j++)
-                z1[m][j] = E->BPI[lev][m][j] * r1[m][j];
-
-
-        /* r1dotz1 = <r1, z1> */
-        r1dotz1 = global_pdot(E, r1, z1, lev);
+        /* z1 = BPI*r1 and r1dotz1 = <r1, z1> are from the previous */
+        /* iteration, summed with its residuals                      */
         assert(r1dotz1 != 0.0  /* Division by zero in head of incompressibility iteration */);
 
         /* update search direction */
@@ -331,7 +353,9 @@ static void solve_Ahat_p_fhat_CG(struct All_variables *E,
 
 
         /* alpha = <r1, z1> / <s2, F> */
-        alpha = r1dotz1 / global_pdot(E, s2, F, lev);
+        i = add_global_pdot(E, s2, F, lev);
+        flush_global_sums(E);
+        alpha = r1dotz1 / get_global_sum(E, i);
 
 
         /* r2 = r1 - alpha * div(u1) */
@@ -352,15 +376,12 @@ static void solve_Ahat_p_fhat_CG(struct All_variables *E,
                 V[m][j] -= alpha * E->u1[m][j];
 
 
-        /* compute velocity and incompressibility residual */
-        E->monitor.vdotv = global_v_norm2(E, V);
-        E->monitor.pdotp = global_p_norm2(E, P);
-        v_norm = sqrt(E->monitor.vdotv);
-        p_norm = sqrt(E->monitor.pdotp);
-        dvelocity = alpha * sqrt(global_v_norm2(E, E->u1) / (1e-32 + E->monitor.vdotv));
-        dpressure = alpha * sqrt(global_p_norm2(E, s2) / (1e-32 + E->monitor.pdotp));
-
-       
+        /* compute velocity and incompressibility residual, and */
+        /* <r2, BPI*r2> for the next iteration, in one reduction */
+        iv = add_global_v_norm2(E, V);
+        ip = add_global_p_norm2(E, P);
+        idv = add_global_v_norm2(E, E->u1);
+        idp = add_global_p_norm2(E, s2);
 
         assemble_div_u(E, V, z1, lev);
         if(E->control.inv_gruneisen != 0)
@@ -368,7 +389,23 @@ static void solve_Ahat_p_fhat_CG(struct All_variables *E,
                 for(j=1;j<=npno;j++) {
                     z1[m][j] += cu[m][j];
             }
-        E->monitor.incompressibility = sqrt(global_div_norm2(E, z1)
+        idiv = add_global_div_norm2(E, z1);
+
+        for(m=1; m<=E->sphere.caps_per_proc; m++)
+            for(j=1; j<=npno; j++)
+                z1[m][j] = E->BPI[lev][m][j] * r2[m][j];
+        irz = add_global_pdot(E, r2, z1, lev);
+
+        flush_global_sums(E);
+        r2dotz2 = get_global_sum(E, irz);
+
+        E->monitor.vdotv = get_global_sum(E, iv);
+        E->monitor.pdotp = get_global_sum(E, ip);
+        v_norm = sqrt(E->monitor.vdotv);
+        p_norm = sqrt(E->monitor.pdotp);
+        dvelocity = alpha * sqrt(get_global_sum(E, idv) / (1e-32 + E->monitor.vdotv));
+        dpressure = alpha * sqrt(get_global_sum(E, idp) / (1e-32 + E->monitor.pdotp));
+        E->monitor.incompressibility = sqrt(get_global_sum(E, idiv)
                                             / (1e-32 + E->monitor.vdotv));
 
         count++;
@@ -415,6 +452,7 @@ static void solve_Ahat_p_fhat_CG(struct All_variables *E,
 
         /* shift <r0, z0> = <r1, z1> */
         r0dotz0 = r1dotz1;
+        r1dotz1 = r2dotz2;
 	if((E->sphere.caps == 12) && (E->control.inner_remove_rigid_rotation)){
 	  /* allow for removal of net rotation at each iterative step
 	     (expensive) */
@@ -467,6 +505,11 @@ static void solve_Ahat_p_fhat_BiCG(struct All_variables *E,
 
     double global_pdot();
     double global_v_norm2(), global_p_norm2(), global_div_norm2();
+    int add_global_pdot(), add_global_v_norm2(), add_global_p_norm2();
+    int add_global_div_norm2();
+    void flush_global_sums();
+    double get_global_sum();
+    int i, i2, iv, ip, idv, idp, idiv, irt;
     double CPU_time0();
 
     int npno, neq;
@@ -474,7 +517,7 @@ static void solve_Ahat_p_fhat_BiCG(struct All_variables *E,
     int valid;
 
     double alpha, beta, omega,inner_imp;
-    double r0dotrt, r1dotrt;
+    double r0dotrt, r1dotrt, r2dotrt;
     double v_norm, p_norm;
     double dvelocity, dpressure;
     int converging;
@@ -527,9 +570,20 @@ static void solve_Ahat_p_fhat_BiCG(struct All_variables *E,
     /* initial residual r1 = div(rho_ref*V) */
     assemble_div_rho_u(E, V, r1, lev);
 
-    E->monitor.vdotv = global_v_norm2(E, V);
-    E->monitor.incompressibility = sqrt(global_div_norm2(E, r1)
+    /* initial conjugate residual rt = r1 */
+    for(m=1; m<=E->sphere.caps_per_proc; m++)
+        for(j=1; j<=npno; j++)
+            rt[m][j] = r1[m][j];
+
+    iv = add_global_v_norm2(E, V);
+    idiv = add_global_div_norm2(E, r1);
+    irt = add_global_pdot(E, r1, rt, lev);
+    flush_global_sums(E);
+
+    E->monitor.vdotv = get_global_sum(E, iv);
+    E->monitor.incompressibility = sqrt(get_global_sum(E, idiv)
                                         / (1e-32 + E->monitor.vdotv));
+    r1dotrt = get_global_sum(E, irt);
 
     v_norm = sqrt(E->monitor.vdotv);
     p_norm = sqrt(E->monitor.pdotp);
@@ -546,20 +600,13 @@ static void solve_Ahat_p_fhat_BiCG(struct All_variables *E,
     }
 
 
-    /* initial conjugate residual rt = r1 */
-    for(m=1; m<=E->sphere.caps_per_proc; m++)
-        for(j=1; j<=npno; j++)
-            rt[m][j] = r1[m][j];
-
-
     valid = 1;
     r0dotrt = alpha = omega = 0;
 
     while( (count < *steps_max) && keep_iterating(E, imp, converging) ) {
         /* require two consecutive converging iterations to quit the while-loop */
 
-        /* r1dotrt = <r1, rt> */
-        r1dotrt = global_pdot(E, r1, rt, lev);
+        /* r1dotrt = <r1, rt> is from the previous iteration */
         if(r1dotrt == 0.0) {
             /* XXX: can we resume the computation when BiCGstab failed? */
             fprintf(E->fp, "BiCGstab method failed!!\n");
@@ -604,7 +651,9 @@ static void solve_Ahat_p_fhat_BiCG(struct All_variables *E,
 
 
         /* alpha = r1dotrt / <rt, v0> */
-        alpha = r1dotrt / global_pdot(E, rt, v0, lev);
+        i = add_global_pdot(E, rt, v0, lev);
+        flush_global_sums(E);
+        alpha = r1dotrt / get_global_sum(E, i);
 
 
         /* s0 = r1 - alpha * v0 */
@@ -634,7 +683,10 @@ static void solve_Ahat_p_fhat_BiCG(struct All_variables *E,
 
 
         /* omega = <t0, s0> / <t0, t0> */
-        omega = global_pdot(E, t0, s0, lev) / global_pdot(E, t0, t0, lev);
+        i = add_global_pdot(E, t0, s0, lev);
+        i2 = add_global_pdot(E, t0, t0, lev);
+        flush_global_sums(E);
+        omega = get_global_sum(E, i) / get_global_sum(E, i2);
 
 
         /* r2 = s0 - omega * t0 */
@@ -663,19 +715,27 @@ static void solve_Ahat_p_fhat_BiCG(struct All_variables *E,
                 V[m][j] -= F[m][j];
 
 
-        /* compute velocity and incompressibility residual */
-        E->monitor.vdotv = global_v_norm2(E, V);
-        E->monitor.pdotp = global_p_norm2(E, P);
-        v_norm = sqrt(E->monitor.vdotv);
-        p_norm = sqrt(E->monitor.pdotp);
-        dvelocity = sqrt(global_v_norm2(E, F) / (1e-32 + E->monitor.vdotv));
-        dpressure = sqrt(global_p_norm2(E, s0) / (1e-32 + E->monitor.pdotp));
+        /* compute velocity and incompressibility residual, and */
+        /* <r2, rt> for the next iteration, in one reduction     */
+        iv = add_global_v_norm2(E, V);
+        ip = add_global_p_norm2(E, P);
+        idv = add_global_v_norm2(E, F);
+        idp = add_global_p_norm2(E, s0);
 
+        assemble_div_rho_u(E, V, t0, lev);
+        idiv = add_global_div_norm2(E, t0);
+        irt = add_global_pdot(E, r2, rt, lev);
 
-	
+        flush_global_sums(E);
+        r2dotrt = get_global_sum(E, irt);
 
-        assemble_div_rho_u(E, V, t0, lev);
-        E->monitor.incompressibility = sqrt(global_div_norm2(E, t0)
+        E->monitor.vdotv = get_global_sum(E, iv);
+        E->monitor.pdotp = get_global_sum(E, ip);
+        v_norm = sqrt(E->monitor.vdotv);
+        p_norm = sqrt(E->monitor.pdotp);
+        dvelocity = sqrt(get_global_sum(E, idv) / (1e-32 + E->monitor.vdotv));
+        dpressure = sqrt(get_global_sum(E, idp) / (1e-32 + E->monitor.pdotp));
+        E->monitor.incompressibility = sqrt(get_global_sum(E, idiv)
                                             / (1e-32 + E->monitor.vdotv));
 
 
@@ -724,6 +784,7 @@ static void solve_Ahat_p_fhat_BiCG(struct All_variables *E,
 
         /* shift <r0, rt> = <r1, rt> */
         r0dotrt = r1dotrt;
+        r1dotrt = r2dotrt;
 
     } /* end loop for conjugate gradient */
 
@@ -760,7 +821,7 @@ static void solve_Ahat_p_fhat_iterCG(struct All_variables *E,
                                      double imp, int *steps_max)
 {
     int m, i;
-    int cycles, num_of_loop;
+    int cycles, num_of_loop, total_cycles;
     double relative_err_v, relative_err_p;
     double *old_v[NCS], *old_p[NCS],*diff_v[NCS],*diff_p[NCS];
     double div_res;
@@ -768,8 +829,10 @@ static void solve_Ahat_p_fhat_iterCG(struct All_variables *E,
     const int neq = E->lmesh.neq;
     const int lev = E->mesh.levmax;
 
-    double global_v_norm2(),global_p_norm2();
-    double global_div_norm2();
+    int add_global_v_norm2(), add_global_p_norm2(), add_global_div_norm2();
+    void flush_global_sums();
+    double get_global_sum();
+    int idiv, idv, idp;
     void assemble_div_rho_u();
     
     for (m=1;m<=E->sphere.caps_per_proc;m++)   {
@@ -788,6 +851,7 @@ static void solve_Ahat_p_fhat_iterCG(struct All_variables *E,
     relative_err_v = 1.0;
     relative_err_p = 1.0;
     num_of_loop = 0;
+    total_cycles = 0;
 
     while((relative_err_v >= imp || relative_err_p >= imp) &&
           (div_res > imp) &&
@@ -799,21 +863,28 @@ static void solve_Ahat_p_fhat_iterCG(struct All_variables *E,
         }
 
         solve_Ahat_p_fhat_CG(E, V, P, F, imp, &cycles);
+        total_cycles += cycles;
 
         /* compute norm of div(rho*V) */
         assemble_div_rho_u(E, V, E->u1, lev);
-        div_res = sqrt(global_div_norm2(E, E->u1) / (1e-32 + E->monitor.vdotv));
+        idiv = add_global_div_norm2(E, E->u1);
 
         for (m=1;m<=E->sphere.caps_per_proc;m++)
             for(i=0;i<neq;i++) diff_v[m][i] = V[m][i] - old_v[m][i];
 
-        relative_err_v = sqrt( global_v_norm2(E,diff_v) /
-                               (1.0e-32 + E->monitor.vdotv) );
+        idv = add_global_v_norm2(E, diff_v);
 
         for (m=1;m<=E->sphere.caps_per_proc;m++)
             for(i=1;i<=npno;i++) diff_p[m][i] = P[m][i] - old_p[m][i];
 
-        relative_err_p = sqrt( global_p_norm2(E,diff_p) /
+        idp = add_global_p_norm2(E, diff_p);
+
+        flush_global_sums(E);
+
+        div_res = sqrt(get_global_sum(E, idiv) / (1e-32 + E->monitor.vdotv));
+        relative_err_v = sqrt( get_global_sum(E, idv) /
+                               (1.0e-32 + E->monitor.vdotv) );
+        relative_err_p = sqrt( get_global_sum(E, idp) /
                                (1.0e-32 + E->monitor.pdotp) );
 
         if(E->parallel.me == 0) {
@@ -832,6 +903,8 @@ static void solve_Ahat_p_fhat_iterCG(struct All_variables *E,
 	free((void *) diff_p[m]);
     }
 
+    *steps_max = total_cycles;
+
     return;
 }
 
@@ -32,6 +32,10 @@
 
 void myerror(struct All_variables *, char *);
 void sphere_expansion(struct All_variables *, float **, float *, float *);
+void sphere_expansion_local(struct All_variables *, float **, float *, float *);
+void sph_coef_sum(struct All_variables *, struct SPH_COMM *, MPI_Comm);
+void sph_coef_bcast(struct All_variables *, struct SPH_COMM *, MPI_Comm);
+void sph_coef_wait(struct All_variables *, struct SPH_COMM *);
 void sum_across_depth_sph1(struct All_variables *, float *, float *);
 void broadcast_vertical(struct All_variables *, float *, float *, int);
 long double lg_pow(long double, int);
@@ -229,6 +233,7 @@ void compute_nodal_stress(struct All_variables *E,
 
   double pre[9],tww[9],rtf[4][9];
   double velo_scaling, stress_scaling, mass_fac;
+  float **fields[8];
 #ifdef CITCOM_ALLOW_ANISOTROPIC_VISC
   double D[6][6],n[3],eps[6],str[6];
 #endif
@@ -451,14 +456,15 @@ void compute_nodal_stress(struct All_variables *E,
     }    /* end for el */
   }     /* end for m */
 
-  (E->exchange_node_f)(E,SXX,lev);
-  (E->exchange_node_f)(E,SYY,lev);
-  (E->exchange_node_f)(E,SZZ,lev);
-  (E->exchange_node_f)(E,SXY,lev);
-  (E->exchange_node_f)(E,SXZ,lev);
-  (E->exchange_node_f)(E,SZY,lev);
-  (E->exchange_node_f)(E,divv,lev);
-  (E->exchange_node_f)(E,vorv,lev);
+  fields[0] = SXX;
+  fields[1] = SYY;
+  fields[2] = SZZ;
+  fields[3] = SXY;
+  fields[4] = SXZ;
+  fields[5] = SZY;
+  fields[6] = divv;
+  fields[7] = vorv;
+  (E->exchange_node_fields)(E,0,NULL,8,fields,lev);
 
   stress_scaling = velo_scaling = 1.0;
 
@@ -583,6 +589,38 @@ void stress_conform_bcs(struct All_variables *E)
 /* ===================================================================
    ===================================================================  */
 
+static void layer_density(struct All_variables *E, int k, float **TT)
+{
+    /* density of the layer between the nodes k and k+1 */
+
+    int m,i,j,node,p,nxnz;
+    float grav,scaling2;
+    double buoy2rho;
+
+    nxnz = E->lmesh.nox*E->lmesh.noz;
+
+    /* scale for buoyancy */
+    scaling2 = -E->data.therm_exp*E->data.ref_temperature*E->data.density
+      / fabs(E->control.Atemp);
+
+    /* correction for variable gravity */
+    grav = 0.5 * (E->refstate.gravity[k] + E->refstate.gravity[k+1]);
+    buoy2rho = scaling2 / grav;
+    for(m=1;m<=E->sphere.caps_per_proc;m++)
+        for(i=1;i<=E->lmesh.noy;i++)
+            for(j=1;j<=E->lmesh.nox;j++)  {
+                node= k + (j-1)*E->lmesh.noz + (i-1)*nxnz;
+                p = j + (i-1)*E->lmesh.nox;
+                /* convert non-dimensional buoyancy to */
+                /* dimensional density */
+                TT[m][p] = (E->buoyancy[m][node]+E->buoyancy[m][node+1])
+                    * 0.5 * buoy2rho;
+            }
+
+    return;
+}
+
+
 static void geoid_from_buoyancy(struct All_variables *E,
                                 float *harm_geoid[2], float *harm_geoidb[2])
 {
@@ -592,20 +630,20 @@ static void geoid_from_buoyancy(struct All_variables *E,
      *
      * E->buoyancy needs to be converted to density (-therm_exp*ref_T/Ra/g)
      * and dimensionalized (data.density). dlayer needs to be dimensionalized.
+     *
+     * The sums across depth are only posted here, the caller must
+     * wait on E->sphere.coef_comm[1] before using the results.
      */
 
-    int m,k,ll,mm,node,i,j,p,noz,snode,nxnz;
-    float *TT[NCS],radius,*geoid[2],dlayer,con1,grav,scaling2,scaling,radius_m;
+    int m,k,ll,mm,p,q;
+    float *TT[NCS],radius,*geoid[2][2],dlayer,con1,scaling,radius_m;
     float cont, conb;
-    double buoy2rho;
+    struct SPH_COMM *c = &E->sphere.coef_comm[0];
+    struct SPH_COMM *cz = &E->sphere.coef_comm[1];
 
     /* some constants */
-    nxnz = E->lmesh.nox*E->lmesh.noz;
     radius_m = E->data.radius_km*1e3;
 
-    /* scale for buoyancy */
-    scaling2 = -E->data.therm_exp*E->data.ref_temperature*E->data.density
-      / fabs(E->control.Atemp);
     /* scale for geoid */
     scaling = 4.0 * M_PI * 1.0e3 * E->data.radius_km * E->data.grav_const
         / E->data.grav_acc;
@@ -614,10 +652,12 @@ static void geoid_from_buoyancy(struct All_variables *E,
     for(m=1;m<=E->sphere.caps_per_proc;m++)
         TT[m] = (float *) malloc ((E->lmesh.nsf+1)*sizeof(float));
 
-    /* cos coeff */
-    geoid[0] = (float*)malloc(E->sphere.hindice*sizeof(float));
-    /* sin coeff */
-    geoid[1] = (float*)malloc(E->sphere.hindice*sizeof(float));
+    /* cos and sin coeff of two layers, one of them is being summed */
+    /* while the other is expanded */
+    for (q = 0; q < 2; q++) {
+        geoid[q][0] = (float*)malloc(E->sphere.hindice*sizeof(float));
+        geoid[q][1] = (float*)malloc(E->sphere.hindice*sizeof(float));
+    }
 
     /* reset arrays */
     for (p = 0; p < E->sphere.hindice; p++) {
@@ -627,24 +667,32 @@ static void geoid_from_buoyancy(struct All_variables *E,
         harm_geoidb[1][p] = 0;
     }
 
+    /* expand the first layer into spherical harmonics */
+    layer_density(E, 1, TT);
+    sphere_expansion_local(E, TT, geoid[1][0], geoid[1][1]);
+    c->nfield = 1;
+    c->sphc[0] = geoid[1][0];
+    c->sphs[0] = geoid[1][1];
+    sph_coef_sum(E, c, E->parallel.horizontal_comm);
+
     /* loop over each layer, notice the range is [1,noz) */
     for(k=1;k<E->lmesh.noz;k++)  {
-        /* correction for variable gravity */
-        grav = 0.5 * (E->refstate.gravity[k] + E->refstate.gravity[k+1]);
-        buoy2rho = scaling2 / grav;
-        for(m=1;m<=E->sphere.caps_per_proc;m++)
-            for(i=1;i<=E->lmesh.noy;i++)
-                for(j=1;j<=E->lmesh.nox;j++)  {
-                    node= k + (j-1)*E->lmesh.noz + (i-1)*nxnz;
-                    p = j + (i-1)*E->lmesh.nox;
-                    /* convert non-dimensional buoyancy to */
-                    /* dimensional density */
-                    TT[m][p] = (E->buoyancy[m][node]+E->buoyancy[m][node+1])
-                        * 0.5 * buoy2rho;
-                }
-
-        /* expand TT into spherical harmonics */
-        sphere_expansion(E,TT,geoid[0],geoid[1]);
+        q = k & 1;
+
+        /* expand the next layer while this one is being summed */
+        if (k+1 < E->lmesh.noz) {
+            layer_density(E, k+1, TT);
+            sphere_expansion_local(E, TT, geoid[1-q][0], geoid[1-q][1]);
+        }
+
+        sph_coef_wait(E, c);
+
+        if (k+1 < E->lmesh.noz) {
+            c->nfield = 1;
+            c->sphc[0] = geoid[1-q][0];
+            c->sphs[0] = geoid[1-q][1];
+            sph_coef_sum(E, c, E->parallel.horizontal_comm);
+        }
 
         /* thickness of the layer */
         dlayer = (E->sx[1][3][k+1]-E->sx[1][3][k])*radius_m;
@@ -660,10 +708,10 @@ static void geoid_from_buoyancy(struct All_variables *E,
 
             for (mm=0;mm<=ll;mm++)   {
                 p = E->sphere.hindex[ll][mm];
-                harm_geoid[0][p] += con1*cont*geoid[0][p];
-                harm_geoid[1][p] += con1*cont*geoid[1][p];
-                harm_geoidb[0][p] += con1*conb*geoid[0][p];
-                harm_geoidb[1][p] += con1*conb*geoid[1][p];
+                harm_geoid[0][p] += con1*cont*geoid[q][0][p];
+                harm_geoid[1][p] += con1*cont*geoid[q][1][p];
+                harm_geoidb[0][p] += con1*conb*geoid[q][0][p];
+                harm_geoidb[1][p] += con1*conb*geoid[q][1][p];
             }
         }
 
@@ -671,19 +719,50 @@ static void geoid_from_buoyancy(struct All_variables *E,
     }
 
     /* accumulate geoid from all layers to the surface (top processors) */
-    sum_across_depth_sph1(E, harm_geoid[0], harm_geoid[1]);
-
-    /* accumulate geoid from all layers to the CMB (bottom processors) */
-    sum_across_depth_sph1(E, harm_geoidb[0], harm_geoidb[1]);
+    /* and to the CMB (bottom processors) in one reduction */
+    if (E->parallel.nprocz > 1)  {
+        cz->nfield = 2;
+        cz->sphc[0] = harm_geoid[0];
+        cz->sphs[0] = harm_geoid[1];
+        cz->sphc[1] = harm_geoidb[0];
+        cz->sphs[1] = harm_geoidb[1];
+        sph_coef_sum(E, cz, E->parallel.vertical_comm);
+    }
 
     for(m=1;m<=E->sphere.caps_per_proc;m++)
         free ((void *)TT[m]);
 
-    free ((void *)geoid[0]);
-    free ((void *)geoid[1]);
+    for (q = 0; q < 2; q++) {
+        free ((void *)geoid[q][0]);
+        free ((void *)geoid[q][1]);
+    }
+    return;
+}
+
+static void broadcast_vertical2(struct All_variables *E,
+                                float *sph1[2], int root1,
+                                float *sph2[2], int root2)
+{
+    /* broadcast the coeff of two fields from different roots at once */
+
+    struct SPH_COMM *c = &E->sphere.coef_comm[0];
+
+    if(E->parallel.nprocz == 1) return;
+
+    c->nfield = 2;
+    c->sphc[0] = sph1[0];
+    c->sphs[0] = sph1[1];
+    c->root[0] = root1;
+    c->sphc[1] = sph2[0];
+    c->sphs[1] = sph2[1];
+    c->root[1] = root2;
+    sph_coef_bcast(E, c, E->parallel.vertical_comm);
+    sph_coef_wait(E, c);
+
     return;
 }
 
+
 static void expand_topo_sph_harm(struct All_variables *E,
                                  float *tpgt[2],
                                  float *tpgb[2])
@@ -743,8 +822,7 @@ static void expand_topo_sph_harm(struct All_variables *E,
     }
 
     /* send arrays to all processors in the same vertical column */
-    broadcast_vertical(E, tpgb[0], tpgb[1], 0);
-    broadcast_vertical(E, tpgt[0], tpgt[1], E->parallel.nprocz-1);
+    broadcast_vertical2(E, tpgb, 0, tpgt, E->parallel.nprocz-1);
 
     return;
 }
@@ -816,8 +894,7 @@ static void geoid_from_topography(struct All_variables *E,
     }
 
     /* send arrays to all processors in the same vertical column */
-    broadcast_vertical(E, geoid_tpgb[0], geoid_tpgb[1], 0);
-    broadcast_vertical(E, geoid_tpgt[0], geoid_tpgt[1], E->parallel.nprocz-1);
+    broadcast_vertical2(E, geoid_tpgb, 0, geoid_tpgt, E->parallel.nprocz-1);
 
     return;
 }
@@ -925,8 +1002,7 @@ static void geoid_from_topography_self_g(struct All_variables *E,
     }
 
     /* send arrays to all processors in the same vertical column */
-    broadcast_vertical(E, geoid_tpgb[0], geoid_tpgb[1], 0);
-    broadcast_vertical(E, geoid_tpgt[0], geoid_tpgt[1], E->parallel.nprocz-1);
+    broadcast_vertical2(E, geoid_tpgb, 0, geoid_tpgt, E->parallel.nprocz-1);
 
     return;
 }
@@ -941,8 +1017,12 @@ void compute_geoid(E)
     geoid_from_buoyancy(E, E->sphere.harm_geoid_from_bncy,
                         E->sphere.harm_geoid_from_bncy_botm);
 
+    /* the sums across depth of the geoid from buoyancy proceed */
+    /* while the topography is expanded */
     expand_topo_sph_harm(E, E->sphere.harm_tpgt, E->sphere.harm_tpgb);
 
+    sph_coef_wait(E, &E->sphere.coef_comm[1]);
+
     if(E->control.self_gravitation)
         geoid_from_topography_self_g(E,
                                      E->sphere.harm_tpgt,
@@ -996,8 +1076,6 @@ void get_CBF_topo(E,H,HB)       /* call this only for top and bottom processors*
     void get_elt_g();
     void get_elt_f();
     void get_global_1d_shape_fn_L();
-    void full_exchange_snode_f();
-    void regional_exchange_snode_f();
     void velo_from_element();
 
     int a,address,el,elb,els,node,nodeb,nodes,i,j,k,l,m,n,count;
@@ -1007,6 +1085,8 @@ void get_CBF_topo(E,H,HB)       /* call this only for top and bottom processors*
     struct Shape_function1_dA dGammax,dGammabx;
 
     float *eltTU,*eltTL,*SU[NCS],*SL[NCS],*RU[NCS],*RL[NCS];
+    float **fields[4];
+    int nfield;
     float VV[4][9];
 
     double eltk[24*24],eltf[24];
@@ -1169,28 +1249,30 @@ void get_CBF_topo(E,H,HB)       /* call this only for top and bottom processors*
 
   }      /* end for j */
 
-  /* for bottom topography */
+  /* bottom and top topography, in one exchange if both are here */
+  nfield = 0;
   if(E->parallel.me_loc[3] == 0) {
-  if(E->sphere.caps == 12)
-      full_exchange_snode_f(E,RL,SL,E->mesh.levmax);
-  else
-      regional_exchange_snode_f(E,RL,SL,E->mesh.levmax);
+      fields[nfield++] = RL;
+      fields[nfield++] = SL;
+  }
+  if(E->parallel.me_loc[3] == E->parallel.nprocz-1) {
+      fields[nfield++] = RU;
+      fields[nfield++] = SU;
+  }
+  if(nfield > 0)
+      (E->exchange_snode_fields)(E,0,NULL,nfield,fields,E->mesh.levmax);
 
+  /* for bottom topography */
+  if(E->parallel.me_loc[3] == 0)
   for (j=1;j<=E->sphere.caps_per_proc;j++)
       for(i=1;i<=E->lmesh.nsf;i++)
           HB[j][i] = RL[j][i]/SL[j][i];
-  }
-  /* for top topo */
-  if(E->parallel.me_loc[3] == E->parallel.nprocz-1) {
-  if(E->sphere.caps == 12)
-      full_exchange_snode_f(E,RU,SU,E->mesh.levmax);
-  else
-      regional_exchange_snode_f(E,RU,SU,E->mesh.levmax);
 
+  /* for top topo */
+  if(E->parallel.me_loc[3] == E->parallel.nprocz-1)
   for (j=1;j<=E->sphere.caps_per_proc;j++)
       for(i=1;i<=E->lmesh.nsf;i++)
           H[j][i] = RU[j][i]/SU[j][i];
-  }
     free((void *)eltTU);
     free((void *)eltTL);
     for (j=1;j<=E->sphere.caps_per_proc;j++)   {
@@ -41,11 +41,27 @@
 
 #include <math.h>
 #include <string.h>
+#include "element_definitions.h"
 #include "global_defs.h"
 #include "parsing.h"
 #include "parallel_related.h"
 #include "composition_related.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#define TRACER_MAX_SUBSTEPS 1000
+
+/* indexed binary tracer file, see read_binary_tracer_file() */
+#define TRACER_BIN_MAGIC 0x42525443
+#define TRACER_BIN_VERSION 1
+#define TRACER_BIN_CHUNK 4096
+
 #ifdef USE_GGRD
 #include "ggrd_handling.h"
 #endif
@@ -57,9 +73,11 @@ void gzip_file(char *);
 
 int icheck_that_processor_shell(struct All_variables *E,
                                        int j, int nprocessor, double rad);
+void allocate_later_array(struct All_variables *E, int j, int size);
 void expand_later_array(struct All_variables *E, int j);
 void expand_tracer_arrays(struct All_variables *E, int j);
 void tracer_post_processing(struct All_variables *E);
+void advect_tracers(struct All_variables *E);
 void allocate_tracer_arrays(struct All_variables *E,
                             int j, int number_of_tracers);
 void count_tracers_of_flavors(struct All_variables *E);
@@ -70,19 +88,46 @@ int regional_icheck_cap(struct All_variables *E, int icap,
                         double x, double y, double z, double rad);
 
 static void find_tracers(struct All_variables *E);
+static void sort_tracers(struct All_variables *E);
+static void get_tracer_velocities(struct All_variables *E, int j,
+                                  double *theta, double *phi, double *rad,
+                                  double *vx, double *vy, double *vz);
 static void predict_tracers(struct All_variables *E);
 static void correct_tracers(struct All_variables *E);
+static int tracer_substeps(struct All_variables *E);
+static void runge_kutta_tracers(struct All_variables *E, int nsub);
+static void runge_kutta_stage(struct All_variables *E, double dt,
+                              int s, int nstages,
+                              const double *a, const double *b);
+static void set_stage_velocity(struct All_variables *E, double frac);
+static void save_tracer_velocity(struct All_variables *E);
 static void make_tracer_array(struct All_variables *E);
 static void generate_random_tracers(struct All_variables *E,
                                     int tracers_cap, int j);
 static void read_tracer_file(struct All_variables *E);
+static int tracer_file_extras(struct All_variables *E, int ncolumns);
+static void add_file_tracer(struct All_variables *E, int j,
+                            double *buffer, int nextra);
+static int read_binary_tracer_file(struct All_variables *E, FILE *fptracer);
+static long long read_tracer_records(struct All_variables *E, int j,
+                                     FILE *fptracer, long data_offset,
+                                     long long first, long long last,
+                                     int ncolumns, int nextra,
+                                     double *buffer);
+static void tracer_unit_vector(double theta, double phi, double *v);
 static void read_old_tracer_file(struct All_variables *E);
 static void check_sum(struct All_variables *E);
 static int isum_tracers(struct All_variables *E);
 static void init_tracer_flavors(struct All_variables *E);
 static void reduce_tracer_arrays(struct All_variables *E);
-static void put_away_later(struct All_variables *E, int j, int it);
-static void eject_tracer(struct All_variables *E, int j, int it);
+static void compact_tracers(struct All_variables *E, int j);
+static void count_flavors_in_chunks(struct All_variables *E, int j);
+static void control_tracer_population(struct All_variables *E);
+static void report_tracer_load(struct All_variables *E, double step_time);
+static int merge_tracers(struct All_variables *E, int j,
+                         int *list, int n, int target);
+static int split_tracers(struct All_variables *E, int j, int e,
+                         int *list, int n, int target);
 int read_double_vector(FILE *, int , double *);
 void cart_to_sphere(struct All_variables *,
                     double , double , double ,
@@ -207,6 +252,48 @@ void tracer_input(struct All_variables *E)
         /* Warning level */
         input_boolean("itracer_warnings",&(E->trace.itracer_warnings),"on",m);
 
+        /* Regroup the tracer arrays by element every tracer_sort_spacing
+           steps (0: never) */
+        input_int("tracer_sort_spacing",&(E->trace.sort_spacing),"0,0,nomax",m);
+
+        /* Interpolate tracer velocities element by element */
+        input_boolean("tracer_batch_velocity",&(E->trace.batch_velocity),"on",m);
+
+        /* Back the tracer arrays with transparent huge pages */
+        input_boolean("tracer_hugepages",&(E->trace.hugepages),"off",m);
+
+        /* Time integration of the tracer paths: 2 (predictor-corrector),
+           3 or 4 (Runge-Kutta of that order) */
+        input_int("tracer_integrator",&(E->trace.integrator),"2,2,4",m);
+
+        /* Extrapolate the velocity in time from the last two steps */
+        input_boolean("tracer_velocity_extrapolation",
+                      &(E->trace.extrapolate_velocity),"off",m);
+
+        /* Sub-step the tracers to keep their Courant number below this
+           (0: no sub-steps) */
+        input_double("tracer_courant",&(E->trace.courant),"0.0",m);
+
+        /* Split or merge tracers to keep the number of tracers per
+           element within these limits (0: no limit) */
+        input_int("tracer_min_per_element",&(E->trace.min_per_element),
+                  "0,0,nomax",m);
+        input_int("tracer_max_per_element",&(E->trace.max_per_element),
+                  "0,0,nomax",m);
+        if (E->trace.max_per_element > 0 &&
+            E->trace.max_per_element < 2*E->trace.min_per_element) {
+            fprintf(stderr,"tracer_max_per_element must be at least twice tracer_min_per_element\n");
+            parallel_process_termination();
+        }
+
+        /* Report the spread of tracers and tracer time over the
+           processors every step */
+        input_boolean("tracer_load_report",&(E->trace.load_report),"off",m);
+
+        /* Cost of a tracer relative to an element, for the radial
+           layers suggested in the checkpoints (0: measured) */
+        input_double("tracer_cost_weight",&(E->trace.cost_weight),"0.0",m);
+
 
         if(E->parallel.nprocxy == 12)
             full_tracer_input(E);
@@ -222,6 +309,7 @@ void tracer_input(struct All_variables *E)
 
 void tracer_initial_settings(struct All_variables *E)
 {
+   int j, d;
    void full_keep_within_bounds();
    void full_tracer_setup();
    void full_get_velocity();
@@ -234,12 +322,31 @@ void tracer_initial_settings(struct All_variables *E)
    E->trace.advection_time = 0;
    E->trace.find_tracers_time = 0;
    E->trace.lost_souls_time = 0;
+   E->trace.sort_tracers_time = 0;
+
+   E->trace.pool_grows = 0;
+   E->trace.pool_shrinks = 0;
+   E->trace.pool_bytes_copied = 0;
+
+   E->trace.last_step_clock = 0;
+   E->trace.last_advection_time = 0;
+   E->trace.balance_tracer_time = 0;
+   E->trace.balance_total_time = 0;
+
+   E->trace.nsubsteps = 1;
+   E->trace.istat_merged = 0;
+   E->trace.istat_split = 0;
+   E->trace.V0_dt = 0;
+   for (j=1; j<=E->sphere.caps_per_proc; j++)
+       for (d=1; d<=3; d++)
+           E->trace.V0[j][d] = E->trace.Vstage[j][d] = NULL;
 
    if(E->parallel.nprocxy == 1) {
        E->problem_tracer_setup = regional_tracer_setup;
 
        E->trace.keep_within_bounds = regional_keep_within_bounds;
        E->trace.get_velocity = regional_get_velocity;
+       E->trace.get_velocity_batch = regional_get_velocity_batch;
        E->trace.iget_element = regional_iget_element;
    }
    else {
@@ -247,6 +354,7 @@ void tracer_initial_settings(struct All_variables *E)
 
        E->trace.keep_within_bounds = full_keep_within_bounds;
        E->trace.get_velocity = full_get_velocity;
+       E->trace.get_velocity_batch = full_get_velocity_batch;
        E->trace.iget_element = full_iget_element;
    }
 }
@@ -265,12 +373,21 @@ void tracer_advection(struct All_variables *E)
     double begin_time = CPU_time0();
 
     /* advect tracers */
-    predict_tracers(E);
-    correct_tracers(E);
+    advect_tracers(E);
 
     /* check that the number of tracers is conserved */
     check_sum(E);
 
+    /* split and merge tracers in crowded or sparse elements */
+    if (E->trace.iweight >= 0)
+        control_tracer_population(E);
+
+    /* regroup tracers by element every sort_spacing steps */
+    if (E->trace.sort_spacing > 0 &&
+        E->monitor.solution_cycles % E->trace.sort_spacing == 0)
+        sort_tracers(E);
+
+
     /* count # of tracers of each flavor */
     if (E->trace.nflavors > 0)
         count_tracers_of_flavors(E);
@@ -294,6 +411,21 @@ void tracer_advection(struct All_variables *E)
 void tracer_post_processing(struct All_variables *E)
 {
     int i;
+    double now, step_time;
+    double CPU_time0();
+
+    /* tracer time of this step, and the totals since the first step */
+    now = CPU_time0();
+    step_time = E->trace.advection_time - E->trace.last_advection_time;
+    if (E->trace.last_step_clock > 0) {
+        E->trace.balance_total_time += now - E->trace.last_step_clock;
+        E->trace.balance_tracer_time += step_time;
+    }
+    E->trace.last_step_clock = now;
+    E->trace.last_advection_time = E->trace.advection_time;
+
+    if (E->trace.load_report)
+        report_tracer_load(E, step_time);
 
     /* reset statistical counters */
 
@@ -306,11 +438,24 @@ void tracer_post_processing(struct All_variables *E)
         fprintf(E->trace.fpt, "STEP %d\n", E->monitor.solution_cycles);
 
         fprintf(E->trace.fpt, "Advecting tracers takes %f seconds.\n",
-                E->trace.advection_time - E->trace.find_tracers_time);
+                E->trace.advection_time - E->trace.find_tracers_time
+                - E->trace.sort_tracers_time);
         fprintf(E->trace.fpt, "Finding element takes %f seconds.\n",
                 E->trace.find_tracers_time - E->trace.lost_souls_time);
         fprintf(E->trace.fpt, "Exchanging lost tracers takes %f seconds.\n",
                 E->trace.lost_souls_time);
+        if (E->trace.sort_spacing > 0)
+            fprintf(E->trace.fpt, "Sorting tracers takes %f seconds.\n",
+                    E->trace.sort_tracers_time);
+        if (E->trace.courant > 0.0)
+            fprintf(E->trace.fpt, "Tracer sub-steps: %d\n", E->trace.nsubsteps);
+        if (E->trace.iweight >= 0)
+            fprintf(E->trace.fpt, "Population control: %d tracers merged away, "
+                    "%d added by splitting.\n", E->trace.istat_merged,
+                    E->trace.istat_split);
+        fprintf(E->trace.fpt, "Tracer arrays grown %d times, shrunk %d times, "
+                "%.0f bytes copied.\n", E->trace.pool_grows,
+                E->trace.pool_shrinks, E->trace.pool_bytes_copied);
     }
 
     if(E->control.verbose){
@@ -370,16 +515,8 @@ static void predict_tracers(struct All_variables *E)
     int numtracers;
     int j;
     int kk;
-    int nelem;
 
     double dt;
-    double theta0,phi0,rad0;
-    double x0,y0,z0;
-    double theta_pred,phi_pred,rad_pred;
-    double x_pred,y_pred,z_pred;
-    double velocity_vector[4];
-
-    void cart_to_sphere();
 
 
     dt=E->advection.timestep;
@@ -389,8 +526,27 @@ static void predict_tracers(struct All_variables *E)
 
         numtracers=E->trace.ntracers[j];
 
+        /* velocities of all tracers go straight to positions 9-11 */
+        if (E->trace.batch_velocity)
+            get_tracer_velocities(E,j,E->trace.basicq[j][0],
+                                  E->trace.basicq[j][1],
+                                  E->trace.basicq[j][2],
+                                  E->trace.basicq[j][9],
+                                  E->trace.basicq[j][10],
+                                  E->trace.basicq[j][11]);
+
+#pragma omp parallel for schedule(static)
         for (kk=1;kk<=numtracers;kk++) {
 
+            int nelem;
+            double theta0,phi0,rad0;
+            double x0,y0,z0;
+            double theta_pred,phi_pred,rad_pred;
+            double x_pred,y_pred,z_pred;
+            double velocity_vector[4];
+
+            void cart_to_sphere();
+
             theta0=E->trace.basicq[j][0][kk];
             phi0=E->trace.basicq[j][1][kk];
             rad0=E->trace.basicq[j][2][kk];
@@ -398,8 +554,15 @@ static void predict_tracers(struct All_variables *E)
             y0=E->trace.basicq[j][4][kk];
             z0=E->trace.basicq[j][5][kk];
 
-            nelem=E->trace.ielement[j][kk];
-            (E->trace.get_velocity)(E,j,nelem,theta0,phi0,rad0,velocity_vector);
+            if (E->trace.batch_velocity) {
+                velocity_vector[1]=E->trace.basicq[j][9][kk];
+                velocity_vector[2]=E->trace.basicq[j][10][kk];
+                velocity_vector[3]=E->trace.basicq[j][11][kk];
+            }
+            else {
+                nelem=E->trace.ielement[j][kk];
+                (E->trace.get_velocity)(E,j,nelem,theta0,phi0,rad0,velocity_vector);
+            }
 
             x_pred=x0+velocity_vector[1]*dt;
             y_pred=y0+velocity_vector[2]*dt;
@@ -463,27 +626,46 @@ static void correct_tracers(struct All_variables *E)
 
     int j;
     int kk;
-    int nelem;
-
+    int numtracers;
 
     double dt;
-    double x0,y0,z0;
-    double theta_pred,phi_pred,rad_pred;
-    double x_pred,y_pred,z_pred;
-    double theta_cor,phi_cor,rad_cor;
-    double x_cor,y_cor,z_cor;
-    double velocity_vector[4];
-    double Vx0,Vy0,Vz0;
-    double Vx_pred,Vy_pred,Vz_pred;
-
-    void cart_to_sphere();
+    double *vpred[4];
 
 
     dt=E->advection.timestep;
 
 
     for (j=1;j<=E->sphere.caps_per_proc;j++) {
-        for (kk=1;kk<=E->trace.ntracers[j];kk++) {
+
+        numtracers=E->trace.ntracers[j];
+
+        if (E->trace.batch_velocity) {
+            for (kk=1;kk<=3;kk++)
+                if ((vpred[kk]=(double *)malloc((numtracers+1)*sizeof(double)))==NULL) {
+                    fprintf(E->trace.fpt,"ERROR(correct tracers)-no memory\n");
+                    fflush(E->trace.fpt);
+                    exit(10);
+                }
+            get_tracer_velocities(E,j,E->trace.basicq[j][0],
+                                  E->trace.basicq[j][1],
+                                  E->trace.basicq[j][2],
+                                  vpred[1],vpred[2],vpred[3]);
+        }
+
+#pragma omp parallel for schedule(static)
+        for (kk=1;kk<=numtracers;kk++) {
+
+            int nelem;
+            double x0,y0,z0;
+            double theta_pred,phi_pred,rad_pred;
+            double x_pred,y_pred,z_pred;
+            double theta_cor,phi_cor,rad_cor;
+            double x_cor,y_cor,z_cor;
+            double velocity_vector[4];
+            double Vx0,Vy0,Vz0;
+            double Vx_pred,Vy_pred,Vz_pred;
+
+            void cart_to_sphere();
 
             theta_pred=E->trace.basicq[j][0][kk];
             phi_pred=E->trace.basicq[j][1][kk];
@@ -500,13 +682,20 @@ static void correct_tracers(struct All_variables *E)
             Vy0=E->trace.basicq[j][10][kk];
             Vz0=E->trace.basicq[j][11][kk];
 
-            nelem=E->trace.ielement[j][kk];
+            if (E->trace.batch_velocity) {
+                Vx_pred=vpred[1][kk];
+                Vy_pred=vpred[2][kk];
+                Vz_pred=vpred[3][kk];
+            }
+            else {
+                nelem=E->trace.ielement[j][kk];
 
-            (E->trace.get_velocity)(E,j,nelem,theta_pred,phi_pred,rad_pred,velocity_vector);
+                (E->trace.get_velocity)(E,j,nelem,theta_pred,phi_pred,rad_pred,velocity_vector);
 
-            Vx_pred=velocity_vector[1];
-            Vy_pred=velocity_vector[2];
-            Vz_pred=velocity_vector[3];
+                Vx_pred=velocity_vector[1];
+                Vy_pred=velocity_vector[2];
+                Vz_pred=velocity_vector[3];
+            }
 
             x_cor=x0 + dt * 0.5*(Vx0+Vx_pred);
             y_cor=y0 + dt * 0.5*(Vy0+Vy_pred);
@@ -525,6 +714,10 @@ static void correct_tracers(struct All_variables *E)
             E->trace.basicq[j][5][kk]=z_cor;
 
         } /* end kk, correcting tracers */
+
+        if (E->trace.batch_velocity)
+            for (kk=1;kk<=3;kk++)
+                free(vpred[kk]);
     } /* end caps */
 
     /* find new tracer elements and caps */
@@ -535,6 +728,388 @@ static void correct_tracers(struct All_variables *E)
 }
 
 
+/*********** ADVECT TRACERS ***********************************************/
+/*                                                                        */
+/* This function moves the tracers through one time step.  The default    */
+/* (tracer_integrator=2, one sub-step, no extrapolation) is the original  */
+/* predictor-corrector; everything else goes through the Runge-Kutta     */
+/* stages below.                                                          */
+
+void advect_tracers(struct All_variables *E)
+{
+    int nsub;
+
+    nsub = tracer_substeps(E);
+    E->trace.nsubsteps = nsub;
+
+    if (E->trace.integrator == 2 && nsub == 1 &&
+        !E->trace.extrapolate_velocity) {
+        predict_tracers(E);
+        correct_tracers(E);
+    }
+    else
+        runge_kutta_tracers(E, nsub);
+
+    if (E->trace.extrapolate_velocity)
+        save_tracer_velocity(E);
+
+    return;
+}
+
+
+/*********** TRACER SUBSTEPS **********************************************/
+/*                                                                        */
+/* Number of sub-steps needed to keep the tracer Courant number (the same */
+/* element measure as std_timestep) below tracer_courant.  Every stage    */
+/* relocates the tracers, possibly on other processors, so all tracers    */
+/* take the same number of sub-steps.                                     */
+
+static int tracer_substeps(struct All_variables *E)
+{
+    int m, el, i;
+    int nsub;
+    float VV[4][9];
+    double uc1, uc2, uc3, cfl;
+
+    void velo_from_element();
+
+    const int sphere_key = 1;
+
+    if (E->trace.courant <= 0.0)
+        return 1;
+
+    cfl = 0.0;
+    for (m=1; m<=E->sphere.caps_per_proc; m++)
+        for (el=1; el<=E->lmesh.nel; el++) {
+
+            velo_from_element(E,VV,m,el,sphere_key);
+
+            uc1 = uc2 = uc3 = 0.0;
+            for (i=1; i<=ENODES3D; i++) {
+                uc1 += E->N.ppt[GNPINDEX(i,1)]*VV[1][i];
+                uc2 += E->N.ppt[GNPINDEX(i,1)]*VV[2][i];
+                uc3 += E->N.ppt[GNPINDEX(i,1)]*VV[3][i];
+            }
+            cfl = max(cfl, fabs(uc1)/E->eco[m][el].size[1]
+                      + fabs(uc2)/E->eco[m][el].size[2]
+                      + fabs(uc3)/E->eco[m][el].size[3]);
+        }
+
+    cfl = global_dmax(E, cfl*E->advection.timestep);
+
+    nsub = (int)ceil(cfl/E->trace.courant);
+    nsub = max(nsub, 1);
+    nsub = min(nsub, TRACER_MAX_SUBSTEPS);
+
+    return nsub;
+}
+
+
+/*********** RUNGE KUTTA TRACERS ******************************************/
+/*                                                                        */
+/* Explicit Runge-Kutta schemes whose stages depend only on the previous  */
+/* stage velocity k_s:                                                    */
+/*                                                                        */
+/*     x_(s+1) = x0 + a[s] dt k_s,   x(t+dt) = x0 + dt sum_s b[s] k_s     */
+/*                                                                        */
+/* Stage s is at time t + a[s-1] dt.  2: Heun (the predictor-corrector),  */
+/* 3: Heun's third order method, 4: the classical fourth order method.   */
+/*                                                                        */
+/* Positions 6-8 hold x0 and positions 9-11 the partial sum of b[s] k_s,  */
+/* so both travel with the tracer when it changes processor between       */
+/* stages.                                                                */
+
+static void runge_kutta_tracers(struct All_variables *E, int nsub)
+{
+    static const double a2[] = {1.0};
+    static const double b2[] = {0.5, 0.5};
+    static const double a3[] = {1.0/3.0, 2.0/3.0};
+    static const double b3[] = {0.25, 0.0, 0.75};
+    static const double a4[] = {0.5, 0.5, 1.0};
+    static const double b4[] = {1.0/6.0, 1.0/3.0, 1.0/3.0, 1.0/6.0};
+
+    const double *a, *b;
+    int nstages;
+    int j, d, n, s;
+    double dt, t;
+
+    switch (E->trace.integrator) {
+    case 3:
+        a = a3; b = b3; nstages = 3;
+        break;
+    case 4:
+        a = a4; b = b4; nstages = 4;
+        break;
+    default:
+        a = a2; b = b2; nstages = 2;
+        break;
+    }
+
+    for (j=1; j<=E->sphere.caps_per_proc; j++)
+        for (d=1; d<=3; d++)
+            E->trace.Vsolution[j][d] = E->sphere.cap[j].V[d];
+
+    dt = E->advection.timestep/nsub;
+
+    for (n=0; n<nsub; n++)
+        for (s=0; s<nstages; s++) {
+
+            if (E->trace.extrapolate_velocity && E->trace.V0_dt > 0.0) {
+                t = (n + (s > 0 ? a[s-1] : 0.0))*dt;
+                set_stage_velocity(E, t/E->trace.V0_dt);
+            }
+
+            runge_kutta_stage(E, dt, s, nstages, a, b);
+
+            /* find new tracer elements and caps */
+            find_tracers(E);
+        }
+
+    for (j=1; j<=E->sphere.caps_per_proc; j++)
+        for (d=1; d<=3; d++)
+            E->sphere.cap[j].V[d] = E->trace.Vsolution[j][d];
+
+    return;
+}
+
+
+static void runge_kutta_stage(struct All_variables *E, double dt,
+                              int s, int nstages,
+                              const double *a, const double *b)
+{
+    int j, kk, d;
+    int numtracers;
+    double *vk[4];
+
+    for (j=1; j<=E->sphere.caps_per_proc; j++) {
+
+        numtracers = E->trace.ntracers[j];
+
+        if (E->trace.batch_velocity) {
+            for (d=1; d<=3; d++)
+                if ((vk[d]=(double *)malloc((numtracers+1)*sizeof(double)))==NULL) {
+                    fprintf(E->trace.fpt,"ERROR(runge kutta stage)-no memory\n");
+                    fflush(E->trace.fpt);
+                    exit(10);
+                }
+            get_tracer_velocities(E,j,E->trace.basicq[j][0],
+                                  E->trace.basicq[j][1],
+                                  E->trace.basicq[j][2],
+                                  vk[1],vk[2],vk[3]);
+        }
+
+#pragma omp parallel for private(d) schedule(static)
+        for (kk=1; kk<=numtracers; kk++) {
+
+            double x0[4], sum[4], v[4], x[4];
+            double theta, phi, rad;
+
+            void cart_to_sphere();
+
+            if (E->trace.batch_velocity) {
+                for (d=1; d<=3; d++)
+                    v[d] = vk[d][kk];
+            }
+            else
+                (E->trace.get_velocity)(E,j,E->trace.ielement[j][kk],
+                                        E->trace.basicq[j][0][kk],
+                                        E->trace.basicq[j][1][kk],
+                                        E->trace.basicq[j][2][kk],v);
+
+            for (d=1; d<=3; d++) {
+                if (s == 0) {
+                    x0[d] = E->trace.basicq[j][2+d][kk];
+                    sum[d] = b[0]*v[d];
+                }
+                else {
+                    x0[d] = E->trace.basicq[j][5+d][kk];
+                    sum[d] = E->trace.basicq[j][8+d][kk] + b[s]*v[d];
+                }
+
+                if (s < nstages-1)
+                    x[d] = x0[d] + a[s]*dt*v[d];
+                else
+                    x[d] = x0[d] + dt*sum[d];
+
+                E->trace.basicq[j][5+d][kk] = x0[d];
+                E->trace.basicq[j][8+d][kk] = sum[d];
+            }
+
+            cart_to_sphere(E,x[1],x[2],x[3],&theta,&phi,&rad);
+            (E->trace.keep_within_bounds)(E,&x[1],&x[2],&x[3],&theta,&phi,&rad);
+
+            E->trace.basicq[j][0][kk] = theta;
+            E->trace.basicq[j][1][kk] = phi;
+            E->trace.basicq[j][2][kk] = rad;
+            E->trace.basicq[j][3][kk] = x[1];
+            E->trace.basicq[j][4][kk] = x[2];
+            E->trace.basicq[j][5][kk] = x[3];
+        }
+
+        if (E->trace.batch_velocity)
+            for (d=1; d<=3; d++)
+                free(vk[d]);
+    }
+
+    return;
+}
+
+
+/*********** STAGE VELOCITY ***********************************************/
+/*                                                                        */
+/* The next Stokes solution is not known while the tracers move, so the   */
+/* stage velocities are extrapolated linearly in time from the current    */
+/* solution and the one of the previous step:                             */
+/*                                                                        */
+/*     V(t + frac dt0) = V(t) + frac (V(t) - V(t - dt0))                  */
+/*                                                                        */
+/* The velocity pointers of the caps are redirected to the extrapolated   */
+/* field until runge_kutta_tracers() puts the solution back.              */
+
+static void set_stage_velocity(struct All_variables *E, double frac)
+{
+    int j, d, i;
+    const int nno = E->lmesh.nno;
+
+    for (j=1; j<=E->sphere.caps_per_proc; j++)
+        for (d=1; d<=3; d++) {
+            float *V = E->trace.Vsolution[j][d];
+            float *V0 = E->trace.V0[j][d];
+            float *Vs;
+
+            if (E->trace.Vstage[j][d] == NULL &&
+                (E->trace.Vstage[j][d]=(float *)malloc((nno+1)*sizeof(float)))==NULL) {
+                fprintf(E->trace.fpt,"ERROR(set stage velocity)-no memory\n");
+                fflush(E->trace.fpt);
+                exit(10);
+            }
+            Vs = E->trace.Vstage[j][d];
+
+#pragma omp parallel for schedule(static)
+            for (i=1; i<=nno; i++)
+                Vs[i] = V[i] + frac*(V[i] - V0[i]);
+
+            E->sphere.cap[j].V[d] = Vs;
+        }
+
+    return;
+}
+
+
+static void save_tracer_velocity(struct All_variables *E)
+{
+    int j, d;
+    const int nno = E->lmesh.nno;
+
+    for (j=1; j<=E->sphere.caps_per_proc; j++)
+        for (d=1; d<=3; d++) {
+            if (E->trace.V0[j][d] == NULL &&
+                (E->trace.V0[j][d]=(float *)malloc((nno+1)*sizeof(float)))==NULL) {
+                fprintf(E->trace.fpt,"ERROR(save tracer velocity)-no memory\n");
+                fflush(E->trace.fpt);
+                exit(10);
+            }
+            memcpy(E->trace.V0[j][d], E->sphere.cap[j].V[d],
+                   (nno+1)*sizeof(float));
+        }
+
+    E->trace.V0_dt = E->advection.timestep;
+
+    return;
+}
+
+
+/*********** GET TRACER VELOCITIES ****************************************/
+/*                                                                        */
+/* This function interpolates the velocity of every tracer in cap j,      */
+/* one element at a time.  Coordinates are read from, and velocities      */
+/* written to, arrays indexed like the tracer arrays (1..ntracers).       */
+/* If the tracers are sorted by element, each element's tracers are       */
+/* passed in place; otherwise they are gathered into element order first. */
+
+static void get_tracer_velocities(struct All_variables *E, int j,
+                                  double *theta, double *phi, double *rad,
+                                  double *vx, double *vy, double *vz)
+{
+    int numtracers, nel;
+    int e, kk, n;
+    int *start, *order;
+    double *buf;
+
+    numtracers = E->trace.ntracers[j];
+    nel = E->lmesh.nel;
+
+    if (E->trace.sorted[j]) {
+        start = E->trace.elem_start[j];
+#pragma omp parallel for private(n) schedule(dynamic,16)
+        for (e=1; e<=nel; e++) {
+            n = start[e+1] - start[e];
+            if (n > 0)
+                (E->trace.get_velocity_batch)(E, j, e, n,
+                                              theta+start[e], phi+start[e],
+                                              rad+start[e], vx+start[e],
+                                              vy+start[e], vz+start[e]);
+        }
+        return;
+    }
+
+    /* bucket the tracers by element */
+    if ((start=(int *)malloc((nel+2)*sizeof(int)))==NULL ||
+        (order=(int *)malloc((numtracers+1)*sizeof(int)))==NULL ||
+        (buf=(double *)malloc(6*(numtracers+1)*sizeof(double)))==NULL) {
+        fprintf(E->trace.fpt,"ERROR(get tracer velocities)-no memory\n");
+        fflush(E->trace.fpt);
+        exit(10);
+    }
+
+    for (e=0; e<=nel+1; e++)
+        start[e] = 0;
+    for (kk=1; kk<=numtracers; kk++)
+        start[E->trace.ielement[j][kk]+1]++;
+    for (e=1; e<=nel+1; e++)
+        start[e] += start[e-1];
+    for (kk=1; kk<=numtracers; kk++)
+        order[start[E->trace.ielement[j][kk]]++] = kk;
+    for (e=nel+1; e>1; e--)
+        start[e] = start[e-1];
+    start[1] = 0;
+
+    /* gather, interpolate, scatter */
+#pragma omp parallel for schedule(static)
+    for (n=0; n<numtracers; n++) {
+        buf[n] = theta[order[n]];
+        buf[numtracers+n] = phi[order[n]];
+        buf[2*numtracers+n] = rad[order[n]];
+    }
+
+#pragma omp parallel for private(n) schedule(dynamic,16)
+    for (e=1; e<=nel; e++) {
+        n = start[e+1] - start[e];
+        if (n > 0)
+            (E->trace.get_velocity_batch)(E, j, e, n,
+                                          buf+start[e],
+                                          buf+numtracers+start[e],
+                                          buf+2*numtracers+start[e],
+                                          buf+3*numtracers+start[e],
+                                          buf+4*numtracers+start[e],
+                                          buf+5*numtracers+start[e]);
+    }
+
+#pragma omp parallel for schedule(static)
+    for (n=0; n<numtracers; n++) {
+        vx[order[n]] = buf[3*numtracers+n];
+        vy[order[n]] = buf[4*numtracers+n];
+        vz[order[n]] = buf[5*numtracers+n];
+    }
+
+    free(buf);
+    free(order);
+    free(start);
+
+    return;
+}
+
+
 /************ FIND TRACERS *************************************/
 /*                                                             */
 /* This function finds tracer elements and moves tracers to    */
@@ -544,20 +1119,11 @@ static void correct_tracers(struct All_variables *E)
 static void find_tracers(struct All_variables *E)
 {
 
-    int iel;
     int kk;
     int j;
-    int it;
-    int iprevious_element;
     int num_tracers;
+    int nlost;
 
-    double theta,phi,rad;
-    double x,y,z;
-    double time_stat1;
-    double time_stat2;
-
-    void put_away_later();
-    void eject_tracer();
     void reduce_tracer_arrays();
     void sphere_to_cart();
     void full_lost_souls();
@@ -573,57 +1139,42 @@ static void find_tracers(struct All_variables *E)
         /* initialize arrays and statistical counters */
 
         E->trace.ilater[j]=E->trace.ilatersize[j]=0;
+        E->trace.sorted[j]=0;
 
         E->trace.istat1=0;
         for (kk=0;kk<=4;kk++) {
             E->trace.istat_ichoice[j][kk]=0;
         }
 
-        //TODO: use while-loop instead of for-loop
-        /* important to index by it, not kk */
-
-        it=0;
         num_tracers=E->trace.ntracers[j];
+        nlost=0;
 
-        for (kk=1;kk<=num_tracers;kk++) {
-
-            it++;
-
-            theta=E->trace.basicq[j][0][it];
-            phi=E->trace.basicq[j][1][it];
-            rad=E->trace.basicq[j][2][it];
-            x=E->trace.basicq[j][3][it];
-            y=E->trace.basicq[j][4][it];
-            z=E->trace.basicq[j][5][it];
-
-            iprevious_element=E->trace.ielement[j][it];
-
-            iel=(E->trace.iget_element)(E,j,iprevious_element,x,y,z,theta,phi,rad);
-            /* debug *
-            fprintf(E->trace.fpt,"BB. kk %d %d %d %d %f %f %f %f %f %f\n",kk,j,iprevious_element,iel,x,y,z,theta,phi,rad);
-            fflush(E->trace.fpt);
-            */
-
-            E->trace.ielement[j][it]=iel;
-
-            if (iel == -99) {
-                /* tracer is inside other processors */
-                put_away_later(E,j,it);
-                eject_tracer(E,j,it);
-                it--;
-            } else if (iel == -1) {
-                /* tracer is inside this processor,
-                 * but cannot find its element.
-                 * Throw away the tracer. */
-
-                if (E->trace.itracer_warnings) exit(10);
+        /* locate every tracer; the arrays are not touched until all */
+        /* tracers are located, so this loop can run in parallel     */
 
+#pragma omp parallel for schedule(dynamic,256) reduction(+:nlost)
+        for (kk=1;kk<=num_tracers;kk++) {
+            int iel;
+
+            iel=(E->trace.iget_element)(E,j,E->trace.ielement[j][kk],
+                                        E->trace.basicq[j][3][kk],
+                                        E->trace.basicq[j][4][kk],
+                                        E->trace.basicq[j][5][kk],
+                                        E->trace.basicq[j][0][kk],
+                                        E->trace.basicq[j][1][kk],
+                                        E->trace.basicq[j][2][kk]);
+            E->trace.ielement[j][kk]=iel;
+
+            /* tracer is inside this processor,
+             * but cannot find its element. */
+            if (iel == -1) nlost++;
+        }
 
-                eject_tracer(E,j,it);
-                it--;
-            }
+        /* tracers found nowhere are thrown away */
+        if (nlost > 0 && E->trace.itracer_warnings) exit(10);
 
-        } /* end tracers */
+        /* move tracers inside other processors (-99) to rlater */
+        compact_tracers(E,j);
 
     } /* end j */
 
@@ -644,9 +1195,7 @@ static void find_tracers(struct All_variables *E)
 
     for (j=1;j<=E->sphere.caps_per_proc;j++) {
         if (E->trace.ilatersize[j]>0) {
-            for (kk=0;kk<=((E->trace.number_of_tracer_quantities)-1);kk++) {
-                free(E->trace.rlater[j][kk]);
-            }
+            free(E->trace.later_pool[j]);
         }
     } /* end j */
 
@@ -661,6 +1210,163 @@ static void find_tracers(struct All_variables *E)
 }
 
 
+/***********************************************************************/
+/* This function reorders the tracer arrays so that the tracers of     */
+/* each element are stored contiguously, in element order.  Elements   */
+/* are numbered radius-first, so neighbouring tracers in memory also   */
+/* share nodal data during interpolation.  The permutation is a        */
+/* counting sort on ielement, applied to every tracer quantity through */
+/* a single scratch array and copied back into place.                  */
+
+static void sort_tracers(struct All_variables *E)
+{
+    int j, kk, e, q;
+    int numtracers, nel;
+    int *start, *perm, *iscratch;
+    double *scratch;
+
+    double CPU_time0();
+    double begin_time = CPU_time0();
+
+    nel = E->lmesh.nel;
+
+    for (j=1; j<=E->sphere.caps_per_proc; j++) {
+
+        numtracers = E->trace.ntracers[j];
+        start = E->trace.elem_start[j];
+
+        if ((perm=(int *)malloc(E->trace.max_ntracers[j]*sizeof(int)))==NULL ||
+            (iscratch=(int *)malloc(E->trace.max_ntracers[j]*sizeof(int)))==NULL ||
+            (scratch=(double *)malloc(E->trace.max_ntracers[j]*sizeof(double)))==NULL) {
+            fprintf(E->trace.fpt,"ERROR(sort tracers)-no memory\n");
+            fflush(E->trace.fpt);
+            exit(10);
+        }
+
+        /* histogram of tracers per element, then exclusive prefix sum */
+        for (e=0; e<=nel+1; e++)
+            start[e] = 0;
+        for (kk=1; kk<=numtracers; kk++)
+            start[E->trace.ielement[j][kk]+1]++;
+        start[1] = 1;
+        for (e=2; e<=nel+1; e++)
+            start[e] += start[e-1];
+
+        /* perm[kk] is the new position of tracer kk */
+        for (kk=1; kk<=numtracers; kk++)
+            perm[kk] = start[E->trace.ielement[j][kk]]++;
+
+        /* the scatter above advanced start[e] to the first slot of e+1 */
+        for (e=nel+1; e>1; e--)
+            start[e] = start[e-1];
+        start[1] = 1;
+
+#pragma omp parallel for schedule(static)
+        for (kk=1; kk<=numtracers; kk++)
+            iscratch[perm[kk]] = E->trace.ielement[j][kk];
+        memcpy(&E->trace.ielement[j][1], &iscratch[1], numtracers*sizeof(int));
+
+        for (q=0; q<E->trace.number_of_basic_quantities; q++) {
+#pragma omp parallel for schedule(static)
+            for (kk=1; kk<=numtracers; kk++)
+                scratch[perm[kk]] = E->trace.basicq[j][q][kk];
+            memcpy(&E->trace.basicq[j][q][1], &scratch[1],
+                   numtracers*sizeof(double));
+        }
+
+        for (q=0; q<E->trace.number_of_extra_quantities; q++) {
+#pragma omp parallel for schedule(static)
+            for (kk=1; kk<=numtracers; kk++)
+                scratch[perm[kk]] = E->trace.extraq[j][q][kk];
+            memcpy(&E->trace.extraq[j][q][1], &scratch[1],
+                   numtracers*sizeof(double));
+        }
+
+        free(scratch);
+        free(iscratch);
+        free(perm);
+
+        E->trace.sorted[j] = 1;
+    }
+
+    E->trace.sort_tracers_time += CPU_time0() - begin_time;
+
+    return;
+}
+
+
+/* Flavor histograms of unsorted tracers. Each thread counts a chunk of */
+/* the tracer array into its own histogram, and the histograms are     */
+/* summed per element at the end.                                      */
+
+static void count_flavors_in_chunks(struct All_variables *E, int j)
+{
+    int nchunks, c, e, kk, flavor, size;
+    int *first, **count;
+    double **weight;
+
+    const int nflavors = E->trace.nflavors;
+    const int nel = E->lmesh.nel;
+    const int numtracers = E->trace.ntracers[j];
+    const int weighted = (E->trace.iweight >= 0);
+
+#ifdef _OPENMP
+    nchunks = omp_get_max_threads();
+#else
+    nchunks = 1;
+#endif
+
+    size = nflavors*(nel+1);
+    first = (int *)malloc((nchunks+1)*sizeof(int));
+    count = (int **)malloc(nchunks*sizeof(int *));
+    weight = (double **)malloc(nchunks*sizeof(double *));
+
+    for (c=0; c<=nchunks; c++)
+        first[c] = 1 + (int)(((long)numtracers * c) / nchunks);
+
+#pragma omp parallel for private(kk,e,flavor) schedule(static,1)
+    for (c=0; c<nchunks; c++) {
+        count[c] = (int *)calloc(size, sizeof(int));
+        weight[c] = weighted ? (double *)calloc(size, sizeof(double)) : NULL;
+
+        for (kk=first[c]; kk<first[c+1]; kk++) {
+            e = E->trace.ielement[j][kk];
+            flavor = E->trace.extraq[j][0][kk];
+            count[c][flavor*(nel+1) + e]++;
+            if (weighted)
+                weight[c][flavor*(nel+1) + e] +=
+                    E->trace.extraq[j][E->trace.iweight][kk];
+        }
+    }
+
+#pragma omp parallel for private(c,flavor) schedule(static)
+    for (e=1; e<=nel; e++)
+        for (flavor=0; flavor<nflavors; flavor++) {
+            E->trace.ntracer_flavor[j][flavor][e] = 0;
+            for (c=0; c<nchunks; c++)
+                E->trace.ntracer_flavor[j][flavor][e] +=
+                    count[c][flavor*(nel+1) + e];
+
+            if (weighted) {
+                E->trace.wtracer_flavor[j][flavor][e] = 0.0;
+                for (c=0; c<nchunks; c++)
+                    E->trace.wtracer_flavor[j][flavor][e] +=
+                        weight[c][flavor*(nel+1) + e];
+            }
+        }
+
+    for (c=0; c<nchunks; c++) {
+        free(count[c]);
+        if (weighted) free(weight[c]);
+    }
+    free(count);
+    free(weight);
+    free(first);
+
+    return;
+}
+
+
 /***********************************************************************/
 /* This function computes the number of tracers in each element.       */
 /* Each tracer can be of different "flavors", which is the 0th index   */
@@ -670,22 +1376,33 @@ void count_tracers_of_flavors(struct All_variables *E)
 {
 
     int j, flavor, e, kk;
-    int numtracers;
+    const int weighted = (E->trace.iweight >= 0);
 
     for (j=1; j<=E->sphere.caps_per_proc; j++) {
 
-        /* first zero arrays */
-        for (flavor=0; flavor<E->trace.nflavors; flavor++)
-            for (e=1; e<=E->lmesh.nel; e++)
-                E->trace.ntracer_flavor[j][flavor][e] = 0;
-
-        numtracers=E->trace.ntracers[j];
+        if (!E->trace.sorted[j]) {
+            count_flavors_in_chunks(E, j);
+            continue;
+        }
 
-        /* Fill arrays */
-        for (kk=1; kk<=numtracers; kk++) {
-            e = E->trace.ielement[j][kk];
-            flavor = E->trace.extraq[j][0][kk];
-            E->trace.ntracer_flavor[j][flavor][e]++;
+        /* tracers of each element are contiguous, so every element */
+        /* is counted by one thread and no array needs zeroing */
+#pragma omp parallel for private(kk,flavor) schedule(static)
+        for (e=1; e<=E->lmesh.nel; e++) {
+            for (flavor=0; flavor<E->trace.nflavors; flavor++)
+                E->trace.ntracer_flavor[j][flavor][e] = 0;
+            if (weighted)
+                for (flavor=0; flavor<E->trace.nflavors; flavor++)
+                    E->trace.wtracer_flavor[j][flavor][e] = 0.0;
+
+            for (kk=E->trace.elem_start[j][e];
+                 kk<E->trace.elem_start[j][e+1]; kk++) {
+                flavor = E->trace.extraq[j][0][kk];
+                E->trace.ntracer_flavor[j][flavor][e]++;
+                if (weighted)
+                    E->trace.wtracer_flavor[j][flavor][e] +=
+                        E->trace.extraq[j][E->trace.iweight][kk];
+            }
         }
     }
 
@@ -736,6 +1453,14 @@ void initialize_tracers(struct All_variables *E)
 
     find_tracers(E);
 
+    if (E->trace.sort_spacing > 0)
+        sort_tracers(E);
+
+    if (E->parallel.nprocxy == 12 && E->trace.ianalytical_tracer_test == 1) {
+        analytical_test(E);
+        parallel_process_termination();
+    }
+
 
     /* count # of tracers of each flavor */
 
@@ -880,6 +1605,9 @@ static void generate_random_tracers(struct All_variables *E,
         E->trace.basicq[j][4][kk]=y;
         E->trace.basicq[j][5][kk]=z;
 
+        if (E->trace.iweight >= 0)
+            E->trace.extraq[j][E->trace.iweight][kk]=1.0;
+
     } /* end while */
 
     return;
@@ -891,147 +1619,424 @@ static void generate_random_tracers(struct All_variables *E,
 /* This function reads tracers from input file.                         */
 /* All processors read the same input file, then sort out which ones    */
 /* belong.                                                              */
+/* If the file is an indexed binary tracer file (made by tracer2bin),   */
+/* each processor only reads the part of the file around its domain.   */
 
 static void read_tracer_file(struct All_variables *E)
 {
 
     char input_s[1000];
 
-    int number_of_tracers, ncolumns;
+    int number_of_tracers, ncolumns, nextra;
     int kk;
     int icheck;
     int iestimate;
     int icushion;
-    int i, j;
+    int magic;
+    int j;
+
+    double buffer[100];
 
+    FILE *fptracer;
+
+    fptracer=fopen(E->trace.tracer_file,"rb");
+    if (fptracer == NULL) {
+        fprintf(E->trace.fpt,"ERROR(read tracer file)-cannot open %s\n",
+                E->trace.tracer_file);
+        fflush(E->trace.fpt);
+        exit(10);
+    }
 
+    if (fread(&magic,sizeof(int),1,fptracer)==1 &&
+        magic==TRACER_BIN_MAGIC) {
+        number_of_tracers = read_binary_tracer_file(E,fptracer);
+    }
+    else {
+        rewind(fptracer);
+
+        fgets(input_s,200,fptracer);
+        if(sscanf(input_s,"%d %d",&number_of_tracers,&ncolumns) != 2) {
+            fprintf(stderr,"Error while reading file '%s'\n", E->trace.tracer_file);
+            exit(8);
+        }
+        fprintf(E->trace.fpt,"%d Tracers, %d columns in file \n",
+                number_of_tracers, ncolumns);
+
+        nextra = tracer_file_extras(E,ncolumns);
+
+        /* initially size tracer arrays to number of tracers divided by processors */
+
+        icushion=100;
+
+        /* for absolute tracer method */
+        E->trace.number_of_tracers = number_of_tracers;
+
+        iestimate=number_of_tracers/E->parallel.nproc + icushion;
+
+        for (j=1;j<=E->sphere.caps_per_proc;j++) {
+
+            allocate_tracer_arrays(E,j,iestimate);
+
+            for (kk=1;kk<=number_of_tracers;kk++) {
+                int len, ncol;
+                ncol = 3 + nextra;
+
+                len = read_double_vector(fptracer, ncol, buffer);
+                if (len != ncol) {
+                    fprintf(E->trace.fpt,"ERROR(read tracer file) - wrong input file format: %s\n", E->trace.tracer_file);
+                    fflush(E->trace.fpt);
+                    exit(10);
+                }
+
+                add_file_tracer(E,j,buffer,nextra);
+
+            } /* end kk, number of tracers */
+
+            fprintf(E->trace.fpt,"Number of tracers in this cap is: %d\n",
+                    E->trace.ntracers[j]);
+
+            /** debug **
+            for (kk=1; kk<=E->trace.ntracers[j]; kk++) {
+                fprintf(E->trace.fpt, "tracer#=%d sph_coord=(%g,%g,%g)", kk,
+                        E->trace.basicq[j][0][kk],
+                        E->trace.basicq[j][1][kk],
+                        E->trace.basicq[j][2][kk]);
+                fprintf(E->trace.fpt, "   extraq=");
+                for (i=0; i<E->trace.number_of_extra_quantities; i++)
+                    fprintf(E->trace.fpt, " %g", E->trace.extraq[j][i][kk]);
+                fprintf(E->trace.fpt, "\n");
+            }
+            fflush(E->trace.fpt);
+            */
+
+        } /* end j */
+    }
+
+    fclose(fptracer);
+
+    icheck=isum_tracers(E);
+
+    if (icheck!=number_of_tracers) {
+        fprintf(E->trace.fpt,"ERROR(read_tracer_file) - tracers != number in file\n");
+        fprintf(E->trace.fpt,"Tracers in system: %d\n", icheck);
+        fprintf(E->trace.fpt,"Tracers in file: %d\n", number_of_tracers);
+        fflush(E->trace.fpt);
+        exit(10);
+    }
+
+    return;
+}
+
+
+/* Number of extra quantities in a tracer file with ncolumns columns. */
+
+static int tracer_file_extras(struct All_variables *E, int ncolumns)
+{
+    int nextra;
+
+    /* the weight column may be left out, then all weights are 1 */
+    nextra = E->trace.number_of_extra_quantities;
+    if (E->trace.iweight >= 0 && nextra+2 == ncolumns)
+        nextra--;
+
+    /* some error control */
+    if (nextra+3 != ncolumns) {
+        fprintf(E->trace.fpt,"ERROR(read tracer file)-wrong # of columns\n");
+        fflush(E->trace.fpt);
+        exit(10);
+    }
+
+    return nextra;
+}
+
+
+/* Keep the tracer (theta, phi, rad, extras) read from a tracer file */
+/* if it is in the domain of this processor.                          */
+
+static void add_file_tracer(struct All_variables *E, int j,
+                            double *buffer, int nextra)
+{
     int icheck_processor_shell();
     void sphere_to_cart();
-    void cart_to_sphere();
     void expand_tracer_arrays();
 
     double x,y,z;
     double theta,phi,rad;
-    double buffer[100];
+    int icheck;
+    int i;
 
-    FILE *fptracer;
+    theta = buffer[0];
+    phi = buffer[1];
+    rad = buffer[2];
+
+    sphere_to_cart(E,theta,phi,rad,&x,&y,&z);
 
-    fptracer=fopen(E->trace.tracer_file,"r");
 
-    fgets(input_s,200,fptracer);
-    if(sscanf(input_s,"%d %d",&number_of_tracers,&ncolumns) != 2) {
-        fprintf(stderr,"Error while reading file '%s'\n", E->trace.tracer_file);
-        exit(8);
+    /* make sure theta, phi is in range, and radius is within bounds */
+
+    (E->trace.keep_within_bounds)(E,&x,&y,&z,&theta,&phi,&rad);
+
+    /* check whether tracer is within processor domain */
+
+    icheck=1;
+    if (E->parallel.nprocz>1) icheck=icheck_processor_shell(E,j,rad);
+    if (icheck!=1) return;
+
+    if (E->parallel.nprocxy==1)
+        icheck=regional_icheck_cap(E,0,theta,phi,rad,rad);
+    else
+        icheck=full_icheck_cap(E,0,x,y,z,rad);
+
+    if (icheck==0) return;
+
+    /* if still here, tracer is in processor domain */
+
+
+    E->trace.ntracers[j]++;
+
+    if (E->trace.ntracers[j]>=(E->trace.max_ntracers[j]-5)) expand_tracer_arrays(E,j);
+
+    E->trace.basicq[j][0][E->trace.ntracers[j]]=theta;
+    E->trace.basicq[j][1][E->trace.ntracers[j]]=phi;
+    E->trace.basicq[j][2][E->trace.ntracers[j]]=rad;
+    E->trace.basicq[j][3][E->trace.ntracers[j]]=x;
+    E->trace.basicq[j][4][E->trace.ntracers[j]]=y;
+    E->trace.basicq[j][5][E->trace.ntracers[j]]=z;
+
+    for (i=0; i<nextra; i++)
+        E->trace.extraq[j][i][E->trace.ntracers[j]]=buffer[i+3];
+    if (nextra < E->trace.number_of_extra_quantities)
+        E->trace.extraq[j][E->trace.iweight][E->trace.ntracers[j]]=1.0;
+
+    return;
+}
+
+
+/******** READ BINARY TRACER FILE ***************************************/
+/*                                                                      */
+/* The indexed binary tracer file (see visual/tracer2bin.c) is          */
+/*                                                                      */
+/*   int       magic, version, ncolumns, ntheta, nphi, nrad             */
+/*   long long ntracers                                                 */
+/*   double    rmin, rmax                                               */
+/*   long long start[ntheta*nphi*nrad+1]                                */
+/*   double    tracer[ntracers][ncolumns]                               */
+/*                                                                      */
+/* The tracers are sorted by bin, (itheta*nphi + iphi)*nrad + irad,     */
+/* uniform in colatitude, longitude and radius.  Processor 0 reads the  */
+/* index and broadcasts it.  Each processor then reads the tracers of   */
+/* the bins that overlap a spherical cap around its domain and its      */
+/* radial range, one contiguous run of records per angular bin, and     */
+/* keeps the ones that are in its domain.  Returns the total number of  */
+/* tracers in the file.                                                 */
+
+static int read_binary_tracer_file(struct All_variables *E, FILE *fptracer)
+{
+    int header[5];
+    int ncolumns, ntheta, nphi, nrad, nbins, nextra;
+    int it, ip, ir0, ir1, b, j, node;
+    int number_of_tracers, iestimate, nselected, noz;
+    long long ntr, *start, first, last, nread;
+    long data_offset;
+    double rbounds[2], center[4], v[4], c[4];
+    double dtheta, dphi, alpha, beta, norm, dot;
+    double *buffer;
+
+    const double margin = 0.01;
+
+    header[0] = 0;
+    start = NULL;
+    if (E->parallel.me == 0) {
+        if (fread(header,sizeof(int),5,fptracer) != 5 ||
+            fread(&ntr,sizeof(long long),1,fptracer) != 1 ||
+            fread(rbounds,sizeof(double),2,fptracer) != 2)
+            header[0] = -1;
+        else if (header[0] == TRACER_BIN_VERSION) {
+            nbins = header[2]*header[3]*header[4];
+            start = (long long *)malloc((nbins+1)*sizeof(long long));
+            if (fread(start,sizeof(long long),nbins+1,fptracer) != nbins+1)
+                header[0] = -1;
+        }
     }
-    fprintf(E->trace.fpt,"%d Tracers, %d columns in file \n",
-            number_of_tracers, ncolumns);
 
-    /* some error control */
-    if (E->trace.number_of_extra_quantities+3 != ncolumns) {
-        fprintf(E->trace.fpt,"ERROR(read tracer file)-wrong # of columns\n");
+    MPI_Bcast(header,5,MPI_INT,0,E->parallel.world);
+    if (header[0] != TRACER_BIN_VERSION) {
+        fprintf(E->trace.fpt,"ERROR(read tracer file) - bad binary tracer file %s\n",
+                E->trace.tracer_file);
         fflush(E->trace.fpt);
         exit(10);
     }
 
+    ncolumns = header[1];
+    ntheta = header[2];
+    nphi = header[3];
+    nrad = header[4];
+    nbins = ntheta*nphi*nrad;
 
-    /* initially size tracer arrays to number of tracers divided by processors */
-
-    icushion=100;
-
-    /* for absolute tracer method */
-    E->trace.number_of_tracers = number_of_tracers;
+    if (E->parallel.me != 0)
+        start = (long long *)malloc((nbins+1)*sizeof(long long));
+    MPI_Bcast(&ntr,1,MPI_LONG_LONG_INT,0,E->parallel.world);
+    MPI_Bcast(rbounds,2,MPI_DOUBLE,0,E->parallel.world);
+    MPI_Bcast(start,nbins+1,MPI_LONG_LONG_INT,0,E->parallel.world);
 
-    iestimate=number_of_tracers/E->parallel.nproc + icushion;
+    number_of_tracers = (int)ntr;
+    fprintf(E->trace.fpt,"%d Tracers, %d columns in binary file (%d x %d x %d bins)\n",
+            number_of_tracers, ncolumns, ntheta, nphi, nrad);
 
-    for (j=1;j<=E->sphere.caps_per_proc;j++) {
+    nextra = tracer_file_extras(E,ncolumns);
 
-        allocate_tracer_arrays(E,j,iestimate);
+    data_offset = 6*sizeof(int) + sizeof(long long) + 2*sizeof(double)
+        + (nbins+1)*sizeof(long long);
 
-        for (kk=1;kk<=number_of_tracers;kk++) {
-            int len, ncol;
-            ncol = 3 + E->trace.number_of_extra_quantities;
+    /* for absolute tracer method */
+    E->trace.number_of_tracers = number_of_tracers;
 
-            len = read_double_vector(fptracer, ncol, buffer);
-            if (len != ncol) {
-                fprintf(E->trace.fpt,"ERROR(read tracer file) - wrong input file format: %s\n", E->trace.tracer_file);
-                fflush(E->trace.fpt);
-                exit(10);
-            }
+    iestimate = number_of_tracers/E->parallel.nproc + 100;
 
-            theta = buffer[0];
-            phi = buffer[1];
-            rad = buffer[2];
+    buffer = (double *)malloc(TRACER_BIN_CHUNK*ncolumns*sizeof(double));
 
-            sphere_to_cart(E,theta,phi,rad,&x,&y,&z);
+    dtheta = M_PI/ntheta;
+    dphi = 2.0*M_PI/nphi;
+    noz = E->lmesh.noz;
 
+    for (j=1;j<=E->sphere.caps_per_proc;j++) {
 
-            /* make sure theta, phi is in range, and radius is within bounds */
+        allocate_tracer_arrays(E,j,iestimate);
 
-            (E->trace.keep_within_bounds)(E,&x,&y,&z,&theta,&phi,&rad);
+        /* a spherical cap, around the direction of the mean of the nodes, */
+        /* that contains the domain                                        */
 
-            /* check whether tracer is within processor domain */
+        center[1] = center[2] = center[3] = 0.0;
+        for (node=1;node<=E->lmesh.nno;node+=noz) {
+            tracer_unit_vector(E->sx[j][1][node],E->sx[j][2][node],v);
+            center[1] += v[1];
+            center[2] += v[2];
+            center[3] += v[3];
+        }
+        norm = sqrt(center[1]*center[1]+center[2]*center[2]+center[3]*center[3]);
+        center[1] /= norm;
+        center[2] /= norm;
+        center[3] /= norm;
+
+        alpha = 0.0;
+        for (node=1;node<=E->lmesh.nno;node+=noz) {
+            tracer_unit_vector(E->sx[j][1][node],E->sx[j][2][node],v);
+            dot = v[1]*center[1]+v[2]*center[2]+v[3]*center[3];
+            alpha = max(alpha, acos(min(1.0,max(-1.0,dot))));
+        }
+        alpha += margin;
+
+        /* radial bins of this processor, the bottom and top processors */
+        /* also take the tracers that are moved into the mesh          */
+
+        ir0 = 0;
+        ir1 = nrad-1;
+        if (rbounds[1] > rbounds[0]) {
+            if (E->parallel.me_loc[3] != 0)
+                ir0 = (int)floor((E->sx[j][3][1]-rbounds[0])
+                                 /(rbounds[1]-rbounds[0])*nrad) - 1;
+            if (E->parallel.me_loc[3] != E->parallel.nprocz-1)
+                ir1 = (int)floor((E->sx[j][3][noz]-rbounds[0])
+                                 /(rbounds[1]-rbounds[0])*nrad) + 1;
+            ir0 = max(ir0,0);
+            ir1 = min(ir1,nrad-1);
+        }
 
-            icheck=1;
-            if (E->parallel.nprocz>1) icheck=icheck_processor_shell(E,j,rad);
-            if (icheck!=1) continue;
+        /* read the records [first,last), merging adjacent runs */
+
+        nselected = 0;
+        nread = 0;
+        first = last = 0;
+        for (it=0;it<ntheta;it++)
+            for (ip=0;ip<nphi;ip++) {
+
+                if (ir0 > ir1) continue;
+
+                if (alpha < 0.5*M_PI) {
+                    tracer_unit_vector((it+0.5)*dtheta,(ip+0.5)*dphi,c);
+                    beta = 0.0;
+                    for (b=0;b<4;b++) {
+                        tracer_unit_vector((it+b/2)*dtheta,(ip+b%2)*dphi,v);
+                        dot = v[1]*c[1]+v[2]*c[2]+v[3]*c[3];
+                        beta = max(beta, acos(min(1.0,max(-1.0,dot))));
+                    }
+                    dot = c[1]*center[1]+c[2]*center[2]+c[3]*center[3];
+                    if (acos(min(1.0,max(-1.0,dot))) > alpha+beta) continue;
+                }
 
-            if (E->parallel.nprocxy==1)
-                icheck=regional_icheck_cap(E,0,theta,phi,rad,rad);
-            else
-                icheck=full_icheck_cap(E,0,x,y,z,rad);
+                nselected++;
+                b = (it*nphi + ip)*nrad;
+                if (start[b+ir0] == start[b+ir1+1]) continue;
 
-            if (icheck==0) continue;
+                if (start[b+ir0] != last) {
+                    nread += read_tracer_records(E,j,fptracer,data_offset,
+                                                 first,last,ncolumns,
+                                                 nextra,buffer);
+                    first = start[b+ir0];
+                }
+                last = start[b+ir1+1];
+            }
+        nread += read_tracer_records(E,j,fptracer,data_offset,first,last,
+                                     ncolumns,nextra,buffer);
 
-            /* if still here, tracer is in processor domain */
+        fprintf(E->trace.fpt,"Read %lld tracers from %d of %d angular bins, radial bins %d to %d\n",
+                nread, nselected, ntheta*nphi, ir0, ir1);
+        fprintf(E->trace.fpt,"Number of tracers in this cap is: %d\n",
+                E->trace.ntracers[j]);
 
+    } /* end j */
 
-            E->trace.ntracers[j]++;
+    free(buffer);
+    free(start);
 
-            if (E->trace.ntracers[j]>=(E->trace.max_ntracers[j]-5)) expand_tracer_arrays(E,j);
+    return number_of_tracers;
+}
 
-            E->trace.basicq[j][0][E->trace.ntracers[j]]=theta;
-            E->trace.basicq[j][1][E->trace.ntracers[j]]=phi;
-            E->trace.basicq[j][2][E->trace.ntracers[j]]=rad;
-            E->trace.basicq[j][3][E->trace.ntracers[j]]=x;
-            E->trace.basicq[j][4][E->trace.ntracers[j]]=y;
-            E->trace.basicq[j][5][E->trace.ntracers[j]]=z;
 
-            for (i=0; i<E->trace.number_of_extra_quantities; i++)
-                E->trace.extraq[j][i][E->trace.ntracers[j]]=buffer[i+3];
+/* Read the tracer records [first,last) of a binary tracer file.      */
 
-        } /* end kk, number of tracers */
+static long long read_tracer_records(struct All_variables *E, int j,
+                                     FILE *fptracer, long data_offset,
+                                     long long first, long long last,
+                                     int ncolumns, int nextra,
+                                     double *buffer)
+{
+    long long k;
+    int i, n;
 
-        fprintf(E->trace.fpt,"Number of tracers in this cap is: %d\n",
-                E->trace.ntracers[j]);
+    if (last <= first) return 0;
 
-        /** debug **
-        for (kk=1; kk<=E->trace.ntracers[j]; kk++) {
-            fprintf(E->trace.fpt, "tracer#=%d sph_coord=(%g,%g,%g)", kk,
-                    E->trace.basicq[j][0][kk],
-                    E->trace.basicq[j][1][kk],
-                    E->trace.basicq[j][2][kk]);
-            fprintf(E->trace.fpt, "   extraq=");
-            for (i=0; i<E->trace.number_of_extra_quantities; i++)
-                fprintf(E->trace.fpt, " %g", E->trace.extraq[j][i][kk]);
-            fprintf(E->trace.fpt, "\n");
-        }
+    if (fseek(fptracer, data_offset + (long)(first*ncolumns*sizeof(double)),
+              SEEK_SET) != 0) {
+        fprintf(E->trace.fpt,"ERROR(read tracer file) - cannot seek in %s\n",
+                E->trace.tracer_file);
         fflush(E->trace.fpt);
-        */
+        exit(10);
+    }
 
-    } /* end j */
+    for (k=first; k<last; k+=n) {
+        n = (int)min(last-k, (long long)TRACER_BIN_CHUNK);
+        if (fread(buffer,ncolumns*sizeof(double),n,fptracer) != n) {
+            fprintf(E->trace.fpt,"ERROR(read tracer file) - wrong input file format: %s\n",
+                    E->trace.tracer_file);
+            fflush(E->trace.fpt);
+            exit(10);
+        }
+        for (i=0; i<n; i++)
+            add_file_tracer(E,j,buffer+i*ncolumns,nextra);
+    }
 
-    fclose(fptracer);
+    return last-first;
+}
 
-    icheck=isum_tracers(E);
 
-    if (icheck!=number_of_tracers) {
-        fprintf(E->trace.fpt,"ERROR(read_tracer_file) - tracers != number in file\n");
-        fprintf(E->trace.fpt,"Tracers in system: %d\n", icheck);
-        fprintf(E->trace.fpt,"Tracers in file: %d\n", number_of_tracers);
-        fflush(E->trace.fpt);
-        exit(10);
-    }
+/* Unit vector v[1..3] of direction (theta, phi).                     */
 
+static void tracer_unit_vector(double theta, double phi, double *v)
+{
+    v[1] = sin(theta)*cos(phi);
+    v[2] = sin(theta)*sin(phi);
+    v[3] = cos(theta);
     return;
 }
 
@@ -1048,7 +2053,7 @@ static void read_old_tracer_file(struct All_variables *E)
     char input_s[1000];
 
     int i,j,kk,rezip;
-    int idum1,ncolumns;
+    int idum1,ncolumns,nextra;
     int numtracers;
 
     double rdum1;
@@ -1103,8 +2108,13 @@ static void read_old_tracer_file(struct All_variables *E)
         }
 
 
+        /* the weight column may be left out, then all weights are 1 */
+        nextra = E->trace.number_of_extra_quantities;
+        if (E->trace.iweight >= 0 && nextra+2 == ncolumns)
+            nextra--;
+
         /* some error control */
-        if (E->trace.number_of_extra_quantities+3 != ncolumns) {
+        if (nextra+3 != ncolumns) {
             fprintf(E->trace.fpt,"ERROR(read_old_tracer_file)-wrong # of columns\n");
             fflush(E->trace.fpt);
             exit(10);
@@ -1117,7 +2127,7 @@ static void read_old_tracer_file(struct All_variables *E)
 
         for (kk=1;kk<=numtracers;kk++) {
             int len, ncol;
-            ncol = 3 + E->trace.number_of_extra_quantities;
+            ncol = 3 + nextra;
 
             len = read_double_vector(fp1, ncol, buffer);
             if (len != ncol) {
@@ -1143,8 +2153,10 @@ static void read_old_tracer_file(struct All_variables *E)
             E->trace.basicq[j][4][kk]=y;
             E->trace.basicq[j][5][kk]=z;
 
-            for (i=0; i<E->trace.number_of_extra_quantities; i++)
+            for (i=0; i<nextra; i++)
                 E->trace.extraq[j][i][kk]=buffer[i+3];
+            if (nextra < E->trace.number_of_extra_quantities)
+                E->trace.extraq[j][E->trace.iweight][kk]=1.0;
 
         }
 
@@ -1445,6 +2457,109 @@ void get_neighboring_caps(struct All_variables *E)
 }
 
 
+/**************** TRACER ARRAY STORAGE *****************************************/
+/*                                                                            */
+/* All quantities of a cap (basicq, then extraq, then ielement) live in one   */
+/* block, each a column of max_ntracers entries.  max_ntracers is kept a      */
+/* multiple of 8, so every column starts on a 64-byte boundary.  The arrays   */
+/* double when full and are halved when less than a quarter full, so a        */
+/* tracer count hovering around a threshold does not resize back and forth.   */
+
+#define TRACER_HUGEPAGE_SIZE (2*1024*1024)
+
+static void *tracer_pool_alloc(struct All_variables *E, size_t nbytes)
+{
+    void *p;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (E->trace.hugepages) {
+        nbytes = (nbytes + TRACER_HUGEPAGE_SIZE - 1)
+            / TRACER_HUGEPAGE_SIZE * TRACER_HUGEPAGE_SIZE;
+        if (posix_memalign(&p, TRACER_HUGEPAGE_SIZE, nbytes) != 0)
+            return NULL;
+        /* only a hint; the kernel may decline */
+        madvise(p, nbytes, MADV_HUGEPAGE);
+        return p;
+    }
+#endif
+
+    if (posix_memalign(&p, 64, nbytes) != 0)
+        return NULL;
+    return p;
+}
+
+
+static size_t tracer_pool_bytes(struct All_variables *E, int size)
+{
+    return (size_t)size * (E->trace.number_of_basic_quantities
+                           + E->trace.number_of_extra_quantities)
+        * sizeof(double) + (size_t)size * sizeof(int);
+}
+
+
+static void set_tracer_columns(struct All_variables *E, int j,
+                               void *pool, int size)
+{
+    double *column = (double *)pool;
+    int kk;
+
+    for (kk=0;kk<E->trace.number_of_basic_quantities;kk++, column+=size)
+        E->trace.basicq[j][kk] = column;
+    for (kk=0;kk<E->trace.number_of_extra_quantities;kk++, column+=size)
+        E->trace.extraq[j][kk] = column;
+    E->trace.ielement[j] = (int *)column;
+
+    E->trace.pool[j] = pool;
+    E->trace.max_ntracers[j] = size;
+}
+
+
+/* Move the tracers of cap j into a new block of inewsize entries */
+
+static void resize_tracer_arrays(struct All_variables *E, int j, int inewsize)
+{
+    void *old_pool = E->trace.pool[j];
+    int n = E->trace.ntracers[j] + 1;
+    int kk;
+
+    double *old_basicq[100], *old_extraq[100];
+    int *old_ielement = E->trace.ielement[j];
+
+    inewsize = (inewsize + 7) / 8 * 8;
+
+    for (kk=0;kk<E->trace.number_of_basic_quantities;kk++)
+        old_basicq[kk] = E->trace.basicq[j][kk];
+    for (kk=0;kk<E->trace.number_of_extra_quantities;kk++)
+        old_extraq[kk] = E->trace.extraq[j][kk];
+
+    if (inewsize < n) {
+        fprintf(E->trace.fpt,"Error(resize tracer arrays)-something up (hdf3)\n");
+        fflush(E->trace.fpt);
+        exit(10);
+    }
+
+    if ((E->trace.pool[j]=tracer_pool_alloc(E, tracer_pool_bytes(E, inewsize)))==NULL) {
+        fprintf(E->trace.fpt,"ERROR(resize tracer arrays)-no memory (%d)\n",inewsize);
+        fflush(E->trace.fpt);
+        exit(10);
+    }
+    set_tracer_columns(E, j, E->trace.pool[j], inewsize);
+
+    /* columns change stride, so only the live entries are copied */
+    for (kk=0;kk<E->trace.number_of_basic_quantities;kk++)
+        memcpy(E->trace.basicq[j][kk], old_basicq[kk], n*sizeof(double));
+    for (kk=0;kk<E->trace.number_of_extra_quantities;kk++)
+        memcpy(E->trace.extraq[j][kk], old_extraq[kk], n*sizeof(double));
+    memcpy(E->trace.ielement[j], old_ielement, n*sizeof(int));
+
+    E->trace.pool_bytes_copied += tracer_pool_bytes(E, n);
+
+    free(old_pool);
+
+    return;
+}
+
+
 /**************** INITIALIZE TRACER ARRAYS ************************************/
 /*                                                                            */
 /* This function allocates memories to tracer arrays.                         */
@@ -1454,38 +2569,33 @@ void allocate_tracer_arrays(struct All_variables *E,
 {
 
     int kk;
+    int size;
+    void *pool;
 
     /* max_ntracers is physical size of tracer array */
     /* (initially make it 25% larger than required */
 
-    E->trace.max_ntracers[j]=number_of_tracers+number_of_tracers/4;
+    size=number_of_tracers+number_of_tracers/4;
+    size=(size+7)/8*8;
     E->trace.ntracers[j]=0;
 
     /* make tracer arrays */
 
-    if ((E->trace.ielement[j]=(int *) malloc(E->trace.max_ntracers[j]*sizeof(int)))==NULL) {
+    if ((pool=tracer_pool_alloc(E, tracer_pool_bytes(E, size)))==NULL) {
         fprintf(E->trace.fpt,"ERROR(make tracer array)-no memory 1a\n");
         fflush(E->trace.fpt);
         exit(10);
     }
+    set_tracer_columns(E, j, pool, size);
+
     for (kk=1;kk<E->trace.max_ntracers[j];kk++)
         E->trace.ielement[j][kk]=-99;
 
-
-    for (kk=0;kk<E->trace.number_of_basic_quantities;kk++) {
-        if ((E->trace.basicq[j][kk]=(double *)malloc(E->trace.max_ntracers[j]*sizeof(double)))==NULL) {
-            fprintf(E->trace.fpt,"ERROR(initialize tracer arrays)-no memory 1b.%d\n",kk);
-            fflush(E->trace.fpt);
-            exit(10);
-        }
-    }
-
-    for (kk=0;kk<E->trace.number_of_extra_quantities;kk++) {
-        if ((E->trace.extraq[j][kk]=(double *)malloc(E->trace.max_ntracers[j]*sizeof(double)))==NULL) {
-            fprintf(E->trace.fpt,"ERROR(initialize tracer arrays)-no memory 1c.%d\n",kk);
-            fflush(E->trace.fpt);
-            exit(10);
-        }
+    E->trace.sorted[j]=0;
+    if ((E->trace.elem_start[j]=(int *)malloc((E->lmesh.nel+2)*sizeof(int)))==NULL) {
+        fprintf(E->trace.fpt,"ERROR(initialize tracer arrays)-no memory 1d\n");
+        fflush(E->trace.fpt);
+        exit(10);
     }
 
     if (E->trace.nflavors > 0) {
@@ -1497,6 +2607,17 @@ void allocate_tracer_arrays(struct All_variables *E,
                 exit(10);
             }
         }
+
+        if (E->trace.iweight >= 0) {
+            E->trace.wtracer_flavor[j]=(double **)malloc(E->trace.nflavors*sizeof(double*));
+            for (kk=0;kk<E->trace.nflavors;kk++) {
+                if ((E->trace.wtracer_flavor[j][kk]=(double *)malloc((E->lmesh.nel+1)*sizeof(double)))==NULL) {
+                    fprintf(E->trace.fpt,"ERROR(initialize tracer arrays)-no memory 1e.%d\n",kk);
+                    fflush(E->trace.fpt);
+                    exit(10);
+                }
+            }
+        }
     }
 
 
@@ -1514,43 +2635,21 @@ void allocate_tracer_arrays(struct All_variables *E,
 void expand_tracer_arrays(struct All_variables *E, int j)
 {
 
-    int inewsize;
-    int kk;
+    int inewsize, ioldsize;
     int icushion;
 
-    /* expand basicq and ielement by 20% */
+    /* double the arrays */
 
     icushion=100;
 
-    inewsize=E->trace.max_ntracers[j]+E->trace.max_ntracers[j]/5+icushion;
-
-    if ((E->trace.ielement[j]=(int *)realloc(E->trace.ielement[j],inewsize*sizeof(int)))==NULL) {
-        fprintf(E->trace.fpt,"ERROR(expand tracer arrays )-no memory (ielement)\n");
-        fflush(E->trace.fpt);
-        exit(10);
-    }
-
-    for (kk=0;kk<=((E->trace.number_of_basic_quantities)-1);kk++) {
-        if ((E->trace.basicq[j][kk]=(double *)realloc(E->trace.basicq[j][kk],inewsize*sizeof(double)))==NULL) {
-            fprintf(E->trace.fpt,"ERROR(expand tracer arrays )-no memory (%d)\n",kk);
-            fflush(E->trace.fpt);
-            exit(10);
-        }
-    }
-
-    for (kk=0;kk<=((E->trace.number_of_extra_quantities)-1);kk++) {
-        if ((E->trace.extraq[j][kk]=(double *)realloc(E->trace.extraq[j][kk],inewsize*sizeof(double)))==NULL) {
-            fprintf(E->trace.fpt,"ERROR(expand tracer arrays )-no memory 78 (%d)\n",kk);
-            fflush(E->trace.fpt);
-            exit(10);
-        }
-    }
+    ioldsize=E->trace.max_ntracers[j];
+    inewsize=2*ioldsize+icushion;
 
+    resize_tracer_arrays(E, j, inewsize);
+    E->trace.pool_grows++;
 
     fprintf(E->trace.fpt,"Expanding physical memory of ielement, basicq, and extraq to %d from %d\n",
-            inewsize,E->trace.max_ntracers[j]);
-
-    E->trace.max_ntracers[j]=inewsize;
+            E->trace.max_ntracers[j],ioldsize);
 
     return;
 }
@@ -1563,9 +2662,7 @@ void expand_tracer_arrays(struct All_variables *E, int j)
 static void reduce_tracer_arrays(struct All_variables *E)
 {
 
-    int inewsize;
-    int kk;
-    int iempty_space;
+    int ioldsize;
     int j;
 
     int icushion=100;
@@ -1573,169 +2670,538 @@ static void reduce_tracer_arrays(struct All_variables *E)
     for (j=1;j<=E->sphere.caps_per_proc;j++) {
 
 
-        /* if physical size is double tracer size, reduce it */
+        /* if less than a quarter is used, halve it */
 
-        iempty_space=(E->trace.max_ntracers[j]-E->trace.ntracers[j]);
+        if (4*(E->trace.ntracers[j]+icushion) < E->trace.max_ntracers[j]) {
 
-        if (iempty_space>(E->trace.ntracers[j]+icushion)) {
+            ioldsize=E->trace.max_ntracers[j];
 
+            resize_tracer_arrays(E, j, ioldsize/2);
+            E->trace.pool_shrinks++;
 
-            inewsize=E->trace.ntracers[j]+E->trace.ntracers[j]/4+icushion;
+            fprintf(E->trace.fpt,"Reducing physical memory of ielement, basicq, and extraq to %d from %d\n",
+                    E->trace.max_ntracers[j],ioldsize);
 
-            if (inewsize<1) {
-                fprintf(E->trace.fpt,"Error(reduce tracer arrays)-something up (hdf3)\n");
-                fflush(E->trace.fpt);
-                exit(10);
-            }
+        } /* end if */
 
+    } /* end j */
 
-            if ((E->trace.ielement[j]=(int *)realloc(E->trace.ielement[j],inewsize*sizeof(int)))==NULL) {
-                fprintf(E->trace.fpt,"ERROR(reduce tracer arrays )-no memory (ielement)\n");
-                fflush(E->trace.fpt);
-                exit(10);
-            }
+    return;
+}
 
 
-            for (kk=0;kk<=((E->trace.number_of_basic_quantities)-1);kk++) {
-                if ((E->trace.basicq[j][kk]=(double *)realloc(E->trace.basicq[j][kk],inewsize*sizeof(double)))==NULL) {
-                    fprintf(E->trace.fpt,"AKM(reduce tracer arrays )-no memory (%d)\n",kk);
-                    fflush(E->trace.fpt);
-                    exit(10);
-                }
-            }
+/********** COMPACT TRACERS ***********************************/
+/*                                                            */
+/* After find_tracers has located all tracers of cap j, this  */
+/* function removes those with ielement -99 (inside another   */
+/* processor) or -1 (lost), and copies the former into the    */
+/* rlater arrays.  rlater has a similar structure to basicq;  */
+/* ilatersize is the physical memory and ilater is the number */
+/* of tracers.                                                */
+/*                                                            */
+/* The tracers are split into one chunk per thread.  A prefix */
+/* sum over the per-chunk counts gives every chunk its own    */
+/* segment of rlater, so the escaped tracers are copied out   */
+/* by all threads at once.  The holes left below the new      */
+/* tracer count are then filled with the kept tracers above   */
+/* it, one independent copy per hole, so only the removed     */
+/* tracers cause data movement.                               */
+
+static void compact_tracers(struct All_variables *E, int j)
+{
+    int numtracers, nchunks, nkeep, nlater, nholes;
+    int c, kk, q, nq, nb;
+    int *first, *later_off, *nremoved;
+    int *hole, *mover;
 
-            for (kk=0;kk<=((E->trace.number_of_extra_quantities)-1);kk++) {
-                if ((E->trace.extraq[j][kk]=(double *)realloc(E->trace.extraq[j][kk],inewsize*sizeof(double)))==NULL) {
-                    fprintf(E->trace.fpt,"AKM(reduce tracer arrays )-no memory 783 (%d)\n",kk);
-                    fflush(E->trace.fpt);
-                    exit(10);
-                }
+    numtracers = E->trace.ntracers[j];
+    nq = E->trace.number_of_tracer_quantities;
+    nb = E->trace.number_of_basic_quantities;
+
+#ifdef _OPENMP
+    nchunks = omp_get_max_threads();
+#else
+    nchunks = 1;
+#endif
+
+    first = (int *)malloc((nchunks+1)*sizeof(int));
+    later_off = (int *)malloc((nchunks+1)*sizeof(int));
+    nremoved = (int *)malloc((nchunks+1)*sizeof(int));
+
+    for (c=0; c<=nchunks; c++)
+        first[c] = 1 + (int)(((long)numtracers * c) / nchunks);
+
+    /* count the tracers leaving each chunk */
+#pragma omp parallel for private(kk) schedule(static,1)
+    for (c=0; c<nchunks; c++) {
+        later_off[c+1] = nremoved[c+1] = 0;
+        for (kk=first[c]; kk<first[c+1]; kk++)
+            if (E->trace.ielement[j][kk] <= 0) {
+                nremoved[c+1]++;
+                if (E->trace.ielement[j][kk] == -99)
+                    later_off[c+1]++;
             }
+    }
 
+    later_off[0] = nremoved[0] = 0;
+    for (c=1; c<=nchunks; c++) {
+        later_off[c] += later_off[c-1];
+        nremoved[c] += nremoved[c-1];
+    }
+    nlater = later_off[nchunks];
+    nkeep = numtracers - nremoved[nchunks];
 
-            fprintf(E->trace.fpt,"Reducing physical memory of ielement, basicq, and extraq to %d from %d\n",
-                    E->trace.max_ntracers[j],inewsize);
+    E->trace.ilater[j] = nlater;
 
-            E->trace.max_ntracers[j]=inewsize;
+    if (nkeep == numtracers) {
+        /* nothing to remove, common case */
+        free(first);
+        free(later_off);
+        free(nremoved);
+        return;
+    }
 
-        } /* end if */
+    /* The first tracer out initiates memory allocation. */
+    /* Memory is freed after parallel communications     */
+    if (nlater > 0) {
+        allocate_later_array(E, j, max(E->trace.max_ntracers[j]/5, nlater+6));
+
+        /* stack basic and extra quantities together (basic first) */
+#pragma omp parallel for private(kk,q) schedule(static,1)
+        for (c=0; c<nchunks; c++) {
+            int ilater = later_off[c];
+
+            for (kk=first[c]; kk<first[c+1]; kk++)
+                if (E->trace.ielement[j][kk] == -99) {
+                    ilater++;
+                    for (q=0; q<nb; q++)
+                        E->trace.rlater[j][q][ilater] = E->trace.basicq[j][q][kk];
+                    for (q=nb; q<nq; q++)
+                        E->trace.rlater[j][q][ilater] = E->trace.extraq[j][q-nb][kk];
+                }
+        }
+    }
 
-    } /* end j */
+    /* pair the holes in 1..nkeep with the kept tracers above nkeep; */
+    /* there are as many of one as of the other                      */
+    nholes = 0;
+    for (kk=1; kk<=nkeep; kk++)
+        if (E->trace.ielement[j][kk] <= 0) nholes++;
+
+    hole = (int *)malloc((nholes+1)*sizeof(int));
+    mover = (int *)malloc((nholes+1)*sizeof(int));
+
+    c = 0;
+    for (kk=1; kk<=nkeep; kk++)
+        if (E->trace.ielement[j][kk] <= 0) hole[c++] = kk;
+    c = 0;
+    for (kk=nkeep+1; kk<=numtracers; kk++)
+        if (E->trace.ielement[j][kk] > 0) mover[c++] = kk;
+
+#pragma omp parallel for private(q) schedule(static)
+    for (c=0; c<nholes; c++) {
+        E->trace.ielement[j][hole[c]] = E->trace.ielement[j][mover[c]];
+        for (q=0; q<nb; q++)
+            E->trace.basicq[j][q][hole[c]] = E->trace.basicq[j][q][mover[c]];
+        for (q=nb; q<nq; q++)
+            E->trace.extraq[j][q-nb][hole[c]] = E->trace.extraq[j][q-nb][mover[c]];
+    }
+
+    E->trace.ntracers[j] = nkeep;
+
+    free(hole);
+    free(mover);
+    free(first);
+    free(later_off);
+    free(nremoved);
 
     return;
 }
 
 
-/********** PUT AWAY LATER ************************************/
-/*                                             */
-/* rlater has a similar structure to basicq     */
-/* ilatersize is the physical memory and       */
-/* ilater is the number of tracers             */
+/****** REPORT TRACER LOAD *******************************************/
+/*                                                                   */
+/* The number of tracers and the tracer time of this step on this    */
+/* processor, with the smallest, mean and largest over all of them.  */
+/* The ratio of largest to mean is the time lost to the imbalance.   */
 
-static void put_away_later(struct All_variables *E, int j, int it)
+static void report_tracer_load(struct All_variables *E, double step_time)
 {
-    int kk;
-    void expand_later_array();
+    int j, n;
+    double local[4], lmax[4], lsum[4];
 
+    n = 0;
+    for (j=1; j<=E->sphere.caps_per_proc; j++)
+        n += E->trace.ntracers[j];
+
+    /* the minimum is the maximum of the negated values */
+    local[0] = n;
+    local[1] = step_time;
+    local[2] = -n;
+    local[3] = -step_time;
+
+    MPI_Allreduce(local, lmax, 4, MPI_DOUBLE, MPI_MAX, E->parallel.world);
+    MPI_Allreduce(local, lsum, 2, MPI_DOUBLE, MPI_SUM, E->parallel.world);
+    lsum[0] /= E->parallel.nproc;
+    lsum[1] /= E->parallel.nproc;
+
+    fprintf(E->trace.fpt, "Tracer load at step %d: %d tracers here, "
+            "%.0f/%.0f/%.0f min/mean/max (imbalance %.2f); "
+            "%.4f s here, %.4f/%.4f/%.4f min/mean/max (imbalance %.2f)\n",
+            E->monitor.solution_cycles, n,
+            -lmax[2], lsum[0], lmax[0],
+            (lsum[0] > 0) ? lmax[0]/lsum[0] : 1.0,
+            step_time, -lmax[3], lsum[1], lmax[1],
+            (lsum[1] > 0) ? lmax[1]/lsum[1] : 1.0);
+    fflush(E->trace.fpt);
+
+    if (E->parallel.me == 0) {
+        fprintf(E->fp, "tracer_load: %d %.0f %.0f %.0f %e %e %e\n",
+                E->monitor.solution_cycles, -lmax[2], lsum[0], lmax[0],
+                -lmax[3], lsum[1], lmax[1]);
+        fflush(E->fp);
+    }
 
-    /* The first tracer in initiates memory allocation. */
-    /* Memory is freed after parallel communications    */
+    return;
+}
 
-    if (E->trace.ilatersize[j]==0) {
 
-        E->trace.ilatersize[j]=E->trace.max_ntracers[j]/5;
+/****** TRACER LAYER COST ********************************************/
+/*                                                                   */
+/* Adds to cost[1..mesh.elz] the cost of the tracers in each radial  */
+/* layer of elements, in units of the cost of an element, i.e. the   */
+/* tracers per element of the layer times tracer_cost_weight.  If    */
+/* that is 0, the weight is the measured time per tracer over the    */
+/* time per element of everything else.                              */
 
-        for (kk=0;kk<=((E->trace.number_of_tracer_quantities)-1);kk++) {
-            if ((E->trace.rlater[j][kk]=(double *)malloc(E->trace.ilatersize[j]*sizeof(double)))==NULL) {
-                fprintf(E->trace.fpt,"AKM(put_away_later)-no memory (%d)\n",kk);
-                fflush(E->trace.fpt);
-                exit(10);
-            }
-        }
-    } /* end first particle initiating memory allocation */
+void tracer_layer_cost(struct All_variables *E, double *cost)
+{
+    int j, kk, e, k, nz;
+    double *count, *total, local[3], global[3], w;
 
+    nz = E->mesh.elz;
+    count = (double *)malloc((nz+1)*sizeof(double));
+    total = (double *)malloc((nz+1)*sizeof(double));
+    for (k=0; k<=nz; k++)
+        count[k] = 0;
 
-    /* Put tracer in later array */
+    for (j=1; j<=E->sphere.caps_per_proc; j++)
+        for (kk=1; kk<=E->trace.ntracers[j]; kk++) {
+            e = E->trace.ielement[j][kk];
+            if (e > 0)
+                count[E->lmesh.ezs + (e-1)%E->lmesh.elz + 1] += 1;
+        }
 
-    E->trace.ilater[j]++;
+    MPI_Allreduce(count, total, nz+1, MPI_DOUBLE, MPI_SUM, E->parallel.world);
 
-    if (E->trace.ilater[j] >= (E->trace.ilatersize[j]-5)) expand_later_array(E,j);
+    w = E->trace.cost_weight;
+    if (w <= 0) {
+        local[0] = E->trace.balance_tracer_time;
+        local[1] = E->trace.balance_total_time - E->trace.balance_tracer_time;
+        local[2] = 0;
+        for (j=1; j<=E->sphere.caps_per_proc; j++)
+            local[2] += E->trace.ntracers[j];
+        MPI_Allreduce(local, global, 3, MPI_DOUBLE, MPI_SUM, E->parallel.world);
 
-    /* stack basic and extra quantities together (basic first) */
+        w = 0;
+        if (global[0] > 0 && global[1] > 0 && global[2] > 0)
+            w = (global[0]/global[2]) / (global[1]/E->mesh.nel);
+    }
 
-    for (kk=0;kk<=((E->trace.number_of_basic_quantities)-1);kk++)
-        E->trace.rlater[j][kk][E->trace.ilater[j]]=E->trace.basicq[j][kk][it];
+    for (k=1; k<=nz; k++)
+        cost[k] += w * total[k] * nz / E->mesh.nel;
 
-    for (kk=0;kk<=((E->trace.number_of_extra_quantities)-1);kk++)
-        E->trace.rlater[j][E->trace.number_of_basic_quantities+kk][E->trace.ilater[j]]=E->trace.extraq[j][kk][it];
+    fprintf(E->trace.fpt, "Cost of a tracer relative to an element: %g\n", w);
+    fflush(E->trace.fpt);
 
+    free(count);
+    free(total);
 
     return;
 }
 
 
-/****** EXPAND LATER ARRAY *****************************************/
-
-void expand_later_array(struct All_variables *E, int j)
+/****** CONTROL TRACER POPULATION ************************************/
+/*                                                                   */
+/* Keeps the number of tracers in every element between             */
+/* tracer_min_per_element and tracer_max_per_element.  Each tracer  */
+/* carries a weight (an extra quantity), and the composition is     */
+/* computed from the summed weights, so merging and splitting do    */
+/* not change the flavor content of an element.                     */
+/*                                                                   */
+/* Crowded elements are thinned to max(min, max/2) tracers, each    */
+/* flavor in proportion to its count.  Sparse elements get their    */
+/* heaviest tracers split until they hold min(2*min, max) tracers,  */
+/* or every tracer has been split once.                             */
+
+static void control_tracer_population(struct All_variables *E)
 {
+    int j, e, kk, n, f, nf, target, nmerged, nsplit;
+    int nel, nflavors, numtracers;
+    int *start, *list, *flist;
 
-    int inewsize;
-    int kk;
-    int icushion;
+    nel = E->lmesh.nel;
+    nflavors = max(E->trace.nflavors, 1);
+    nmerged = nsplit = 0;
 
-    /* expand rlater by 20% */
-
-    icushion=100;
+    for (j=1; j<=E->sphere.caps_per_proc; j++) {
 
-    inewsize=E->trace.ilatersize[j]+E->trace.ilatersize[j]/5+icushion;
+        numtracers = E->trace.ntracers[j];
 
-    for (kk=0;kk<=((E->trace.number_of_tracer_quantities)-1);kk++) {
-        if ((E->trace.rlater[j][kk]=(double *)realloc(E->trace.rlater[j][kk],inewsize*sizeof(double)))==NULL) {
-            fprintf(E->trace.fpt,"AKM(expand later array )-no memory (%d)\n",kk);
+        if ((start=(int *)malloc((nel+2)*sizeof(int)))==NULL ||
+            (list=(int *)malloc((numtracers+1)*sizeof(int)))==NULL ||
+            (flist=(int *)malloc((numtracers+1)*sizeof(int)))==NULL) {
+            fprintf(E->trace.fpt,"ERROR(control tracer population)-no memory\n");
             fflush(E->trace.fpt);
             exit(10);
         }
-    }
 
+        /* list the tracers of each element, as in sort_tracers */
+        for (e=0; e<=nel+1; e++)
+            start[e] = 0;
+        for (kk=1; kk<=numtracers; kk++)
+            start[E->trace.ielement[j][kk]+1]++;
+        start[1] = 0;
+        for (e=2; e<=nel+1; e++)
+            start[e] += start[e-1];
+        for (kk=1; kk<=numtracers; kk++)
+            list[start[E->trace.ielement[j][kk]]++] = kk;
+        for (e=nel+1; e>1; e--)
+            start[e] = start[e-1];
+        start[1] = 0;
+
+        for (e=1; e<=nel; e++) {
+            n = start[e+1] - start[e];
+
+            if (E->trace.max_per_element > 0 && n > E->trace.max_per_element) {
+                target = max(E->trace.min_per_element,
+                             E->trace.max_per_element/2);
+
+                for (f=0; f<nflavors; f++) {
+                    nf = 0;
+                    for (kk=start[e]; kk<start[e+1]; kk++)
+                        if (nflavors == 1 ||
+                            (int)E->trace.extraq[j][0][list[kk]] == f)
+                            flist[nf++] = list[kk];
+                    if (nf == 0) continue;
+
+                    nmerged += merge_tracers(E, j, flist, nf,
+                                             max(1, (int)((double)nf*target/n + 0.5)));
+                }
+            }
+            else if (E->trace.min_per_element > 0 && n > 0 &&
+                     n < E->trace.min_per_element) {
+                target = 2*E->trace.min_per_element;
+                if (E->trace.max_per_element > 0)
+                    target = min(target, E->trace.max_per_element);
+
+                nsplit += split_tracers(E, j, e, &list[start[e]], n, target);
+            }
+        }
 
-    fprintf(E->trace.fpt,"Expanding physical memory of rlater to %d from %d\n",
-            inewsize,E->trace.ilatersize[j]);
+        free(flist);
+        free(list);
+        free(start);
 
-    E->trace.ilatersize[j]=inewsize;
+        /* drop the merged tracers, their ielement is 0 */
+        compact_tracers(E, j);
+        E->trace.sorted[j] = 0;
+    }
+
+    E->trace.istat_merged += nmerged;
+    E->trace.istat_split += nsplit;
+
+    /* the number of tracers changed on purpose */
+    E->trace.ilast_tracer_count = isum_tracers(E);
 
     return;
 }
 
 
-/***** EJECT TRACER ************************************************/
+/* Merges the n tracers in list into target tracers, by groups of  */
+/* consecutive entries.  The first tracer of a group survives with */
+/* the summed weight and the weighted mean of the other extra      */
+/* quantities; the rest get ielement 0.  Returns the number of     */
+/* tracers removed.                                                */
 
-static void eject_tracer(struct All_variables *E, int j, int it)
+static int merge_tracers(struct All_variables *E, int j,
+                         int *list, int n, int target)
 {
+    int g, i, q, first, last, kk, iw;
+    double w, wsum;
+
+    if (target >= n) return 0;
+
+    iw = E->trace.iweight;
+
+    for (g=0; g<target; g++) {
+        first = (int)(((long)n * g) / target);
+        last = (int)(((long)n * (g+1)) / target);
+        kk = list[first];
+
+        wsum = E->trace.extraq[j][iw][kk];
+        for (q=1; q<E->trace.number_of_extra_quantities; q++)
+            if (q != iw)
+                E->trace.extraq[j][q][kk] *= wsum;
+
+        for (i=first+1; i<last; i++) {
+            w = E->trace.extraq[j][iw][list[i]];
+            wsum += w;
+            for (q=1; q<E->trace.number_of_extra_quantities; q++)
+                if (q != iw)
+                    E->trace.extraq[j][q][kk] += w*E->trace.extraq[j][q][list[i]];
+            E->trace.ielement[j][list[i]] = 0;
+        }
 
-    int ilast_tracer;
-    int kk;
+        for (q=1; q<E->trace.number_of_extra_quantities; q++)
+            if (q != iw)
+                E->trace.extraq[j][q][kk] /= wsum;
+        E->trace.extraq[j][iw][kk] = wsum;
+    }
+
+    return n - target;
+}
+
+
+/* Splits the heaviest of the n tracers of element e in list until  */
+/* there are target tracers.  The copy is placed half way between   */
+/* the tracer and the centroid of the element, and both halves get  */
+/* half the weight.  A copy that does not land in this processor is */
+/* dropped.  Returns the number of tracers added.                   */
+
+static int split_tracers(struct All_variables *E, int j, int e,
+                         int *list, int n, int target)
+{
+    int i, s, q, kk, inew, iel, heaviest, nadded;
+    double xc, yc, zc, x, y, z, theta, phi, rad, w;
+
+    nadded = 0;
+
+    xc = yc = zc = 0.0;
+    for (i=1; i<=ENODES3D; i++) {
+        xc += E->x[j][1][E->ien[j][e].node[i]];
+        yc += E->x[j][2][E->ien[j][e].node[i]];
+        zc += E->x[j][3][E->ien[j][e].node[i]];
+    }
+    xc /= ENODES3D;
+    yc /= ENODES3D;
+    zc /= ENODES3D;
+
+    /* each tracer is split at most once per step */
+    for (s=n; s<target && s<2*n; s++) {
+
+        /* move the heaviest unsplit tracer to the end of the list */
+        heaviest = 0;
+        for (i=1; i<n-(s-n); i++)
+            if (E->trace.extraq[j][E->trace.iweight][list[i]] >
+                E->trace.extraq[j][E->trace.iweight][list[heaviest]])
+                heaviest = i;
+        kk = list[heaviest];
+        list[heaviest] = list[n-(s-n)-1];
+        list[n-(s-n)-1] = kk;
+
+        x = 0.5*(E->trace.basicq[j][3][kk] + xc);
+        y = 0.5*(E->trace.basicq[j][4][kk] + yc);
+        z = 0.5*(E->trace.basicq[j][5][kk] + zc);
+        cart_to_sphere(E, x, y, z, &theta, &phi, &rad);
+
+        iel = (E->trace.iget_element)(E, j, e, x, y, z, theta, phi, rad);
+        if (iel <= 0) continue;
+
+        if (E->trace.ntracers[j] >= E->trace.max_ntracers[j]-5)
+            expand_tracer_arrays(E, j);
+
+        inew = ++E->trace.ntracers[j];
+        for (q=0; q<E->trace.number_of_basic_quantities; q++)
+            E->trace.basicq[j][q][inew] = E->trace.basicq[j][q][kk];
+        for (q=0; q<E->trace.number_of_extra_quantities; q++)
+            E->trace.extraq[j][q][inew] = E->trace.extraq[j][q][kk];
+
+        E->trace.basicq[j][0][inew] = theta;
+        E->trace.basicq[j][1][inew] = phi;
+        E->trace.basicq[j][2][inew] = rad;
+        E->trace.basicq[j][3][inew] = x;
+        E->trace.basicq[j][4][inew] = y;
+        E->trace.basicq[j][5][inew] = z;
+        E->trace.ielement[j][inew] = iel;
+
+        w = 0.5*E->trace.extraq[j][E->trace.iweight][kk];
+        E->trace.extraq[j][E->trace.iweight][kk] = w;
+        E->trace.extraq[j][E->trace.iweight][inew] = w;
+
+        nadded++;
+    }
 
+    return nadded;
+}
 
-    ilast_tracer=E->trace.ntracers[j];
 
-    /* put last tracer in ejected tracer position */
+/****** ALLOCATE LATER ARRAY *****************************************/
+/*                                                                   */
+/* rlater is one block too, one column of ilatersize per quantity.   */
 
-    E->trace.ielement[j][it]=E->trace.ielement[j][ilast_tracer];
+void allocate_later_array(struct All_variables *E, int j, int size)
+{
 
-    for (kk=0;kk<=((E->trace.number_of_basic_quantities)-1);kk++)
-        E->trace.basicq[j][kk][it]=E->trace.basicq[j][kk][ilast_tracer];
+    double *column;
+    int kk;
 
-    for (kk=0;kk<=((E->trace.number_of_extra_quantities)-1);kk++)
-        E->trace.extraq[j][kk][it]=E->trace.extraq[j][kk][ilast_tracer];
+    size=(size+7)/8*8;
 
+    if ((E->trace.later_pool[j]=tracer_pool_alloc(E, (size_t)size*E->trace.number_of_tracer_quantities*sizeof(double)))==NULL) {
+        fprintf(E->trace.fpt,"AKM(allocate later array)-no memory (%d)\n",size);
+        fflush(E->trace.fpt);
+        exit(10);
+    }
 
+    column=(double *)E->trace.later_pool[j];
+    for (kk=0;kk<E->trace.number_of_tracer_quantities;kk++, column+=size)
+        E->trace.rlater[j][kk]=column;
 
-    E->trace.ntracers[j]--;
+    E->trace.ilatersize[j]=size;
 
     return;
 }
 
 
+/****** EXPAND LATER ARRAY *****************************************/
+
+void expand_later_array(struct All_variables *E, int j)
+{
+
+    void *old_pool;
+    double *old_rlater[100];
+    int ioldsize;
+    int kk;
+    int icushion;
+
+    /* double rlater */
+
+    icushion=100;
+
+    old_pool=E->trace.later_pool[j];
+    ioldsize=E->trace.ilatersize[j];
+    for (kk=0;kk<E->trace.number_of_tracer_quantities;kk++)
+        old_rlater[kk]=E->trace.rlater[j][kk];
+
+    allocate_later_array(E, j, 2*ioldsize+icushion);
+
+    for (kk=0;kk<E->trace.number_of_tracer_quantities;kk++)
+        memcpy(E->trace.rlater[j][kk], old_rlater[kk],
+               (E->trace.ilater[j]+1)*sizeof(double));
+
+    free(old_pool);
+
+    E->trace.pool_grows++;
+    E->trace.pool_bytes_copied += (double)(E->trace.ilater[j]+1)
+        * E->trace.number_of_tracer_quantities * sizeof(double);
+
+    fprintf(E->trace.fpt,"Expanding physical memory of rlater to %d from %d\n",
+            E->trace.ilatersize[j],ioldsize);
+
+    return;
+}
+
 
 /********** ICHECK PROCESSOR SHELL *************/
 /* returns -99 if rad is below current shell  */
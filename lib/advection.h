@@ -47,6 +47,28 @@ struct ADVECTION {
   int sub_iterations;
   int last_sub_iterations;
 
+  /* cache of the Petrov-Galerkin shape functions, valid as long as
+     the velocity field does not change */
+  int pg_cache;
+  float pg_cache_max_mb;
+  int pg_cache_nel[NCS];
+  int pg_cache_version;
+  double pg_cache_diff;
+  struct PG_ELEMENT *pg_cache_el[NCS];
+
+  /* implicit (Crank-Nicolson for adv_gamma=0.5) treatment of diffusion */
+  int implicit_diffusion;
+  float implicit_diffusion_tol;
+  int implicit_diffusion_maxiter;
+  int implicit_diffusion_iterations;
+  float explicit_diff_timestep;
+  struct DIFF_ELEMENT *diff_el[NCS];
+  double *implicit_work[5][NCS];
+
+  /* work arrays of PG_timestep_solve() */
+  double *DTdot[NCS];
+  double *T_old[NCS], *Tdot_old[NCS];
+
 } advection;
 
 
@@ -34,6 +34,7 @@ extern "C" {
 
 void general_stokes_solver(struct All_variables*);
 void general_stokes_solver_setup(struct All_variables*);
+void adaptive_stokes_solver(struct All_variables*);
 
 #ifdef __cplusplus
 }
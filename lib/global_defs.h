@@ -107,6 +107,8 @@ extern "C" {
 
 #define MAX_LEVELS 12   /* max. number of multigrid levels */
 #define NCS      14   /* max. number of sphere caps */
+#define MAX_GLOBAL_SUMS 16 /* max. number of batched global sums */
+#define MAX_HALO_FIELDS 8  /* max. number of fields in one halo exchange */
 
 /* type of elt_del and elt_c arrays */
 /* double precision doesn't help,
@@ -227,9 +229,23 @@ struct Parallel {
     int redundant[MAX_LEVELS];
     int idb;
     int me_loc[4];
+
+    /* global sums batched into one MPI_Allreduce, see add_global_sum() */
+    int nsums;
+    double sum_local[MAX_GLOBAL_SUMS];
+    double sum_global[MAX_GLOBAL_SUMS];
+    double sum_scale[MAX_GLOBAL_SUMS];
+    int num_reductions;   /* # of batched MPI_Allreduce so far */
+
+    /* elements in each radial layer of processors (finest level); */
+    /* chkpt_layer_elz is the split of the checkpoint read on restart */
+    int *layer_elz;
+    int *chkpt_layer_elz;
+    int radial_repartition;
     int num_b;
+    /* # of equations of shared nodes owned by other processors, */
+    /* numbered last by construct_id() */
     int Skip_neq[MAX_LEVELS][NCS];
-    int *Skip_id[MAX_LEVELS][NCS];
 
     int TNUM_PASS[MAX_LEVELS][NCS];
     struct BOUND *NODE[MAX_LEVELS][NCS];
@@ -247,10 +263,58 @@ struct Parallel {
     struct PASS NUM_NEQz[MAX_LEVELS];
     struct PASS NUM_NODEz[MAX_LEVELS];
 
+    /* the passes of the halo exchange in ordered phases, used by */
+    /* halo_exchange() for the shared memory and the neighborhood */
+    /* collective exchanges, see setup_halo_exchange() */
+    int generic_halo;
+    int halo_nphase;
+    int halo_npass[MAX_LEVELS];
+    struct PASS halo_pass[MAX_LEVELS];  /* index into EXCHANGE_ID/NODE */
+    struct PASS halo_proc[MAX_LEVELS];  /* neighbor of the pass */
+    struct PASS halo_phase[MAX_LEVELS];
+
+    /* halo exchange with the neighbors on the same compute node */
+    /* through an MPI-3 shared memory window */
+    int shm_halo;
+    int shm_parity;               /* which half of the window is in use */
+    int shm_size;                 /* # of doubles in each half */
+    double *shm_base;
+    MPI_Comm node_comm;
+#if MPI_VERSION >= 3
+    MPI_Win shm_win;
+#endif
+    struct PASS shm_slot[MAX_LEVELS];   /* my slot, -1 if off-node */
+    struct PASS shm_rsize[MAX_LEVELS];  /* neighbor's shm_size */
+    double *shm_remote[MAX_LEVELS][27]; /* neighbor's slot */
+    int shm_active[MAX_LEVELS][3];      /* any on-node pass in the phase */
+
+    /* halo exchange with the other neighbors by neighborhood */
+    /* collectives on a distributed graph */
+    int neighbor_coll;
+    MPI_Comm graph_comm;
+    int graph_degree;
+    struct PASS halo_edge[MAX_LEVELS];  /* edge of the pass, -1 if none */
+
+    /* message buffers of halo_exchange(), sized once by */
+    /* setup_halo_exchange(); each pass has its own block  */
+    struct PASS halo_offset[MAX_LEVELS];
+    double *halo_sbuf;
+    double *halo_rbuf;
+    MPI_Request *halo_request;
+    int *halo_counts;                   /* counts and displs of the edges */
+
     int sTNUM_PASS[MAX_LEVELS][NCS];
     struct PASS NUM_sNODE[MAX_LEVELS][NCS];
     struct PASS sPROCESSOR[MAX_LEVELS][NCS];
     struct PASS *EXCHANGE_sNODE[MAX_LEVELS][NCS];
+
+    /* buffers of exchange_node_fields() and exchange_snode_fields(), */
+    /* grown as needed by grow_field_buffers() */
+    int fields_bufsize;
+    int fields_nrequest;
+    double *fields_sbuf;
+    double *fields_rbuf;
+    MPI_Request *fields_request;
     };
 
 struct CAP    {
@@ -262,6 +326,20 @@ struct CAP    {
     float *Vprev[4];
     };
 
+#define MAX_SPH_FIELDS 4
+
+struct SPH_COMM {   /* batched, nonblocking exchange of sph. harm. coeff */
+    int nfield;
+    float *sphc[MAX_SPH_FIELDS];   /* cos coeff of each field */
+    float *sphs[MAX_SPH_FIELDS];   /* sin coeff of each field */
+    int root[MAX_SPH_FIELDS];      /* broadcast root of each field */
+    int bcast;                     /* broadcast if 1, sum if 0 */
+    int rank;                      /* my rank in the communicator */
+    int nreq;
+    MPI_Request req[MAX_SPH_FIELDS];
+    float *sbuf, *rbuf;
+};
+
 struct SPHERE   {
   int caps;
   int caps_per_proc;
@@ -278,6 +356,9 @@ struct SPHERE   {
   float *harm_tpgt[2];
   float *harm_tpgb[2];
 
+  /* 0: general use, 1: depth sums of the geoid from buoyancy */
+  struct SPH_COMM coef_comm[2];
+
   double **tablesplm[NCS];
   double **tablescosf[NCS];
   double **tablessinf[NCS];
@@ -364,6 +445,9 @@ struct HAVE {    /* horizontal averages */
     float *T;
     float *V[4];
     float **C;
+    double *dA;      /* bottom face jacobians of each element */
+    double *dAtop;   /* top face jacobians of the top layer */
+    double *area;    /* global area of each layer */
 };
 
 struct SLICE {    /* horizontally sliced data, including topography */
@@ -382,6 +466,7 @@ struct MONITOR {
     int solution_cycles_init;
 
     int visc_iter_count;
+    int velocity_updates; /* incremented whenever sphere.cap[].V changes */
 
     int stop_topo_loop;
     int topo_loop;
@@ -550,6 +635,15 @@ struct CONTROL {
     int total_iteration_cycles;
     int total_v_solver_calls;
 
+    int stokes_skip;
+    int stokes_skip_max;
+    int stokes_skip_piterations;
+    double stokes_skip_tol;
+    int stokes_skip_count;
+    int stokes_full_solves;
+    int stokes_corrections;
+    int stokes_skips;
+
     int checkpoint_frequency;
     int record_every;
     int record_all_until;
@@ -622,6 +716,8 @@ struct gzd_struc{
 
 };
 
+struct async_output;  /* Output_binary.c */
+
 struct Output {
     char format[20];  /* ascii or hdf5 */
     char optional[1000]; /* comma-delimited list of objects to output */
@@ -632,6 +728,11 @@ struct Output {
     /* size of collective buffer used by MPI-IO */
     int cb_block_size;
     int cb_buffer_size;
+    int cb_nodes;     /* number of aggregators, 0 to leave it to MPI */
+
+    /* snapshots written by an I/O thread (ascii and binary formats) */
+    int async;
+    struct async_output *async_state;
 
     /* size of data sieve buffer used by HDF5 */
     int sieve_buf_size;
@@ -645,6 +746,11 @@ struct Output {
     int cache_rdcc_nelmts;
     int cache_rdcc_nbytes;
 
+    /* one HDF5 file for the whole run, flushed every flush_spacing */
+    /* output cycles */
+    int time_series;
+    int flush_spacing;
+
     int connectivity; /* whether to output connectivity */
     int stress;       /* whether to output stress */
     int pressure;     /* whether to output pressure */
@@ -684,6 +790,12 @@ struct COMPOSITION {
     double **comp_el[13];
     double **comp_node[13];
 
+    /* elements around node n and their weights are in */
+    /* node_el[node_el_start[n] .. node_el_start[n+1]-1] */
+    int *node_el_start[13];
+    int *node_el[13];
+    double *node_el_weight[13];
+
     double *initial_bulk_composition;
     double *bulk_composition;
     double *error_fraction;
@@ -774,6 +886,7 @@ struct All_variables {
 
     double *P[NCS],*F[NCS],*U[NCS];
     double *T[NCS],*Tdot[NCS],*buoyancy[NCS];
+    double *buoyancy_last[NCS];
     double *u1[NCS];
     double *temp[NCS],*temp1[NCS];
     double *Mass[NCS], *MASS[MAX_LEVELS][NCS];
@@ -853,6 +966,10 @@ struct All_variables {
   /* the following function pointers are for exchanger */
   void (* exchange_node_d)(struct All_variables *, double**, int);
   void (* exchange_node_f)(struct All_variables *, float**, int);
+  void (* exchange_node_fields)(struct All_variables *, int, double***,
+                                int, float***, int);
+  void (* exchange_snode_fields)(struct All_variables *, int, double***,
+                                 int, float***, int);
   void (* temperatures_conform_bcs)(struct All_variables *);
 
 };
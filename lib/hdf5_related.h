@@ -77,4 +77,11 @@ struct HDF5_INFO
 
     /* Actual data buffer -- shared over all fields! */
     float *data;
+
+    /* Number of cycles written to the time series file */
+    int record;
+
+    /* Time spent in HDF5 output, and in opening and closing files */
+    double io_time;
+    double open_time;
 };
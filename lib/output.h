@@ -40,6 +40,11 @@ void output_checkpoint(struct All_variables *);
 void output_coord_bin(struct All_variables *);
 void output_domain(struct All_variables *);
 void output_seismic(struct All_variables *, int);
+void binary_output(struct All_variables *, int);
+void mpiio_output(struct All_variables *, int);
+void async_ascii_output(struct All_variables *, int);
+void async_binary_output(struct All_variables *, int);
+void async_output_finalize(struct All_variables *);
 
 FILE* output_open(char *, char *);
 
@@ -36,6 +36,7 @@ extern "C" {
 void h5output_allocate_memory(struct All_variables *);
 void h5input_params(struct All_variables *);
 void h5output(struct All_variables *, int);
+void h5output_finalize(struct All_variables *);
 
 #ifdef __cplusplus
 }
@@ -36,6 +36,9 @@ extern "C" {
 void parallel_process_finalize();
 void parallel_process_termination();
 void parallel_process_sync(struct All_variables *E);
+void setup_halo_exchange(struct All_variables *E);
+void halo_exchange(struct All_variables *E, int lev, int by_id,
+                   int nd, double ***Ud, int nf, float ***Uf);
 double CPU_time0();
 
 #ifdef __cplusplus
@@ -48,11 +48,13 @@ void internal_horizontal_bc(struct All_variables *, float *[], int, int, float,
 void strip_bcs_from_residual(struct All_variables *, double **, int);
 void temperatures_conform_bcs(struct All_variables *);
 void temperatures_conform_bcs2(struct All_variables *);
+double temperature_bc_value(struct All_variables *, int, int, unsigned int);
 void velocities_conform_bcs(struct All_variables *, double **);
 void assign_internal_bc(struct All_variables *);
 /* Checkpoints.c */
 void output_checkpoint(struct All_variables *);
 void read_checkpoint(struct All_variables *);
+int read_checkpoint_layers(struct All_variables *, int *, int *);
 /* Citcom_init.c */
 struct All_variables *citcom_init(MPI_Comm *);
 void citcom_finalize(struct All_variables *, int);
@@ -98,11 +100,13 @@ void hc_lubksb_3x3(double [3][3], int, int *, double *);
 /* Drive_solvers.c */
 void general_stokes_solver_setup(struct All_variables *);
 void general_stokes_solver(struct All_variables *);
+void adaptive_stokes_solver(struct All_variables *);
 int need_visc_update(struct All_variables *);
 int need_to_iterate(struct All_variables *);
 void general_stokes_solver_pseudo_surf(struct All_variables *);
 /* Element_calculations.c */
 void assemble_forces(struct All_variables *, int);
+void assemble_forces_buoyancy(struct All_variables *, int);
 void get_ba(struct Shape_function *, struct Shape_function_dx *, struct CC *, struct CCX *, double [4][9], int, double [9][9][4][7]);
 void get_ba_p(struct Shape_function *, struct Shape_function_dx *, struct CC *, struct CCX *, double [4][9], int, double [9][9][4][7]);
 void get_elt_k(struct All_variables *, int, double [24*24], int, int, int);
@@ -137,7 +141,6 @@ void full_parallel_domain_boundary_nodes(struct All_variables *);
 void full_parallel_communication_routs_v(struct All_variables *);
 void full_parallel_communication_routs_s(struct All_variables *);
 void full_exchange_id_d(struct All_variables *, double **, int);
-void full_exchange_snode_f(struct All_variables *, float **, float **, int);
 /* Full_read_input_from_files.c */
 void full_read_input_files_for_timesteps(struct All_variables *, int, int);
 /* Full_solver.c */
@@ -153,6 +156,7 @@ void full_lost_souls(struct All_variables *);
 void full_get_shape_functions(struct All_variables *, double [9], int, double, double, double);
 double full_interpolate_data(struct All_variables *, double [9], double [9]);
 void full_get_velocity(struct All_variables *, int, int, double, double, double, double *);
+void full_get_velocity_batch(struct All_variables *, int, int, int, const double *, const double *, const double *, double *, double *, double *);
 int full_icheck_cap(struct All_variables *, int, double, double, double, double);
 int full_iget_element(struct All_variables *, int, int, double, double, double, double, double, double);
 void full_keep_within_bounds(struct All_variables *, double *, double *, double *, double *, double *, double *);
@@ -192,6 +196,7 @@ void remove_horiz_ave(struct All_variables *, double **, double *, int);
 void remove_horiz_ave2(struct All_variables *, double **);
 void return_horiz_ave(struct All_variables *, double **, double *);
 void return_horiz_ave_f(struct All_variables *, float **, float *);
+void return_horiz_ave_fields(struct All_variables *, int, double ***, double **, int, float ***, float **);
 void return_elementwise_horiz_ave(struct All_variables *, double **, double *);
 float return_bulk_value(struct All_variables *, float **, int);
 double return_bulk_value_d(struct All_variables *, double **, int);
@@ -205,6 +210,13 @@ double global_pdot(struct All_variables *, double **, double **, int);
 double global_v_norm2(struct All_variables *, double **);
 double global_p_norm2(struct All_variables *, double **);
 double global_div_norm2(struct All_variables *, double **);
+int add_global_sum(struct All_variables *, double, double);
+int add_global_pdot(struct All_variables *, double **, double **, int);
+int add_global_v_norm2(struct All_variables *, double **);
+int add_global_p_norm2(struct All_variables *, double **);
+int add_global_div_norm2(struct All_variables *, double **);
+void flush_global_sums(struct All_variables *);
+double get_global_sum(struct All_variables *, int);
 double global_tdot_d(struct All_variables *, double **, double **, int);
 float global_tdot(struct All_variables *, float **, float **, int);
 float global_fmin(struct All_variables *, double);
@@ -215,6 +227,9 @@ float Tmax(struct All_variables *, float **);
 double vnorm_nonnewt(struct All_variables *, double **, double **, int);
 void sum_across_depth_sph1(struct All_variables *, float *, float *);
 void broadcast_vertical(struct All_variables *, float *, float *, int);
+void sph_coef_sum(struct All_variables *, struct SPH_COMM *, MPI_Comm);
+void sph_coef_bcast(struct All_variables *, struct SPH_COMM *, MPI_Comm);
+void sph_coef_wait(struct All_variables *, struct SPH_COMM *);
 void remove_rigid_rot(struct All_variables *);
 
 /* Initial_temperature.c */
@@ -363,6 +378,10 @@ void get_3x3_from_9vec(double [3][3], double *);
 void parallel_process_finalize(void);
 void parallel_process_termination(void);
 void parallel_process_sync(struct All_variables *);
+void setup_halo_exchange(struct All_variables *);
+void teardown_halo_exchange(struct All_variables *);
+void halo_exchange(struct All_variables *, int, int, int, double ***, int, float ***);
+void grow_field_buffers(struct All_variables *, int, int);
 double CPU_time0(void);
 /* Parsing.c */
 void setup_parser(struct All_variables *, char *);
@@ -415,7 +434,6 @@ void regional_parallel_domain_boundary_nodes(struct All_variables *);
 void regional_parallel_communication_routs_v(struct All_variables *);
 void regional_parallel_communication_routs_s(struct All_variables *);
 void regional_exchange_id_d(struct All_variables *, double **, int);
-void regional_exchange_snode_f(struct All_variables *, float **, float **, int);
 /* Regional_read_input_from_files.c */
 void regional_read_input_files_for_timesteps(struct All_variables *, int, int);
 /* Regional_solver.c */
@@ -431,6 +449,7 @@ int regional_icheck_cap(struct All_variables *, int, double, double, double, dou
 void regional_get_shape_functions(struct All_variables *, double [9], int, double, double, double);
 double regional_interpolate_data(struct All_variables *, double [9], double [9]);
 void regional_get_velocity(struct All_variables *, int, int, double, double, double, double *);
+void regional_get_velocity_batch(struct All_variables *, int, int, int, const double *, const double *, const double *, double *, double *, double *);
 void regional_keep_within_bounds(struct All_variables *, double *, double *, double *, double *, double *, double *);
 void regional_lost_souls(struct All_variables *);
 /* Regional_version_dependent.c */
@@ -478,6 +497,7 @@ void fill_in_gaps(struct All_variables *, double **, int);
 void set_sphere_harmonics(struct All_variables *);
 double modified_plgndr_a(int, int, double);
 void sphere_expansion(struct All_variables *, float **, float *, float *);
+void sphere_expansion_local(struct All_variables *, float **, float *, float *);
 void debug_sphere_expansion(struct All_variables *);
 /* Sphere_util.c */
 void even_divide_arc12(int, double, double, double, double, double, double, double *, double *);
@@ -502,6 +522,7 @@ void get_CBF_topo(struct All_variables *, float **, float **);
 void tracer_input(struct All_variables *);
 void tracer_initial_settings(struct All_variables *);
 void tracer_advection(struct All_variables *);
+void advect_tracers(struct All_variables *);
 void tracer_post_processing(struct All_variables *);
 void count_tracers_of_flavors(struct All_variables *);
 void initialize_tracers(struct All_variables *);
@@ -510,9 +531,11 @@ void sphere_to_cart(struct All_variables *, double, double, double, double *, do
 void get_neighboring_caps(struct All_variables *);
 void allocate_tracer_arrays(struct All_variables *, int, int);
 void expand_tracer_arrays(struct All_variables *, int);
+void allocate_later_array(struct All_variables *, int, int);
 void expand_later_array(struct All_variables *, int);
 int icheck_processor_shell(struct All_variables *, int, double);
 int icheck_that_processor_shell(struct All_variables *, int, int, double);
+void tracer_layer_cost(struct All_variables *, double *);
 /* Viscosity_structures.c */
 void viscosity_system_input(struct All_variables *);
 void viscosity_input(struct All_variables *);
@@ -58,16 +58,52 @@ struct TRACE{
     int max_ntracers[13];
     int *ielement[13];
 
+    /* basicq, extraq and ielement of a cap share one allocation, each
+       quantity a column of max_ntracers entries */
+    void *pool[13];
+    int hugepages;
+
+    /* element-sorted storage: when sorted[j] is set, the tracers in
+       element e are elem_start[j][e] .. elem_start[j][e+1]-1 */
+    int sort_spacing;
+    int batch_velocity;
+    int sorted[13];
+    int *elem_start[13];
+
+    /* time integration: 2 (predictor-corrector), 3 or 4 (Runge-Kutta) */
+    int integrator;
+    int extrapolate_velocity;
+    double courant;
+    int nsubsteps;
+
+    /* velocity of the previous step, for extrapolating in time */
+    double V0_dt;
+    float *V0[13][4];
+    float *Vstage[13][4];
+    float *Vsolution[13][4];
+
     int number_of_tracers;
 
     int ilatersize[13];
     int ilater[13];
     double *rlater[13][100];
+    void *later_pool[13];
 
     /* tracer flavors */
     int nflavors;
     int **ntracer_flavor[13];
 
+    /* population control: tracers are merged or split to keep between
+       min_per_element and max_per_element tracers in each element
+       (0: no limit).  The tracer weight, extraq[iweight], keeps the
+       flavor content of each element unchanged; iweight is -1 if off */
+    int min_per_element;
+    int max_per_element;
+    int iweight;
+    double **wtracer_flavor[13];
+    int istat_merged;
+    int istat_split;
+
     int ic_method_for_flavors;
     double *z_interface;
 
@@ -89,6 +125,22 @@ struct TRACE{
     double advection_time;
     double find_tracers_time;
     double lost_souls_time;
+    double sort_tracers_time;
+
+    /* tracer array resizing statistics */
+    int pool_grows;
+    int pool_shrinks;
+    double pool_bytes_copied;
+
+    /* load balance: per-step report, and the time spent on tracers */
+    /* and on everything else since the first step, from which the  */
+    /* cost of a tracer relative to an element is estimated         */
+    int load_report;
+    double cost_weight;
+    double last_step_clock;
+    double last_advection_time;
+    double balance_tracer_time;
+    double balance_total_time;
 
 
     /* Mesh information */
@@ -127,6 +179,56 @@ struct TRACE{
     /* gnomonic shape functions */
     double *shape_coefs[13][3][10];
 
+    /* direct lookup grid in gnomonic (u,v) space: the candidate */
+    /* surface elements of cell c are uv_cell_el[uv_cell_start[c]] */
+    /* ... uv_cell_el[uv_cell_start[c+1]-1]. A negative entry means */
+    /* the whole cell lies inside that element.                   */
+    int uv_index;
+    int uv_refine;
+    int uv_nu[13];
+    int uv_nv[13];
+    int uv_max_candidates[13];
+    double uv_umin[13];
+    double uv_vmin[13];
+    double uv_du_inv[13];
+    double uv_dv_inv[13];
+    double uv_frame[13][3][4];
+    int *uv_cell_start[13];
+    int *uv_cell_el[13];
+    double *uv_edge[13];
+
+    /* direct radial index: first layer of each radial cell */
+    int nrad_index[13];
+    double rad_index_min[13];
+    double rad_index_inv[13];
+    int *rad_index[13];
+
+    int location_benchmark;
+
+    /* single-round exchange of escaped tracers over a graph of the  */
+    /* horizontal neighbors (incl. diagonal) and the layers above    */
+    /* and below them; ngb_index[3*h+dz+1] is the position of the    */
+    /* processor at horizontal pass h, vertical offset dz in ngb_rank */
+    int neighbor_exchange;
+    MPI_Comm ngb_comm;
+    int ngb_n;
+    int *ngb_rank;
+    int *ngb_index;
+    double *layer_rbot;
+    double *layer_rtop;
+    /* per-neighbor counts and displacements, in tracers and in doubles */
+    int *ngb_scount, *ngb_rcount, *ngb_sdispl, *ngb_rdispl;
+    int *ngb_sc, *ngb_rc, *ngb_sd, *ngb_rd, *ngb_fill;
+    int ngb_sendsize;
+    int ngb_recvsize;
+    double *ngb_sendbuf;
+    double *ngb_recvbuf;
+    /* destination of each escaped tracer, and those beyond the neighbors */
+    int ngb_lostsize;
+    int *ngb_dest;
+    double *ngb_far;
+    double *ngb_stay;
+
 
 
 
@@ -151,6 +253,10 @@ struct TRACE{
     void (* get_velocity)(struct All_variables*, int, int,
                           double, double, double, double*);
 
+    void (* get_velocity_batch)(struct All_variables*, int, int, int,
+                                const double*, const double*, const double*,
+                                double*, double*, double*);
+
     void (* keep_within_bounds)(struct All_variables*,
                                 double*, double*, double*,
                                 double*, double*, double*);
@@ -0,0 +1,22 @@
+#!/bin/sh
+
+## Run a diffusion-dominated case with the explicit scheme at a stable time
+## step, then with implicit diffusion at 4 times that step, to the same
+## model time. The temperatures should agree to the time discretization
+## error.
+
+for run in explicit implicit; do
+    ../../Py2C/Py2C $run.cfg $run.in false && \
+    mpirun -np 1 ../../bin/CitcomSRegional $run.in > /dev/null 2>&1 || exit 1
+done
+
+awk 'FNR <= 2 { next }
+     FNR == NR { t[FNR] = $4; next }
+     { d = $4 - t[FNR]; if (d < 0) d = -d; if (d > max) max = d }
+     END { print "max temperature difference", max; exit (max > 0.01) }' \
+    exp.velo.0.40 imp.velo.0.10
+status=$?
+
+## clean up
+rm -f exp.* imp.* explicit.in implicit.in pid*
+exit $status
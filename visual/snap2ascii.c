@@ -0,0 +1,642 @@
+/*
+ * snap2ascii.c
+ * Copyright (C) 2026, California Institute of Technology.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Convert a binary snapshot (output_format=binary), or a shared
+ * snapshot of all processors (output_format=mpiio), to the ASCII files
+ * (velo, visc, surf, botm, stress, pressure, comp_nd, comp_el, heating
+ * and, for cycle 0, coord) that output_format=ascii would have
+ * written, so that the post-processing scripts can be used unchanged.
+ *
+ * The layouts are described in lib/Output_binary.c.  The file is
+ * mmap'ed, so only the pages of the selected caps and layers of a
+ * shared snapshot are read; on a big-endian machine the values are
+ * swapped while they are printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define SNAP_VERSION 1
+#define SNAP_HEADER_SIZE 64
+#define SNAP_FIELD_SIZE 48
+#define SHARED_HEADER_SIZE 96
+#define SHARED_FIELD_SIZE 56
+
+#define SNAP_ALL 0
+#define SNAP_TOP 1
+#define SNAP_BOTM 2
+#define SNAP_GLOBAL 3
+
+#define SNAP_FLAT 0
+#define SNAP_NODES 1
+#define SNAP_ELEMENTS 2
+
+struct field {
+    char name[25];
+    int size, ncomp, n, scope, radial;
+    const char *data;
+};
+
+struct snapshot {
+    const char *base;
+    size_t length;
+    int swap;
+    int cycle, rank;
+    double time;
+    int nno, nel, nsf, nox, noy, noz, ncomp, nfield;
+    struct field *field;
+
+    /* shared snapshot only */
+    int shared;
+    int nproc, ncaps, nprocx, nprocy, nprocz;
+    const char *slot_rank, *layer_elz;
+};
+
+static long long nbytes_written, nbytes_read;
+static volatile char page_touch;
+
+
+void print_help()
+{
+    const char msg[] = ""
+        "Convert binary CitcomS snapshots to the ASCII output files\n"
+        "\n"
+        "Usage: snap2ascii [-t] [-o prefix] [-c cap] [-z first[,last]]\n"
+        "                  snapfile [snapfile ...]\n"
+        "\n"
+        "snapfile: a file 'datafile.snap.rank.cycle' written with\n"
+        "          output_format=binary, or 'datafile.mpiio.cycle'\n"
+        "          written with output_format=mpiio\n"
+        "-o prefix: prefix of the ASCII files (default: datafile)\n"
+        "-c cap: only convert the processors of this cap (0, 1, ...)\n"
+        "        of a shared snapshot\n"
+        "-z first,last: only convert the processors in these radial\n"
+        "        layers (0 is the bottom) of a shared snapshot\n"
+        "-t: report the time spent reading the snapshot and writing the\n"
+        "    ASCII files, as a throughput comparison of the two formats\n";
+
+    fputs(msg, stderr);
+    return;
+}
+
+
+static double wtime(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+
+static void get_value(const struct snapshot *s, const char *p,
+                      int size, void *value)
+{
+    char *v = (char *)value;
+    int b;
+
+    if (!s->swap) {
+        memcpy(value, p, size);
+        return;
+    }
+    for (b=0; b<size; b++)
+        v[b] = p[size-1-b];
+}
+
+
+static int32_t get_i32(const struct snapshot *s, const char *p)
+{
+    int32_t v;
+    get_value(s, p, 4, &v);
+    return v;
+}
+
+
+/* value i of component c of field f, as a double */
+static double fval(const struct snapshot *s, const struct field *f,
+                   int c, int i)
+{
+    long block = (((long)f->size*f->n + 7) / 8) * 8;
+    const char *p = f->data + c*block + (long)i*f->size;
+
+    if (f->size == 4) {
+        float v;
+        get_value(s, p, 4, &v);
+        return v;
+    }
+    else {
+        double v;
+        get_value(s, p, 8, &v);
+        return v;
+    }
+}
+
+
+static const struct field *find_field(const struct snapshot *s,
+                                      const char *name)
+{
+    int i;
+    for (i=0; i<s->nfield; i++)
+        if (strcmp(s->field[i].name, name) == 0)
+            return &s->field[i];
+    return NULL;
+}
+
+
+static long slot_bytes(const struct field *f)
+{
+    return f->ncomp*((((long)f->size*f->n + 7) / 8) * 8);
+}
+
+
+/* values per component of a field of a shared snapshot on a */
+/* processor in radial layer lz                              */
+static int layer_values(const struct snapshot *s, const struct field *f,
+                        int lz)
+{
+    const int elz = get_i32(s, s->layer_elz + 4*lz);
+
+    switch (f->radial) {
+    case SNAP_NODES:
+        return f->n*(elz + 1);
+    case SNAP_ELEMENTS:
+        return f->n*elz;
+    default:
+        return f->n;
+    }
+}
+
+
+static long layer_slot_bytes(const struct snapshot *s,
+                             const struct field *f, int lz)
+{
+    struct field g = *f;
+
+    g.n = layer_values(s, f, lz);
+    return slot_bytes(&g);
+}
+
+
+/* bytes of the slots of a field in a cap, below radial layer lz */
+static long cap_bytes(const struct snapshot *s, const struct field *f,
+                      int lz)
+{
+    long bytes = 0;
+    int k;
+
+    for (k=0; k<lz; k++)
+        bytes += s->nprocx*s->nprocy*layer_slot_bytes(s, f, k);
+    return bytes;
+}
+
+
+/* bytes of all slots of a field */
+static long field_bytes(const struct snapshot *s, const struct field *f)
+{
+    if (!s->shared)
+        return slot_bytes(f);
+
+    switch (f->scope) {
+    case SNAP_ALL:
+        return s->ncaps*cap_bytes(s, f, s->nprocz);
+    case SNAP_GLOBAL:
+        return slot_bytes(f);
+    default:
+        return s->ncaps*s->nprocx*s->nprocy*slot_bytes(f);
+    }
+}
+
+
+static int open_snapshot(const char *filename, struct snapshot *s)
+{
+    struct stat st;
+    const char *p;
+    int fd, i, table, entry;
+    int64_t offset;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "cannot open '%s'\n", filename);
+        return 1;
+    }
+
+    s->length = st.st_size;
+    s->base = (const char *)mmap(NULL, s->length, PROT_READ, MAP_PRIVATE,
+                                 fd, 0);
+    close(fd);
+    if (s->base == MAP_FAILED || s->length < SHARED_HEADER_SIZE ||
+        (memcmp(s->base, "CITSNAP", 8) != 0 &&
+         memcmp(s->base, "CITSHARE", 8) != 0)) {
+        fprintf(stderr, "'%s' is not a snapshot file\n", filename);
+        return 1;
+    }
+    s->shared = (memcmp(s->base, "CITSHARE", 8) == 0);
+
+    s->swap = 0;
+    if (get_i32(s, s->base + 8) != 0x12345678) {
+        s->swap = 1;
+        if (get_i32(s, s->base + 8) != 0x12345678) {
+            fprintf(stderr, "'%s': bad byte-order guard\n", filename);
+            return 1;
+        }
+    }
+
+    p = s->base + 12;
+    if (get_i32(s, p) != SNAP_VERSION) {
+        fprintf(stderr, "'%s': unknown version %d\n", filename,
+                get_i32(s, p));
+        return 1;
+    }
+    s->cycle = get_i32(s, s->base + 16);
+    s->rank = get_i32(s, s->base + 20);
+    get_value(s, s->base + 24, 8, &s->time);
+    s->nno = get_i32(s, s->base + 32);
+    s->nel = get_i32(s, s->base + 36);
+    s->nsf = get_i32(s, s->base + 40);
+    s->nox = get_i32(s, s->base + 44);
+    s->noy = get_i32(s, s->base + 48);
+    s->noz = get_i32(s, s->base + 52);
+    s->ncomp = get_i32(s, s->base + 56);
+    s->nfield = get_i32(s, s->base + 60);
+
+    table = SNAP_HEADER_SIZE;
+    entry = SNAP_FIELD_SIZE;
+    if (s->shared) {
+        s->nproc = s->rank;
+        s->ncaps = get_i32(s, s->base + 64);
+        s->nprocx = get_i32(s, s->base + 68);
+        s->nprocy = get_i32(s, s->base + 72);
+        s->nprocz = get_i32(s, s->base + 76);
+        if (get_i32(s, s->base + 92) > (int64_t)s->length) {
+            fprintf(stderr, "'%s': header is truncated\n", filename);
+            return 1;
+        }
+        table = SHARED_HEADER_SIZE;
+        entry = SHARED_FIELD_SIZE;
+        s->slot_rank = s->base + table + s->nfield*entry;
+        s->layer_elz = s->slot_rank + 4*s->nproc;
+    }
+
+    s->field = (struct field *)malloc(s->nfield*sizeof(struct field));
+    for (i=0; i<s->nfield; i++) {
+        struct field *f = &s->field[i];
+
+        p = s->base + table + i*entry;
+        memcpy(f->name, p, 24);
+        f->name[24] = 0;
+        f->size = get_i32(s, p + 24);
+        f->ncomp = get_i32(s, p + 28);
+        f->n = get_i32(s, p + 32);
+        f->scope = s->shared ? get_i32(s, p + 36) : SNAP_ALL;
+        f->radial = s->shared ? get_i32(s, p + 40) : SNAP_FLAT;
+        get_value(s, p + entry - 8, 8, &offset);
+        f->data = s->base + offset;
+
+        if (offset + field_bytes(s, f) > (int64_t)s->length) {
+            fprintf(stderr, "'%s': field %s is truncated\n",
+                    filename, f->name);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* the part of a shared snapshot written by one processor; the */
+/* radial layers of processors may differ in size             */
+static void select_proc(const struct snapshot *s, int cap,
+                        int lx, int ly, int lz, struct snapshot *v)
+{
+    const int nprocxy = s->nprocx*s->nprocy;
+    const int surf = cap*nprocxy + ly*s->nprocx + lx;
+    const int slot = cap*nprocxy*s->nprocz + lz*nprocxy + ly*s->nprocx + lx;
+    const int elz = get_i32(s, s->layer_elz + 4*lz);
+    int i;
+
+    *v = *s;
+    v->shared = 0;
+    v->rank = get_i32(s, s->slot_rank + 4*slot);
+    v->noz = elz + 1;
+    v->nno = s->nox*s->noy*v->noz;
+    v->nel = (s->nox-1)*(s->noy-1)*elz;
+    v->field = (struct field *)malloc(s->nfield*sizeof(struct field));
+    v->nfield = 0;
+
+    for (i=0; i<s->nfield; i++) {
+        const struct field *f = &s->field[i];
+        struct field *g = &v->field[v->nfield];
+
+        *g = *f;
+        g->n = layer_values(s, f, lz);
+        switch (f->scope) {
+        case SNAP_ALL:
+            g->data += cap*cap_bytes(s, f, s->nprocz) + cap_bytes(s, f, lz)
+                + (ly*s->nprocx + lx)*slot_bytes(g);
+            break;
+        case SNAP_TOP:
+            if (lz != s->nprocz-1) continue;
+            g->data += surf*slot_bytes(f);
+            break;
+        case SNAP_BOTM:
+            if (lz != 0) continue;
+            g->data += surf*slot_bytes(f);
+            break;
+        }
+        v->nfield++;
+    }
+
+    return;
+}
+
+
+static FILE *open_output(const char *prefix, const char *kind,
+                         const struct snapshot *s, int with_cycle)
+{
+    char filename[512];
+    FILE *fp;
+
+    if (with_cycle)
+        snprintf(filename, 512, "%s.%s.%d.%d", prefix, kind, s->rank, s->cycle);
+    else
+        snprintf(filename, 512, "%s.%s.%d", prefix, kind, s->rank);
+
+    fp = fopen(filename, "w");
+    if (!fp) {
+        fprintf(stderr, "cannot write '%s'\n", filename);
+        exit(1);
+    }
+    return fp;
+}
+
+
+static void close_output(FILE *fp)
+{
+    nbytes_written += ftell(fp);
+    fclose(fp);
+}
+
+
+static void write_ascii(const struct snapshot *s, const char *prefix)
+{
+    const struct field *f, *g;
+    FILE *fp;
+    int i, k, n;
+
+    /* the formats follow lib/Output.c */
+
+    if ((f = find_field(s, "coord"))) {
+        fp = open_output(prefix, "coord", s, 0);
+        fprintf(fp,"%3d %7d\n",1,s->nno);
+        for(i=0;i<s->nno;i++)
+            fprintf(fp,"%.6e %.6e %.6e\n",
+                    fval(s,f,0,i),fval(s,f,1,i),fval(s,f,2,i));
+        close_output(fp);
+    }
+
+    f = find_field(s, "velocity");
+    g = find_field(s, "temperature");
+    if (f && g) {
+        fp = open_output(prefix, "velo", s, 1);
+        fprintf(fp,"%d %d %.5e\n",s->cycle,s->nno,s->time);
+        fprintf(fp,"%3d %7d\n",1,s->nno);
+        for(i=0;i<s->nno;i++)
+            fprintf(fp,"%.6e %.6e %.6e %.6e\n",fval(s,f,0,i),
+                    fval(s,f,1,i),fval(s,f,2,i),fval(s,g,0,i));
+        close_output(fp);
+    }
+
+    if ((f = find_field(s, "viscosity"))) {
+        fp = open_output(prefix, "visc", s, 1);
+        fprintf(fp,"%3d %7d\n",1,s->nno);
+        for(i=0;i<s->nno;i++)
+            fprintf(fp,"%.4e\n",fval(s,f,0,i));
+        close_output(fp);
+    }
+
+    if ((f = find_field(s, "avisc"))) {
+        fp = open_output(prefix, "avisc", s, 1);
+        fprintf(fp,"%3d %7d\n",1,s->nno);
+        for(i=0;i<s->nno;i++)
+            fprintf(fp,"%.4e %.4e %.4e %.4e\n",fval(s,f,0,i),
+                    fval(s,f,1,i),fval(s,f,2,i),fval(s,f,3,i));
+        close_output(fp);
+    }
+
+    f = find_field(s, "surf_topo");
+    g = find_field(s, "surf_heatflux");
+    if (f && g) {
+        const struct field *v = find_field(s, "velocity");
+        fp = open_output(prefix, "surf", s, 1);
+        fprintf(fp,"%3d %7d\n",1,s->nsf);
+        for(i=1;i<=s->nsf;i++) {
+            n = i*s->noz - 1;
+            fprintf(fp,"%.4e %.4e %.4e %.4e\n",fval(s,f,0,i-1),
+                    fval(s,g,0,i-1),fval(s,v,0,n),fval(s,v,1,n));
+        }
+        close_output(fp);
+    }
+
+    f = find_field(s, "botm_topo");
+    g = find_field(s, "botm_heatflux");
+    if (f && g) {
+        const struct field *v = find_field(s, "velocity");
+        fp = open_output(prefix, "botm", s, 1);
+        fprintf(fp,"%3d %7d\n",1,s->nsf);
+        for(i=1;i<=s->nsf;i++) {
+            n = (i-1)*s->noz;
+            fprintf(fp,"%.4e %.4e %.4e %.4e\n",fval(s,f,0,i-1),
+                    fval(s,g,0,i-1),fval(s,v,0,n),fval(s,v,1,n));
+        }
+        close_output(fp);
+    }
+
+    if ((f = find_field(s, "stress"))) {
+        fp = open_output(prefix, "stress", s, 1);
+        fprintf(fp,"%d %d %.5e\n",s->cycle,s->nno,s->time);
+        fprintf(fp,"%3d %7d\n",1,s->nno);
+        for(i=0;i<s->nno;i++)
+            fprintf(fp,"%.4e %.4e %.4e %.4e %.4e %.4e\n",
+                    fval(s,f,0,i),fval(s,f,1,i),fval(s,f,2,i),
+                    fval(s,f,3,i),fval(s,f,4,i),fval(s,f,5,i));
+        close_output(fp);
+    }
+
+    if ((f = find_field(s, "pressure"))) {
+        fp = open_output(prefix, "pressure", s, 1);
+        fprintf(fp,"%d %d %.5e\n",s->cycle,s->nno,s->time);
+        fprintf(fp,"%3d %7d\n",1,s->nno);
+        for(i=0;i<s->nno;i++)
+            fprintf(fp,"%.6e\n",fval(s,f,0,i));
+        close_output(fp);
+    }
+
+    g = find_field(s, "bulk_composition");
+    for (k=0; k<2; k++) {
+        const char *kind = k ? "comp_el" : "comp_nd";
+        int nn;
+
+        if (!(f = find_field(s, kind)) || !g) continue;
+
+        nn = k ? s->nel : s->nno;
+        fp = open_output(prefix, kind, s, 1);
+        fprintf(fp,"%3d %7d %.5e %d\n",1,s->nel,s->time,f->ncomp);
+        for(i=0;i<f->ncomp;i++)
+            fprintf(fp,"%.5e %.5e ",fval(s,g,0,i),fval(s,g,1,i));
+        fprintf(fp,"\n");
+        for(i=0;i<nn;i++) {
+            for(n=0;n<f->ncomp;n++)
+                fprintf(fp,"%.6e ",fval(s,f,n,i));
+            fprintf(fp,"\n");
+        }
+        close_output(fp);
+    }
+
+    if ((f = find_field(s, "heating"))) {
+        fp = open_output(prefix, "heating", s, 1);
+        fprintf(fp,"%.5e\n",s->time);
+        fprintf(fp,"%3d %7d\n",1,s->nel);
+        for(i=0;i<s->nel;i++)
+            fprintf(fp,"%.4e %.4e %.4e\n",
+                    fval(s,f,0,i),fval(s,f,1,i),fval(s,f,2,i));
+        close_output(fp);
+    }
+
+    return;
+}
+
+
+/* read the pages of the fields, so that the read is timed apart */
+/* from the formatting */
+static double read_fields(const struct snapshot *s)
+{
+    double t0 = wtime();
+    long b;
+    int i;
+
+    for (i=0; i<s->nfield; i++) {
+        for (b=0; b<slot_bytes(&s->field[i]); b+=4096)
+            page_touch = s->field[i].data[b];
+        nbytes_read += slot_bytes(&s->field[i]);
+    }
+
+    return wtime() - t0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct snapshot s, v;
+    char prefix[512], *p;
+    const char *outprefix = NULL;
+    int i, timing = 0, status = 0;
+    int cap, lx, ly, lz;
+    int cap_only = -1, zfirst = 0, zlast = -1;
+    double t0, tread, twrite;
+    long long nbytes, nread;
+
+    for (i=1; i<argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-t") == 0)
+            timing = 1;
+        else if (strcmp(argv[i], "-o") == 0 && i+1 < argc)
+            outprefix = argv[++i];
+        else if (strcmp(argv[i], "-c") == 0 && i+1 < argc)
+            cap_only = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-z") == 0 && i+1 < argc) {
+            if (sscanf(argv[++i], "%d,%d", &zfirst, &zlast) == 1)
+                zlast = zfirst;
+        }
+        else {
+            print_help();
+            return 1;
+        }
+    }
+
+    if (i >= argc) {
+        print_help();
+        return 1;
+    }
+
+    for (; i<argc; i++) {
+        t0 = wtime();
+        if (open_snapshot(argv[i], &s)) {
+            status = 1;
+            continue;
+        }
+        tread = wtime() - t0;
+
+        if (outprefix)
+            strncpy(prefix, outprefix, 511);
+        else {
+            strncpy(prefix, argv[i], 511);
+            p = strstr(prefix, s.shared ? ".mpiio." : ".snap.");
+            if (p) *p = 0;
+        }
+        prefix[511] = 0;
+
+        nbytes = nbytes_written;
+        nread = nbytes_read;
+        twrite = 0;
+
+        if (!s.shared) {
+            tread += read_fields(&s);
+            t0 = wtime();
+            write_ascii(&s, prefix);
+            twrite += wtime() - t0;
+        }
+        else {
+            /* a cap, and a layer of processors in it, are contiguous */
+            for (cap=0; cap<s.ncaps; cap++) {
+                if (cap_only >= 0 && cap != cap_only) continue;
+                for (lz=0; lz<s.nprocz; lz++) {
+                    if (lz < zfirst || (zlast >= 0 && lz > zlast)) continue;
+                    for (ly=0; ly<s.nprocy; ly++)
+                        for (lx=0; lx<s.nprocx; lx++) {
+                            select_proc(&s, cap, lx, ly, lz, &v);
+                            tread += read_fields(&v);
+                            t0 = wtime();
+                            write_ascii(&v, prefix);
+                            twrite += wtime() - t0;
+                            free(v.field);
+                        }
+                }
+            }
+        }
+
+        if (timing)
+            fprintf(stderr, "%s: read %lld bytes in %.3f s (%.1f MB/s), "
+                    "wrote %lld ASCII bytes in %.3f s (%.1f MB/s)\n",
+                    argv[i], nbytes_read-nread, tread,
+                    (nbytes_read-nread)/1e6/(tread+1e-9),
+                    nbytes_written-nbytes, twrite,
+                    (nbytes_written-nbytes)/1e6/(twrite+1e-9));
+
+        munmap((void *)s.base, s.length);
+        free(s.field);
+    }
+
+    return status;
+}
@@ -0,0 +1,238 @@
+/*
+ * tracer2bin.c
+ * Copyright (C) 2026, California Institute of Technology.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Convert an ASCII tracer file (tracer_ic_method=1) to the indexed
+ * binary tracer file, which lets each processor read only the part of
+ * the file that can fall in its domain.
+ *
+ * The binary file is written in the native byte order:
+ *
+ *   int       magic (TRACER_BIN_MAGIC), version
+ *   int       ncolumns, ntheta, nphi, nrad
+ *   long long ntracers
+ *   double    rmin, rmax
+ *   long long start[ntheta*nphi*nrad+1]
+ *   double    tracer[ntracers][ncolumns]
+ *
+ * The tracers are sorted by bin, bin = (itheta*nphi + iphi)*nrad + irad,
+ * where the bins are uniform in colatitude [0,pi], longitude [0,2pi)
+ * and radius [rmin,rmax].  The tracers of a bin are the records
+ * start[bin] to start[bin+1]-1.  The columns are copied unchanged.
+ *
+ * The layout must agree with read_binary_tracer_file() in
+ * lib/Tracer_setup.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define TRACER_BIN_MAGIC 0x42525443
+#define TRACER_BIN_VERSION 1
+
+
+void print_help()
+{
+    const char msg[] = ""
+        "Convert an ASCII tracer file to the indexed binary tracer file\n"
+        "\n"
+        "Usage: tracer2bin infile outfile [n_latitude [n_radius]]\n"
+        "\n"
+        "infile: name of the ASCII tracer file, with a header line\n"
+        "        'ntracers ncolumns' followed by 'theta phi rad ...'\n"
+        "outfile: name of the binary tracer file\n"
+        "n_latitude: # of bins in colatitude (default: 60),\n"
+        "            there are twice as many bins in longitude\n"
+        "n_radius: # of bins in radius (default: 16)\n";
+
+    fputs(msg, stderr);
+
+    return;
+}
+
+
+static int scan_line(char *buffer, int len, double *values)
+{
+    char *nptr, *endptr;
+    int i;
+
+    /* same parsing as read_double_vector() in CitcomS */
+    nptr = endptr = buffer;
+    for (i = 0; i < len; ++i) {
+        values[i] = strtod(nptr, &endptr);
+        if (nptr == endptr)
+            return i;
+        nptr = endptr;
+    }
+    return len;
+}
+
+
+static int find_bin(const double *rec, int ntheta, int nphi, int nrad,
+                    double rmin, double rmax)
+{
+    const double pi = 4.0 * atan(1.0);
+    double x, y, z, r, theta, phi;
+    int it, ip, ir;
+
+    /* bin by the direction, so that any theta, phi is allowed */
+    x = sin(rec[0]) * cos(rec[1]);
+    y = sin(rec[0]) * sin(rec[1]);
+    z = cos(rec[0]);
+    r = sqrt(x*x + y*y + z*z);
+    theta = acos(z / r);
+    phi = atan2(y, x);
+    if (phi < 0) phi += 2 * pi;
+
+    it = (int)(theta / pi * ntheta);
+    ip = (int)(phi / (2 * pi) * nphi);
+    ir = (rmax > rmin) ? (int)((rec[2] - rmin) / (rmax - rmin) * nrad) : 0;
+
+    if (it < 0) it = 0;
+    if (it >= ntheta) it = ntheta - 1;
+    if (ip < 0) ip = 0;
+    if (ip >= nphi) ip = nphi - 1;
+    if (ir < 0) ir = 0;
+    if (ir >= nrad) ir = nrad - 1;
+
+    return (it * nphi + ip) * nrad + ir;
+}
+
+
+int main(int argc, char **argv)
+{
+    FILE *in, *out;
+    char buffer[256];
+    int ntracers, ncolumns, ntheta, nphi, nrad, nbins;
+    int magic, version;
+    int i, n, *bin;
+    long long ntr, *start, *next;
+    double rmin, rmax, *data, *sorted;
+
+    if (argc < 3 || argc > 5) {
+        print_help();
+        exit(1);
+    }
+
+    ntheta = (argc > 3) ? atoi(argv[3]) : 60;
+    nrad = (argc > 4) ? atoi(argv[4]) : 16;
+    nphi = 2 * ntheta;
+    if (ntheta < 1 || nrad < 1) {
+        print_help();
+        exit(1);
+    }
+
+    in = fopen(argv[1], "r");
+    if (in == NULL) {
+        fprintf(stderr, "Error: cannot open file: %s\n", argv[1]);
+        exit(1);
+    }
+
+    if (fgets(buffer, 255, in) == NULL ||
+        sscanf(buffer, "%d %d", &ntracers, &ncolumns) != 2 ||
+        ntracers < 0 || ncolumns < 3 || ncolumns > 100) {
+        fprintf(stderr, "Error: bad header in file: %s\n", argv[1]);
+        exit(1);
+    }
+
+    data = malloc((size_t)ntracers * ncolumns * sizeof(double));
+    sorted = malloc((size_t)ntracers * ncolumns * sizeof(double));
+    bin = malloc((ntracers + 1) * sizeof(int));
+    if (data == NULL || sorted == NULL || bin == NULL) {
+        fprintf(stderr, "Error: cannot allocate memory for %d tracers\n",
+                ntracers);
+        exit(1);
+    }
+
+    rmin = 1e30;
+    rmax = -1e30;
+    for (n = 0; n < ntracers; n++) {
+        double *rec = data + (size_t)n * ncolumns;
+
+        if (fgets(buffer, 255, in) == NULL ||
+            scan_line(buffer, ncolumns, rec) != ncolumns) {
+            fprintf(stderr, "Error: cannot read tracer #%d in file: %s\n",
+                    n + 1, argv[1]);
+            exit(1);
+        }
+        if (rec[2] < rmin) rmin = rec[2];
+        if (rec[2] > rmax) rmax = rec[2];
+    }
+    fclose(in);
+
+    if (ntracers == 0) rmin = rmax = 0;
+    if (rmax <= rmin) nrad = 1;
+    nbins = ntheta * nphi * nrad;
+
+    /* counting sort of the tracers by bin, stable within a bin */
+    start = calloc(nbins + 1, sizeof(long long));
+    next = malloc((nbins + 1) * sizeof(long long));
+    for (n = 0; n < ntracers; n++) {
+        bin[n] = find_bin(data + (size_t)n * ncolumns,
+                          ntheta, nphi, nrad, rmin, rmax);
+        start[bin[n] + 1]++;
+    }
+    for (i = 0; i < nbins; i++)
+        start[i + 1] += start[i];
+
+    memcpy(next, start, (nbins + 1) * sizeof(long long));
+    for (n = 0; n < ntracers; n++)
+        memcpy(sorted + next[bin[n]]++ * ncolumns,
+               data + (size_t)n * ncolumns, ncolumns * sizeof(double));
+
+    out = fopen(argv[2], "wb");
+    if (out == NULL) {
+        fprintf(stderr, "Error: cannot open file: %s\n", argv[2]);
+        exit(1);
+    }
+
+    magic = TRACER_BIN_MAGIC;
+    version = TRACER_BIN_VERSION;
+    ntr = ntracers;
+    fwrite(&magic, sizeof(int), 1, out);
+    fwrite(&version, sizeof(int), 1, out);
+    fwrite(&ncolumns, sizeof(int), 1, out);
+    fwrite(&ntheta, sizeof(int), 1, out);
+    fwrite(&nphi, sizeof(int), 1, out);
+    fwrite(&nrad, sizeof(int), 1, out);
+    fwrite(&ntr, sizeof(long long), 1, out);
+    fwrite(&rmin, sizeof(double), 1, out);
+    fwrite(&rmax, sizeof(double), 1, out);
+    fwrite(start, sizeof(long long), nbins + 1, out);
+    if (fwrite(sorted, sizeof(double) * ncolumns, ntracers, out)
+        != (size_t)ntracers) {
+        fprintf(stderr, "Error: cannot write file: %s\n", argv[2]);
+        exit(1);
+    }
+    fclose(out);
+
+    fprintf(stderr, "%d tracers, %d columns, %d x %d x %d bins, "
+            "radius %g to %g\n", ntracers, ncolumns, ntheta, nphi, nrad,
+            rmin, rmax);
+
+    free(data);
+    free(sorted);
+    free(bin);
+    free(start);
+    free(next);
+
+    return 0;
+}